@@ -0,0 +1,709 @@
+#include <iostream>
+
+#include <ICaveData.h>
+
+#include "Microbenchmarks.h"
+
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+//Returns the peak resident set size of this process in bytes.
+size_t PeakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+struct RayCastingEngineInfo
+{
+	ICaveData::RayCastingEngine engine;
+	const char* option;
+	const char* name;
+};
+
+const RayCastingEngineInfo rayCastingEngines[] =
+{
+	{ ICaveData::AllIntersectionsAABBTree, "aabb", "AABB tree (all intersections)" },
+	{ ICaveData::ClosestHitBVH, "bvh", "BVH (closest hit)" },
+	{ ICaveData::PacketBVH, "packet", "BVH (SIMD packets)" },
+};
+
+//Returns the maximum relative difference between the unsmoothed cave sizes and the reference sizes.
+double MaxRelativeDifference(const ICaveData& data, const std::vector<double>& reference)
+{
+	double maxDifference = 0;
+	for (size_t i = 0; i < reference.size(); ++i)
+	{
+		double size = data.CaveSizeUnsmoothed(i);
+		if (std::isnan(size) || std::isnan(reference[i]))
+			continue;
+		maxDifference = std::max(maxDifference, std::abs(size - reference[i]) / reference[i]);
+	}
+	return maxDifference;
+}
+
+//Calculates the cave sizes with every ray casting engine (or only with the one specified by engineOption) and reports
+//the ray throughput and the peak memory usage. The sizes of the first engine serve as reference for the others.
+void BenchmarkRayCasting(ICaveData& data, const std::string& engineOption)
+{
+	std::cout << "Ray casting (" << data.NumberOfVertices() << " skeleton vertices)" << std::endl;
+	std::cout << "\tPeak memory after loading: " << PeakMemoryUsage() / (1024 * 1024) << " MB" << std::endl;
+
+	std::vector<double> referenceSizes;
+	for (auto& info : rayCastingEngines)
+	{
+		if (!engineOption.empty() && engineOption != info.option)
+			continue;
+
+		data.RayCaster() = info.engine;
+		data.RayDistanceCaching() = ICaveData::NoRayDistanceCache;
+		data.CalculateDistances();
+		auto& stats = data.LastDistanceStatistics();
+
+		std::cout << "\t" << std::left << std::setw(32) << info.name << std::right
+			<< std::setw(10) << stats.tracedRays << " rays, "
+			<< std::fixed << std::setprecision(3) << std::setw(8) << stats.rayCastingSeconds << " s ray casting, "
+			<< std::setprecision(0) << std::setw(10) << stats.tracedRays / stats.rayCastingSeconds << " rays/s per thread, "
+			<< std::setprecision(3) << std::setw(8) << stats.totalSeconds << " s total";
+		std::cout.unsetf(std::ios::floatfield);
+
+		if (referenceSizes.empty())
+		{
+			for (size_t i = 0; i < data.NumberOfVertices(); ++i)
+				referenceSizes.push_back(data.CaveSizeUnsmoothed(i));
+		}
+		else
+			std::cout << ", max. relative size difference " << MaxRelativeDifference(data, referenceSizes);
+		std::cout << ", peak memory " << PeakMemoryUsage() / (1024 * 1024) << " MB" << std::endl;
+	}
+}
+
+struct RayDistanceCacheInfo
+{
+	ICaveData::RayDistanceCacheMode mode;
+	const char* name;
+};
+
+const RayDistanceCacheInfo rayDistanceCacheModes[] =
+{
+	{ ICaveData::NoRayDistanceCache, "No cache" },
+	{ ICaveData::Float32RayDistanceCache, "Float32 cache" },
+	{ ICaveData::Float16RayDistanceCache, "Float16 cache" },
+};
+
+//Calculates the cave sizes for a sweep of exponents with every ray distance cache mode and reports the time per
+//exponent. The sizes without cache serve as reference for the others.
+void BenchmarkExponentSweep(ICaveData& data)
+{
+	const float exponents[] = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f };
+	const size_t exponentCount = sizeof(exponents) / sizeof(exponents[0]);
+
+	std::cout << "Exponent sweep (" << data.NumberOfVertices() << " skeleton vertices, " << exponentCount << " exponents)" << std::endl;
+
+	std::vector<std::vector<double>> referenceSizes(exponentCount);
+	for (auto& info : rayDistanceCacheModes)
+	{
+		data.RayDistanceCaching() = info.mode;
+		std::cout << "\t" << std::left << std::setw(16) << info.name << std::right << std::fixed << std::setprecision(3);
+
+		double totalSeconds = 0;
+		double maxDifference = 0;
+		size_t tracedRays = 0;
+		for (size_t iExponent = 0; iExponent < exponentCount; ++iExponent)
+		{
+			data.CalculateDistances(exponents[iExponent]);
+			auto& stats = data.LastDistanceStatistics();
+			totalSeconds += stats.totalSeconds;
+			tracedRays += stats.tracedRays;
+			std::cout << std::setw(8) << stats.totalSeconds << " s";
+
+			if (referenceSizes[iExponent].empty())
+			{
+				for (size_t i = 0; i < data.NumberOfVertices(); ++i)
+					referenceSizes[iExponent].push_back(data.CaveSizeUnsmoothed(i));
+			}
+			else
+				maxDifference = std::max(maxDifference, MaxRelativeDifference(data, referenceSizes[iExponent]));
+		}
+		std::cout << ", total " << std::setw(8) << totalSeconds << " s, " << std::setw(10) << tracedRays << " rays";
+		std::cout.unsetf(std::ios::floatfield);
+		std::cout << ", max. relative size difference " << maxDifference << ", peak memory " << PeakMemoryUsage() / (1024 * 1024) << " MB" << std::endl;
+	}
+}
+
+//Calculates the cave sizes with both BVH engines with and without traversal hints and reports the visited nodes per ray.
+void BenchmarkTraversalHints(ICaveData& data)
+{
+	std::cout << "Traversal hints (" << data.NumberOfVertices() << " skeleton vertices)" << std::endl;
+
+	data.RayDistanceCaching() = ICaveData::NoRayDistanceCache;
+	for (auto& info : rayCastingEngines)
+	{
+		if (info.engine == ICaveData::AllIntersectionsAABBTree)
+			continue;
+
+		data.RayCaster() = info.engine;
+		std::vector<double> referenceSizes;
+		for (int hints = 0; hints < 2; ++hints)
+		{
+			data.RayTraversalHints() = hints != 0;
+			data.CalculateDistances();
+			auto& stats = data.LastDistanceStatistics();
+
+			std::cout << "\t" << std::left << std::setw(32) << info.name << std::setw(14) << (hints ? "with hints" : "without hints") << std::right
+				<< std::fixed << std::setprecision(2) << std::setw(8) << (double)stats.visitedNodes / stats.tracedRays << " node visits per ray, "
+				<< std::setprecision(1) << std::setw(5) << 100.0 * stats.hintedRays / stats.tracedRays << " % hinted, "
+				<< std::setprecision(3) << std::setw(8) << stats.rayCastingSeconds << " s ray casting";
+			std::cout.unsetf(std::ios::floatfield);
+
+			if (referenceSizes.empty())
+			{
+				for (size_t i = 0; i < data.NumberOfVertices(); ++i)
+					referenceSizes.push_back(data.CaveSizeUnsmoothed(i));
+			}
+			else
+				std::cout << ", max. relative size difference " << MaxRelativeDifference(data, referenceSizes);
+			std::cout << std::endl;
+		}
+	}
+	data.RayTraversalHints() = false;
+}
+
+//Calculates the cave sizes with adaptive sphere sampling for several quality settings and reports the number of cast rays and the
+//difference to the sizes at full resolution.
+void BenchmarkAdaptiveSampling(ICaveData& data)
+{
+	const double qualities[] = { 1.0, 0.9, 0.75, 0.5, 0.25, 0.1 };
+
+	std::cout << "Adaptive sphere sampling (" << data.NumberOfVertices() << " skeleton vertices)" << std::endl;
+
+	data.RayDistanceCaching() = ICaveData::NoRayDistanceCache;
+	std::vector<double> referenceSizes;
+	size_t referenceRays = 0;
+	for (double quality : qualities)
+	{
+		data.SphereSamplingQuality() = quality;
+		data.CalculateDistances();
+		auto& stats = data.LastDistanceStatistics();
+
+		double meanDifference = 0;
+		if (referenceSizes.empty())
+		{
+			referenceRays = stats.tracedRays;
+			for (size_t i = 0; i < data.NumberOfVertices(); ++i)
+				referenceSizes.push_back(data.CaveSizeUnsmoothed(i));
+		}
+		else
+		{
+			for (size_t i = 0; i < referenceSizes.size(); ++i)
+				meanDifference += std::abs(data.CaveSizeUnsmoothed(i) - referenceSizes[i]) / referenceSizes[i];
+			meanDifference /= referenceSizes.size();
+		}
+
+		std::cout << "\tQuality " << std::fixed << std::setprecision(2) << std::setw(4) << quality << ": " << std::setw(10) << stats.tracedRays << " rays ("
+			<< std::setprecision(1) << std::setw(5) << 100.0 * stats.tracedRays / referenceRays << " %), "
+			<< std::setprecision(3) << std::setw(8) << stats.rayCastingSeconds << " s ray casting, " << std::setw(8) << stats.totalSeconds << " s total";
+		std::cout.unsetf(std::ios::floatfield);
+		std::cout << ", relative size difference mean " << meanDifference << ", max. " << MaxRelativeDifference(data, referenceSizes) << std::endl;
+	}
+	data.SphereSamplingQuality() = 1.0;
+}
+
+//Calculates the cave sizes with all supported sphere sampling resolutions and reports the time per skeleton vertex and the difference
+//to the sizes with the default resolution.
+void BenchmarkSamplingResolutions(ICaveData& data)
+{
+	const int resolutions[] = { 51, 31, 81 };
+
+	std::cout << "Sphere sampling resolutions (" << data.NumberOfVertices() << " skeleton vertices)" << std::endl;
+
+	data.RayDistanceCaching() = ICaveData::NoRayDistanceCache;
+	std::vector<double> referenceSizes;
+	for (int resolution : resolutions)
+	{
+		data.SphereSamplingResolution() = resolution;
+		data.CalculateDistances(); //builds the sampling on first use
+		data.CalculateDistances();
+		auto& stats = data.LastDistanceStatistics();
+
+		double meanDifference = 0;
+		if (referenceSizes.empty())
+		{
+			for (size_t i = 0; i < data.NumberOfVertices(); ++i)
+				referenceSizes.push_back(data.CaveSizeUnsmoothed(i));
+		}
+		else
+		{
+			for (size_t i = 0; i < referenceSizes.size(); ++i)
+				meanDifference += std::abs(data.CaveSizeUnsmoothed(i) - referenceSizes[i]) / referenceSizes[i];
+			meanDifference /= referenceSizes.size();
+		}
+
+		std::cout << "\tResolution " << std::setw(2) << resolution << ": " << std::setw(10) << stats.tracedRays << " rays, " << std::fixed << std::setprecision(3)
+			<< std::setw(8) << stats.totalSeconds * 1e3 / data.NumberOfVertices() << " ms per vertex";
+		std::cout.unsetf(std::ios::floatfield);
+		std::cout << ", relative size difference mean " << meanDifference << ", max. " << MaxRelativeDifference(data, referenceSizes) << std::endl;
+	}
+	data.SphereSamplingResolution() = resolutions[0];
+}
+
+//Calculates the cave sizes with every cave size calculator and reports the time per skeleton vertex as well as the relative size
+//difference and the correlation to the sizes of the line flow calculator. Ray distances are cached after the first run, such that
+//the times are dominated by the size calculation.
+void BenchmarkCaveSizeCalculators(ICaveData& data)
+{
+	struct CalculatorInfo
+	{
+		ICaveData::CaveSizeCalculatorType calculator;
+		const char* name;
+	};
+	const CalculatorInfo calculators[] = { { ICaveData::LineFlowCaveSize, "Line flow" }, { ICaveData::VoronoiCaveSize, "Voronoi" }, { ICaveData::VoidCaveSize, "Void" } };
+
+	std::cout << "Cave size calculators (" << data.NumberOfVertices() << " skeleton vertices)" << std::endl;
+
+	std::vector<double> referenceSizes;
+	data.RayDistanceCaching() = ICaveData::Float32RayDistanceCache;
+	data.CalculateDistances(); //fills the ray distance cache
+	for (auto& info : calculators)
+	{
+		data.CaveSizeCalculator() = info.calculator;
+		data.CalculateDistances();
+		auto& stats = data.LastDistanceStatistics();
+
+		std::cout << "\t" << std::setw(9) << info.name << ": " << std::fixed << std::setprecision(3) << std::setw(7)
+			<< stats.totalSeconds * 1e3 / data.NumberOfVertices() << " ms per vertex";
+		std::cout.unsetf(std::ios::floatfield);
+		if (referenceSizes.empty())
+		{
+			for (size_t i = 0; i < data.NumberOfVertices(); ++i)
+				referenceSizes.push_back(data.CaveSizeUnsmoothed(i));
+		}
+		else if (info.calculator != ICaveData::VoidCaveSize)
+		{
+			//Pearson correlation of the sizes
+			double meanReference = 0, mean = 0, meanDifference = 0;
+			size_t count = referenceSizes.size();
+			for (size_t i = 0; i < count; ++i)
+			{
+				meanReference += referenceSizes[i] / count;
+				mean += data.CaveSizeUnsmoothed(i) / count;
+				meanDifference += std::abs(data.CaveSizeUnsmoothed(i) - referenceSizes[i]) / referenceSizes[i] / count;
+			}
+			double covariance = 0, referenceVariance = 0, variance = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				covariance += (referenceSizes[i] - meanReference) * (data.CaveSizeUnsmoothed(i) - mean);
+				referenceVariance += (referenceSizes[i] - meanReference) * (referenceSizes[i] - meanReference);
+				variance += (data.CaveSizeUnsmoothed(i) - mean) * (data.CaveSizeUnsmoothed(i) - mean);
+			}
+			std::cout << ", relative size difference mean " << meanDifference << ", max. " << MaxRelativeDifference(data, referenceSizes)
+				<< ", correlation " << covariance / sqrt(referenceVariance * variance);
+		}
+		std::cout << std::endl;
+	}
+	data.CaveSizeCalculator() = ICaveData::LineFlowCaveSize;
+}
+
+//Calculates the cave sizes with several convergence tolerances for the line flow and reports the iterations per vertex (in total and
+//after the optimal line has been found), the time per vertex, and the difference to the sizes without convergence detection. Ray
+//distances are cached after the first run, such that the times are dominated by the line flow.
+void BenchmarkLineFlowConvergence(ICaveData& data)
+{
+	struct Tolerances { double potential, displacement; };
+	const Tolerances settings[] = { { 0, 0 }, { 1e-4, 0 }, { 1e-3, 0 }, { 0, 0.05 }, { 0, 0.1 }, { 0, 0.2 }, { 1e-3, 0.1 } };
+
+	std::cout << "Line flow convergence (" << data.NumberOfVertices() << " skeleton vertices)" << std::endl;
+
+	data.RecordLineFlowStatistics() = true;
+	auto& termination = data.LineFlowTerminationCriteria();
+	std::vector<double> referenceSizes;
+	data.RayDistanceCaching() = ICaveData::Float32RayDistanceCache;
+	data.CalculateDistances(); //fills the ray distance cache
+	for (auto& setting : settings)
+	{
+		termination.potentialTolerance = setting.potential;
+		termination.displacementTolerance = setting.displacement;
+		data.CalculateDistances();
+		auto& stats = data.LastDistanceStatistics();
+
+		double lines = 0, iterations = 0, iterationsAfterOptimum = 0, stationaryLines = 0;
+		for (size_t i = 0; i < data.NumberOfVertices(); ++i)
+		{
+			auto vertexStats = data.VertexLineFlowStatistics(i);
+			lines += vertexStats.lines;
+			iterations += vertexStats.iterations;
+			iterationsAfterOptimum += vertexStats.iterationsAfterOptimum;
+			stationaryLines += vertexStats.stationaryLines;
+		}
+
+		double meanDifference = 0;
+		if (referenceSizes.empty())
+		{
+			for (size_t i = 0; i < data.NumberOfVertices(); ++i)
+				referenceSizes.push_back(data.CaveSizeUnsmoothed(i));
+		}
+		else
+		{
+			for (size_t i = 0; i < referenceSizes.size(); ++i)
+				meanDifference += std::abs(data.CaveSizeUnsmoothed(i) - referenceSizes[i]) / referenceSizes[i];
+			meanDifference /= referenceSizes.size();
+		}
+
+		double vertices = (double)data.NumberOfVertices();
+		std::cout << "\tPotential tol. " << std::setw(6) << setting.potential << ", displacement tol. " << std::setw(4) << setting.displacement << ": "
+			<< std::fixed << std::setprecision(1) << std::setw(6) << iterations / vertices << " iterations per vertex (" << std::setw(6) << iterationsAfterOptimum / vertices
+			<< " after optimum), " << std::setw(5) << 100.0 * stationaryLines / lines << " % of lines stationary, "
+			<< std::setprecision(3) << std::setw(7) << stats.totalSeconds * 1e3 / vertices << " ms per vertex";
+		std::cout.unsetf(std::ios::floatfield);
+		std::cout << ", relative size difference mean " << meanDifference << ", max. " << MaxRelativeDifference(data, referenceSizes) << std::endl;
+	}
+	termination = ICaveData::LineFlowTermination();
+	data.RecordLineFlowStatistics() = false;
+}
+
+//Calculates the cave sizes with 1 to maxThreads threads (without ray distance cache) and reports the speedup and the parallel
+//efficiency relative to a single thread. Every measurement is preceded by a warm-up run with the same number of threads, such
+//that the scheduler can order the vertices by the times of that run.
+void BenchmarkScaling(ICaveData& data, int maxThreads)
+{
+	std::cout << "Scaling (" << data.NumberOfVertices() << " skeleton vertices, up to " << maxThreads << " threads)" << std::endl;
+
+	data.RayDistanceCaching() = ICaveData::NoRayDistanceCache;
+	double singleThreadSeconds = 0;
+	for (int threads = 1; threads <= maxThreads; ++threads)
+	{
+		data.NumberOfThreads() = threads;
+		data.CalculateDistances();
+		data.CalculateDistances();
+		auto& stats = data.LastDistanceStatistics();
+		if (threads == 1)
+			singleThreadSeconds = stats.totalSeconds;
+
+		double speedup = singleThreadSeconds / stats.totalSeconds;
+		std::cout << "\t" << std::setw(3) << stats.threads << " threads: " << std::fixed << std::setprecision(3) << std::setw(8) << stats.totalSeconds << " s, speedup "
+			<< std::setprecision(2) << std::setw(6) << speedup << ", efficiency " << std::setw(6) << 100.0 * speedup / stats.threads << " %" << std::endl;
+		std::cout.unsetf(std::ios::floatfield);
+	}
+	data.NumberOfThreads() = 0;
+}
+
+//Prints the results of a micro benchmark as a table.
+void PrintMicrobenchmarkResults(const std::vector<MicrobenchmarkResult>& results)
+{
+	for (auto& result : results)
+	{
+		std::cout << "\t" << std::left << std::setw(22) << result.name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(10) << result.referenceSeconds * 1e6 << " us before, " << std::setw(10) << result.optimizedSeconds * 1e6 << " us after, speedup "
+			<< std::setw(6) << result.referenceSeconds / result.optimizedSeconds;
+		std::cout.unsetf(std::ios::floatfield);
+		std::cout << ", max. difference " << result.maxDifference << std::endl;
+	}
+}
+
+//Compares the nested and the flat layout of sphere fields for all sampling resolutions.
+void BenchmarkSphereFields()
+{
+	const int resolutions[] = { 31, 51, 81 };
+	for (int resolution : resolutions)
+	{
+		std::cout << "Sphere field layouts (resolution " << resolution << ", nested before, flat after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkSphereFieldLayouts(resolution, 200));
+	}
+}
+
+//Compares the gradient calculation via normal equations and via the precomputed operator for all sampling resolutions.
+void BenchmarkGradient()
+{
+	const int resolutions[] = { 31, 51, 81 };
+	for (int resolution : resolutions)
+	{
+		std::cout << "Sphere gradient (resolution " << resolution << ", normal equations before, sparse operator after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkSphereGradient(resolution, 200));
+	}
+}
+
+//Compares the extremum search with neighborhoods from the range iterator and from the precomputed table for all sampling resolutions.
+void BenchmarkExtrema()
+{
+	const int resolutions[] = { 31, 51, 81 };
+	for (int resolution : resolutions)
+	{
+		std::cout << "Strong local extrema (resolution " << resolution << ", range iterator before, neighborhood table after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkStrongExtrema(resolution, 200));
+	}
+}
+
+//Compares the point-by-point and the batched interpolation of sphere fields for all sampling resolutions.
+void BenchmarkInterpolation()
+{
+	const int resolutions[] = { 31, 51, 81 };
+	for (int resolution : resolutions)
+	{
+		std::cout << "Interpolation (resolution " << resolution << ", point by point before, batched after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkBatchedInterpolation(resolution, 20000));
+	}
+}
+
+//Compares LineFlow on a linked list and on a contiguous buffer for all sampling resolutions.
+void BenchmarkLineFlows()
+{
+	const int resolutions[] = { 31, 51, 81 };
+	for (int resolution : resolutions)
+	{
+		std::cout << "Line flow (resolution " << resolution << ", linked list before, contiguous buffer after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkLineFlow(resolution, 200));
+	}
+}
+
+//Compares the Voronoi cave size calculations for all sampling resolutions.
+void BenchmarkVoronoi()
+{
+	const int resolutions[] = { 31, 51, 81 };
+	for (int resolution : resolutions)
+	{
+		std::cout << "Voronoi cave size (resolution " << resolution << ", priority queue per sample before, precomputed nearest maxima after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkVoronoiCaveSize(resolution, 50));
+	}
+}
+
+//Compares the dynamic programs for the optimal mean average on random lines of several lengths.
+void BenchmarkMeanAverage()
+{
+	const int sampleCounts[] = { 8, 32, 128 };
+	for (int sampleCount : sampleCounts)
+	{
+		std::cout << "Optimal mean average (" << sampleCount << " samples per line, exhaustive relaxation before, sliding window after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkOptimalMeanAverage(sampleCount, sampleCount > 64 ? 2 : 20));
+	}
+}
+
+//Compares the smoothing of skeleton vertices on synthetic skeletons of several sizes.
+void BenchmarkSmoothing()
+{
+	const int vertexCounts[] = { 10000, 100000 };
+	for (int vertexCount : vertexCounts)
+	{
+		std::cout << "Skeleton smoothing (" << vertexCount << " vertices, set and map per search before, reusable workspace after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkSkeletonSmoothing(vertexCount, vertexCount > 50000 ? 1 : 3));
+	}
+}
+
+//Compares kernel sweeps with and without the smoothing operator on synthetic skeletons of several sizes.
+void BenchmarkSmoothingSweep()
+{
+	const int vertexCounts[] = { 10000, 100000 };
+	for (int vertexCount : vertexCounts)
+	{
+		std::cout << "Smoothing sweep (" << vertexCount << " vertices, Dijkstra search per kernel before, smoothing operator after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkSmoothingOperator(vertexCount, vertexCount > 50000 ? 1 : 3));
+	}
+}
+
+//Compares the Max and Advect cave scale algorithms with and without the chain decomposition on synthetic skeletons of increasing size.
+void BenchmarkChainMaxima()
+{
+	const int vertexCounts[] = { 1000, 10000, 100000 };
+	for (int vertexCount : vertexCounts)
+	{
+		std::cout << "Cave scale maxima (" << vertexCount << " vertices, depth-first search per vertex before, chain decomposition after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkChainMaxima(vertexCount, vertexCount > 50000 ? 1 : 3));
+	}
+}
+
+//Compares the per-edge steps of the cave size smoothing with a map of edge ids and with the compressed adjacency on synthetic skeletons of increasing size.
+void BenchmarkSkeletonGraph()
+{
+	const int vertexCounts[] = { 10000, 100000 };
+	for (int vertexCount : vertexCounts)
+	{
+		std::cout << "Skeleton graph (" << vertexCount << " vertices, adjacency lists and map of edge ids before, compressed adjacency after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkSkeletonGraph(vertexCount, vertexCount > 50000 ? 1 : 3));
+	}
+}
+
+//Compares the per-edge smoothing with a set and map per search and with the reusable workspace on synthetic skeletons of increasing size.
+void BenchmarkEdgeSmoothing()
+{
+	const int vertexCounts[] = { 10000, 100000 };
+	for (int vertexCount : vertexCounts)
+	{
+		std::cout << "Edge smoothing (" << vertexCount << " vertices, set and map per search before, reusable workspace after)" << std::endl;
+		PrintMicrobenchmarkResults(BenchmarkEdgeSmoothing(vertexCount, vertexCount > 50000 ? 1 : 3));
+	}
+}
+
+struct MicrobenchmarkInfo
+{
+	const char* option;
+	const char* description;
+	void(*run)();
+};
+
+//Micro benchmarks in the order in which they run
+const MicrobenchmarkInfo microbenchmarks[] =
+{
+	{ "--sphereFields", "Compare the nested and the flat memory layout of sphere fields (gradient, extrema, interpolation).", BenchmarkSphereFields },
+	{ "--gradient", "Compare the per-sample normal equations with the precomputed sparse gradient operator.", BenchmarkGradient },
+	{ "--extrema", "Compare the extremum search with the range iterator and with precomputed neighborhoods.", BenchmarkExtrema },
+	{ "--interpolation", "Compare point-by-point interpolation of sphere fields with the batched interpolation.", BenchmarkInterpolation },
+	{ "--lineFlow", "Compare LineFlow on a linked list with LineFlow on a contiguous buffer.", BenchmarkLineFlows },
+	{ "--meanAverage", "Compare the exhaustive and the sliding window dynamic program for the optimal mean average on random lines.", BenchmarkMeanAverage },
+	{ "--voronoi", "Compare the Voronoi cave size with a priority queue per sample and with precomputed nearest maxima.", BenchmarkVoronoi },
+	{ "--smoothing", "Compare the Dijkstra smoothing of skeleton vertices with a set and map per search and with a reusable workspace.", BenchmarkSmoothing },
+	{ "--smoothingSweep", "Compare a sweep over smoothing kernels with Dijkstra searches and with a precomputed smoothing operator.", BenchmarkSmoothingSweep },
+	{ "--chainMaxima", "Compare the Max and Advect cave scale with a search per vertex and with the chain decomposition.", BenchmarkChainMaxima },
+	{ "--skeletonGraph", "Compare the per-edge smoothing and derivative with a map of edge ids and with the compressed adjacency.", BenchmarkSkeletonGraph },
+	{ "--edgeSmoothing", "Compare the per-edge smoothing with a set and map per search and with the vertex Dijkstra workspace.", BenchmarkEdgeSmoothing },
+};
+const int microbenchmarkCount = sizeof(microbenchmarks) / sizeof(microbenchmarks[0]);
+
+void PrintHelp()
+{
+	std::cout << "Usage: Benchmark [options]" << std::endl;
+	std::cout << "Obligatory Options: " << std::endl;
+	std::cout << "\t-d [dataDirectory]     The data directory must contain a \"model.off\" and a \"model.skel\"." << std::endl;
+	std::cout << "Benchmarks: " << std::endl;
+	std::cout << "\t--rays                 Measure the ray throughput of all ray casting engines and compare their results." << std::endl;
+	std::cout << "\t--scaling              Measure the distance calculation with 1 to N threads and report the parallel efficiency." << std::endl;
+	std::cout << "\t--hints                Measure the BVH traversal with and without hints from neighboring skeleton vertices." << std::endl;
+	std::cout << "\t--adaptive             Measure adaptive sphere sampling with several quality settings and compare to full resolution." << std::endl;
+	std::cout << "\t--exponents            Measure a sweep over several distance exponents with and without the ray distance cache." << std::endl;
+	std::cout << "\t--resolutions          Measure the distance calculation with all sphere sampling resolutions and compare to the default." << std::endl;
+	std::cout << "\t--calculators          Measure every cave size calculator and compare its sizes to the line flow calculator." << std::endl;
+	std::cout << "\t--flowConvergence      Measure the line flow iterations with several convergence tolerances and compare to the default." << std::endl;
+	std::cout << "Micro benchmarks (do not need a data directory): " << std::endl;
+	std::cout << "\t--micro                Run all micro benchmarks." << std::endl;
+	for (auto& microbenchmark : microbenchmarks)
+		std::cout << "\t" << std::left << std::setw(23) << microbenchmark.option << microbenchmark.description << std::endl;
+	std::cout << "Optional Options: " << std::endl;
+	std::cout << "\t--rayCaster [name]     Restrict --rays to a single engine (\"aabb\", \"bvh\", or \"packet\")." << std::endl;
+	std::cout << "\t                       Peak memory is reported per process, so run once per engine to compare memory usage." << std::endl;
+	std::cout << "\t--threads [int]        Maximum number of threads for --scaling (default: number of hardware threads)." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string dataDirectory;
+	bool benchmarkRays = false;
+	bool benchmarkExponents = false;
+	bool benchmarkScaling = false;
+	bool benchmarkAdaptive = false;
+	bool benchmarkHints = false;
+	bool benchmarkResolutions = false;
+	bool benchmarkFlowConvergence = false;
+	bool benchmarkCalculators = false;
+	std::vector<bool> runMicrobenchmark(microbenchmarkCount, false);
+	int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	std::string rayCaster;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+		{
+			dataDirectory = std::string(argv[i + 1]);
+			++i;
+		}
+		else if (strcmp(argv[i], "--rays") == 0)
+			benchmarkRays = true;
+		else if (strcmp(argv[i], "--exponents") == 0)
+			benchmarkExponents = true;
+		else if (strcmp(argv[i], "--scaling") == 0)
+			benchmarkScaling = true;
+		else if (strcmp(argv[i], "--adaptive") == 0)
+			benchmarkAdaptive = true;
+		else if (strcmp(argv[i], "--hints") == 0)
+			benchmarkHints = true;
+		else if (strcmp(argv[i], "--resolutions") == 0)
+			benchmarkResolutions = true;
+		else if (strcmp(argv[i], "--flowConvergence") == 0)
+			benchmarkFlowConvergence = true;
+		else if (strcmp(argv[i], "--calculators") == 0)
+			benchmarkCalculators = true;
+		else if (strcmp(argv[i], "--micro") == 0)
+			std::fill(runMicrobenchmark.begin(), runMicrobenchmark.end(), true);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			maxThreads = std::max(1, atoi(argv[i + 1]));
+			++i;
+		}
+		else if (strcmp(argv[i], "--rayCaster") == 0 && i + 1 < argc)
+		{
+			rayCaster = std::string(argv[i + 1]);
+			++i;
+		}
+		else
+		{
+			for (int j = 0; j < microbenchmarkCount; ++j)
+				if (strcmp(argv[i], microbenchmarks[j].option) == 0)
+					runMicrobenchmark[j] = true;
+		}
+	}
+
+	bool ranMicrobenchmarks = false;
+	for (int j = 0; j < microbenchmarkCount; ++j)
+		if (runMicrobenchmark[j])
+		{
+			microbenchmarks[j].run();
+			ranMicrobenchmarks = true;
+		}
+
+	bool needsData = benchmarkRays || benchmarkExponents || benchmarkScaling || benchmarkAdaptive || benchmarkHints || benchmarkResolutions || benchmarkFlowConvergence || benchmarkCalculators;
+	if (!needsData && ranMicrobenchmarks)
+		return 0;
+
+	if (dataDirectory.empty())
+	{
+		std::cout << "You did not specify a data directory." << std::endl;
+		PrintHelp();
+		return 1;
+	}
+
+	auto data = CreateCaveData();
+	data->SetVerbose(false);
+	data->LoadMesh(dataDirectory + "/model.off");
+	CurveSkeleton* skeleton = LoadCurveSkeleton((dataDirectory + "/model.skel").c_str());
+	data->SetSkeleton(skeleton);
+
+	if (benchmarkRays)
+		BenchmarkRayCasting(*data, rayCaster);
+	if (benchmarkExponents)
+		BenchmarkExponentSweep(*data);
+	if (benchmarkScaling)
+		BenchmarkScaling(*data, maxThreads);
+	if (benchmarkAdaptive)
+		BenchmarkAdaptiveSampling(*data);
+	if (benchmarkHints)
+		BenchmarkTraversalHints(*data);
+	if (benchmarkResolutions)
+		BenchmarkSamplingResolutions(*data);
+	if (benchmarkFlowConvergence)
+		BenchmarkLineFlowConvergence(*data);
+	if (benchmarkCalculators)
+		BenchmarkCaveSizeCalculators(*data);
+
+	data->SetSkeleton(nullptr);
+	DestroySkeleton(skeleton);
+
+	return 0;
+}
@@ -0,0 +1,1864 @@
+#include "Microbenchmarks.h"
+
+#include "SphereProc.h"
+#include "LineProc.h"
+#include "SizeCalculation.h"
+#include "GraphProc.h"
+#include "SkeletonAdjacency.h"
+#include "SmoothingOperator.h"
+#include "SkeletonChains.h"
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <list>
+#include <cstring>
+#include <queue>
+
+//Sphere fields in the nested per-latitude layout, i.e. the layout before the introduction of SphereScalarField and SphereVectorField
+typedef std::vector<std::vector<double>> NestedScalarField;
+typedef std::vector<std::vector<Vector>> NestedVectorField;
+
+template <typename T>
+void PrepareNestedField(const RegularUniformSphereSampling& sphereSampling, std::vector<std::vector<T>>& field)
+{
+	field.resize(sphereSampling.RingCount());
+	for (int ring = 0; ring < sphereSampling.RingCount(); ++ring)
+		field[ring].resize(sphereSampling.RingSize(ring));
+}
+
+//Reference implementation of the gradient calculation on nested fields
+void NestedCalculateGradient(const RegularUniformSphereSampling& sphereSampling, const NestedScalarField& sphereDistances, NestedVectorField& distanceGradient)
+{
+	for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
+	{
+		double currentDistance = sphereDistances[it.Ring()][it.IndexOnRing()];
+		Vector currentPos = *it;
+
+		double a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, h = 0, i = 0;
+
+		for (auto neighbor : sphereSampling.Neighbors(it))
+		{
+			Vector neighborPos = *neighbor;
+			double neighborDistance = sphereDistances[neighbor.Ring()][neighbor.IndexOnRing()];
+			Vector direction = neighborPos - currentPos;
+			double dirLength = sqrt(direction.squared_length());
+			direction = direction * (1.0 / dirLength);
+			double derivative = (neighborDistance - currentDistance) / dirLength;
+
+			a += direction.x() * direction.x();
+			b += direction.x() * direction.y();
+			c += direction.x() * direction.z();
+			d += direction.y() * direction.y();
+			e += direction.y() * direction.z();
+			f += direction.z() * direction.z();
+			g += direction.x() * derivative;
+			h += direction.y() * derivative;
+			i += direction.z() * derivative;
+		}
+
+		double denom = c * c * d - 2 * b * c * e + a * e * e + b * b * f - a * d * f;
+		Vector gradient(
+			(e * e * g - d * f * g - c * e * h + b * f * h + c * d * i - b * e * i) / denom,
+			(b * f * g - c * e * g + c * c * h - a * f * h - b * c * i + a * e * i) / denom,
+			(c * d * g - b * e * g - b * c * h + a * e * h + b * b * i - a * d * i) / denom);
+
+		gradient = gradient - (gradient * currentPos) * currentPos;
+
+		distanceGradient[it.Ring()][it.IndexOnRing()] = gradient;
+	}
+}
+
+//Reference implementation of the gradient calculation on flat fields that solves the normal equations for every sample
+//(i.e. before the introduction of SphereGradientOperator)
+void NormalEquationsGradient(const RegularUniformSphereSampling& sphereSampling, const SphereScalarField& sphereDistances, SphereVectorField& distanceGradient)
+{
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+	{
+		double currentDistance = sphereDistances[iSample];
+		const Vector& currentPos = sphereSampling.Direction(iSample);
+
+		double a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, h = 0, i = 0;
+
+		for (auto neighbor : sphereSampling.NeighborIndices(iSample))
+		{
+			const Vector& neighborPos = sphereSampling.Direction(neighbor);
+			double neighborDistance = sphereDistances[neighbor];
+			Vector direction = neighborPos - currentPos;
+			double dirLength = sqrt(direction.squared_length());
+			direction = direction * (1.0 / dirLength);
+			double derivative = (neighborDistance - currentDistance) / dirLength;
+
+			a += direction.x() * direction.x();
+			b += direction.x() * direction.y();
+			c += direction.x() * direction.z();
+			d += direction.y() * direction.y();
+			e += direction.y() * direction.z();
+			f += direction.z() * direction.z();
+			g += direction.x() * derivative;
+			h += direction.y() * derivative;
+			i += direction.z() * derivative;
+		}
+
+		double denom = c * c * d - 2 * b * c * e + a * e * e + b * b * f - a * d * f;
+		Vector gradient(
+			(e * e * g - d * f * g - c * e * h + b * f * h + c * d * i - b * e * i) / denom,
+			(b * f * g - c * e * g + c * c * h - a * f * h - b * c * i + a * e * i) / denom,
+			(c * d * g - b * e * g - b * c * h + a * e * h + b * b * i - a * d * i) / denom);
+
+		gradient = gradient - (gradient * currentPos) * currentPos;
+
+		distanceGradient.Set(iSample, gradient);
+	}
+}
+
+//Reference implementation of FindStrongLocalExtrema() on nested fields
+template <typename TSphereVisualizer>
+void NestedFindStrongLocalExtrema(const RegularUniformSphereSampling& sphereSampling, const NestedScalarField& sphereDistances, double extremumSearchRadius, ArenaVector<PositionValue>& maxima, ArenaVector<PositionValue>& minima, TSphereVisualizer& visualizer)
+{
+	for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
+	{
+		double dist = sphereDistances[it.Ring()][it.IndexOnRing()];
+
+		bool isLocalMaximum = true;
+		bool isLocalMinimum = true;
+		for (auto neighbor : sphereSampling.Neighbors(*it, extremumSearchRadius))
+		{
+			double d = sphereDistances[neighbor.Ring()][neighbor.IndexOnRing()];
+			if (dist < d)
+				isLocalMaximum = false;
+			if (dist > d)
+				isLocalMinimum = false;
+			if (!isLocalMaximum && !isLocalMinimum)
+				break;
+		}
+
+		if (isLocalMaximum)
+			maxima.push_back({ *it, dist });
+		if (isLocalMinimum)
+			minima.push_back({ *it, dist });
+
+		double x, y, w, h;
+		BYTE c = (BYTE)(std::min(255.0, dist * 255 / 20));
+		BYTE r = c, g = c, b = c;
+		if (isLocalMaximum)
+		{
+			g >>= 1;
+			b >>= 1;
+		}
+		if (isLocalMinimum)
+		{
+			r >>= 1;
+			g >>= 1;
+		}
+		it.GetParameterSpaceRect(x, y, w, h);
+		visualizer.FillRect(x, y, w, h, Gdiplus::Color(r, g, b));
+	}
+}
+
+//Reference implementation of FindStrongLocalExtrema() on flat fields that finds the neighborhoods with the range iterator
+//(i.e. before the introduction of RegularUniformSphereSampling::range_table)
+template <typename TSphereVisualizer>
+void RangeIteratorStrongLocalExtrema(const RegularUniformSphereSampling& sphereSampling, const SphereScalarField& sphereDistances, double extremumSearchRadius, ArenaVector<PositionValue>& maxima, ArenaVector<PositionValue>& minima, TSphereVisualizer& visualizer)
+{
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+	{
+		double dist = sphereDistances[iSample];
+		const Vector& position = sphereSampling.Direction(iSample);
+
+		bool isLocalMaximum = true;
+		bool isLocalMinimum = true;
+		for (auto neighbor : sphereSampling.Neighbors(position, extremumSearchRadius))
+		{
+			double d = sphereDistances[sphereSampling.SampleIndex(neighbor)];
+			if (dist < d)
+				isLocalMaximum = false;
+			if (dist > d)
+				isLocalMinimum = false;
+			if (!isLocalMaximum && !isLocalMinimum)
+				break;
+		}
+
+		if (isLocalMaximum)
+			maxima.push_back({ position, dist });
+		if (isLocalMinimum)
+			minima.push_back({ position, dist });
+
+		double x, y, w, h;
+		BYTE c = (BYTE)(std::min(255.0, dist * 255 / 20));
+		BYTE r = c, g = c, b = c;
+		if (isLocalMaximum)
+		{
+			g >>= 1;
+			b >>= 1;
+		}
+		if (isLocalMinimum)
+		{
+			r >>= 1;
+			g >>= 1;
+		}
+		sphereSampling.GetParameterSpaceRect(iSample, x, y, w, h);
+		visualizer.FillRect(x, y, w, h, Gdiplus::Color(r, g, b));
+	}
+}
+
+//Reference implementation of RegularUniformSphereSampling::InterpolateField() on nested fields
+template <typename T>
+T NestedInterpolate(const RegularUniformSphereSampling& sphereSampling, const std::vector<std::vector<T>>& container, double phi, double theta)
+{
+	int nPhi = sphereSampling.RingCount();
+	double phiSlice = M_PI / (nPhi - 1);
+	double iPhi = (phi / phiSlice);
+	int lowerPhi = (int)floor(iPhi);
+	int upperPhi = (int)ceil(iPhi);
+
+	int lowerNTheta = sphereSampling.RingSize(lowerPhi);
+	double iLowerTheta = (theta / (2 * M_PI / lowerNTheta));
+	int lowerLeftTheta = (int)floor(iLowerTheta);
+	int lowerRightTheta = (int)ceil(iLowerTheta);
+	if (lowerLeftTheta >= lowerNTheta)
+	{
+		iLowerTheta -= lowerNTheta;
+		lowerLeftTheta -= lowerNTheta;
+		lowerRightTheta -= lowerNTheta;
+	}
+
+	if (lowerPhi == upperPhi && lowerLeftTheta == lowerRightTheta)
+		return container[lowerPhi][lowerLeftTheta];
+
+	if (lowerPhi == upperPhi)
+	{
+		double alpha = (iLowerTheta - lowerLeftTheta);
+		return (1 - alpha) * container[lowerPhi][lowerLeftTheta] + alpha * container[lowerPhi][lowerRightTheta % lowerNTheta];
+	}
+
+	int upperNTheta = sphereSampling.RingSize(upperPhi);
+	double iUpperTheta = (theta / (2 * M_PI / upperNTheta));
+	int upperLeftTheta = (int)floor(iUpperTheta);
+	int upperRightTheta = (int)ceil(iUpperTheta);
+	if (upperLeftTheta >= upperNTheta)
+	{
+		iUpperTheta -= upperNTheta;
+		upperLeftTheta -= upperNTheta;
+		upperRightTheta -= upperNTheta;
+	}
+
+	T interpolLower, interpolUpper;
+	if (lowerLeftTheta == lowerRightTheta)
+		interpolLower = container[lowerPhi][lowerLeftTheta];
+	else
+	{
+		double alphaLowerTheta = (iLowerTheta - lowerLeftTheta);
+		interpolLower = (1 - alphaLowerTheta) * container[lowerPhi][lowerLeftTheta] + alphaLowerTheta * container[lowerPhi][lowerRightTheta % lowerNTheta];
+	}
+
+	if (upperLeftTheta == upperRightTheta)
+		interpolUpper = container[upperPhi][upperLeftTheta];
+	else
+	{
+		double alphaUpperTheta = (iUpperTheta - upperLeftTheta);
+		interpolUpper = (1 - alphaUpperTheta) * container[upperPhi][upperLeftTheta] + alphaUpperTheta * container[upperPhi][upperRightTheta % upperNTheta];
+	}
+
+	double alphaPhi = (iPhi - lowerPhi);
+	return (1 - alphaPhi) * interpolLower + alphaPhi * interpolUpper;
+}
+
+//Returns the neighbors of a linked list element (the element itself at the ends of a non-circular list)
+template<bool CIRCULAR, typename T>
+void FindLinkedListNeighbors(std::list<T>& list,
+	const typename std::list<T>::iterator it,
+	const int steps,
+	typename std::list<T>::iterator& prev,
+	typename std::list<T>::iterator& next)
+{
+	prev = it;
+	next = it;
+	for (int i = 0; i < steps; ++i)
+	{
+		if (prev == list.begin())
+		{
+			if (CIRCULAR)
+			{
+				prev = list.end();
+				--prev;
+			}
+		}
+		else
+		{
+			--prev;
+		}
+
+		++next;
+		if (next == list.end())
+		{
+			if (CIRCULAR)
+			{
+				next = list.begin();
+			}
+			else
+			{
+				--next;
+			}
+		}
+	}
+}
+
+//Reference implementation of LineFlow() on a linked list, which inserts and erases line points in place
+template<bool CIRCULAR, typename TSphereVisualizer>
+void ListLineFlow(std::list<PositionGradient>& linePoints, const RegularUniformSphereSampling& sphereSampling, const SphereScalarField& potential, const SphereVectorField& potentialGradient, double direction, double& optimalAveragePotential, double& optimalLineLength, TSphereVisualizer& visualizer, const std::wstring& baseFilename)
+{
+	//maximum distance that a line point moves per iteration
+	const double maxFlowDistance = sphereSampling.LatitudeSpacing() / 2;
+
+	int stopAfterIterations = 20;
+	optimalAveragePotential = std::numeric_limits<double>::infinity() * (- direction);
+
+
+	//Line point positions and interpolation results as structure of arrays for the batched field interpolation
+	std::vector<double> x, y, z, gx, gy, gz, potentials;
+
+	for (int iteration = 0; iteration < 400; ++iteration)
+	{
+		if (stopAfterIterations == 0)
+			break;
+		--stopAfterIterations;
+
+		double maxGradientSquareMagnitude = 0;
+
+		size_t n = linePoints.size();
+		x.resize(n); y.resize(n); z.resize(n);
+		gx.resize(n); gy.resize(n); gz.resize(n);
+		size_t i = 0;
+		for (auto& p : linePoints)
+		{
+			x[i] = p.position.x(); y[i] = p.position.y(); z[i] = p.position.z();
+			++i;
+		}
+		sphereSampling.InterpolateField(potentialGradient, x.data(), y.data(), z.data(), n, gx.data(), gy.data(), gz.data());
+
+		//line flow preparation
+		i = 0;
+		for (auto it = linePoints.begin(); it != linePoints.end(); ++it, ++i)
+		{
+			Vector g(gx[i], gy[i], gz[i]);
+		
+			if (!CIRCULAR && (i == 0 || i == n - 1))
+				g = Vector(0, 0, 0); //fix end points
+
+			it->gradient = g;
+
+
+			double l = g.squared_length();
+			if (l > maxGradientSquareMagnitude)
+				maxGradientSquareMagnitude = l;
+		}
+
+		double gradientMultiplier = maxFlowDistance / sqrt(maxGradientSquareMagnitude);
+
+
+		//actual flow
+		for (auto it = linePoints.begin(); it != linePoints.end(); ++it)
+		{
+			Vector p = it->position + it->gradient * gradientMultiplier * direction;
+			it->position = p / sqrt(p.squared_length());
+		}
+
+		//repair line if necessary
+		for (auto it = linePoints.begin(); it != linePoints.end();)
+		{
+			bool dontIncrement = false;
+
+			Vector p = it->position;
+
+			std::list<PositionGradient>::iterator prev, next;
+			FindLinkedListNeighbors<CIRCULAR>(linePoints, it, 1, prev, next);
+
+			if (next != it) //if this is not the last element
+			{
+				double distanceToNext = acos(it->position * next->position);
+				if (distanceToNext > 1.5 * LINE_POINT_DISTANCE)
+				{
+					Vector meanPosition = it->position + next->position;
+					meanPosition = meanPosition / sqrt(meanPosition.squared_length());
+					linePoints.insert(next, PositionGradient(meanPosition));
+				}
+
+				if (prev != it) //if this is not the first or last element
+				{
+					double distancePrevToNext = acos(prev->position * next->position);
+					if (distanceToNext < 0.25 * LINE_POINT_DISTANCE || distancePrevToNext < 0.5 * LINE_POINT_DISTANCE)
+					{
+						it = linePoints.erase(it);
+						dontIncrement = true;
+					}
+				}
+			}
+
+			if (!dontIncrement)
+				++it;
+		}
+
+		//calculate average potential
+		double lineLength = 0;
+		double averagePotential = 0;
+
+		n = linePoints.size();
+		x.resize(n); y.resize(n); z.resize(n);
+		potentials.resize(n);
+		i = 0;
+		for (auto& p : linePoints)
+		{
+			x[i] = p.position.x(); y[i] = p.position.y(); z[i] = p.position.z();
+			++i;
+		}
+		sphereSampling.InterpolateField(potential, x.data(), y.data(), z.data(), n, potentials.data());
+
+		i = 0;
+		for (auto it = linePoints.begin(); it != linePoints.end(); ++it, ++i)
+		{
+			double distance = potentials[i];
+
+			std::list<PositionGradient>::iterator prev, next;
+			FindLinkedListNeighbors<CIRCULAR>(linePoints, it, 1, prev, next);
+
+			double distanceToPrev = acos(std::min(1.0, std::max(-1.0, it->position * prev->position)));
+			double distanceToNext = acos(std::min(1.0, std::max(-1.0, it->position * next->position)));
+			double vertexDiameter = (distanceToPrev + distanceToNext) / 2;
+			lineLength += vertexDiameter;
+			averagePotential = averagePotential + vertexDiameter / lineLength * (distance - averagePotential);
+		}
+
+		if (averagePotential * direction > optimalAveragePotential * direction)	//found a local extremum...
+		{
+			stopAfterIterations = 20;				//check 20 more iterations
+			optimalAveragePotential = averagePotential;
+			optimalLineLength = lineLength;
+		}
+
+
+		//draw separate image
+		TSphereVisualizer stateVis(visualizer);				
+		for (auto& p : linePoints)
+		{
+			double phi, theta;
+			sphereSampling.ParametersFromPoint(p.position, phi, theta);
+
+			stateVis.FillCircle(theta, phi, 3, SphereVisualizer::FLOW_OUTLINE_COLOR);
+			stateVis.FillCircle(theta, phi, 2, SphereVisualizer::FLOW_COLOR);
+		}
+		std::wstring filename = baseFilename + L"_" + std::to_wstring(iteration) + L".png";
+		stateVis.Save(filename);
+	}
+
+}
+
+//Table of the reference implementation of FindOptimalMeanAverage()
+struct TableMeanAverageWorkspace
+{
+	struct TableEntry
+	{
+		double accumulatedValue;
+		int predecessor; //sequence last index
+	};
+
+	TableEntry* data;
+	int dataCount;
+	std::vector<std::pair<int, int>> columnBounds; //lower bound inclusive, upper bound exlusive
+
+	TableMeanAverageWorkspace() : dataCount(0), data(nullptr) {}
+
+	~TableMeanAverageWorkspace()
+	{
+		if (data)
+			delete[] data;
+	}
+
+	void Initialize(int sampleCount, int maxSubsetSize)
+	{
+		this->sampleCount = sampleCount;
+		int requiredDataCount = sampleCount * maxSubsetSize;
+		if (dataCount < requiredDataCount)
+		{
+			if (data)
+				delete[] data;
+			data = new TableEntry[requiredDataCount];
+			dataCount = requiredDataCount;
+		}
+		if(!columnBounds.empty())
+			memset(&columnBounds[0], 0, sizeof(std::pair<int, int>) * columnBounds.size()); //reset column bounds
+		columnBounds.resize(sampleCount, std::pair<int, int>(0, 0));
+	}
+
+	TableEntry& Entry(int subsetSize, int sampleIndex)
+	{
+		auto& bounds = columnBounds[sampleIndex];
+		if (subsetSize < bounds.first || bounds.first == 0)
+			bounds.first = subsetSize;
+		if (subsetSize + 1 > bounds.second)
+			bounds.second = subsetSize + 1;
+		return data[sampleIndex + (subsetSize - 1) * sampleCount];
+	}
+
+	bool HasEntry(int subsetSize, int sampleIndex)
+	{
+		auto& bounds = columnBounds[sampleIndex];
+		return subsetSize >= bounds.first && subsetSize < bounds.second;
+	}
+
+	void ColumnBounds(int sampleIndex, int& minInclusive, int& maxExclusive)
+	{
+		auto& bounds = columnBounds[sampleIndex];
+		minInclusive = bounds.first;
+		maxExclusive = bounds.second;
+	}
+
+private:
+	int sampleCount;
+};
+
+//Reference implementation of FindOptimalMeanAverage() that relaxes all pairs of samples in a table with column bounds for every
+//first picked sample (i.e. before the sliding window formulation)
+template <typename T>
+void TableFindOptimalMeanAverage(const std::vector<T>& line, double minAngularDistance, double maxAngularDistance, TableMeanAverageWorkspace& workspace, std::vector<int>& result)
+{
+	/*
+	This DP algorithm successively calculates the following table:
+	
+	k \ idx  |  0  |  1  |  2  | ... | ... | ... |  n
+	---------+-----+-----+-----+-----+-----+-----+-----
+	    1    |  
+		2    |
+		3    |
+	  k_max  |
+	                      | <-  accept  -> |
+
+	where the entries denote the minimum sum of a sequence with k entries ending at idx.
+	The optimal solution is the entry in the accept-range with the minimum mean (= value / k).
+	*/
+
+	int n = (int)line.size();
+
+	double globalOptimalMean = std::numeric_limits<double>::infinity();
+
+	for (int firstPickedSample = 0; firstPickedSample < n; ++firstPickedSample)
+	{
+		if (line.at(firstPickedSample).angle - line.at(0).angle > maxAngularDistance)
+			break;
+
+		workspace.Initialize(n, (int)floor(2 * M_PI / minAngularDistance));
+
+		double acceptMin = line.at(firstPickedSample).angle + 2 * M_PI - maxAngularDistance;
+		double acceptMax = line.at(firstPickedSample).angle + 2 * M_PI - minAngularDistance;
+
+		double optimalMeanSoFar = std::numeric_limits<double>::infinity();
+		int optimalMeanIdx = -1;
+		int optimalMeanK = -1;
+
+		//Initialize the table
+		auto& initialEntry = workspace.Entry(1, firstPickedSample);
+		initialEntry.accumulatedValue = line.at(firstPickedSample).value;
+		initialEntry.predecessor = -1;
+
+		//Start DP
+		for (int currentIdx = firstPickedSample; currentIdx < n; ++currentIdx)
+		{
+			//the next sample must be in this range
+			double minNextAngle = line.at(currentIdx).angle + minAngularDistance;
+			double maxNextAngle = std::min(line.at(currentIdx).angle + maxAngularDistance, acceptMax);
+
+			if (maxNextAngle < minNextAngle)
+				break; //we cannot find a new sample that falls in the accept range
+
+			int kLower, kUpper;
+			workspace.ColumnBounds(currentIdx, kLower, kUpper);
+
+			for (int searchIdx = currentIdx + 1; searchIdx < n; ++searchIdx)
+			{
+				double angle = line.at(searchIdx).angle;
+				if (angle < minNextAngle)
+					continue;
+				if (angle > maxNextAngle)
+					break;
+
+				double newSampleValue = line.at(searchIdx).value;
+
+				for (int currentK = kLower; currentK < kUpper; ++currentK)
+				{
+					double newAccumulatedValue = workspace.Entry(currentK, currentIdx).accumulatedValue + newSampleValue;
+					bool overwrite = !workspace.HasEntry(currentK + 1, searchIdx);
+					auto& entry = workspace.Entry(currentK + 1, searchIdx);
+					if (!overwrite)
+						overwrite = newAccumulatedValue < entry.accumulatedValue;
+					if (overwrite)
+					{
+						entry.accumulatedValue = newAccumulatedValue;
+						entry.predecessor = currentIdx;
+
+						//if we are in the accept range
+						if (angle >= acceptMin)
+						{
+							//check if the new mean is better than the current best mean
+							double mean = newAccumulatedValue / (currentK + 1);
+							if (mean < optimalMeanSoFar)
+							{
+								optimalMeanSoFar = mean;
+								optimalMeanIdx = searchIdx;
+								optimalMeanK = currentK + 1;
+							}
+						}
+					}
+				}
+			}
+		}
+		if (optimalMeanSoFar < globalOptimalMean)
+		{
+			result.clear();
+			while (optimalMeanIdx >= 0)
+			{
+				result.push_back(optimalMeanIdx);
+				optimalMeanIdx = workspace.Entry(optimalMeanK, optimalMeanIdx).predecessor;
+				--optimalMeanK;
+			}
+			globalOptimalMean = optimalMeanSoFar;
+		}
+	}	
+}
+
+//Nearest maximum of a sample in the reference implementation of CaveSizeCalculatorVoronoi
+struct VoronoiCellCenter
+{
+	Vector location;
+	double distance;
+
+	VoronoiCellCenter(Vector location, double distance) : location(location), distance(distance) {}
+	bool operator<(const VoronoiCellCenter& other) const { return distance < other.distance; }
+};
+
+//Reference implementation of CaveSizeCalculatorVoronoi::CalculateDistance() that finds the two nearest maxima of every sample with a
+//priority queue and calculates the corners of its parameter space rectangle on the fly (i.e. before precomputing both)
+template <typename TSphereVisualizer>
+double PriorityQueueVoronoiCaveSize(const RegularUniformSphereSampling& sphereSampling, const SphereScalarField& sphereDistances, const ArenaVector<PositionValue>& sphereDistanceMaxima, TSphereVisualizer& visualizer)
+{
+	double voronoiEdgeArea = 0.0;
+	double voronoiDistance = 0.0;
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+	{
+		const Vector& sample = sphereSampling.Direction(iSample);
+		std::priority_queue<VoronoiCellCenter> nearestNeighbors;
+		for (auto& clusterCenter : sphereDistanceMaxima)
+		{
+			double distance = 1 - clusterCenter.position * sample;
+			if (nearestNeighbors.size() < 2)
+				nearestNeighbors.push(VoronoiCellCenter(clusterCenter.position, distance));
+			else
+			{
+				if (distance < nearestNeighbors.top().distance)
+				{
+					nearestNeighbors.pop();
+					nearestNeighbors.push(VoronoiCellCenter(clusterCenter.position, distance));
+				}
+			}
+		}
+		Vector planeNormal = nearestNeighbors.top().location;
+		nearestNeighbors.pop();
+		if (nearestNeighbors.size() > 0)
+			planeNormal = planeNormal - nearestNeighbors.top().location;
+
+		double theta, phi, wTheta, wPhi;
+		sphereSampling.GetParameterSpaceRect(iSample, theta, phi, wTheta, wPhi);
+
+		bool isOnVoronoiEdge = false;
+
+		Vector r1(sin(phi) * sin(theta), sin(phi) * cos(theta), cos(phi));
+		Vector r2(sin(phi + wPhi) * sin(theta), sin(phi + wPhi) * cos(theta), cos(phi + wPhi));
+		if (DIFFERENT_SIGN(r1 * planeNormal, r2 * planeNormal))
+			isOnVoronoiEdge = true;
+		else
+		{
+			Vector r3(sin(phi + wPhi) * sin(theta + wTheta), sin(phi + wPhi) * cos(theta + wTheta), cos(phi + wPhi));
+			if (DIFFERENT_SIGN(r1 * planeNormal, r3 * planeNormal))
+				isOnVoronoiEdge = true;
+			else
+			{
+				Vector r4(sin(phi) * sin(theta + wTheta), sin(phi) * cos(theta + wTheta), cos(phi));
+				if (DIFFERENT_SIGN(r1 * planeNormal, r4 * planeNormal))
+					isOnVoronoiEdge = true;
+			}
+		}
+
+		if (isOnVoronoiEdge)
+		{
+			visualizer.DrawRect(theta, phi, wTheta, wPhi, SphereVisualizer::VORONOI_COLOR);
+
+			double area = sphereSampling.Area(iSample);
+			voronoiDistance += area * sphereDistances[iSample];
+			voronoiEdgeArea += area;
+		}
+	}
+	return voronoiDistance / voronoiEdgeArea;
+}
+
+//Reference implementation of smoothSingleVertex() with a std::set as priority queue and a std::map of distances per search
+template <typename T>
+T SetMapSmoothSingleVertex(const std::vector<CurveSkeleton::Vertex>& vertices, int iVert, const SkeletonAdjacency& adjacency, double smoothDeviation, const std::vector<T>& source)
+{
+	if (smoothDeviation <= 0)
+		return source[iVert];
+
+	double distanceThreshold = 3 * smoothDeviation;
+
+	std::set<NodeDistance> activeNodes;
+	activeNodes.insert({ iVert, 0.0 });
+
+	std::map<int, double> minDistances;
+	minDistances[iVert] = 0;
+
+	double smoothVariance = smoothDeviation * smoothDeviation;
+	double sumWeight = 0;
+	T sumValue = 0;
+	while (!activeNodes.empty())
+	{
+		const NodeDistance node = *activeNodes.begin();
+		activeNodes.erase(activeNodes.begin());
+		if (node.distance > distanceThreshold)
+			break;
+
+		auto v = source.at(node.node);
+		if (!std::isnan(v))
+		{
+			double weight = gauss(node.distance, smoothVariance);
+			sumWeight += weight;
+			sumValue += (T)(weight * v);
+		}
+
+		for (auto& neighbor : adjacency.Neighbors(node.node))
+		{
+			int adjV = neighbor.vertex;
+			auto& v = vertices.at(adjV);
+			double distance = (vertices.at(node.node).position - v.position).norm() + node.distance;
+			auto distanceEntry = minDistances.find(adjV);
+			if (distanceEntry == minDistances.end() || distance < distanceEntry->second)
+			{
+				if (distanceEntry != minDistances.end())
+					activeNodes.erase({ adjV, distanceEntry->second });
+				minDistances[adjV] = distance;
+				activeNodes.insert({ adjV, distance });
+			}
+		}
+	}
+	return static_cast<T>(sumValue / sumWeight);
+}
+
+//Edge in the priority queue of the per-edge smoothing before EdgeSmoothingWorkspace: the distance at which the search enters it,
+//whether it is traversed backwards, and whether its measure must be inverted
+struct EdgeOrientationDistance
+{
+	EdgeOrientationDistance(size_t edge, double distanceAtBase, bool propagationReversed, bool measureReversed)
+		: edge(edge), distanceAtBase(distanceAtBase), propagationReversed(propagationReversed), measureReversed(measureReversed)
+	{ }
+
+	EdgeOrientationDistance(size_t edge, double distanceAtBase)
+		: edge(edge), distanceAtBase(distanceAtBase)
+	{ }
+
+	size_t edge;
+	double distanceAtBase;
+	bool propagationReversed;
+	bool measureReversed;
+
+	bool operator<(const EdgeOrientationDistance& rhs) const
+	{
+		if (distanceAtBase != rhs.distanceAtBase)
+			return distanceAtBase < rhs.distanceAtBase;
+		return edge < rhs.edge;
+	}
+};
+
+//Reference implementation of the search step of the per-edge smoothing with a std::set as priority queue and a std::map of
+//distances: queues the edges behind the tip of eod. The previous implementation looked up the distances by vertex instead of by
+//edge, which could skip edges or count them twice; this is fixed here.
+void SetMapAddEdgeNeighborsToSet(const EdgeOrientationDistance& eod, double distanceAtTip, const IGraph& graph, std::set<EdgeOrientationDistance>& edgeSet, std::map<size_t, double>& distances)
+{
+	size_t v1, v2;
+	graph.IncidentVertices(eod.edge, v1, v2);
+	auto baseVertex = (eod.propagationReversed ? v2 : v1);
+	auto tipVertex = (eod.propagationReversed ? v1 : v2);
+
+	for (auto& neighbor : graph.Neighbors(tipVertex))
+	{
+		int adjV = neighbor.vertex;
+		if (adjV == baseVertex)
+			continue;
+
+		size_t e = neighbor.edge;
+		auto distanceEntry = distances.find(e);
+		if (distanceEntry == distances.end() || distanceEntry->second > distanceAtTip)
+		{
+			if (distanceEntry != distances.end())
+				edgeSet.erase(EdgeOrientationDistance(e, distanceEntry->second));
+			bool propReversed = (neighbor.direction < 0);
+			edgeSet.insert(EdgeOrientationDistance(e, distanceAtTip, propReversed, eod.measureReversed ^ eod.propagationReversed ^ propReversed));
+			distances[e] = distanceAtTip;
+		}
+	}
+}
+
+//Reference implementation of smoothSingleEdge() for direction-dependent measures with a std::set as priority queue, a std::map of
+//distances, and std::erf per edge
+double SetMapSmoothSingleEdge(const IGraph& graph, size_t iEdge, double smoothDeviation, const std::vector<double>& source)
+{
+	size_t firstV, secondV;
+	graph.IncidentVertices(iEdge, firstV, secondV);
+	double halfEdgeLength = (graph.VertexPosition(firstV) - graph.VertexPosition(secondV)).norm() / 2;
+
+	double distanceThreshold = 3 * smoothDeviation;
+
+	std::set<EdgeOrientationDistance> activeEdges;
+	std::map<size_t, double> minDistances;
+	minDistances[iEdge] = 0;
+
+	double sumWeight = gaussIntegrate(smoothDeviation, -halfEdgeLength, halfEdgeLength);
+	double sumMeasure = sumWeight * source.at(iEdge);
+
+	EdgeOrientationDistance initialEdge = { iEdge, 0, false, false };
+	SetMapAddEdgeNeighborsToSet(initialEdge, halfEdgeLength, graph, activeEdges, minDistances);
+	initialEdge.propagationReversed = true;
+	SetMapAddEdgeNeighborsToSet(initialEdge, halfEdgeLength, graph, activeEdges, minDistances);
+
+	while (!activeEdges.empty())
+	{
+		const EdgeOrientationDistance eod = *activeEdges.begin();
+		activeEdges.erase(activeEdges.begin());
+		if (eod.distanceAtBase > distanceThreshold)
+			break;
+
+		size_t currentV1, currentV2;
+		graph.IncidentVertices(eod.edge, currentV1, currentV2);
+
+		double edgeLength = (graph.VertexPosition(currentV1) - graph.VertexPosition(currentV2)).norm();
+		double distanceAtTip = eod.distanceAtBase + edgeLength;
+		double weight = gaussIntegrate(smoothDeviation, eod.distanceAtBase, distanceAtTip);
+
+		sumWeight += weight;
+		double v = source.at(eod.edge);
+		if (eod.measureReversed)
+			v = -v;
+		sumMeasure += weight * v;
+
+		SetMapAddEdgeNeighborsToSet(eod, distanceAtTip, graph, activeEdges, minDistances);
+	}
+
+	return sumMeasure / sumWeight;
+}
+
+//Skeleton graph with adjacency lists and a std::map from vertex pairs to edge ids, i.e. the layout of CaveData before SkeletonAdjacency
+class MapSkeletonGraph
+{
+public:
+	MapSkeletonGraph(const std::vector<CurveSkeleton::Vertex>& vertices, const std::vector<CurveSkeleton::TEdge>& edges)
+		: vertices(vertices), edges(edges), adjacency(vertices.size())
+	{
+		for (int iEdge = 0; iEdge < (int)edges.size(); ++iEdge)
+		{
+			auto& edge = edges[iEdge];
+			adjacency[edge.first].push_back(edge.second);
+			adjacency[edge.second].push_back(edge.first);
+			vertexPairToEdge[edge] = iEdge;
+			vertexPairToEdge[std::pair<int, int>(edge.second, edge.first)] = iEdge;
+		}
+	}
+
+	const std::vector<int>& AdjacentNodes(size_t skeletonVertex) const { return adjacency[skeletonVertex]; }
+	size_t EdgeIdFromVertexPair(size_t v1, size_t v2) const { return vertexPairToEdge.at(std::make_pair(v1, v2)); }
+	void IncidentVertices(size_t edgeId, size_t& v1, size_t& v2) const { v1 = edges[edgeId].first; v2 = edges[edgeId].second; }
+	const Eigen::Vector3f& VertexPosition(size_t vertexId) const { return vertices[vertexId].position; }
+	size_t NumberOfEdges() const { return edges.size(); }
+
+private:
+	const std::vector<CurveSkeleton::Vertex>& vertices;
+	const std::vector<CurveSkeleton::TEdge>& edges;
+	std::vector<std::vector<int>> adjacency;
+	std::map<std::pair<size_t, size_t>, size_t> vertexPairToEdge;
+};
+
+//Reference implementation of SetMapAddEdgeNeighborsToSet() with edge ids and directions from the std::map
+void MapAddEdgeNeighborsToSet(const EdgeOrientationDistance& eod, double distanceAtTip, const MapSkeletonGraph& graph, std::set<EdgeOrientationDistance>& edgeSet, std::map<size_t, double>& distances)
+{
+	size_t v1, v2;
+	graph.IncidentVertices(eod.edge, v1, v2);
+	auto baseVertex = (eod.propagationReversed ? v2 : v1);
+	auto tipVertex = (eod.propagationReversed ? v1 : v2);
+
+	for (auto adjV : graph.AdjacentNodes(tipVertex))
+	{
+		if (adjV == baseVertex)
+			continue;
+
+		size_t e = graph.EdgeIdFromVertexPair(adjV, tipVertex);
+		auto distanceEntry = distances.find(e);
+		if (distanceEntry == distances.end() || distanceEntry->second > distanceAtTip)
+		{
+			if (distanceEntry != distances.end())
+				edgeSet.erase(EdgeOrientationDistance(e, distanceEntry->second));
+			size_t incident1, incident2;
+			graph.IncidentVertices(e, incident1, incident2);
+			bool propReversed = (incident1 == adjV);
+			edgeSet.insert(EdgeOrientationDistance(e, distanceAtTip, propReversed, eod.measureReversed ^ eod.propagationReversed ^ propReversed));
+			distances[e] = distanceAtTip;
+		}
+	}
+}
+
+//Reference implementation of SetMapSmoothSingleEdge() on a MapSkeletonGraph
+double MapSmoothSingleEdge(const MapSkeletonGraph& graph, size_t iEdge, double smoothDeviation, const std::vector<double>& source)
+{
+	size_t firstV, secondV;
+	graph.IncidentVertices(iEdge, firstV, secondV);
+	double halfEdgeLength = (graph.VertexPosition(firstV) - graph.VertexPosition(secondV)).norm() / 2;
+
+	double distanceThreshold = 3 * smoothDeviation;
+
+	std::set<EdgeOrientationDistance> activeEdges;
+	std::map<size_t, double> minDistances;
+	minDistances[iEdge] = 0;
+
+	double sumWeight = gaussIntegrate(smoothDeviation, -halfEdgeLength, halfEdgeLength);
+	double sumMeasure = sumWeight * source.at(iEdge);
+
+	EdgeOrientationDistance initialEdge = { iEdge, 0, false, false };
+	MapAddEdgeNeighborsToSet(initialEdge, halfEdgeLength, graph, activeEdges, minDistances);
+	initialEdge.propagationReversed = true;
+	MapAddEdgeNeighborsToSet(initialEdge, halfEdgeLength, graph, activeEdges, minDistances);
+
+	while (!activeEdges.empty())
+	{
+		const EdgeOrientationDistance eod = *activeEdges.begin();
+		activeEdges.erase(activeEdges.begin());
+		if (eod.distanceAtBase > distanceThreshold)
+			break;
+
+		size_t currentV1, currentV2;
+		graph.IncidentVertices(eod.edge, currentV1, currentV2);
+
+		double edgeLength = (graph.VertexPosition(currentV1) - graph.VertexPosition(currentV2)).norm();
+		double distanceAtTip = eod.distanceAtBase + edgeLength;
+		double weight = gaussIntegrate(smoothDeviation, eod.distanceAtBase, distanceAtTip);
+
+		sumWeight += weight;
+		double v = source.at(eod.edge);
+		if (eod.measureReversed)
+			v = -v;
+		sumMeasure += weight * v;
+
+		MapAddEdgeNeighborsToSet(eod, distanceAtTip, graph, activeEdges, minDistances);
+	}
+
+	return sumMeasure / sumWeight;
+}
+
+//Reference implementation of derivePerEdge() for direction-dependent measures on a MapSkeletonGraph
+void MapDerivePerEdge(const MapSkeletonGraph& graph, const std::vector<double>& source, std::vector<double>& target)
+{
+	for (int iEdge = 0; iEdge < graph.NumberOfEdges(); ++iEdge)
+	{
+		size_t v1, v2;
+		graph.IncidentVertices(iEdge, v1, v2);
+		double edgeLength = (graph.VertexPosition(v1) - graph.VertexPosition(v2)).norm();
+		double currentValue = source.at(iEdge);
+
+		double sumIn = 0, sumOut = 0;
+		double distanceIn = 0, distanceOut = 0;
+
+		auto& inNeighbors = graph.AdjacentNodes(v1);
+		int neighborCount = 0;
+		for (auto neighbor : inNeighbors)
+		{
+			if (neighbor == v2)
+				continue;
+			auto edgeId = graph.EdgeIdFromVertexPair(neighbor, v1);
+			double measure = source.at(edgeId);
+			size_t incident1, incident2;
+			graph.IncidentVertices(edgeId, incident1, incident2);
+			if (incident1 != neighbor)
+				measure = -measure;
+			sumIn += measure;
+			distanceIn += (graph.VertexPosition(neighbor) - graph.VertexPosition(v1)).norm();
+			++neighborCount;
+		}
+		if (inNeighbors.size() == 1)
+		{
+			sumIn = currentValue;
+			distanceIn = 0;
+		}
+		else
+		{
+			sumIn = sumIn / neighborCount;
+			distanceIn = (distanceIn / inNeighbors.size() + edgeLength) / 2;
+		}
+
+		auto& outNeighbors = graph.AdjacentNodes(v2);
+		neighborCount = 0;
+		for (auto neighbor : outNeighbors)
+		{
+			if (neighbor == v1)
+				continue;
+			auto edgeId = graph.EdgeIdFromVertexPair(v2, neighbor);
+			double measure = source.at(edgeId);
+			size_t incident1, incident2;
+			graph.IncidentVertices(edgeId, incident1, incident2);
+			if (incident2 != neighbor)
+				measure = -measure;
+			sumOut += measure;
+			distanceOut += (graph.VertexPosition(neighbor) - graph.VertexPosition(v2)).norm();
+			++neighborCount;
+		}
+		if (outNeighbors.size() == 1)
+		{
+			sumOut = currentValue;
+			distanceOut = 0;
+		}
+		else
+		{
+			sumOut = sumOut / neighborCount;
+			distanceOut = (distanceOut / outNeighbors.size() + edgeLength) / 2;
+		}
+
+		target[iEdge] = (sumOut - sumIn) / (distanceIn + distanceOut);
+	}
+}
+
+//Skeleton graph on a SkeletonAdjacency, i.e. the layout of CaveData
+class CsrSkeletonGraph : public IGraph
+{
+public:
+	CsrSkeletonGraph(const std::vector<CurveSkeleton::Vertex>& vertices, const std::vector<CurveSkeleton::TEdge>& edges)
+		: vertices(vertices), edges(edges)
+	{
+		adjacency.Build(vertices.size(), edges);
+	}
+
+	SkeletonNeighborRange Neighbors(size_t skeletonVertex) const { return adjacency.Neighbors(skeletonVertex); }
+	size_t EdgeIdFromVertexPair(size_t v1, size_t v2) const { return adjacency.FindEdge(v1, v2); }
+	void IncidentVertices(size_t edgeId, size_t& v1, size_t& v2) const { v1 = edges[edgeId].first; v2 = edges[edgeId].second; }
+	const Eigen::Vector3f& VertexPosition(size_t vertexId) const { return vertices[vertexId].position; }
+	double NodeRadius(size_t vertexId) const
+	{
+		double radius = 0;
+		for (auto& neighbor : Neighbors(vertexId))
+			radius += (vertices[vertexId].position - vertices[neighbor.vertex].position).norm() / 2;
+		return radius / adjacency.Degree(vertexId);
+	}
+	size_t NumberOfVertices() const { return vertices.size(); }
+	size_t NumberOfEdges() const { return edges.size(); }
+
+private:
+	const std::vector<CurveSkeleton::Vertex>& vertices;
+	const std::vector<CurveSkeleton::TEdge>& edges;
+	SkeletonAdjacency adjacency;
+};
+
+//Synthetic distance field: a constant radius with several smooth bumps and dents
+double SyntheticDistance(const Vector& direction)
+{
+	const double lobes[][5] = //direction, amplitude, sharpness
+	{
+		{ 1, 0, 0, 4.0, 3.0 },
+		{ -1, 0, 0, 3.0, 5.0 },
+		{ 0, 0.8, 0.6, 2.0, 8.0 },
+		{ 0, -0.6, 0.8, -1.5, 4.0 },
+		{ 0.6, 0, -0.8, 2.5, 6.0 },
+		{ -0.48, 0.6, -0.64, -1.0, 10.0 },
+	};
+
+	double distance = 5.0;
+	for (auto& lobe : lobes)
+		distance += lobe[3] * exp(-lobe[4] * (1 - (direction.x() * lobe[0] + direction.y() * lobe[1] + direction.z() * lobe[2])));
+	return distance;
+}
+
+//Runs f repetitions times and returns the average time of a run
+template <typename TFunc>
+double MeasureSeconds(int repetitions, TFunc&& f)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < repetitions; ++i)
+		f();
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / repetitions;
+}
+
+double MaxDifference(const Vector& a, const Vector& b)
+{
+	return std::max(std::abs(a.x() - b.x()), std::max(std::abs(a.y() - b.y()), std::abs(a.z() - b.z())));
+}
+
+double MaxDifference(const ArenaVector<PositionValue>& a, const ArenaVector<PositionValue>& b)
+{
+	if (a.size() != b.size())
+		return std::numeric_limits<double>::infinity();
+	double difference = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+		difference = std::max(difference, std::max(std::abs(a[i].value - b[i].value), MaxDifference(a[i].position, b[i].position)));
+	return difference;
+}
+
+//Fills a flat field with the synthetic distance field
+void SyntheticDistanceField(const RegularUniformSphereSampling& sphereSampling, SphereScalarField& distances)
+{
+	sphereSampling.PrepareField(distances);
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+		distances[iSample] = SyntheticDistance(sphereSampling.Direction(iSample));
+}
+
+//Generates uniformly distributed unit vectors with a fixed seed
+void RandomDirections(size_t count, std::vector<Vector>& directions)
+{
+	std::mt19937 rnd(42);
+	std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+	directions.clear();
+	while (directions.size() < count)
+	{
+		Vector v(uniform(rnd), uniform(rnd), uniform(rnd));
+		double length = sqrt(v.squared_length());
+		if (length > 0.1 && length <= 1)
+			directions.push_back(v / length);
+	}
+}
+
+//Generates a synthetic tree-shaped skeleton with the given number of vertices and a fixed seed. Branches of 10 to 100 vertices
+//with a spacing of about 0.5 start at random vertices of the previous branches and take a random walk. The values are cave
+//sizes between 2 and 6 that vary smoothly along the branches. If loopCount is positive, that many edges are added between vertices
+//that are 20 to 60 edges apart, which closes loops like the passages around pillars in a cave.
+void SyntheticSkeleton(size_t vertexCount, std::vector<CurveSkeleton::Vertex>& vertices, std::vector<CurveSkeleton::TEdge>& edges, std::vector<double>& values, int loopCount = 0)
+{
+	const float SPACING = 0.5f;
+
+	std::mt19937 rnd(42);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> branchLength(10, 100);
+	std::vector<std::vector<int>> adjacency;
+	vertices.clear();
+	edges.clear();
+	values.clear();
+	vertices.emplace_back(Eigen::Vector3f(0, 0, 0));
+	adjacency.emplace_back();
+	values.push_back(4.0);
+	while (vertices.size() < vertexCount)
+	{
+		int previous = std::uniform_int_distribution<int>(0, (int)vertices.size() - 1)(rnd);
+		Eigen::Vector3f direction(uniform(rnd), uniform(rnd), uniform(rnd));
+		for (int i = branchLength(rnd); i > 0 && vertices.size() < vertexCount; --i)
+		{
+			direction = (direction + 0.3f * Eigen::Vector3f(uniform(rnd), uniform(rnd), uniform(rnd))).normalized();
+			int current = (int)vertices.size();
+			vertices.emplace_back(Eigen::Vector3f(vertices[previous].position + SPACING * direction));
+			adjacency.emplace_back();
+			adjacency[previous].push_back(current);
+			adjacency[current].push_back(previous);
+			edges.emplace_back(previous, current);
+			values.push_back(std::min(6.0, std::max(2.0, values[previous] + 0.2 * uniform(rnd))));
+			previous = current;
+		}
+	}
+
+	std::uniform_int_distribution<int> loopLength(20, 60);
+	for (int iLoop = 0; iLoop < loopCount; ++iLoop)
+	{
+		int first = std::uniform_int_distribution<int>(0, (int)vertices.size() - 1)(rnd);
+		int previous = -1, current = first;
+		for (int i = loopLength(rnd); i > 0; --i)
+		{
+			auto& adj = adjacency[current];
+			int next = adj[std::uniform_int_distribution<int>(0, (int)adj.size() - 1)(rnd)];
+			if (next == previous && adj.size() > 1)
+				continue;
+			previous = current;
+			current = next;
+		}
+		if (current != first && std::find(adjacency[first].begin(), adjacency[first].end(), current) == adjacency[first].end())
+		{
+			adjacency[first].push_back(current);
+			adjacency[current].push_back(first);
+			edges.emplace_back(first, current);
+		}
+	}
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkSphereFieldLayouts(int resolution, int repetitions)
+{
+	const double EXTREMUM_SEARCH_RADIUS = MAXIMUM_SEARCH_RADIUS;
+	const int INTERPOLATION_QUERIES = 4096;
+
+	RegularUniformSphereSampling sphereSampling(resolution);
+
+	SphereScalarField flatDistances;
+	SphereVectorField flatGradient;
+	SyntheticDistanceField(sphereSampling, flatDistances);
+	sphereSampling.PrepareField(flatGradient);
+
+	NestedScalarField nestedDistances;
+	NestedVectorField nestedGradient;
+	PrepareNestedField(sphereSampling, nestedDistances);
+	PrepareNestedField(sphereSampling, nestedGradient);
+
+	for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
+		nestedDistances[it.Ring()][it.IndexOnRing()] = flatDistances[sphereSampling.SampleIndex(it)];
+
+	std::vector<Vector> queries;
+	RandomDirections(INTERPOLATION_QUERIES, queries);
+
+	std::vector<MicrobenchmarkResult> results;
+	VoidSphereVisualizer visualizer(L"");
+
+	//Gradient
+	{
+		MicrobenchmarkResult result;
+		result.name = "Gradient";
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]() { NestedCalculateGradient(sphereSampling, nestedDistances, nestedGradient); });
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]() { NormalEquationsGradient(sphereSampling, flatDistances, flatGradient); });
+		result.maxDifference = 0;
+		for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
+			result.maxDifference = std::max(result.maxDifference, MaxDifference(nestedGradient[it.Ring()][it.IndexOnRing()], flatGradient[sphereSampling.SampleIndex(it)]));
+		results.push_back(result);
+	}
+
+	//Strong local extrema
+	{
+		ArenaVector<PositionValue> nestedMaxima, nestedMinima, flatMaxima, flatMinima;
+		MicrobenchmarkResult result;
+		result.name = "Strong local extrema";
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			nestedMaxima.clear();
+			nestedMinima.clear();
+			NestedFindStrongLocalExtrema(sphereSampling, nestedDistances, EXTREMUM_SEARCH_RADIUS, nestedMaxima, nestedMinima, visualizer);
+		});
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			flatMaxima.clear();
+			flatMinima.clear();
+			RangeIteratorStrongLocalExtrema(sphereSampling, flatDistances, EXTREMUM_SEARCH_RADIUS, flatMaxima, flatMinima, visualizer);
+		});
+		result.maxDifference = std::max(MaxDifference(nestedMaxima, flatMaxima), MaxDifference(nestedMinima, flatMinima));
+		results.push_back(result);
+	}
+
+	//Interpolation of the distance and the gradient (as in LineFlow)
+	{
+		std::vector<double> nestedValues(queries.size()), flatValues(queries.size());
+		std::vector<Vector> nestedGradients(queries.size()), flatGradients(queries.size());
+		MicrobenchmarkResult result;
+		result.name = "Interpolation";
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			for (size_t i = 0; i < queries.size(); ++i)
+			{
+				double phi, theta;
+				sphereSampling.ParametersFromPoint(queries[i], phi, theta);
+				nestedValues[i] = NestedInterpolate(sphereSampling, nestedDistances, phi, theta);
+				nestedGradients[i] = NestedInterpolate(sphereSampling, nestedGradient, phi, theta);
+			}
+		});
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			for (size_t i = 0; i < queries.size(); ++i)
+			{
+				double phi, theta;
+				sphereSampling.ParametersFromPoint(queries[i], phi, theta);
+				flatValues[i] = sphereSampling.InterpolateField(flatDistances, phi, theta);
+				flatGradients[i] = sphereSampling.InterpolateField(flatGradient, phi, theta);
+			}
+		});
+		result.maxDifference = 0;
+		for (size_t i = 0; i < queries.size(); ++i)
+			result.maxDifference = std::max(result.maxDifference, std::max(std::abs(nestedValues[i] - flatValues[i]), MaxDifference(nestedGradients[i], flatGradients[i])));
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkSphereGradient(int resolution, int repetitions)
+{
+	RegularUniformSphereSampling sphereSampling(resolution);
+	SphereGradientOperator gradientOperator(sphereSampling);
+
+	SphereScalarField distances;
+	SphereVectorField referenceGradient, gradient;
+	SyntheticDistanceField(sphereSampling, distances);
+	sphereSampling.PrepareField(referenceGradient);
+	sphereSampling.PrepareField(gradient);
+
+	MicrobenchmarkResult result;
+	result.name = "Gradient";
+	result.referenceSeconds = MeasureSeconds(repetitions, [&]() { NormalEquationsGradient(sphereSampling, distances, referenceGradient); });
+	result.optimizedSeconds = MeasureSeconds(repetitions, [&]() { gradientOperator.Apply(distances, gradient); });
+	result.maxDifference = 0;
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+		result.maxDifference = std::max(result.maxDifference, MaxDifference(referenceGradient[iSample], gradient[iSample]));
+
+	return std::vector<MicrobenchmarkResult>(1, result);
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkStrongExtrema(int resolution, int repetitions)
+{
+	RegularUniformSphereSampling sphereSampling(resolution);
+	auto neighborhoods = sphereSampling.RangeNeighborhoods(MAXIMUM_SEARCH_RADIUS);
+	VoidSphereVisualizer visualizer(L"");
+
+	//The smooth synthetic field and a quantized version of it with many plateaus, where ties decide about extrema
+	SphereScalarField distances, quantizedDistances;
+	SyntheticDistanceField(sphereSampling, distances);
+	sphereSampling.PrepareField(quantizedDistances);
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+		quantizedDistances[iSample] = floor(distances[iSample] * 4) / 4;
+
+	std::vector<MicrobenchmarkResult> results;
+	const SphereScalarField* fields[] = { &distances, &quantizedDistances };
+	const char* names[] = { "Extrema", "Extrema (plateaus)" };
+	for (int iField = 0; iField < 2; ++iField)
+	{
+		ArenaVector<PositionValue> referenceMaxima, referenceMinima, maxima, minima;
+		MicrobenchmarkResult result;
+		result.name = names[iField];
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			referenceMaxima.clear();
+			referenceMinima.clear();
+			RangeIteratorStrongLocalExtrema(sphereSampling, *fields[iField], MAXIMUM_SEARCH_RADIUS, referenceMaxima, referenceMinima, visualizer);
+		});
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			maxima.clear();
+			minima.clear();
+			FindStrongLocalExtrema(sphereSampling, *fields[iField], neighborhoods, maxima, minima, visualizer);
+		});
+		result.maxDifference = std::max(MaxDifference(referenceMaxima, maxima), MaxDifference(referenceMinima, minima));
+		results.push_back(result);
+	}
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkBatchedInterpolation(int resolution, int repetitions)
+{
+	//About the number of points that LineFlow interpolates per iteration
+	const int INTERPOLATION_QUERIES = 64;
+
+	RegularUniformSphereSampling sphereSampling(resolution);
+	SphereGradientOperator gradientOperator(sphereSampling);
+
+	SphereScalarField distances;
+	SphereVectorField gradient;
+	SyntheticDistanceField(sphereSampling, distances);
+	sphereSampling.PrepareField(gradient);
+	gradientOperator.Apply(distances, gradient);
+
+	std::vector<Vector> queries;
+	RandomDirections(INTERPOLATION_QUERIES, queries);
+	std::vector<double> x, y, z;
+	for (auto& q : queries)
+	{
+		x.push_back(q.x());
+		y.push_back(q.y());
+		z.push_back(q.z());
+	}
+
+	std::vector<MicrobenchmarkResult> results;
+
+	{
+		std::vector<double> referenceValues(queries.size()), values(queries.size());
+		MicrobenchmarkResult result;
+		result.name = "Interpolation (scalar)";
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			for (size_t i = 0; i < queries.size(); ++i)
+				referenceValues[i] = sphereSampling.InterpolateField(distances, queries[i]);
+		});
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			sphereSampling.InterpolateField(distances, x.data(), y.data(), z.data(), queries.size(), values.data());
+		});
+		result.maxDifference = 0;
+		for (size_t i = 0; i < queries.size(); ++i)
+			result.maxDifference = std::max(result.maxDifference, std::abs(referenceValues[i] - values[i]));
+		results.push_back(result);
+	}
+
+	{
+		std::vector<Vector> referenceGradients(queries.size());
+		std::vector<double> gx(queries.size()), gy(queries.size()), gz(queries.size());
+		MicrobenchmarkResult result;
+		result.name = "Interpolation (gradient)";
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			for (size_t i = 0; i < queries.size(); ++i)
+				referenceGradients[i] = sphereSampling.InterpolateField(gradient, queries[i]);
+		});
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			sphereSampling.InterpolateField(gradient, x.data(), y.data(), z.data(), queries.size(), gx.data(), gy.data(), gz.data());
+		});
+		result.maxDifference = 0;
+		for (size_t i = 0; i < queries.size(); ++i)
+			result.maxDifference = std::max(result.maxDifference, MaxDifference(referenceGradients[i], Vector(gx[i], gy[i], gz[i])));
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkLineFlow(int resolution, int repetitions)
+{
+	RegularUniformSphereSampling sphereSampling(resolution);
+	SphereGradientOperator gradientOperator(sphereSampling);
+	VoidSphereVisualizer visualizer(L"");
+
+	SphereScalarField distances;
+	SphereVectorField gradient;
+	SyntheticDistanceField(sphereSampling, distances);
+	sphereSampling.PrepareField(gradient);
+	gradientOperator.Apply(distances, gradient);
+
+	//A closed circle that climbs up to the ridges (like the separating circle of CaveSizeCalculatorLineFlow) and an open arc
+	//between two fixed end points that flows into the valleys (like the lines through the minima)
+	std::vector<PositionGradient> circle, arc;
+	Vector axis1 = Vector(0, 1, 1) / sqrt(2.0), axis2(1, 0, 0), axis3 = CGAL::cross_product(axis1, axis2);
+	for (int i = 0; i < 36; ++i)
+		circle.push_back(PositionGradient(axis1 * cos(i * M_PI / 18) + axis2 * sin(i * M_PI / 18)));
+	for (double beta = 0; beta <= M_PI; beta += LINE_POINT_DISTANCE)
+		arc.push_back(PositionGradient(axis3 * cos(beta) + axis1 * sin(beta)));
+
+	std::vector<MicrobenchmarkResult> results;
+	LineFlowWorkspace workspace;
+	const char* names[] = { "LineFlow (closed)", "LineFlow (open)" };
+	for (int iLine = 0; iLine < 2; ++iLine)
+	{
+		bool closed = iLine == 0;
+		const std::vector<PositionGradient>& initialLine = closed ? circle : arc;
+		double direction = closed ? +1.0 : -1.0;
+
+		std::list<PositionGradient> listLine;
+		std::vector<PositionGradient> line;
+		double referenceAverage, referenceLength, average, length;
+		MicrobenchmarkResult result;
+		result.name = names[iLine];
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			listLine.assign(initialLine.begin(), initialLine.end());
+			if (closed)
+				ListLineFlow<true>(listLine, sphereSampling, distances, gradient, direction, referenceAverage, referenceLength, visualizer, L"");
+			else
+				ListLineFlow<false>(listLine, sphereSampling, distances, gradient, direction, referenceAverage, referenceLength, visualizer, L"");
+		});
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			line.assign(initialLine.begin(), initialLine.end());
+			if (closed)
+				LineFlow<true>(line, sphereSampling, distances, gradient, direction, average, length, workspace, visualizer, L"");
+			else
+				LineFlow<false>(line, sphereSampling, distances, gradient, direction, average, length, workspace, visualizer, L"");
+		});
+
+		result.maxDifference = std::max(std::abs(referenceAverage - average), std::abs(referenceLength - length));
+		if (listLine.size() != line.size())
+			result.maxDifference = std::numeric_limits<double>::infinity();
+		else
+		{
+			size_t i = 0;
+			for (auto& p : listLine)
+				result.maxDifference = std::max(result.maxDifference, MaxDifference(p.position, line[i++].position));
+		}
+		results.push_back(result);
+	}
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkOptimalMeanAverage(int sampleCount, int repetitions)
+{
+	struct AngleValue
+	{
+		double angle;
+		double value;
+	};
+	const int LINES = 64;
+
+	//Random lines with uniformly distributed angles and a quantized version of them with many equal sums, where ties decide
+	//about the picked samples
+	std::mt19937 rnd(42);
+	std::uniform_real_distribution<double> uniformAngle(0, 2 * M_PI), uniformValue(1, 3);
+	std::vector<std::vector<AngleValue>> lines(LINES), quantizedLines(LINES);
+	for (int iLine = 0; iLine < LINES; ++iLine)
+	{
+		auto& line = lines[iLine];
+		line.resize(sampleCount);
+		for (auto& sample : line)
+		{
+			sample.angle = uniformAngle(rnd);
+			sample.value = uniformValue(rnd);
+		}
+		std::sort(line.begin(), line.end(), [](const AngleValue& a, const AngleValue& b) { return a.angle < b.angle; });
+		quantizedLines[iLine] = line;
+		for (auto& sample : quantizedLines[iLine])
+			sample.value = floor(sample.value * 2) / 2;
+	}
+
+	std::vector<MicrobenchmarkResult> results;
+	const std::vector<std::vector<AngleValue>>* lineSets[] = { &lines, &quantizedLines };
+	const char* names[] = { "Optimal mean average", "Optimal mean average (ties)" };
+	for (int iSet = 0; iSet < 2; ++iSet)
+	{
+		auto& lineSet = *lineSets[iSet];
+		std::vector<std::vector<int>> referenceResults(LINES), optimizedResults(LINES);
+		TableMeanAverageWorkspace referenceWorkspace;
+		MeanAverageWorkspace workspace;
+
+		MicrobenchmarkResult result;
+		result.name = names[iSet];
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			for (int iLine = 0; iLine < LINES; ++iLine)
+			{
+				referenceResults[iLine].clear();
+				TableFindOptimalMeanAverage(lineSet[iLine], CIRCLE_SUBSAMPLING_MIN_DISTANCE, CIRCLE_SUBSAMPLING_MAX_DISTANCE, referenceWorkspace, referenceResults[iLine]);
+			}
+		}) / LINES;
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			for (int iLine = 0; iLine < LINES; ++iLine)
+			{
+				optimizedResults[iLine].clear();
+				FindOptimalMeanAverage(lineSet[iLine], CIRCLE_SUBSAMPLING_MIN_DISTANCE, CIRCLE_SUBSAMPLING_MAX_DISTANCE, workspace, optimizedResults[iLine]);
+			}
+		}) / LINES;
+
+		//both implementations must pick the same samples
+		result.maxDifference = 0;
+		for (int iLine = 0; iLine < LINES; ++iLine)
+		{
+			if (referenceResults[iLine] != optimizedResults[iLine])
+			{
+				result.maxDifference = std::numeric_limits<double>::infinity();
+				break;
+			}
+		}
+		results.push_back(result);
+	}
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkVoronoiCaveSize(int resolution, int repetitions)
+{
+	auto sphere = PrebuiltSphereSampling::Get(resolution);
+	auto& sphereSampling = sphere->sampling;
+	VoidSphereVisualizer visualizer(L"");
+
+	SphereScalarField distances;
+	SphereVectorField gradient;
+	SyntheticDistanceField(sphereSampling, distances);
+	sphereSampling.PrepareField(gradient);
+	sphere->gradientOperator.Apply(distances, gradient);
+
+	//The maxima of the synthetic field and random sets of 2, 8, and 32 maxima
+	std::vector<ArenaVector<PositionValue>> maximaSets(1);
+	ArenaVector<PositionValue> minima;
+	FindStrongLocalExtrema(sphereSampling, distances, sphere->extremumSearchNeighborhoods, maximaSets[0], minima, visualizer);
+	const int maximaCounts[] = { 2, 8, 32 };
+	std::vector<Vector> directions;
+	RandomDirections(2 + 8 + 32, directions);
+	size_t nextDirection = 0;
+	for (int count : maximaCounts)
+	{
+		maximaSets.emplace_back();
+		for (int i = 0; i < count; ++i)
+			maximaSets.back().push_back({ directions[nextDirection++], 0.0 });
+	}
+
+	std::vector<MicrobenchmarkResult> results;
+	CaveSizeCalculatorVoronoi::TCustomData workspace;
+	MonotonicArena arena;
+	for (auto& maxima : maximaSets)
+	{
+		double referenceSize, size;
+		MicrobenchmarkResult result;
+		result.name = "Voronoi cave size (" + std::to_string(maxima.size()) + " maxima)";
+		result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			referenceSize = PriorityQueueVoronoiCaveSize(sphereSampling, distances, maxima, visualizer);
+		});
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			size = CaveSizeCalculatorVoronoi::CalculateDistance(sphereSampling, distances, gradient, maxima, minima, visualizer, 0, arena, workspace);
+		});
+		result.maxDifference = std::abs(referenceSize - size);
+		results.push_back(result);
+	}
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkSkeletonSmoothing(int vertexCount, int repetitions)
+{
+	std::vector<CurveSkeleton::Vertex> vertices;
+	std::vector<CurveSkeleton::TEdge> edges;
+	std::vector<double> values;
+	SyntheticSkeleton(vertexCount, vertices, edges, values);
+	SkeletonAdjacency adjacency;
+	adjacency.Build(vertices.size(), edges);
+
+	//The cave size kernel (0.2 times the size) and a kernel that is five times wider
+	const double kernelFactors[] = { 0.2, 1.0 };
+	std::vector<int> threadCounts(1, 1);
+	if (omp_get_max_threads() > 1)
+		threadCounts.push_back(omp_get_max_threads());
+
+	std::vector<MicrobenchmarkResult> results;
+	std::vector<double> referenceSmoothed(vertices.size()), smoothed(vertices.size());
+	for (double kernelFactor : kernelFactors)
+	{
+		auto deviation = [&](int iVert) { return kernelFactor * values[iVert]; };
+		double referenceSeconds = MeasureSeconds(repetitions, [&]()
+		{
+			for (int iVert = 0; iVert < (int)vertices.size(); ++iVert)
+				referenceSmoothed[iVert] = SetMapSmoothSingleVertex(vertices, iVert, adjacency, deviation(iVert), values);
+		});
+		for (int threads : threadCounts)
+		{
+			MicrobenchmarkResult result;
+			result.name = "Smoothing (kernel " + std::to_string(kernelFactor).substr(0, 3) + " * size, " + std::to_string(threads) + (threads == 1 ? " thread)" : " threads)");
+			result.referenceSeconds = referenceSeconds;
+			result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+			{
+				smooth(vertices, adjacency, deviation, values, smoothed, threads);
+			});
+			result.maxDifference = 0;
+			for (size_t i = 0; i < vertices.size(); ++i)
+				result.maxDifference = std::max(result.maxDifference, std::abs(referenceSmoothed[i] - smoothed[i]));
+			results.push_back(result);
+		}
+	}
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkSmoothingOperator(int vertexCount, int repetitions)
+{
+	std::vector<CurveSkeleton::Vertex> vertices;
+	std::vector<CurveSkeleton::TEdge> edges;
+	std::vector<double> values;
+	SyntheticSkeleton(vertexCount, vertices, edges, values);
+	SkeletonAdjacency adjacency;
+	adjacency.Build(vertices.size(), edges);
+	int threads = omp_get_max_threads();
+
+	//A sweep over the cave size kernel factor as in the evaluation
+	const double kernelFactors[] = { 0.05, 0.1, 0.15, 0.2, 0.25, 0.3, 0.35, 0.4, 0.45, 0.5 };
+	const int KERNELS = sizeof(kernelFactors) / sizeof(kernelFactors[0]);
+	double maxValue = *std::max_element(values.begin(), values.end());
+
+	std::vector<std::vector<double>> referenceSmoothed(KERNELS, std::vector<double>(vertices.size())), smoothed = referenceSmoothed;
+	SmoothingOperator smoothingOperator;
+
+	std::vector<MicrobenchmarkResult> results;
+	MicrobenchmarkResult sweep;
+	sweep.name = "Sweep over " + std::to_string(KERNELS) + " kernels (incl. build)";
+	sweep.referenceSeconds = MeasureSeconds(repetitions, [&]()
+	{
+		for (int k = 0; k < KERNELS; ++k)
+			smooth(vertices, adjacency, [&](int iVert) { return kernelFactors[k] * values[iVert]; }, values, referenceSmoothed[k], threads);
+	});
+	sweep.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+	{
+		smoothingOperator.Build(vertices, adjacency, 3 * (kernelFactors[KERNELS - 1] * maxValue), std::numeric_limits<size_t>::max(), threads);
+		for (int k = 0; k < KERNELS; ++k)
+			smoothingOperator.Apply([&](int iVert) { return kernelFactors[k] * values[iVert]; }, values, smoothed[k], threads);
+	});
+	sweep.maxDifference = 0;
+	for (int k = 0; k < KERNELS; ++k)
+		for (size_t i = 0; i < vertices.size(); ++i)
+			sweep.maxDifference = std::max(sweep.maxDifference, std::abs(referenceSmoothed[k][i] - smoothed[k][i]));
+	results.push_back(sweep);
+
+	MicrobenchmarkResult single;
+	single.name = "Largest kernel (prebuilt operator)";
+	single.referenceSeconds = MeasureSeconds(repetitions, [&]()
+	{
+		smooth(vertices, adjacency, [&](int iVert) { return kernelFactors[KERNELS - 1] * values[iVert]; }, values, referenceSmoothed[KERNELS - 1], threads);
+	});
+	single.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+	{
+		smoothingOperator.Apply([&](int iVert) { return kernelFactors[KERNELS - 1] * values[iVert]; }, values, smoothed[KERNELS - 1], threads);
+	});
+	single.maxDifference = 0;
+	for (size_t i = 0; i < vertices.size(); ++i)
+		single.maxDifference = std::max(single.maxDifference, std::abs(referenceSmoothed[KERNELS - 1][i] - smoothed[KERNELS - 1][i]));
+	results.push_back(single);
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkChainMaxima(int vertexCount, int repetitions)
+{
+	std::vector<CurveSkeleton::Vertex> vertices;
+	std::vector<CurveSkeleton::TEdge> edges;
+	std::vector<double> values;
+	SyntheticSkeleton(vertexCount, vertices, edges, values, vertexCount / 1000);
+	SkeletonAdjacency adjacency;
+	adjacency.Build(vertices.size(), edges);
+
+	//The default cave scale kernel factor and a smaller one
+	const double kernelFactors[] = { 2.0, 10.0 };
+
+	std::vector<MicrobenchmarkResult> results;
+	std::vector<double> referenceMaxima(vertices.size()), maxima(vertices.size());
+	for (double kernelFactor : kernelFactors)
+	{
+		auto searchDistance = [&](int iVert) { return kernelFactor * values[iVert]; };
+		for (int advect = 0; advect < 2; ++advect)
+		{
+			MicrobenchmarkResult result;
+			result.name = std::string(advect ? "Advect" : "Max") + ", kernel factor " + std::to_string((int)kernelFactor);
+			result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+			{
+				if (advect)
+					maxAdvect<double>(vertices, adjacency, searchDistance, values, referenceMaxima);
+				else
+					findMax<double>(vertices, adjacency, searchDistance, values, referenceMaxima);
+			});
+			result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+			{
+				SkeletonChains chains;
+				chains.Build(vertices, adjacency);
+				if (advect)
+					chains.MaxAdvect(searchDistance, values, maxima);
+				else
+					chains.FindMax(searchDistance, values, maxima);
+			});
+			result.maxDifference = 0;
+			for (size_t i = 0; i < vertices.size(); ++i)
+				result.maxDifference = std::max(result.maxDifference, std::abs(referenceMaxima[i] - maxima[i]));
+			results.push_back(result);
+		}
+	}
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkSkeletonGraph(int vertexCount, int repetitions)
+{
+	std::vector<CurveSkeleton::Vertex> vertices;
+	std::vector<CurveSkeleton::TEdge> edges;
+	std::vector<double> values;
+	SyntheticSkeleton(vertexCount, vertices, edges, values, vertexCount / 1000);
+
+	//The per-edge steps of SmoothAndDeriveDistances() with the default cave size derivative kernel factor, using the values as cave scale
+	const double KERNEL_FACTOR = 0.2;
+	std::vector<double> derivatives(edges.size());
+	for (size_t iEdge = 0; iEdge < edges.size(); ++iEdge)
+	{
+		auto& edge = edges[iEdge];
+		derivatives[iEdge] = (values[edge.second] - values[edge.first]) / (vertices[edge.first].position - vertices[edge.second].position).norm();
+	}
+	auto smoothDeviation = [&](int iEdge) { return KERNEL_FACTOR * 0.5 * (values[edges[iEdge].first] + values[edges[iEdge].second]); };
+
+	std::vector<MicrobenchmarkResult> results;
+	std::vector<double> referenceSmoothed(edges.size()), smoothed(edges.size());
+	std::vector<double> referenceCurvatures(edges.size()), curvatures(edges.size());
+
+	MicrobenchmarkResult result;
+	result.name = "Graph construction";
+	result.referenceSeconds = MeasureSeconds(repetitions, [&]() { MapSkeletonGraph graph(vertices, edges); });
+	result.optimizedSeconds = MeasureSeconds(repetitions, [&]() { CsrSkeletonGraph graph(vertices, edges); });
+	result.maxDifference = 0;
+	results.push_back(result);
+
+	MapSkeletonGraph referenceGraph(vertices, edges);
+	CsrSkeletonGraph graph(vertices, edges);
+
+	result.name = "Smoothing per edge";
+	result.referenceSeconds = MeasureSeconds(repetitions, [&]()
+	{
+		for (int iEdge = 0; iEdge < (int)edges.size(); ++iEdge)
+			referenceSmoothed[iEdge] = MapSmoothSingleEdge(referenceGraph, iEdge, smoothDeviation(iEdge), derivatives);
+	});
+	result.optimizedSeconds = MeasureSeconds(repetitions, [&]()
+	{
+		for (int iEdge = 0; iEdge < (int)edges.size(); ++iEdge)
+			smoothed[iEdge] = SetMapSmoothSingleEdge(graph, iEdge, smoothDeviation(iEdge), derivatives);
+	});
+	result.maxDifference = 0;
+	for (size_t i = 0; i < edges.size(); ++i)
+		result.maxDifference = std::max(result.maxDifference, std::abs(referenceSmoothed[i] - smoothed[i]));
+	results.push_back(result);
+
+	result.name = "Derivative per edge";
+	result.referenceSeconds = MeasureSeconds(repetitions, [&]() { MapDerivePerEdge(referenceGraph, referenceSmoothed, referenceCurvatures); });
+	result.optimizedSeconds = MeasureSeconds(repetitions, [&]() { derivePerEdge<double, true>(graph, smoothed, curvatures); });
+	result.maxDifference = 0;
+	for (size_t i = 0; i < edges.size(); ++i)
+		result.maxDifference = std::max(result.maxDifference, std::abs(referenceCurvatures[i] - curvatures[i]));
+	results.push_back(result);
+	return results;
+}
+
+std::vector<MicrobenchmarkResult> BenchmarkEdgeSmoothing(int vertexCount, int repetitions)
+{
+	std::vector<CurveSkeleton::Vertex> vertices;
+	std::vector<CurveSkeleton::TEdge> edges;
+	std::vector<double> values;
+	SyntheticSkeleton(vertexCount, vertices, edges, values, vertexCount / 1000);
+	CsrSkeletonGraph graph(vertices, edges);
+	int threads = omp_get_max_threads();
+
+	//The cave size derivative as in SmoothAndDeriveDistances(), using the values as cave scale
+	std::vector<double> derivatives(edges.size());
+	for (size_t iEdge = 0; iEdge < edges.size(); ++iEdge)
+	{
+		auto& edge = edges[iEdge];
+		derivatives[iEdge] = (values[edge.second] - values[edge.first]) / (vertices[edge.first].position - vertices[edge.second].position).norm();
+	}
+	//A sweep over the cave size derivative kernel factor as in the evaluation; the default factor is 0.2
+	const double kernelFactors[] = { 0.1, 0.2, 0.3, 0.4, 0.5 };
+	const int KERNELS = sizeof(kernelFactors) / sizeof(kernelFactors[0]);
+	const int DEFAULT_KERNEL = 1;
+	std::vector<std::function<double(int)>> smoothDeviations;
+	for (double kernelFactor : kernelFactors)
+		smoothDeviations.push_back([&, kernelFactor](int iEdge) { return kernelFactor * 0.5 * (values[edges[iEdge].first] + values[edges[iEdge].second]); });
+
+	std::vector<std::vector<double>> referenceSmoothed(KERNELS, std::vector<double>(edges.size())), smoothed = referenceSmoothed;
+	auto maxDifference = [&](int k)
+	{
+		double difference = 0;
+		for (size_t i = 0; i < edges.size(); ++i)
+			difference = std::max(difference, std::abs(referenceSmoothed[k][i] - smoothed[k][i]));
+		return difference;
+	};
+
+	std::vector<MicrobenchmarkResult> results;
+	double referenceSeconds = MeasureSeconds(repetitions, [&]()
+	{
+		for (int iEdge = 0; iEdge < (int)edges.size(); ++iEdge)
+			referenceSmoothed[DEFAULT_KERNEL][iEdge] = SetMapSmoothSingleEdge(graph, iEdge, smoothDeviations[DEFAULT_KERNEL](iEdge), derivatives);
+	});
+	for (int t : { 1, threads })
+	{
+		MicrobenchmarkResult result;
+		result.name = "Kernel 0.2 * scale, " + std::to_string(t) + (t == 1 ? " thread" : " threads");
+		result.referenceSeconds = referenceSeconds;
+		result.optimizedSeconds = MeasureSeconds(repetitions, [&]() { smoothPerEdge<double, true>(graph, smoothDeviations[DEFAULT_KERNEL], derivatives, smoothed[DEFAULT_KERNEL], t); });
+		result.maxDifference = maxDifference(DEFAULT_KERNEL);
+		results.push_back(result);
+		if (threads == 1)
+			break;
+	}
+
+	MicrobenchmarkResult sweep;
+	sweep.name = "Sweep over " + std::to_string(KERNELS) + " kernels, 1 thread";
+	sweep.referenceSeconds = MeasureSeconds(repetitions, [&]()
+	{
+		for (int k = 0; k < KERNELS; ++k)
+			for (int iEdge = 0; iEdge < (int)edges.size(); ++iEdge)
+				referenceSmoothed[k][iEdge] = SetMapSmoothSingleEdge(graph, iEdge, smoothDeviations[k](iEdge), derivatives);
+	});
+	sweep.optimizedSeconds = MeasureSeconds(repetitions, [&]() { smoothPerEdge<double, true>(graph, smoothDeviations, derivatives, smoothed); });
+	sweep.maxDifference = 0;
+	for (int k = 0; k < KERNELS; ++k)
+		sweep.maxDifference = std::max(sweep.maxDifference, maxDifference(k));
+	results.push_back(sweep);
+	return results;
+}
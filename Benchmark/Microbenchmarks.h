@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+//The micro benchmarks compile the reference implementations of internal algorithms together with the library sources of the
+//optimized implementations into the benchmark application. Neither is exported from the library.
+
+//Result of a micro benchmark that runs a reference implementation and an optimized implementation of an internal
+//algorithm on the same input.
+struct MicrobenchmarkResult
+{
+	std::string name;
+	//Average time of a single run
+	double referenceSeconds;
+	double optimizedSeconds;
+	//Maximum absolute difference between the results of both implementations
+	double maxDifference;
+};
+
+//Compares the nested per-latitude layout of sphere fields (std::vector<std::vector<T>> with neighbors from the neighbor iterator)
+//with the flat layout (fields indexed by sample with precomputed neighbor lists) for the gradient calculation, the search for
+//strong local extrema, and interpolation. The input is a synthetic distance field on a sphere sampling with the given resolution.
+std::vector<MicrobenchmarkResult> BenchmarkSphereFieldLayouts(int resolution, int repetitions);
+
+//Compares solving the least-squares normal equations per sample (before) with the precomputed sparse gradient operator (after)
+//for the gradient of a synthetic distance field on a sphere sampling with the given resolution.
+std::vector<MicrobenchmarkResult> BenchmarkSphereGradient(int resolution, int repetitions);
+
+//Compares the search for strong local extrema with neighborhoods from the range iterator (before) and from a precomputed
+//neighborhood table (after) on a synthetic distance field and on a quantized version with plateaus. Any difference in the
+//found extrema results in an infinite difference.
+std::vector<MicrobenchmarkResult> BenchmarkStrongExtrema(int resolution, int repetitions);
+
+//Compares the interpolation of a synthetic distance field and its gradient point by point with ParametersFromPoint (before)
+//with the batched interpolation that uses polynomial approximations of the inverse trigonometric functions (after).
+std::vector<MicrobenchmarkResult> BenchmarkBatchedInterpolation(int resolution, int repetitions);
+
+//Compares LineFlow on a linked list (before) with LineFlow on a contiguous buffer with a reusable workspace (after) for a closed
+//line that flows towards the maxima and an open line that flows towards the minima of a synthetic distance field. Any difference in
+//the resulting lines results in an infinite difference.
+std::vector<MicrobenchmarkResult> BenchmarkLineFlow(int resolution, int repetitions);
+
+//Compares the exhaustive relaxation of all pairs of samples (before) with the sliding window dynamic program (after) in
+//FindOptimalMeanAverage() on random lines with the given number of samples, with random and with quantized values. The times are
+//per line. Any difference in the picked samples results in an infinite difference.
+std::vector<MicrobenchmarkResult> BenchmarkOptimalMeanAverage(int sampleCount, int repetitions);
+
+//Compares the Voronoi cave size calculation with a priority queue of the nearest maxima per sample (before) with the precomputed
+//nearest-two-maxima assignment and rectangle corners (after) on a synthetic distance field, for its own maxima and for random maxima.
+std::vector<MicrobenchmarkResult> BenchmarkVoronoiCaveSize(int resolution, int repetitions);
+
+//Compares the Gaussian smoothing of skeleton vertices with a std::set and a std::map per Dijkstra search (before) with the reusable
+//flat workspace and binary heap of smooth() (after) on a synthetic tree-shaped skeleton with the given number of vertices. The
+//optimized version runs with a single thread and with all threads.
+std::vector<MicrobenchmarkResult> BenchmarkSkeletonSmoothing(int vertexCount, int repetitions);
+
+//Compares a sweep over ten cave size kernel factors with a Dijkstra search per vertex and kernel (before) with a SmoothingOperator
+//that is built once for the largest kernel and applied for every kernel (after) on a synthetic tree-shaped skeleton, with all threads.
+//Also compares the largest kernel alone with a prebuilt operator.
+std::vector<MicrobenchmarkResult> BenchmarkSmoothingOperator(int vertexCount, int repetitions);
+
+//Compares the cave scale algorithms Max and Advect with a depth-first search per vertex (findMax() and maxAdvect(), before) with
+//the chain decomposition of SkeletonChains (after) on a synthetic tree-shaped skeleton with one loop per 1000 vertices, for two
+//kernel factors. Both run with a single thread; the optimized time includes building the decomposition.
+std::vector<MicrobenchmarkResult> BenchmarkChainMaxima(int vertexCount, int repetitions);
+
+//Compares the per-edge steps of SmoothAndDeriveDistances() (Gaussian smoothing of the cave size derivative and the second
+//derivative) on adjacency lists with a std::map from vertex pairs to edge ids (before) with the compressed adjacency whose entries
+//carry the edge id and direction (after) on a synthetic tree-shaped skeleton with one loop per 1000 vertices. Also compares the
+//construction of both graphs. All steps run with a single thread.
+std::vector<MicrobenchmarkResult> BenchmarkSkeletonGraph(int vertexCount, int repetitions);
+
+//Compares the Gaussian smoothing of per-edge measures with a std::set, a std::map, and std::erf per edge search (before) with the
+//reusable vertex Dijkstra workspace and the tabulated error function of smoothPerEdge() (after) for the cave size derivative on a
+//synthetic tree-shaped skeleton with one loop per 1000 vertices, with one thread and with all threads. Also compares a sweep over
+//five kernel factors with a search per kernel (before) and a single search for all kernels (after).
+std::vector<MicrobenchmarkResult> BenchmarkEdgeSmoothing(int vertexCount, int repetitions);
@@ -8,6 +8,11 @@
 #include <boost/filesystem.hpp>
 
 #include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <CurveSkeleton.h>
 
 void PrintHelp()
@@ -20,11 +25,24 @@ void PrintHelp()
 	std::cout << "Optional Options: " << std::endl;
 	std::cout << "\t--calcSkel             Specify this to calculate the skeleton and save it to file. Otherwise, it will be loaded from a file." << std::endl;
 	std::cout << "\t--calcDist             Specify this to calculate distance data and save them to file. Otherwise, they will be loaded from a file." << std::endl;
+	std::cout << "\t--shard [i/N]          Calculate distance data only for shard i (0-based) of N, save them to \"[dataDirectory]/distances.shard[i]of[N].bin\", and exit." << std::endl;
+	std::cout << "\t--mergeShards [N]      Merge the distance data of N shards and save them to file instead of calculating or loading them." << std::endl;
+	std::cout << "\t--recalcDist [list]    Recalculate the loaded distance data only for a comma-separated list of skeleton vertices (e.g. after editing the model around them) and save them to file. Cannot be combined with --calcDist, --shard, or --mergeShards." << std::endl;
 	std::cout << "\t--edgeLength [float]   Specify the edge collapse threshold for skeleton calculation in percent of the model's bounding box diagonal." << std::endl;
 	std::cout << "\t--wsmooth [float]      Specify the smoothing weight for skeleton calculation." << std::endl;
 	std::cout << "\t--wvelocity [float]    Specify the velocity weight for skeleton calculation." << std::endl;
 	std::cout << "\t--wmedial [float]      Specify the medial weight for skeleton calculation." << std::endl;
 	std::cout << "\t--exp [float]          Specify the exponent for distance calculation." << std::endl;
+	std::cout << "\t--threads [int]        Specify the number of threads for distance calculation (default: all available threads)." << std::endl;
+	std::cout << "\t--rayCaster [name]     Specify the ray casting engine for distance calculation (\"aabb\", \"bvh\", or \"packet\", default: \"bvh\")." << std::endl;
+	std::cout << "\t--sizeCalculator [name] Specify the cave size calculation (\"lineflow\", \"voronoi\", or \"void\", default: \"lineflow\")." << std::endl;
+	std::cout << "\t--rayCache [mode]      Specify how ray distances are cached between distance calculations (\"none\", \"float32\", or \"float16\", default: \"none\", or \"float32\" with --rayCacheFile)." << std::endl;
+	std::cout << "\t--rayCacheFile [path]  Persist the ray distance cache in the given file, such that later runs with a different exponent skip ray casting." << std::endl;
+	std::cout << "\t--rayHints             Use the hits of neighboring skeleton vertices as traversal hints during ray casting." << std::endl;
+	std::cout << "\t--samplingQuality [float] Specify the sphere sampling quality in (0, 1] (default: 1). Lower values cast fewer rays by sampling adaptively." << std::endl;
+	std::cout << "\t--samplingResolution [int] Specify the number of latitudes of the sphere sampling: 31, 51 (default), or 81." << std::endl;
+	std::cout << "\t--flowPotentialTol [float] Stop line flows once the relative change of the average potential stays below this value (default: 0 = off)." << std::endl;
+	std::cout << "\t--flowDisplacementTol [float] Stop line flows once no point moves farther than this fraction of the maximum flow distance perpendicular to the line (default: 0 = off)." << std::endl;
 	std::cout << "\t--scaleKernel [float]  Specify the width of the cave scale kernel (mu_scale from paper)." << std::endl;
 	std::cout << "\t--sizeKernel [float]   Specify the width of the cave size kernel (mu_size from the paper)." << std::endl;
 	std::cout << "\t--derivKernel [float]  Specify the width of the cave size derivative kernel (mu_size' from the paper)." << std::endl;
@@ -33,10 +51,34 @@ void PrintHelp()
 	std::cout << "All output will be saved in \"[dataDirectory]/output\"." << std::endl;
 }
 
+//Parses a comma-separated list of skeleton vertex indices. Returns false if an entry is empty or not a non-negative integer.
+bool ParseVertexList(const char* list, std::vector<size_t>& vertices)
+{
+	//getline() does not report an empty entry after a trailing comma
+	if (*list == '\0' || list[strlen(list) - 1] == ',')
+		return false;
+	std::stringstream stream(list);
+	std::string entry;
+	while (std::getline(stream, entry, ','))
+	{
+		char* end;
+		if (entry.empty() || !isdigit((unsigned char)entry[0]))
+			return false;
+		vertices.push_back(strtoul(entry.c_str(), &end, 10));
+		if (*end != '\0')
+			return false;
+	}
+	return true;
+}
+
 int main(int argc, char* argv[])
 {	
 	bool calculateSkeleton = false;
 	bool calculateDistances = false;
+	std::vector<size_t> recalculateVertices;
+	int shard = -1;
+	int shardCount = 0;
+	int mergeShardCount = 0;
 	std::string dataDirectory;
 
 	float edgeCollapseThresholdPercent = 0.2f;
@@ -45,6 +87,8 @@ int main(int argc, char* argv[])
 	float w_medial = 1.0f;
 
 	float exponent = 1.0f;
+	bool rayCacheSpecified = false;
+	bool rayCacheFileSpecified = false;
 
 	auto data = CreateCaveData();
 
@@ -67,6 +111,38 @@ int main(int argc, char* argv[])
 				calculateSkeleton = true;
 			else if (strcmp(argv[i], "--calcDist") == 0)
 				calculateDistances = true;
+			else if (strcmp(argv[i], "--shard") == 0)
+			{
+				char rest;
+				if (i + 1 >= argc || sscanf(argv[i + 1], "%d/%d%c", &shard, &shardCount, &rest) != 2 || shardCount < 1 || shard < 0 || shard >= shardCount)
+				{
+					std::cout << "Invalid shard \"" << (i + 1 < argc ? argv[i + 1] : "") << "\". Expected i/N with 0 <= i < N." << std::endl;
+					PrintHelp();
+					return 1;
+				}
+				++i;
+			}
+			else if (strcmp(argv[i], "--mergeShards") == 0)
+			{
+				char rest;
+				if (i + 1 >= argc || sscanf(argv[i + 1], "%d%c", &mergeShardCount, &rest) != 1 || mergeShardCount < 1)
+				{
+					std::cout << "Invalid number of shards \"" << (i + 1 < argc ? argv[i + 1] : "") << "\". Expected a positive integer." << std::endl;
+					PrintHelp();
+					return 1;
+				}
+				++i;
+			}
+			else if (strcmp(argv[i], "--recalcDist") == 0)
+			{
+				if (i + 1 >= argc || !ParseVertexList(argv[i + 1], recalculateVertices))
+				{
+					std::cout << "Invalid list of skeleton vertices \"" << (i + 1 < argc ? argv[i + 1] : "") << "\". Expected comma-separated vertex indices." << std::endl;
+					PrintHelp();
+					return 1;
+				}
+				++i;
+			}
 			else if (strcmp(argv[i], "--edgeLength") == 0)
 			{
 				edgeCollapseThresholdPercent = std::stof(argv[i + 1]);
@@ -92,6 +168,84 @@ int main(int argc, char* argv[])
 				exponent = std::stof(argv[i + 1]);
 				++i;
 			}
+			else if (strcmp(argv[i], "--rayCaster") == 0)
+			{
+				if (strcmp(argv[i + 1], "aabb") == 0)
+					data->RayCaster() = ICaveData::AllIntersectionsAABBTree;
+				else if (strcmp(argv[i + 1], "bvh") == 0)
+					data->RayCaster() = ICaveData::ClosestHitBVH;
+				else if (strcmp(argv[i + 1], "packet") == 0)
+					data->RayCaster() = ICaveData::PacketBVH;
+				else
+					std::cout << "Unknown ray casting engine \"" << argv[i + 1] << "\"." << std::endl;
+				++i;
+			}
+			else if (strcmp(argv[i], "--sizeCalculator") == 0)
+			{
+				if (strcmp(argv[i + 1], "lineflow") == 0)
+					data->CaveSizeCalculator() = ICaveData::LineFlowCaveSize;
+				else if (strcmp(argv[i + 1], "voronoi") == 0)
+					data->CaveSizeCalculator() = ICaveData::VoronoiCaveSize;
+				else if (strcmp(argv[i + 1], "void") == 0)
+					data->CaveSizeCalculator() = ICaveData::VoidCaveSize;
+				else
+					std::cout << "Unknown cave size calculator \"" << argv[i + 1] << "\"." << std::endl;
+				++i;
+			}
+			else if (strcmp(argv[i], "--rayCache") == 0)
+			{
+				if (strcmp(argv[i + 1], "none") == 0)
+					data->RayDistanceCaching() = ICaveData::NoRayDistanceCache;
+				else if (strcmp(argv[i + 1], "float32") == 0)
+					data->RayDistanceCaching() = ICaveData::Float32RayDistanceCache;
+				else if (strcmp(argv[i + 1], "float16") == 0)
+					data->RayDistanceCaching() = ICaveData::Float16RayDistanceCache;
+				else
+					std::cout << "Unknown ray distance cache mode \"" << argv[i + 1] << "\"." << std::endl;
+				rayCacheSpecified = true;
+				++i;
+			}
+			else if (strcmp(argv[i], "--rayCacheFile") == 0)
+			{
+				data->SetRayDistanceCacheFile(argv[i + 1]);
+				rayCacheFileSpecified = true;
+				++i;
+			}
+			else if (strcmp(argv[i], "--rayHints") == 0)
+				data->RayTraversalHints() = true;
+			else if (strcmp(argv[i], "--samplingQuality") == 0)
+			{
+				data->SphereSamplingQuality() = std::stof(argv[i + 1]);
+				++i;
+			}
+			else if (strcmp(argv[i], "--samplingResolution") == 0)
+			{
+				int resolution;
+				char rest;
+				if (i + 1 >= argc || sscanf(argv[i + 1], "%d%c", &resolution, &rest) != 1 || !ICaveData::IsSupportedSphereSamplingResolution(resolution))
+				{
+					std::cout << "Invalid sphere sampling resolution \"" << (i + 1 < argc ? argv[i + 1] : "") << "\". Expected 31, 51, or 81." << std::endl;
+					PrintHelp();
+					return 1;
+				}
+				data->SphereSamplingResolution() = resolution;
+				++i;
+			}
+			else if (strcmp(argv[i], "--flowPotentialTol") == 0)
+			{
+				data->LineFlowTerminationCriteria().potentialTolerance = std::stof(argv[i + 1]);
+				++i;
+			}
+			else if (strcmp(argv[i], "--flowDisplacementTol") == 0)
+			{
+				data->LineFlowTerminationCriteria().displacementTolerance = std::stof(argv[i + 1]);
+				++i;
+			}
+			else if (strcmp(argv[i], "--threads") == 0)
+			{
+				data->NumberOfThreads() = std::stoi(argv[i + 1]);
+				++i;
+			}
 			else if (strcmp(argv[i], "--scaleKernel") == 0)
 			{
 				data->CaveScaleKernelFactor() = std::stof(argv[i + 1]);
@@ -120,6 +274,18 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	//Recalculation updates loaded distances, which the other distance modes do not load
+	if (!recalculateVertices.empty() && (calculateDistances || shardCount > 0 || mergeShardCount > 0))
+	{
+		std::cout << "--recalcDist cannot be combined with --calcDist, --shard, or --mergeShards." << std::endl;
+		PrintHelp();
+		return 1;
+	}
+
+	//A persisted cache is of no use without caching
+	if (rayCacheFileSpecified && !rayCacheSpecified)
+		data->RayDistanceCaching() = ICaveData::Float32RayDistanceCache;
+
 	if (dataDirectory.empty())
 	{
 		std::cout << "You did not specify a data directory." << std::endl;
@@ -138,6 +304,7 @@ int main(int argc, char* argv[])
 	const std::string offFile = dataDirectory + "/model.off";
 	const std::string skeletonFile = dataDirectory + "/model.skel";
 	const std::string distancesFile = dataDirectory + "/distances.bin";
+	auto distanceShardFile = [&](int i, int n) { return dataDirectory + "/distances.shard" + std::to_string(i) + "of" + std::to_string(n) + ".bin"; };
 
 	const std::string calculatedSkeletonFile = outputDirectory + "/skeleton.obj";
 	const std::string calculatedSkeletonCorrFile = outputDirectory + "/skeletonCorr.obj";
@@ -192,7 +359,53 @@ int main(int argc, char* argv[])
 	data->SetSkeleton(skeleton);
 	
 	
-	if (calculateDistances)
+	if (shardCount > 0)
+	{
+		std::cout << "Calculating distances of shard " << shard << "/" << shardCount << "..." << std::endl;
+		std::cout << "Using exponent " << exponent << std::endl;
+		try
+		{
+			data->CalculateDistanceShard(shard, shardCount, exponent);
+
+			std::cout << "Saving distance shard to " << distanceShardFile(shard, shardCount) << std::endl;
+			data->SaveDistanceShard(distanceShardFile(shard, shardCount), shard, shardCount);
+		}
+		catch (std::exception& e)
+		{
+			std::cerr << "Cannot calculate distance shard " << shard << "/" << shardCount << ": " << e.what() << std::endl;
+			return 4;
+		}
+
+		ICaveData::StopCaveSeg();
+		return 0;
+	}
+	else if (mergeShardCount > 0)
+	{
+		std::vector<std::string> shardFiles;
+		for (int i = 0; i < mergeShardCount; ++i)
+			shardFiles.push_back(distanceShardFile(i, mergeShardCount));
+		try
+		{
+			data->MergeDistanceShards(shardFiles, exponent);
+		}
+		catch (std::exception& e)
+		{
+			std::cerr << "Cannot merge distance shards: " << e.what() << std::endl;
+			return 4;
+		}
+
+		try
+		{
+			std::cout << "Saving distances to " << distancesFile << std::endl;
+			data->SaveDistances(distancesFile);
+		}
+		catch (std::exception& e)
+		{
+			std::cerr << "Cannot save distances to " << distancesFile << ": " << e.what() << std::endl;
+			return 4;
+		}
+	}
+	else if (calculateDistances)
 	{		
 		std::cout << "Calculating distances..." << std::endl;
 		std::cout << "Using exponent " << exponent << std::endl;
@@ -213,6 +426,24 @@ int main(int argc, char* argv[])
 			std::cerr << "Cannot load distances from " << distancesFile << ": " << e.what() << std::endl;
 			return 4;
 		}
+
+		if (!recalculateVertices.empty())
+		{
+			for (size_t v : recalculateVertices)
+			{
+				if (v >= data->NumberOfVertices())
+				{
+					std::cerr << "Skeleton vertex " << v << " does not exist." << std::endl;
+					return 4;
+				}
+			}
+			std::cout << "Recalculating distances of " << recalculateVertices.size() << " vertices..." << std::endl;
+			std::cout << "Using exponent " << exponent << std::endl;
+			data->CalculateDistances(recalculateVertices, exponent);
+
+			std::cout << "Saving distances to " << distancesFile << std::endl;
+			data->SaveDistances(distancesFile);
+		}
 	}
 	std::cout << "Smoothing distances and deriving additional measures..." << std::endl;
 	std::cout << "Using cave scale kernel factor " << data->CaveScaleKernelFactor() << std::endl;
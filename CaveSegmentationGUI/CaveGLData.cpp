@@ -279,6 +279,22 @@ void CaveGLData::SmoothAndDeriveDistances()
 	}
 }
 
+void CaveGLData::SmoothAndDeriveDistances(const std::vector<size_t>& changedVertices)
+{
+	if (HasUnsmoothedCaveSizes() && CaveSizeUnsmoothed(0) > 0)
+	{
+		decoratee->SmoothAndDeriveDistances(changedVertices);
+		emit distancesChanged();
+	}
+}
+
+bool CaveGLData::CalculateDistances(const std::vector<size_t>& vertices, float exponent)
+{
+	bool valid = decoratee->CalculateDistances(vertices, exponent);
+	emit distancesChanged();
+	return valid;
+}
+
 void CaveGLData::drawSkeleton(CameraProvider* cam)
 {
 	ContextSpecificData& data = contextSpecificData.at(QOpenGLContext::currentContext());
@@ -436,8 +452,9 @@ void CaveGLData::FindPath(int startVertex, int targetVertex, std::deque<int>& re
 			continue;
 
 		closedSet.insert(closedSet.end(), active.vertex);
-		for (int neighbor : AdjacentNodes(active.vertex))
+		for (auto& adjacent : Neighbors(active.vertex))
 		{
+			int neighbor = adjacent.vertex;
 			if (closedSet.find(neighbor) != closedSet.end())
 				continue;
 
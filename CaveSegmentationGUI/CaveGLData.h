@@ -26,6 +26,8 @@ public:
 	void LoadMesh(const std::string& offFile);
 	void SetSkeleton(CurveSkeleton* skeleton);
 	void SmoothAndDeriveDistances();
+	void SmoothAndDeriveDistances(const std::vector<size_t>& changedVertices);
+	bool CalculateDistances(const std::vector<size_t>& vertices, float exponent = 1.0f);
 
 	//ICaveData forwarded functions
 	void WriteMesh(const std::string& offFile, std::function<void(int i, int& r, int& g, int& b)> colorFunc) const { decoratee->WriteMesh(offFile, colorFunc); }
@@ -33,8 +35,23 @@ public:
 	void WriteSurfaceSegmentation(const std::string& path, const std::vector<int32_t>& segmentation) const { decoratee->WriteSurfaceSegmentation(path, segmentation); }
 	bool CalculateDistances(float exponent = 1.0f) { return decoratee->CalculateDistances(exponent); }
 	bool CalculateDistancesSingleVertexWithDebugOutput(int iVert, float exponent = 1.0f) { return decoratee->CalculateDistancesSingleVertexWithDebugOutput(iVert, exponent); }
+	ICaveData::RayCastingEngine& RayCaster() { return decoratee->RayCaster(); }
+	ICaveData::CaveSizeCalculatorType& CaveSizeCalculator() { return decoratee->CaveSizeCalculator(); }
+	const ICaveData::DistanceStatistics& LastDistanceStatistics() const { return decoratee->LastDistanceStatistics(); }
+	ICaveData::RayDistanceCacheMode& RayDistanceCaching() { return decoratee->RayDistanceCaching(); }
+	int& NumberOfThreads() { return decoratee->NumberOfThreads(); }
+	double& SphereSamplingQuality() { return decoratee->SphereSamplingQuality(); }
+	int& SphereSamplingResolution() { return decoratee->SphereSamplingResolution(); }
+	ICaveData::LineFlowTermination& LineFlowTerminationCriteria() { return decoratee->LineFlowTerminationCriteria(); }
+	bool& RecordLineFlowStatistics() { return decoratee->RecordLineFlowStatistics(); }
+	ICaveData::LineFlowStatistics VertexLineFlowStatistics(size_t iVertex) const { return decoratee->VertexLineFlowStatistics(iVertex); }
+	bool& RayTraversalHints() { return decoratee->RayTraversalHints(); }
+	void SetRayDistanceCacheFile(const std::string& file) { decoratee->SetRayDistanceCacheFile(file); }
 	void LoadDistances(const std::string& file) { decoratee->LoadDistances(file); }
 	void SaveDistances(const std::string& file) const { decoratee->SaveDistances(file); }
+	bool CalculateDistanceShard(int shard, int shardCount, float exponent = 1.0f) { return decoratee->CalculateDistanceShard(shard, shardCount, exponent); }
+	void SaveDistanceShard(const std::string& file, int shard, int shardCount) const { decoratee->SaveDistanceShard(file, shard, shardCount); }
+	void MergeDistanceShards(const std::vector<std::string>& files, float exponent = 1.0f) { decoratee->MergeDistanceShards(files, exponent); }
 	void SetOutputDirectory(const std::wstring& outputDirectory) { decoratee->SetOutputDirectory(outputDirectory); }
 	void ResizeMeshAttributes(size_t vertexCount) { decoratee->ResizeMeshAttributes(vertexCount); }
 	void ResizeSkeletonAttributes(size_t vertexCount, size_t edgeCount) { decoratee->ResizeSkeletonAttributes(vertexCount, edgeCount); }
@@ -44,6 +61,7 @@ public:
 	double& CaveScaleKernelFactor() { return decoratee->CaveScaleKernelFactor(); }
 	double& CaveSizeKernelFactor() { return decoratee->CaveSizeKernelFactor(); }
 	double& CaveSizeDerivativeKernelFactor() { return decoratee->CaveSizeDerivativeKernelFactor(); }
+	size_t& SmoothingOperatorMemoryLimit() { return decoratee->SmoothingOperatorMemoryLimit(); }
 	bool HasCaveSizes() const { return decoratee->HasCaveSizes(); }
 	bool HasUnsmoothedCaveSizes() const { return decoratee->HasUnsmoothedCaveSizes(); }
 	const std::vector<size_t>& VerticesWithInvalidSize() const { return decoratee->VerticesWithInvalidSize(); }
@@ -55,7 +73,7 @@ public:
 	void SetVerbose(bool verbose) { decoratee->SetVerbose(verbose); }
 
 	//IGraph forwarded functions
-	const std::vector<int>& AdjacentNodes(size_t skeletonVertex) const { return decoratee->AdjacentNodes(skeletonVertex); }
+	SkeletonNeighborRange Neighbors(size_t skeletonVertex) const { return decoratee->Neighbors(skeletonVertex); }
 	size_t EdgeIdFromVertexPair(size_t v1, size_t v2) const { return decoratee->EdgeIdFromVertexPair(v1, v2); }
 	void IncidentVertices(size_t edgeId, size_t& v1, size_t& v2) const { decoratee->IncidentVertices(edgeId, v1, v2); }
 	const Eigen::Vector3f& VertexPosition(size_t vertexId) const { return decoratee->VertexPosition(vertexId); }
@@ -11,9 +11,11 @@ ViewModel::ViewModel(QObject * parent) : QObject(parent), lookThrough(true),
 {
 	marker.x = std::numeric_limits<double>::quiet_NaN();
 
-	connect(&caveScaleKernelFactor, &ObservableVariable<double>::changed, &caveData, &CaveGLData::SmoothAndDeriveDistances);
-	connect(&caveSizeKernelFactor, &ObservableVariable<double>::changed, &caveData, &CaveGLData::SmoothAndDeriveDistances);
-	connect(&caveSizeDerivativeKernelFactor, &ObservableVariable<double>::changed, &caveData, &CaveGLData::SmoothAndDeriveDistances);
+	//Kernel changes affect all vertices, so the measures are smoothed from scratch
+	auto smoothAll = static_cast<void (CaveGLData::*)()>(&CaveGLData::SmoothAndDeriveDistances);
+	connect(&caveScaleKernelFactor, &ObservableVariable<double>::changed, &caveData, smoothAll);
+	connect(&caveSizeKernelFactor, &ObservableVariable<double>::changed, &caveData, smoothAll);
+	connect(&caveSizeDerivativeKernelFactor, &ObservableVariable<double>::changed, &caveData, smoothAll);
 
 	_cursorPos.x = std::numeric_limits<float>::quiet_NaN();
 
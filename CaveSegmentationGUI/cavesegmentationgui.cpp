@@ -303,6 +303,8 @@ void CaveSegmentationGUI::calculateSpecificVertexDistances(bool)
 		return;
 	
 	vm.caveData.CalculateDistancesSingleVertexWithDebugOutput(vm.selectedVertex.get(), vm.distanceExponent.get());
+	//Only the measures around the recalculated vertex need to be updated
+	vm.caveData.SmoothAndDeriveDistances(std::vector<size_t>(1, vm.selectedVertex.get()));
 	QMessageBox::information(this, "Distance Calculation", "Calculated Cave Size at vertex " + QString::number(vm.selectedVertex.get()) + ": " + QString::number(vm.caveData.CaveSizeUnsmoothed(vm.selectedVertex.get())));
 }
 
@@ -20,6 +20,70 @@ public:
 		Advect
 	};
 
+	//Method for casting the rays that sample the visible sphere around a skeleton vertex
+	enum RayCastingEngine
+	{
+		AllIntersectionsAABBTree, //CGAL AABB tree that enumerates all intersections along a ray (reference)
+		ClosestHitBVH, //front-to-back traversal of a bounding volume hierarchy that stops at the closest hit
+		PacketBVH //same as ClosestHitBVH but traces coherent rays together in SIMD packets
+	};
+
+	//Method for calculating the cave size of a skeleton vertex from the distance field on the sphere around it
+	enum CaveSizeCalculatorType
+	{
+		LineFlowCaveSize, //averages the distances along a line that separates the distance maxima and lines through the minima (default)
+		VoronoiCaveSize, //averages the distances along the edges of the Voronoi diagram of the distance maxima
+		VoidCaveSize //returns 0, e.g. to measure the distance calculation without size calculation
+	};
+
+	//Storage of the raw ray distances per skeleton vertex and sample direction. With a cache, CalculateDistances() only casts rays
+	//for the first exponent and re-uses the stored distances for all subsequent calls until the mesh or the skeleton changes.
+	enum RayDistanceCacheMode
+	{
+		NoRayDistanceCache,
+		Float32RayDistanceCache, //4 bytes per sample direction
+		Float16RayDistanceCache //2 bytes per sample direction with a relative precision of 2^-11
+	};
+
+	//Statistics about the last call of CalculateDistances()
+	struct DistanceStatistics
+	{
+		size_t tracedRays;
+		size_t cachedVertices; //vertices whose ray distances have been taken from the cache
+		double rayCastingSeconds; //accumulated over all threads
+		double totalSeconds; //wall clock time
+		int threads; //number of threads that have been used
+		size_t visitedNodes; //BVH nodes visited during ray casting (once per packet for packets)
+		size_t hintedRays; //rays whose traversal hint has been hit
+	};
+
+	//Termination criteria of the line flows that find the separating line and the lines through the minima on the sphere around a
+	//skeleton vertex. A flow always stops when the average potential along the line has not improved for patience iterations or after
+	//maxIterations. It also stops when the line has been stationary for stationaryIterations consecutive iterations, where stationary
+	//means that the relative change of the average potential is at most potentialTolerance and that no line point moved more than
+	//displacementTolerance times the maximum flow distance perpendicular to the line. Only the perpendicular displacement is
+	//considered because the flow step is normalized to the steepest gradient, such that points keep sliding along a converged line.
+	//A tolerance of 0 disables the criterion.
+	struct LineFlowTermination
+	{
+		LineFlowTermination() : patience(20), maxIterations(400), stationaryIterations(3), potentialTolerance(0), displacementTolerance(0) {}
+
+		int patience;
+		int maxIterations;
+		int stationaryIterations;
+		double potentialTolerance;
+		double displacementTolerance;
+	};
+
+	//Work of the line flows for a single skeleton vertex
+	struct LineFlowStatistics
+	{
+		int lines;
+		int iterations; //sum over all lines
+		int iterationsAfterOptimum; //iterations after the one with the optimal average potential, i.e. the work spent to confirm the optimum
+		int stationaryLines; //lines that stopped because they became stationary
+	};
+
 	virtual void LoadMesh(const std::string& offFile) = 0;
 	virtual void WriteMesh(const std::string& offFile, std::function<void(int i, int& r, int& g, int& b)> colorFunc) const = 0;
 	virtual void WriteSegmentationColoredOff(const std::string& path, const std::vector<int32_t>& segmentation) const = 0;
@@ -29,14 +93,64 @@ public:
 	//Calculates the cave distances and sizes for every vertex and returns if there are any vertices with invalid sizes.
 	virtual bool CalculateDistances(float exponent = 1.0f) = 0;
 
+	//Recalculates the cave distances and sizes only for the given vertices, e.g. after the geometry around them has been edited.
+	//Their cached ray distances are discarded. If the distances have been smoothed before, the smoothed and derived measures are
+	//updated incrementally (see SmoothAndDeriveDistances(changedVertices)). Returns if all given vertices have valid sizes.
+	virtual bool CalculateDistances(const std::vector<size_t>& vertices, float exponent = 1.0f) = 0;
+
 	//Calculates the cave distances and size for a single vertex and writes debug output to disk. Returns if
 	//size calculation has been successful.
 	virtual bool CalculateDistancesSingleVertexWithDebugOutput(int iVert, float exponent = 1.0f) = 0;
 
+	virtual RayCastingEngine& RayCaster() = 0;
+	virtual CaveSizeCalculatorType& CaveSizeCalculator() = 0;
+	//Number of threads for the distance calculation. 0 (default) uses all available threads.
+	virtual int& NumberOfThreads() = 0;
+	//Quality of the sphere sampling in (0, 1]. With 1 (default), rays are cast for every sample direction. Lower values cast rays
+	//on a coarse grid and refine it only around extrema and steep changes of the distance; the remaining samples are interpolated.
+	virtual double& SphereSamplingQuality() = 0;
+	//Number of latitudes of the sphere sampling: 31, 51 (default), or 81. The sampling and everything that is precomputed for it is
+	//built once per resolution and process. Lower resolutions cast fewer rays per skeleton vertex at the cost of accuracy. Other
+	//resolutions make the distance calculation throw (see IsSupportedSphereSamplingResolution()).
+	virtual int& SphereSamplingResolution() = 0;
+	//Specifies if rays are first intersected with the triangle that has been hit in the same direction from the previously processed
+	//(usually neighboring) skeleton vertex, which bounds the BVH traversal. Default: false, since the front-to-back traversal
+	//already finds the closest hit early and the hints rarely save enough node visits to pay for the extra triangle test.
+	virtual bool& RayTraversalHints() = 0;
+	virtual const DistanceStatistics& LastDistanceStatistics() const = 0;
+
+	virtual LineFlowTermination& LineFlowTerminationCriteria() = 0;
+	//Specifies if the line flow statistics are recorded per skeleton vertex during the distance calculation. Default: false.
+	virtual bool& RecordLineFlowStatistics() = 0;
+	//Returns the line flow statistics of a vertex from the last distance calculation that recorded them (all zero if there is none).
+	virtual LineFlowStatistics VertexLineFlowStatistics(size_t iVertex) const = 0;
+
+	//Default: NoRayDistanceCache, since the cache holds all raw ray distances (about 12.6 KB per skeleton vertex in float32 with the
+	//default sampling). Enable it for repeated calculations with different exponents.
+	virtual RayDistanceCacheMode& RayDistanceCaching() = 0;
+	//Specifies a file in which the ray distance cache is persisted between runs. If empty (default), the cache is only kept in memory.
+	virtual void SetRayDistanceCacheFile(const std::string& file) = 0;
+
 	
 	virtual void LoadDistances(const std::string& file) = 0;
 	virtual void SaveDistances(const std::string& file) const = 0;
+
+	//Distributed distance calculation: the skeleton vertices are split into shardCount shards (vertex v belongs to shard v % shardCount),
+	//which can be calculated by different processes or machines with the same mesh, skeleton, and options.
+	//Calculates the cave sizes of the vertices of a single shard. Returns if all of them have valid sizes.
+	virtual bool CalculateDistanceShard(int shard, int shardCount, float exponent = 1.0f) = 0;
+	//Writes the result of CalculateDistanceShard() to a partial distances file. The file records the mesh, skeleton, sampling, ray
+	//casting engine, exponent, cave size calculator, and line flow termination criteria.
+	virtual void SaveDistanceShard(const std::string& file, int shard, int shardCount) const = 0;
+	//Assembles the distances from the partial files of all shards and reconstructs invalid vertices, such that the result is the same
+	//as with CalculateDistances(exponent). Throws if a shard is missing or if any of the recorded settings differs from the current
+	//ones.
+	virtual void MergeDistanceShards(const std::vector<std::string>& files, float exponent = 1.0f) = 0;
 	virtual void SmoothAndDeriveDistances() = 0;
+	//Updates the smoothed and derived measures after the unsmoothed sizes of the given vertices have changed. Only the vertices and edges
+	//within the kernel radii around them are recalculated; the result is the same as with a full SmoothAndDeriveDistances(). Falls back
+	//to the full calculation if the measures have not been smoothed with the current parameters before.
+	virtual void SmoothAndDeriveDistances(const std::vector<size_t>& changedVertices) = 0;
 
 	virtual bool HasUnsmoothedCaveSizes() const = 0;
 	virtual bool HasCaveSizes() const = 0;
@@ -58,6 +172,11 @@ public:
 	virtual double& CaveScaleKernelFactor() = 0; //kernel deviation for calculating cave scale (multiplied by local cave size)
 	virtual double& CaveSizeKernelFactor() = 0; //kernel deviation for smoothing cave size (multiplied by cave scale)
 	virtual double& CaveSizeDerivativeKernelFactor() = 0; //kernel deviation for smoothing cave size derivative (multiplied by cave scale)	
+	//Maximum memory in bytes for the geodesic neighborhoods of all skeleton vertices, which are precomputed once per skeleton and
+	//reused by SmoothAndDeriveDistances() for all kernel factors whose kernels they cover. The limit applies to the peak memory while
+	//they are precomputed, which is up to three times their final size. Kernels that would need more memory are evaluated with a Dijkstra
+	//search per vertex. 0 disables the precomputation. Default: 256 MB.
+	virtual size_t& SmoothingOperatorMemoryLimit() = 0;
 
 	virtual double CaveSize(size_t iVertex) const = 0;
 	virtual double CaveSizeUnsmoothed(size_t iVertex) const = 0;
@@ -70,6 +189,9 @@ public:
 	//Returns the default color for a segment as a 3-component RGB array.
 	static const int* GetSegmentColor(int segmentIndex);
 
+	//Returns if the given number of latitudes can be used as SphereSamplingResolution().
+	static bool IsSupportedSphereSamplingResolution(int resolution);
+
 	//Initialize the cave segmentation system
 	static void StartCaveSeg();
 
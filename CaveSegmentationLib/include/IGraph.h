@@ -4,14 +4,41 @@
 
 #include <vector>
 
+//Entry of the adjacency list of a skeleton vertex
+struct SkeletonNeighbor
+{
+	//Adjacent vertex
+	int vertex;
+	//Edge between the vertex of the list and the adjacent vertex
+	int edge;
+	//+1 if the edge is stored as (vertex of the list, adjacent vertex), -1 if it is stored the other way round
+	int direction;
+};
+
+//The neighbors of a skeleton vertex, which are stored contiguously
+class SkeletonNeighborRange
+{
+public:
+	SkeletonNeighborRange(const SkeletonNeighbor* first, const SkeletonNeighbor* last) : first(first), last(last) { }
+
+	const SkeletonNeighbor* begin() const { return first; }
+	const SkeletonNeighbor* end() const { return last; }
+	size_t size() const { return last - first; }
+	const SkeletonNeighbor& operator[](size_t i) const { return first[i]; }
+
+private:
+	const SkeletonNeighbor* first;
+	const SkeletonNeighbor* last;
+};
+
 class CAVESEGMENTATIONLIB_API IGraph
 {
 public:
 
-	//Returns the skeleton vertices that are adjacent to the given vertex.
-	virtual const std::vector<int>& AdjacentNodes(size_t skeletonVertex) const = 0;
+	//Returns the skeleton vertices that are adjacent to the given vertex together with the connecting edges.
+	virtual SkeletonNeighborRange Neighbors(size_t skeletonVertex) const = 0;
 
-	//Returns the id of the edge between two vertices.
+	//Returns the id of the edge between two vertices. Prefer the edge ids of Neighbors() in loops.
 	virtual size_t EdgeIdFromVertexPair(size_t v1, size_t v2) const = 0;
 
 	virtual void IncidentVertices(size_t edgeId, size_t& v1, size_t& v2) const = 0;
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <xmmintrin.h>
+
+//STL allocator that aligns all allocations to Alignment bytes (e.g. to cache lines).
+template <typename T, size_t Alignment>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() { }
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) { }
+
+	T* allocate(size_t n)
+	{
+		void* p = _mm_malloc(n * sizeof(T), Alignment);
+		if (p == nullptr)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		_mm_free(p);
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
@@ -8,8 +8,13 @@
 #include "IndexedTriangle.h"
 #include "SizeCalculation.h"
 #include "RegularUniformSphereSampling.h"
+#include "SphereProc.h"
 #include "SphereVisualizer.h"
 #include "MeshProc.h"
+#include "RayDistanceCache.h"
+#include "SkeletonAdjacency.h"
+#include "SmoothingOperator.h"
+#include "SkeletonChains.h"
 #include "BoundingBoxAccumulator.h"
 
 #pragma warning(disable: 4250) //inherits via dominance
@@ -26,10 +31,27 @@ struct CaveData : public virtual ICaveData, public BoundingBoxAccumulator
 	void SetSkeleton(CurveSkeleton* skeleton);
 
 	bool CalculateDistances(float exponent = 1.0f);
+	bool CalculateDistances(const std::vector<size_t>& vertices, float exponent = 1.0f);
 	bool CalculateDistancesSingleVertexWithDebugOutput(int iVert, float exponent = 1.0f);
+	ICaveData::RayCastingEngine& RayCaster() { return RAY_CASTING_ENGINE; }
+	ICaveData::CaveSizeCalculatorType& CaveSizeCalculator() { return CAVE_SIZE_CALCULATOR; }
+	ICaveData::RayDistanceCacheMode& RayDistanceCaching() { return RAY_DISTANCE_CACHE_MODE; }
+	int& NumberOfThreads() { return NUMBER_OF_THREADS; }
+	double& SphereSamplingQuality() { return SPHERE_SAMPLING_QUALITY; }
+	int& SphereSamplingResolution() { return SPHERE_SAMPLING_RESOLUTION; }
+	bool& RayTraversalHints() { return RAY_TRAVERSAL_HINTS; }
+	void SetRayDistanceCacheFile(const std::string& file);
+	const ICaveData::DistanceStatistics& LastDistanceStatistics() const { return distanceStatistics; }
+	ICaveData::LineFlowTermination& LineFlowTerminationCriteria() { return LINE_FLOW_TERMINATION; }
+	bool& RecordLineFlowStatistics() { return RECORD_LINE_FLOW_STATISTICS; }
+	ICaveData::LineFlowStatistics VertexLineFlowStatistics(size_t iVertex) const;
 	void LoadDistances(const std::string& file);
 	void SaveDistances(const std::string& file) const;
+	bool CalculateDistanceShard(int shard, int shardCount, float exponent = 1.0f);
+	void SaveDistanceShard(const std::string& file, int shard, int shardCount) const;
+	void MergeDistanceShards(const std::vector<std::string>& files, float exponent = 1.0f);
 	void SmoothAndDeriveDistances();
+	void SmoothAndDeriveDistances(const std::vector<size_t>& changedVertices);
 	bool HasUnsmoothedCaveSizes() const { return caveSizeUnsmoothed.size() != 0; };
 	bool HasCaveSizes() const { return caveSizes.size() != 0; }
 
@@ -38,11 +60,17 @@ struct CaveData : public virtual ICaveData, public BoundingBoxAccumulator
 	void ResizeMeshAttributes(size_t vertexCount);
 	void ResizeSkeletonAttributes(size_t vertexCount, size_t edgeCount);	
 
-	const std::vector<int>& AdjacentNodes(size_t skeletonVertex) const { return adjacency[skeletonVertex]; }
+	SkeletonNeighborRange Neighbors(size_t skeletonVertex) const { return adjacency.Neighbors(skeletonVertex); }
 
 	const CurveSkeleton* Skeleton() const { return skeleton; }
 
-	size_t EdgeIdFromVertexPair(size_t v1, size_t v2) const { return vertexPairToEdge.at(std::make_pair(v1, v2)); }
+	size_t EdgeIdFromVertexPair(size_t v1, size_t v2) const
+	{
+		int edge = adjacency.FindEdge(v1, v2);
+		if (edge < 0)
+			throw std::exception("The vertices are not adjacent.");
+		return edge;
+	}
 
 	void IncidentVertices(size_t edgeId, size_t& v1, size_t& v2) const
 	{
@@ -72,25 +100,107 @@ struct CaveData : public virtual ICaveData, public BoundingBoxAccumulator
 	double& CaveScaleKernelFactor() { return CAVE_SCALE_KERNEL_FACTOR; }
 	double& CaveSizeKernelFactor() { return CAVE_SIZE_KERNEL_FACTOR; }
 	double& CaveSizeDerivativeKernelFactor() { return CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR; }
+	size_t& SmoothingOperatorMemoryLimit() { return SMOOTHING_OPERATOR_MEMORY_LIMIT; }
 
 	const std::vector<size_t>& VerticesWithInvalidSize() const { return invalidVertices; }
 
 	void SetVerbose(bool verbose) { this->verbose = verbose; }
 protected:
+	//Buffers that are needed to calculate the cave size of a single vertex. Every thread owns its own workspace.
+	struct DistanceWorkspace
+	{
+		DistanceWorkspace(const RegularUniformSphereSampling& sphereSampling)
+			: rayDistances(sphereSampling.NumberOfSamples()), triangleHints(sphereSampling.NumberOfSamples(), -1)
+		{
+			sphereSampling.PrepareField(sphereDistances);
+			sphereSampling.PrepareField(distanceGradient);
+		}
+
+		std::vector<float> rayDistances;
+		//Per sample direction, the triangle that has been hit by the last ray of this thread. Since the thread processes
+		//neighboring skeleton vertices one after another, this is a good first candidate for the next ray.
+		std::vector<int32_t> triangleHints;
+		TriangleBVH::TraversalStatistics traversalStatistics;
+		//Buffers for adaptive sampling and for tracing subsets of the samples
+		std::vector<char> knownSamples, refinedSamples;
+		std::vector<size_t> raySamples;
+		std::vector<float> rayDirections[3], rayParameters;
+		std::vector<int32_t> rayHints;
+		SphereScalarField sphereDistances;
+		SphereVectorField distanceGradient;
+		CaveSizeCalculatorLineFlow::TCustomData lineFlowCalculatorData;
+		CaveSizeCalculatorVoronoi::TCustomData voronoiCalculatorData;
+		CaveSizeCalculatorVoid::TCustomData voidCalculatorData;
+		//Temporary buffers of a single vertex; reset at the start of every vertex
+		MonotonicArena arena;
+	};
 
 	template <typename TSphereVisualizer = VoidSphereVisualizer>
 	bool CalculateDistancesSingleVertex(int iVert, float exponent = 1.0f);
 
 	template <typename TSphereVisualizer = VoidSphereVisualizer>
-	bool CalculateDistancesSingleVertex(int iVert, float exponent, std::vector<std::vector<double>>& sphereDistances, std::vector<std::vector<Vector>>& distanceGradient);
+	bool CalculateDistancesSingleVertex(int iVert, float exponent, DistanceWorkspace& workspace);
+
+	//Splits the skeleton (or only the given vertices if vertices is not null) into chunks of vertices that are consecutive in a depth-first
+	//traversal. The chunks are ordered by their expected cost of the distance calculation (most expensive first), which is estimated from
+	//the times of the last calculation. Chunk i consists of the vertices order[chunkOffsets[i]] to order[chunkOffsets[i + 1] - 1].
+	void DistanceCalculationChunks(int threads, const std::vector<size_t>* vertices, std::vector<int>& order, std::vector<size_t>& chunkOffsets) const;
+
+	//Calculates the cave sizes of all vertices in the given chunks in parallel. Records the time per vertex and the traversal statistics
+	//and appends the vertices without a valid size to invalid.
+	void CalculateDistancesOfChunks(int threads, const std::vector<int>& order, const std::vector<size_t>& chunkOffsets, float exponent, std::vector<size_t>& invalid);
+
+	//Interpolates the sizes of the vertices in invalidVertices from their valid neighbors.
+	void ReconstructInvalidSizes();
+
+	//Returns if the smoothed and derived measures belong to the current kernel parameters and can be updated incrementally.
+	bool SmoothedDistancesAreCurrent() const;
+
+	//Returns the number of threads to use for parallel loops.
+	int Threads() const;
+
+	//Builds the acceleration structure for the selected ray casting engine if it does not exist yet.
+	void PrepareRayCasting();
+
+	//Switches to the prebuilt sphere sampling of the selected resolution if it is not the current one.
+	void PrepareSphereSampling();
+
+	//Allocates the per-vertex line flow statistics if they are recorded.
+	void PrepareLineFlowStatistics();
+
+	//Sets up the ray distance cache for the current configuration and loads it from file if possible.
+	void PrepareRayDistanceCache();
+
+	//Returns a hash of the mesh, the skeleton, the sampling, and the ray casting engine, which identifies a persisted ray distance cache.
+	uint64_t RayDistanceCacheKey() const;
+
+	//Casts a single ray with the closest-hit BVH in the direction of a sample and returns the distance to the mesh.
+	float CastRay(const Eigen::Vector3f& origin, size_t sample, DistanceWorkspace& workspace) const;
+
+	//Casts rays from origin in the directions of all samples with mask[i] != 0 and stores the distances in workspace.rayDistances.
+	//Returns the number of cast rays.
+	size_t CastRays(const Eigen::Vector3f& origin, const std::vector<char>& mask, DistanceWorkspace& workspace) const;
+
+	//Casts rays for a coarse grid of samples, interpolates all other samples, and casts rays for the samples around extrema and
+	//steep changes of the distance. Stores the distances in workspace.rayDistances and returns the number of cast rays.
+	size_t CastRaysAdaptively(const Eigen::Vector3f& origin, int coarseStride, double refinementSteepness, DistanceWorkspace& workspace) const;
+
+	//Returns the squared distance from p to the mesh along dir using the selected ray casting engine.
+	double SqrDistanceToMesh(const Point& p, const Vector& dir) const;
 
 	//Calculates basic derived data from the stored skeleton, such as adjacency, node radii, etc.
 	void CalculateBasicSkeletonData();
 
-	RegularUniformSphereSampling sphereSampling;
-	typedef CaveSizeCalculatorLineFlow CaveSizeCalculator;
-	std::vector<CaveSizeCalculator::TCustomData> caveSizeCalculatorCustomData;
+	//Builds the smoothing operator if it does not cover the given radius yet and fits into the memory limit. Returns if the operator
+	//covers the radius.
+	bool PrepareSmoothingOperator(double radius);
 
+	//Smoothes source into target like smooth(). maxDeviation is the largest deviation of all vertices; if the smoothing operator covers
+	//its kernel, the operator is applied instead of a Dijkstra search per vertex.
+	void SmoothVertices(std::function<double(int)> smoothDeviation, double maxDeviation, std::vector<double>& source, std::vector<double>& target);
+
+	//Sphere sampling of the current resolution with its gradient operator and extremum search neighborhoods
+	std::shared_ptr<const PrebuiltSphereSampling> sphere;
 	//Cave size for a given skeleton vertex
 	std::vector<double> caveSizes;
 	//Unsmoothed cave size per skeleton vertex as calculated by the size calculator
@@ -115,27 +225,66 @@ protected:
 	//Correspondence of the mesh vertices to skeleton vertices
 	std::vector<unsigned int> meshVertexCorrespondsTo;
 
-	//Adjacency list of the skeleton
-	std::vector<std::vector<int>> adjacency;
-	//Maps a pair of vertices to an edge index for the ...PerEdge vectors
-	std::map<std::pair<size_t, size_t>, size_t> vertexPairToEdge;
+	//Adjacency of the skeleton with the edge index of every neighbor for the ...PerEdge vectors
+	SkeletonAdjacency adjacency;
 	
-	const TriangleList& meshTriangles() const { return _meshTriangles; }	
-	const Tree& meshAABBTree() { return _meshAABBTree; }	
-
 	std::vector<size_t> invalidVertices; //a list of vertices that did not have valid distances before reconstruction
 
+	//Unsmoothed cave sizes and parameters of the last call of SmoothAndDeriveDistances(); empty if the smoothed measures are outdated
+	std::vector<double> smoothedCaveSizeUnsmoothed;
+	ICaveData::Algorithm smoothedCaveScaleAlgorithm;
+	double smoothedKernelFactors[3];
+
+	//Geodesic neighborhoods of all skeleton vertices for smoothing with different kernels
+	SmoothingOperator smoothingOperator;
+	//Smallest radius (and the memory limit) for which the smoothing operator has exceeded the memory limit; it is not built for
+	//larger radii with the same limit again
+	double smoothingOperatorFailedRadius;
+	size_t smoothingOperatorFailedLimit;
+
+	//Chain decomposition of the skeleton for the Max and Advect cave scale algorithms
+	SkeletonChains skeletonChains;
+
 	ICaveData::Algorithm CAVE_SCALE_ALGORITHM;
+	ICaveData::RayCastingEngine RAY_CASTING_ENGINE;
+	ICaveData::CaveSizeCalculatorType CAVE_SIZE_CALCULATOR;
+	ICaveData::RayDistanceCacheMode RAY_DISTANCE_CACHE_MODE;
+	int NUMBER_OF_THREADS;
+	double SPHERE_SAMPLING_QUALITY;
+	int SPHERE_SAMPLING_RESOLUTION;
+	bool RAY_TRAVERSAL_HINTS;
+	ICaveData::LineFlowTermination LINE_FLOW_TERMINATION;
+	bool RECORD_LINE_FLOW_STATISTICS;
 	double CAVE_SCALE_KERNEL_FACTOR; //kernel deviation for calculating cave scale (multiplied by local cave size)
 	double CAVE_SIZE_KERNEL_FACTOR; //kernel deviation for smoothing cave size (multiplied by cave scale)
 	double CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR; //kernel deviation for smoothing cave size derivative (multiplied by cave scale)	
+	size_t SMOOTHING_OPERATOR_MEMORY_LIMIT;
 
 
 	std::vector<Eigen::Vector3f> _meshVertices;
-	TriangleList _meshTriangles;
 	std::vector<IndexedTriangle> _meshTriIndices;
+	TriangleBVH _meshBVH;
+
+	//Double-precision copy of the geometry and CGAL tree for the reference ray casting engine; empty unless this engine is used.
+	TriangleList _meshTriangles;
 	Tree _meshAABBTree;
 
+	//Raw ray distances per skeleton vertex and sample, optionally persisted in rayDistanceCacheFile
+	RayDistanceCache rayDistanceCache;
+	std::string rayDistanceCacheFile;
+	//Sphere sampling quality and ray casting engine with which the cached distances have been calculated
+	double rayDistanceCacheQuality;
+	ICaveData::RayCastingEngine rayDistanceCacheEngine;
+
+	//Exponent of the last CalculateDistanceShard(), which is stored in the shard file
+	float shardExponent;
+
+	ICaveData::DistanceStatistics distanceStatistics;
+	//Time in seconds that the last distance calculation took per skeleton vertex
+	std::vector<double> distanceCalculationSeconds;
+	//Line flow statistics per skeleton vertex; empty unless RECORD_LINE_FLOW_STATISTICS
+	std::vector<ICaveData::LineFlowStatistics> lineFlowStatistics;
+
 	std::wstring outputDirectoryW;
 
 	bool verbose;
@@ -5,8 +5,14 @@
 #include <map>
 #include <set>
 #include <unordered_set>
+#include <stack>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cmath>
 
 #include "IGraph.h"
+#include "SkeletonAdjacency.h"
 
 //Returns the unnormalized value of the Gaussian normal distribution
 extern double gauss(double x, double variance);
@@ -38,7 +44,7 @@ class IDFSHook
 // The methods of the hook object are called during the execution of the search.
 // THook must obey to class IDFSHook
 template <typename THook>
-void graphDFS(THook& hook, const std::vector<CurveSkeleton::Vertex>& vertices, int iVert, const std::vector<std::vector<int>>& adjacency, double searchDistance)
+void graphDFS(THook& hook, const std::vector<CurveSkeleton::Vertex>& vertices, int iVert, const SkeletonAdjacency& adjacency, double searchDistance)
 {
 	//perform depth-first search
 
@@ -57,8 +63,9 @@ void graphDFS(THook& hook, const std::vector<CurveSkeleton::Vertex>& vertices, i
 
 		auto currentP = vertices.at(current.node).position;
 
-		for (int adj : adjacency.at(current.node))
+		for (auto& neighbor : adjacency.Neighbors(current.node))
 		{
+			int adj = neighbor.vertex;
 			double distance = current.distance + (vertices.at(adj).position - currentP).norm();
 			if (distance <= searchDistance && visited.find(adj) == visited.end())
 			{
@@ -91,7 +98,7 @@ private:
 };
 
 template <typename T>
-void findMax(const std::vector<CurveSkeleton::Vertex>& vertices, const std::vector<std::vector<int>>& adjacency, double searchDistance, std::vector<T>& source, std::vector<T>& target)
+void findMax(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, double searchDistance, std::vector<T>& source, std::vector<T>& target)
 {
 	for (int iVert = 0; iVert < vertices.size(); ++iVert)
 	{
@@ -101,8 +108,9 @@ void findMax(const std::vector<CurveSkeleton::Vertex>& vertices, const std::vect
 	}
 }
 
+//SkeletonChains::FindMax() calculates the same result without a search per vertex.
 template <typename T>
-void findMax(const std::vector<CurveSkeleton::Vertex>& vertices, const std::vector<std::vector<int>>& adjacency, std::function<double(int)> searchDistance, std::vector<T>& source, std::vector<T>& target)
+void findMax(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, std::function<double(int)> searchDistance, std::vector<T>& source, std::vector<T>& target)
 {
 	for (int iVert = 0; iVert < vertices.size(); ++iVert)
 	{
@@ -116,12 +124,15 @@ template <typename T>
 class MaxAdvectDFSHook : IDFSHook
 {
 public:
-	MaxAdvectDFSHook(T advectValue, std::vector<T>& target)
-		: advectValue(advectValue), target(target)
+	//If targetMask is given, only the nodes with targetMask[node] != 0 are updated.
+	MaxAdvectDFSHook(T advectValue, std::vector<T>& target, const std::vector<char>* targetMask = nullptr)
+		: advectValue(advectValue), target(target), targetMask(targetMask)
 	{ }
 
 	void processNode(const NodeDistance& node)
 	{
+		if (targetMask && !(*targetMask)[node.node])
+			return;
 		if (target.at(node.node) < advectValue)
 			target.at(node.node) = advectValue;
 	}
@@ -129,10 +140,12 @@ public:
 private:
 	T advectValue;
 	std::vector<T>& target;
+	const std::vector<char>* targetMask;
 };
 
+//SkeletonChains::MaxAdvect() calculates the same result without a search per vertex.
 template <typename T> 
-void maxAdvect(const std::vector<CurveSkeleton::Vertex>& vertices, const std::vector<std::vector<int>>& adjacency, std::function<double(int)> searchDistance, std::vector<T>& source, std::vector<T>& target)
+void maxAdvect(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, std::function<double(int)> searchDistance, std::vector<T>& source, std::vector<T>& target)
 {
 	for (int iVert = 0; iVert < vertices.size(); ++iVert)
 	{
@@ -146,165 +159,412 @@ void maxAdvect(const std::vector<CurveSkeleton::Vertex>& vertices, const std::ve
 	}
 }
 
+//Updates target only for the vertices with targetMask[v] != 0, such that it matches the result of maxAdvect(). sources must contain
+//all vertices whose search distance reaches any of these vertices.
 template <typename T>
-T smoothSingleVertex(const std::vector<CurveSkeleton::Vertex>& vertices, int iVert, const std::vector<std::vector<int>>& adjacency, double smoothDeviation, const std::vector<T>& source)
+void maxAdvect(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, std::function<double(int)> searchDistance, std::vector<T>& source, std::vector<T>& target,
+	const std::vector<size_t>& sources, const std::vector<char>& targetMask)
 {
-	if (smoothDeviation <= 0)
-		return source[iVert];
+	for (int iVert = 0; iVert < vertices.size(); ++iVert)
+	{
+		if (targetMask[iVert])
+			target.at(iVert) = source.at(iVert);
+	}
 
-	double distanceThreshold = 3 * smoothDeviation; //Gaussian is practically 0 after 3 * standardDeviation
+	for (size_t iVert : sources)
+	{
+		MaxAdvectDFSHook<T> hook(source.at(iVert), target, &targetMask);
+		graphDFS(hook, vertices, (int)iVert, adjacency, searchDistance((int)iVert));
+	}
+}
 
-	//perform Dijkstra
-	std::set<NodeDistance> activeNodes;
-	activeNodes.insert({ iVert, 0.0 });
+//Finds all vertices whose geodesic distance to the closest seed is at most searchDistance (multi-source Dijkstra)
+//and stores them in result in the order of increasing distance.
+inline void verticesWithinDistance(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, const std::vector<size_t>& seeds, double searchDistance, std::vector<size_t>& result)
+{
+	result.clear();
 
-	std::map<int, double> minDistances;
-	minDistances[iVert] = 0;
+	std::vector<double> minDistances(vertices.size(), std::numeric_limits<double>::infinity());
+	std::set<NodeDistance> activeNodes;
+	for (size_t seed : seeds)
+	{
+		if (minDistances[seed] == 0)
+			continue;
+		minDistances[seed] = 0;
+		activeNodes.insert({ (int)seed, 0.0 });
+	}
 
-	double smoothVariance = smoothDeviation * smoothDeviation;
-	double sumWeight = 0;
-	T sumValue = 0;
 	while (!activeNodes.empty())
 	{
 		const NodeDistance node = *activeNodes.begin();
 		activeNodes.erase(activeNodes.begin());
-		if (node.distance > distanceThreshold)
+		result.push_back(node.node);
+
+		for (auto& neighbor : adjacency.Neighbors(node.node))
+		{
+			int adjV = neighbor.vertex;
+			double distance = (vertices.at(node.node).position - vertices.at(adjV).position).norm() + node.distance;
+			if (distance <= searchDistance && distance < minDistances[adjV])
+			{
+				if (minDistances[adjV] != std::numeric_limits<double>::infinity())
+					activeNodes.erase({ adjV, minDistances[adjV] });
+				minDistances[adjV] = distance;
+				activeNodes.insert({ adjV, distance });
+			}
+		}
+	}
+}
+
+//Tentative distances and priority queue of a Dijkstra search that keep their memory between searches. The distances are only valid
+//for the nodes whose stamp equals the current generation, such that a new search does not need to clear them. Every thread owns
+//its own workspace.
+struct DijkstraWorkspace
+{
+	DijkstraWorkspace() : generation(0) { }
+
+	std::vector<double> distances;
+	std::vector<unsigned int> stamps;
+	unsigned int generation;
+	//Binary min-heap of the active nodes. Nodes whose distance decreases are inserted again; outdated entries are skipped.
+	std::vector<NodeDistance> heap;
+
+	//Prepares a new search on a graph with the given number of nodes.
+	void Begin(size_t nodeCount)
+	{
+		if (stamps.size() != nodeCount)
+		{
+			distances.resize(nodeCount);
+			stamps.assign(nodeCount, 0);
+			generation = 0;
+		}
+		if (++generation == 0)
+		{
+			//the stamps have wrapped around
+			std::fill(stamps.begin(), stamps.end(), 0);
+			generation = 1;
+		}
+		heap.clear();
+	}
+
+	double Distance(int node) const { return stamps[node] == generation ? distances[node] : std::numeric_limits<double>::infinity(); }
+
+	void Push(int node, double distance)
+	{
+		distances[node] = distance;
+		stamps[node] = generation;
+		heap.emplace_back(node, distance);
+		std::push_heap(heap.begin(), heap.end(), HeapOrder);
+	}
+
+	//Removes the node with the minimum distance (of minimum index among equal distances) from the heap. Returns false if there is none.
+	bool Pop(NodeDistance& node)
+	{
+		while (!heap.empty())
+		{
+			std::pop_heap(heap.begin(), heap.end(), HeapOrder);
+			node = heap.back();
+			heap.pop_back();
+			if (node.distance == distances[node.node])
+				return true;
+		}
+		return false;
+	}
+
+private:
+	static bool HeapOrder(const NodeDistance& lhs, const NodeDistance& rhs) { return rhs < lhs; }
+};
+
+//Visits all vertices whose geodesic distance to iVert is at most searchDistance with visit(const NodeDistance&), in the order of
+//increasing distance (and index among equal distances).
+template <typename TVisitor>
+void dijkstraWithinDistance(const std::vector<CurveSkeleton::Vertex>& vertices, int iVert, const SkeletonAdjacency& adjacency, double searchDistance, DijkstraWorkspace& workspace, TVisitor&& visit)
+{
+	workspace.Begin(vertices.size());
+	workspace.Push(iVert, 0.0);
+
+	NodeDistance node(iVert, 0.0);
+	while (workspace.Pop(node))
+	{
+		if (node.distance > searchDistance)
 			break;
 
-		auto v = source.at(node.node);
+		visit(node);
+
+		auto& nodePosition = vertices[node.node].position;
+		for (auto& neighbor : adjacency.Neighbors(node.node))
+		{
+			int adjV = neighbor.vertex;
+			double distance = (nodePosition - vertices[adjV].position).norm() + node.distance;
+			//nodes beyond the search distance are never visited, so they are not queued
+			if (distance <= searchDistance && distance < workspace.Distance(adjV))
+				workspace.Push(adjV, distance);
+		}
+	}
+}
+
+//Calculates the Gaussian-weighted average of source around iVert with respect to the geodesic distance along the skeleton. The nodes
+//are visited in the order of increasing distance (and index), such that the result does not depend on the workspace's history.
+template <typename T>
+T smoothSingleVertex(const std::vector<CurveSkeleton::Vertex>& vertices, int iVert, const SkeletonAdjacency& adjacency, double smoothDeviation, const std::vector<T>& source, DijkstraWorkspace& workspace)
+{
+	if (smoothDeviation <= 0)
+		return source[iVert];
+
+	double distanceThreshold = 3 * smoothDeviation; //Gaussian is practically 0 after 3 * standardDeviation
+
+	double smoothVariance = smoothDeviation * smoothDeviation;
+	double sumWeight = 0;
+	T sumValue = 0;
+	dijkstraWithinDistance(vertices, iVert, adjacency, distanceThreshold, workspace, [&](const NodeDistance& node)
+	{
+		auto v = source[node.node];
 		if (!std::isnan(v))
 		{
 			double weight = gauss(node.distance, smoothVariance);
 			sumWeight += weight;
 			sumValue += (T)(weight * v);
 		}
-
-		auto& adj = adjacency.at(node.node);
-		for (auto adjV : adj)
-		{
-			auto& v = vertices.at(adjV);
-			double distance = (vertices.at(node.node).position - v.position).norm() + node.distance;
-			auto distanceEntry = minDistances.find(adjV);
-			if (distanceEntry == minDistances.end() || distance < distanceEntry->second)
-			{
-				if(distanceEntry != minDistances.end())
-					activeNodes.erase({ adjV, distanceEntry->second });
-				minDistances[adjV] = distance;
-				activeNodes.insert({ adjV, distance });				
-			}			
-		}		
-	}
+	});
 	return static_cast<T>(sumValue / sumWeight);
 }
 
 template <typename T>
-void smooth(const std::vector<CurveSkeleton::Vertex>& vertices, const std::vector<std::vector<int>>& adjacency, double smoothDeviation, std::vector<T>& source, std::vector<T>& target)
+T smoothSingleVertex(const std::vector<CurveSkeleton::Vertex>& vertices, int iVert, const SkeletonAdjacency& adjacency, double smoothDeviation, const std::vector<T>& source)
 {
-	for (int iVert = 0; iVert < vertices.size(); ++iVert)
-	{
-		target.at(iVert) = smoothSingleVertex(vertices, iVert, adjacency, smoothDeviation, source);
-	}
+	DijkstraWorkspace workspace;
+	return smoothSingleVertex(vertices, iVert, adjacency, smoothDeviation, source, workspace);
 }
 
+//Smoothes source with smoothSingleVertex() for all vertices in parallel. Every vertex is calculated independently, so the result
+//does not depend on the number of threads.
 template <typename T>
-void smooth(const std::vector<CurveSkeleton::Vertex>& vertices, const std::vector<std::vector<int>>& adjacency, std::function<double(int)> smoothDeviation, std::vector<T>& source, std::vector<T>& target)
+void smooth(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, std::function<double(int)> smoothDeviation, std::vector<T>& source, std::vector<T>& target, int threads = 1)
 {
-	for (int iVert = 0; iVert < vertices.size(); ++iVert)
+#pragma omp parallel num_threads(threads)
 	{
-		target.at(iVert) = smoothSingleVertex(vertices, iVert, adjacency, smoothDeviation(iVert), source);
+		DijkstraWorkspace workspace;
+#pragma omp for schedule(dynamic, 64)
+		for (int iVert = 0; iVert < (int)vertices.size(); ++iVert)
+		{
+			target[iVert] = smoothSingleVertex(vertices, iVert, adjacency, smoothDeviation(iVert), source, workspace);
+		}
 	}
 }
 
-struct EdgeOrientationDistance
+template <typename T>
+void smooth(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, double smoothDeviation, std::vector<T>& source, std::vector<T>& target, int threads = 1)
 {
-	EdgeOrientationDistance(size_t edge, double distanceAtBase, bool propagationReversed, bool measureReversed)
-		: edge(edge), distanceAtBase(distanceAtBase), propagationReversed(propagationReversed), measureReversed(measureReversed)
-	{ }
-
-	EdgeOrientationDistance(size_t edge, double distanceAtBase)
-		: edge(edge), distanceAtBase(distanceAtBase)
-	{ }
+	smooth(vertices, adjacency, [smoothDeviation](int) { return smoothDeviation; }, source, target, threads);
+}
 
-	size_t edge;
-	double distanceAtBase;
-	bool propagationReversed;
-	bool measureReversed;
+//Error function, tabulated on [0, 6] in steps of 1/128 and interpolated with cubic Hermite polynomials. The absolute error is
+//below 1e-10. Replaces std::erf in the integrals of the per-edge smoothing.
+class TabulatedErf
+{
+public:
+	TabulatedErf();
 
-	bool operator<(const EdgeOrientationDistance& rhs) const
+	double operator()(double x) const
 	{
-		if (distanceAtBase != rhs.distanceAtBase)
-			return distanceAtBase < rhs.distanceAtBase;
-		return edge < rhs.edge;
+		double a = std::abs(x) * SAMPLES_PER_UNIT;
+		double y = 1;
+		if (a < RANGE * SAMPLES_PER_UNIT)
+		{
+			int i = (int)a;
+			double t = a - i;
+			const double* c = &coefficients[4 * i];
+			y = c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+		}
+		return x < 0 ? -y : y;
 	}
+
+private:
+	static const int SAMPLES_PER_UNIT = 128;
+	static const int RANGE = 6;
+
+	//Polynomial coefficients of every interval in increasing order
+	std::vector<double> coefficients;
 };
 
-extern void addEdgeNeighborsToSet(const EdgeOrientationDistance& eod, double distanceAtTip, const IGraph& graph, std::set<EdgeOrientationDistance>& edgeSet, std::map<size_t, double>& distances);
+extern const TabulatedErf tabulatedErf;
 
-template <typename T, bool DirectionDependentMeasure>
-T smoothSingleEdge(const IGraph& graph, size_t iEdge, double smoothDeviation, const std::vector<T>& source)
+//Dijkstra search of the per-edge smoothing, which keeps its memory between searches. Besides the distance, it records for every
+//vertex whether it has been reached through the first vertex of the smoothed edge (i.e. against its direction) and whether it has
+//been settled. Every thread owns its own workspace.
+struct EdgeSmoothingWorkspace
 {
-	double smoothVariance = smoothDeviation * smoothDeviation;
+	void Begin(size_t vertexCount)
+	{
+		search.Begin(vertexCount);
+		flags.resize(vertexCount);
+	}
 
-	size_t firstV, secondV;
-	graph.IncidentVertices(iEdge, firstV, secondV);	
-	double halfEdgeLength = (graph.VertexPosition(firstV) - graph.VertexPosition(secondV)).norm() / 2;
+	double Distance(int vertex) const { return search.Distance(vertex); }
+	bool Reversed(int vertex) const { return (flags[vertex] & REVERSED) != 0; }
+	bool Settled(int vertex) const { return search.Distance(vertex) != std::numeric_limits<double>::infinity() && (flags[vertex] & SETTLED) != 0; }
 
-	double distanceThreshold = 3 * smoothDeviation; //Gaussian is practically 0 after 3 * standardDeviation
+	void Push(int vertex, double distance, bool reversed)
+	{
+		search.Push(vertex, distance);
+		flags[vertex] = reversed ? REVERSED : 0;
+	}
 
-	//perform Dijkstra
-	std::set<EdgeOrientationDistance> activeEdges;
-	std::map<size_t, double> minDistances;
+	bool Pop(NodeDistance& node)
+	{
+		if (!search.Pop(node))
+			return false;
+		flags[node.node] |= SETTLED;
+		return true;
+	}
 
-	double sumWeight = gaussIntegrate(smoothDeviation, -halfEdgeLength, halfEdgeLength);
-	T sumMeasure = sumWeight * source.at(iEdge);
+	//Per kernel: 1 / (sqrt(2) * standard deviation), cut-off radius, sums, and the error function at the current vertex
+	std::vector<double> scales, radii, sumWeights, sumMeasures, erfAtBase;
 
-	EdgeOrientationDistance initialEdge = { iEdge, 0, false, false };
-	addEdgeNeighborsToSet(initialEdge, halfEdgeLength, graph, activeEdges, minDistances);
-	initialEdge.propagationReversed = true;
-	addEdgeNeighborsToSet(initialEdge, halfEdgeLength, graph, activeEdges, minDistances);
+private:
+	enum : char { REVERSED = 1, SETTLED = 2 };
 
-	while(!activeEdges.empty())
+	DijkstraWorkspace search;
+	//Valid for the vertices that have been reached in the current search
+	std::vector<char> flags;
+};
+
+//Calculates the Gaussian-weighted averages of source around iEdge for kernelCount kernels with the given standard deviations in a
+//single search and stores them in results. Every edge contributes the integral of the Gaussian over its extent, starting at the
+//geodesic distance of its closer vertex from the center of iEdge. Edges whose closer vertex is farther away than 3 standard
+//deviations do not contribute. The vertices are settled in the order of increasing distance (and index), so the result for a
+//kernel is the same as with a search for that kernel alone.
+/// DirectionDependentMeasure: Set to true if the measure T must be inverted if an edge is traversed in its backwards direction.
+template <typename T, bool DirectionDependentMeasure>
+void smoothSingleEdge(const IGraph& graph, size_t iEdge, const double* smoothDeviations, int kernelCount, const std::vector<T>& source, EdgeSmoothingWorkspace& workspace, T* results)
+{
+	size_t firstV, secondV;
+	graph.IncidentVertices(iEdge, firstV, secondV);
+	double halfEdgeLength = (graph.VertexPosition(firstV) - graph.VertexPosition(secondV)).norm() / 2;
+	double center = source[iEdge];
+
+	workspace.scales.resize(kernelCount);
+	workspace.radii.resize(kernelCount);
+	workspace.sumWeights.resize(kernelCount);
+	workspace.sumMeasures.resize(kernelCount);
+	workspace.erfAtBase.resize(kernelCount);
+	double searchDistance = -1;
+	for (int k = 0; k < kernelCount; ++k)
 	{
-		const EdgeOrientationDistance eod = *activeEdges.begin();
-		activeEdges.erase(activeEdges.begin());
-		if (eod.distanceAtBase > distanceThreshold)
+		if (smoothDeviations[k] <= 0)
+		{
+			workspace.radii[k] = -1;
+			continue;
+		}
+		workspace.scales[k] = 1 / (sqrt(2) * smoothDeviations[k]);
+		workspace.radii[k] = 3 * smoothDeviations[k]; //Gaussian is practically 0 after 3 * standardDeviation
+		workspace.sumWeights[k] = 2 * tabulatedErf(halfEdgeLength * workspace.scales[k]);
+		workspace.sumMeasures[k] = workspace.sumWeights[k] * center;
+		searchDistance = std::max(searchDistance, workspace.radii[k]);
+	}
+
+	workspace.Begin(graph.NumberOfVertices());
+	workspace.Push((int)secondV, halfEdgeLength, false);
+	if (firstV != secondV)
+		workspace.Push((int)firstV, halfEdgeLength, true);
+	NodeDistance node((int)secondV, halfEdgeLength);
+	while (workspace.Pop(node))
+	{
+		if (node.distance > searchDistance)
 			break;
 
-		size_t currentV1, currentV2;
-		graph.IncidentVertices(eod.edge, currentV1, currentV2);
+		for (int k = 0; k < kernelCount; ++k)
+			if (node.distance <= workspace.radii[k])
+				workspace.erfAtBase[k] = tabulatedErf(node.distance * workspace.scales[k]);
 
-		double edgeLength = (graph.VertexPosition(currentV1) - graph.VertexPosition(currentV2)).norm();
-		double distanceAtTip = eod.distanceAtBase + edgeLength;
-		double weight = gaussIntegrate(smoothDeviation, eod.distanceAtBase, distanceAtTip);
+		bool reversed = workspace.Reversed(node.node);
+		auto& nodePosition = graph.VertexPosition(node.node);
+		for (auto& neighbor : graph.Neighbors(node.node))
+		{
+			//every edge is accumulated when its closer vertex is settled
+			if (neighbor.edge == (int)iEdge || workspace.Settled(neighbor.vertex))
+				continue;
 
-		sumWeight += weight;
-		double v = source.at(eod.edge);
-		if (DirectionDependentMeasure && eod.measureReversed)
-			v = -v;
-		sumMeasure += static_cast<T>(weight * v);
+			double distanceAtTip = node.distance + (graph.VertexPosition(neighbor.vertex) - nodePosition).norm();
+			double v = source[neighbor.edge];
+			//the edge is traversed away from node.node, i.e. backwards if it points towards node.node
+			if (DirectionDependentMeasure && reversed != (neighbor.direction < 0))
+				v = -v;
+			for (int k = 0; k < kernelCount; ++k)
+			{
+				if (node.distance > workspace.radii[k])
+					continue;
+				double weight = tabulatedErf(distanceAtTip * workspace.scales[k]) - workspace.erfAtBase[k];
+				workspace.sumWeights[k] += weight;
+				workspace.sumMeasures[k] += weight * v;
+			}
 
-		addEdgeNeighborsToSet(eod, distanceAtTip, graph, activeEdges, minDistances);
+			if (distanceAtTip <= searchDistance && distanceAtTip < workspace.Distance(neighbor.vertex))
+				workspace.Push(neighbor.vertex, distanceAtTip, reversed);
+		}
 	}
 
-	return (T)((sumMeasure) / (sumWeight));
+	for (int k = 0; k < kernelCount; ++k)
+		results[k] = workspace.radii[k] < 0 ? source[iEdge] : static_cast<T>(workspace.sumMeasures[k] / workspace.sumWeights[k]);
+}
+
+template <typename T, bool DirectionDependentMeasure>
+T smoothSingleEdge(const IGraph& graph, size_t iEdge, double smoothDeviation, const std::vector<T>& source, EdgeSmoothingWorkspace& workspace)
+{
+	T result;
+	smoothSingleEdge<T, DirectionDependentMeasure>(graph, iEdge, &smoothDeviation, 1, source, workspace, &result);
+	return result;
+}
+
+template <typename T, bool DirectionDependentMeasure>
+T smoothSingleEdge(const IGraph& graph, size_t iEdge, double smoothDeviation, const std::vector<T>& source)
+{
+	EdgeSmoothingWorkspace workspace;
+	return smoothSingleEdge<T, DirectionDependentMeasure>(graph, iEdge, smoothDeviation, source, workspace);
 }
 
+//Smoothes source with smoothSingleEdge() for all edges in parallel. Every edge is calculated independently, so the result does not
+//depend on the number of threads.
 /// DirectionDependentMeasure: Set to true if the measure T must be inverted if an edge is traversed in its backwards direction.
 template <typename T, bool DirectionDependentMeasure>
-void smoothPerEdge(const IGraph& graph, double smoothDeviation, const std::vector<T>& source, std::vector<T>& target)
+void smoothPerEdge(const IGraph& graph, std::function<double(int)> smoothDeviation, const std::vector<T>& source, std::vector<T>& target, int threads = 1)
 {
-	for (int iEdge = 0; iEdge < skeleton->edges.size(); ++iEdge)
+#pragma omp parallel num_threads(threads)
 	{
-		target.at(iEdge) = smoothSingleEdge<T, DirectionDependentMeasure>(graph, iEdge, smoothDeviation, source);
+		EdgeSmoothingWorkspace workspace;
+#pragma omp for schedule(dynamic, 64)
+		for (int iEdge = 0; iEdge < (int)graph.NumberOfEdges(); ++iEdge)
+		{
+			target[iEdge] = smoothSingleEdge<T, DirectionDependentMeasure>(graph, iEdge, smoothDeviation(iEdge), source, workspace);
+		}
 	}
 }
 
 template <typename T, bool DirectionDependentMeasure>
-void smoothPerEdge(const IGraph& graph, std::function<double(int)> smoothDeviation, const std::vector<T>& source, std::vector<T>& target)
+void smoothPerEdge(const IGraph& graph, double smoothDeviation, const std::vector<T>& source, std::vector<T>& target, int threads = 1)
 {
-	for (int iEdge = 0; iEdge < graph.NumberOfEdges(); ++iEdge)
+	smoothPerEdge<T, DirectionDependentMeasure>(graph, [smoothDeviation](int) { return smoothDeviation; }, source, target, threads);
+}
+
+//Smoothes source with several kernels in one search per edge and stores the result of smoothDeviations[k] in targets[k]. The results
+//are the same as with a separate smoothPerEdge() per kernel.
+template <typename T, bool DirectionDependentMeasure>
+void smoothPerEdge(const IGraph& graph, const std::vector<std::function<double(int)>>& smoothDeviations, const std::vector<T>& source, std::vector<std::vector<T>>& targets, int threads = 1)
+{
+	int kernelCount = (int)smoothDeviations.size();
+#pragma omp parallel num_threads(threads)
 	{
-		target.at(iEdge) = smoothSingleEdge<T, DirectionDependentMeasure>(graph, iEdge, smoothDeviation(iEdge), source);
+		EdgeSmoothingWorkspace workspace;
+		std::vector<double> deviations(kernelCount);
+		std::vector<T> results(kernelCount);
+#pragma omp for schedule(dynamic, 64)
+		for (int iEdge = 0; iEdge < (int)graph.NumberOfEdges(); ++iEdge)
+		{
+			for (int k = 0; k < kernelCount; ++k)
+				deviations[k] = smoothDeviations[k](iEdge);
+			smoothSingleEdge<T, DirectionDependentMeasure>(graph, iEdge, deviations.data(), kernelCount, source, workspace, results.data());
+			for (int k = 0; k < kernelCount; ++k)
+				targets[k][iEdge] = results[k];
+		}
 	}
 }
 
@@ -367,23 +627,18 @@ void derivePerEdge(const IGraph& graph, const std::vector<T>& source, std::vecto
 		double distanceIn = 0, distanceOut = 0;
 
 		//iterate neighbors of first vertex
-		auto& inNeighbors = graph.AdjacentNodes(v1);
+		auto inNeighbors = graph.Neighbors(v1);
 		int neighborCount = 0;
-		for (auto neighbor : inNeighbors)
+		for (auto& neighbor : inNeighbors)
 		{
-			if (neighbor == v2)
+			if (neighbor.vertex == v2)
 				continue;
-			auto edgeId = graph.EdgeIdFromVertexPair(neighbor, v1);
-			T measure = source.at(edgeId);
-			if (DirectionDependentMeasure)
-			{
-				size_t incident1, incident2;
-				graph.IncidentVertices(edgeId, incident1, incident2);
-				if (incident1 != neighbor)
-					measure = -measure;
-			}
+			T measure = source[neighbor.edge];
+			//incoming edges must point towards v1
+			if (DirectionDependentMeasure && neighbor.direction > 0)
+				measure = -measure;
 			sumIn += measure;
-			distanceIn += (graph.VertexPosition(neighbor) - graph.VertexPosition(v1)).norm();
+			distanceIn += (graph.VertexPosition(neighbor.vertex) - graph.VertexPosition(v1)).norm();
 			++neighborCount;
 		}
 		if (inNeighbors.size() == 1) //no incoming edges
@@ -398,23 +653,18 @@ void derivePerEdge(const IGraph& graph, const std::vector<T>& source, std::vecto
 		}
 
 		//iterate neighbors of second vertex
-		auto& outNeighbors = graph.AdjacentNodes(v2);
+		auto outNeighbors = graph.Neighbors(v2);
 		neighborCount = 0;
-		for (auto neighbor : outNeighbors)
+		for (auto& neighbor : outNeighbors)
 		{
-			if (neighbor == v1)
+			if (neighbor.vertex == v1)
 				continue;
-			auto edgeId = graph.EdgeIdFromVertexPair(v2, neighbor);
-			T measure = source.at(edgeId);
-			if (DirectionDependentMeasure)
-			{
-				size_t incident1, incident2;
-				graph.IncidentVertices(edgeId, incident1, incident2);
-				if (incident2 != neighbor)
-					measure = -measure;
-			}
+			T measure = source[neighbor.edge];
+			//outgoing edges must point away from v2
+			if (DirectionDependentMeasure && neighbor.direction < 0)
+				measure = -measure;
 			sumOut += measure;
-			distanceOut += (graph.VertexPosition(neighbor) - graph.VertexPosition(v2)).norm();
+			distanceOut += (graph.VertexPosition(neighbor.vertex) - graph.VertexPosition(v2)).norm();
 			++neighborCount;
 		}
 		if (outNeighbors.size() == 1) //no outgoing edges
@@ -448,12 +698,12 @@ void derivePerEdgeFromVertices(CurveSkeleton* skeleton, std::vector<T>& source,
 template <typename TAccessor, typename T>
 bool IsEdgeLocalMaximum(const IGraph& graph, const TAccessor& valueAccessor, int referenceVertex, int excludeNeighbor, T maxValue)
 {
-	for (int neighbor : graph.AdjacentNodes(referenceVertex))
+	for (auto& neighbor : graph.Neighbors(referenceVertex))
 	{
-		if (neighbor == excludeNeighbor)
+		if (neighbor.vertex == excludeNeighbor)
 			continue;
 
-		T neighborEdgeValue = valueAccessor(graph.EdgeIdFromVertexPair(referenceVertex, neighbor));
+		T neighborEdgeValue = valueAccessor(neighbor.edge);
 		if (neighborEdgeValue > maxValue)
 		{
 			return false;
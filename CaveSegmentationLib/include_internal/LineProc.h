@@ -3,13 +3,14 @@
 #include "Options.h"
 
 #include <vector>
-#include <list>
 #include <fstream>
+#include <algorithm>
+#include <limits>
 
+#include "ICaveData.h"
 #include "RegularUniformSphereSampling.h"
 #include "SphereVisualizer.h"
 
-const double MAX_FLOW_DISTANCE = M_PI / 2 / (SPHERE_SAMPLING_RESOLUTION - 1);
 const double LINE_POINT_DISTANCE = 0.1; //geodesic distance
 
 struct PositionGradient
@@ -22,49 +23,122 @@ struct PositionGradient
 	PositionGradient(const Vector& position, const Vector& gradient) : position(position), gradient(gradient) {}
 };
 
-template<bool CIRCULAR, typename T>
-void FindLinkedListNeighbors(std::list<T>& list,
-	const typename std::list<T>::iterator it,
-	const int steps,
-	typename std::list<T>::iterator& prev,
-	typename std::list<T>::iterator& next)
+//Buffers for LineFlow that keep their capacity between calls, such that flow iterations do not allocate memory once the buffers
+//have grown to the longest line. Every thread owns its own workspace.
+struct LineFlowWorkspace
 {
-	prev = it;
-	next = it;
-	for (int i = 0; i < steps; ++i)
+	LineFlowWorkspace() : statistics(nullptr) {}
+
+	ICaveData::LineFlowTermination termination;
+	//If not null, every LineFlow() call adds its work to these statistics
+	ICaveData::LineFlowStatistics* statistics;
+
+	//The resampled line of the current iteration, which is swapped with the line afterwards
+	std::vector<PositionGradient> resampled;
+	//Line point positions and interpolation results as structure of arrays for the batched field interpolation
+	std::vector<double> x, y, z, gx, gy, gz, potentials;
+
+	//Copies the positions of all line points to x, y, z and resizes the other arrays accordingly.
+	void GatherPositions(const std::vector<PositionGradient>& line)
 	{
-		if (prev == list.begin())
+		size_t n = line.size();
+		x.resize(n); y.resize(n); z.resize(n);
+		gx.resize(n); gy.resize(n); gz.resize(n);
+		potentials.resize(n);
+		for (size_t i = 0; i < n; ++i)
 		{
-			if (CIRCULAR)
-			{
-				prev = list.end();
-				--prev;
-			}
+			x[i] = line[i].position.x();
+			y[i] = line[i].position.y();
+			z[i] = line[i].position.z();
 		}
-		else
+	}
+};
+
+//Inserts a point between adjacent points that are farther apart than 1.5 * LINE_POINT_DISTANCE and removes points that are very
+//close to their successor or whose neighbors are close to each other. Points are processed in order and see the insertions and
+//removals before them; an inserted point is processed right after its predecessor. The result is built in buffer, which is then
+//swapped with line.
+template<bool CIRCULAR>
+void ResampleLine(std::vector<PositionGradient>& line, std::vector<PositionGradient>& buffer)
+{
+	std::vector<PositionGradient>& result = buffer;
+	result.clear();
+
+	size_t n = line.size();
+	size_t nextInput = 0;
+	//The point that has been inserted after the last processed point
+	PositionGradient inserted;
+	bool hasInserted = false;
+
+	while (hasInserted || nextInput < n)
+	{
+		PositionGradient current;
+		if (hasInserted)
 		{
-			--prev;
+			current = inserted;
+			hasInserted = false;
 		}
+		else
+			current = line[nextInput++];
+
+		//The remaining points are line[nextInput] to line[n - 1]. The neighbors of the first and last point wrap around on a circular
+		//line and do not exist (i.e. are the point itself) on an open line.
+		bool hasSuccessor = nextInput < n;
+		const PositionGradient* next = hasSuccessor ? &line[nextInput] : (CIRCULAR && !result.empty() ? &result.front() : nullptr);
+		const PositionGradient* prev = !result.empty() ? &result.back() : (CIRCULAR && hasSuccessor ? &line[n - 1] : nullptr);
 
-		++next;
-		if (next == list.end())
+		bool keep = true;
+		if (next)
 		{
-			if (CIRCULAR)
+			double distanceToNext = acos(current.position * next->position);
+			bool insert = distanceToNext > 1.5 * LINE_POINT_DISTANCE;
+			Vector meanPosition;
+			if (insert)
+			{
+				meanPosition = current.position + next->position;
+				meanPosition = meanPosition / sqrt(meanPosition.squared_length());
+			}
+
+			if (prev)
 			{
-				next = list.begin();
+				double distancePrevToNext = acos(prev->position * next->position);
+				keep = !(distanceToNext < 0.25 * LINE_POINT_DISTANCE || distancePrevToNext < 0.5 * LINE_POINT_DISTANCE);
 			}
-			else
+
+			if (insert)
 			{
-				--next;
+				if (hasSuccessor)
+				{
+					inserted = PositionGradient(meanPosition);
+					hasInserted = true;
+				}
+				else
+					result.insert(result.begin(), PositionGradient(meanPosition)); //the successor of the last point is the first one
 			}
 		}
+
+		if (keep)
+			result.push_back(current);
 	}
+
+	line.swap(result);
 }
 
 template<bool CIRCULAR, typename TSphereVisualizer>
-void LineFlow(std::list<PositionGradient>& linePoints, const RegularUniformSphereSampling& sphereSampling, const std::vector<std::vector<double>>& potential, const std::vector<std::vector<Vector>>& potentialGradient, double direction, double& optimalAveragePotential, double& optimalLineLength, TSphereVisualizer& visualizer, const std::wstring& baseFilename)
+void LineFlow(std::vector<PositionGradient>& linePoints, const RegularUniformSphereSampling& sphereSampling, const SphereScalarField& potential, const SphereVectorField& potentialGradient, double direction, double& optimalAveragePotential, double& optimalLineLength, LineFlowWorkspace& workspace, TSphereVisualizer& visualizer, const std::wstring& baseFilename)
 {
-	int stopAfterIterations = 20;
+	//maximum distance that a line point moves per iteration
+	const double maxFlowDistance = sphereSampling.LatitudeSpacing() / 2;
+
+	const ICaveData::LineFlowTermination& termination = workspace.termination;
+	bool checkDisplacement = termination.displacementTolerance > 0;
+	bool checkStationarity = termination.potentialTolerance > 0 || checkDisplacement;
+
+	int stopAfterIterations = termination.patience;
+	int stationaryIterations = 0;
+	int iterations = 0;
+	int optimalIteration = 0;
+	double lastAveragePotential = std::numeric_limits<double>::quiet_NaN();
 	optimalAveragePotential = std::numeric_limits<double>::infinity() * (- direction);
 
 #ifdef WRITE_SPHERE_STATS
@@ -73,142 +147,76 @@ void LineFlow(std::list<PositionGradient>& linePoints, const RegularUniformSpher
 	lineTracingStats << "iteration;averageDistance;maxGradientSquareMagnitude" << std::endl;
 #endif
 
-	for (int iteration = 0; iteration < 400; ++iteration)
+	for (int iteration = 0; iteration < termination.maxIterations; ++iteration)
 	{
 		if (stopAfterIterations == 0)
 			break;
 		--stopAfterIterations;
+		++iterations;
 
 		double maxGradientSquareMagnitude = 0;
 
 		//line flow preparation
-		for (auto it = linePoints.begin(); it != linePoints.end(); ++it)
+		size_t n = linePoints.size();
+		workspace.GatherPositions(linePoints);
+		sphereSampling.InterpolateField(potentialGradient, workspace.x.data(), workspace.y.data(), workspace.z.data(), n, workspace.gx.data(), workspace.gy.data(), workspace.gz.data());
+		for (size_t i = 0; i < n; ++i)
 		{
-			Vector p = it->position;
-
-			double phi, theta;
-			sphereSampling.ParametersFromPoint(p, phi, theta);
-		
-			Vector g = sphereSampling.AccessInterpolatedContainerData(potentialGradient, phi, theta);						
-		
-			if (!CIRCULAR)
-			{
-				std::list<PositionGradient>::iterator prev, next;
-				FindLinkedListNeighbors<CIRCULAR>(linePoints, it, 1, prev, next);
-				if (it == prev || it == next)
-					g = Vector(0, 0, 0); //fix end points
-			}
-
-			it->gradient = g;
-
-			//Previous attempts for orthogonal line movement
-			/*
-			std::list<PositionGradient>::iterator prev, next;
-			FindCircularLinkedListNeighbors(linePoints, it, 3, prev, next);
-
-			Vector lineDir = next->position - prev->position;
-
-			//possible movement direction
-			Vector moveDir = CGAL::cross_product(p, lineDir);
-
-			//project gradient on movement direction
-			double weight = 1 - g * lineDir / sqrt(g.squared_length()) / sqrt(lineDir.squared_length());
-			Vector orthogonalPart = (g * moveDir) / moveDir.squared_length() * moveDir;
-			Vector parallelPart = (g - orthogonalPart);
-			parallelPart = parallelPart - (parallelPart * p) * p;
-			//g = g; // orthogonalPart + 0.1 * parallelPart;
-
-			//allow only movements orthogonal to the line
-			//g = g - (g * lineDir) / lineDir.squared_length() * lineDir;
-
-			//project gradient on sphere
-			//g = g - (g * p) * p;
-			*/
+			Vector g(workspace.gx[i], workspace.gy[i], workspace.gz[i]);
+			if (!CIRCULAR && (i == 0 || i == n - 1))
+				g = Vector(0, 0, 0); //fix end points
+			linePoints[i].gradient = g;
 
 			double l = g.squared_length();
 			if (l > maxGradientSquareMagnitude)
 				maxGradientSquareMagnitude = l;
 		}
 
-		double gradientMultiplier = MAX_FLOW_DISTANCE / sqrt(maxGradientSquareMagnitude);
+		double gradientMultiplier = maxFlowDistance / sqrt(maxGradientSquareMagnitude);
 
+		//displacement perpendicular to the line (the tangent is approximated by the chord between the neighbors)
+		double maxSquaredDisplacement = 0;
+		if (checkDisplacement)
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				size_t prev = i > 0 ? i - 1 : (CIRCULAR ? n - 1 : i);
+				size_t next = i + 1 < n ? i + 1 : (CIRCULAR ? 0 : i);
+				Vector tangent = linePoints[next].position - linePoints[prev].position;
+				Vector displacement = linePoints[i].gradient * gradientMultiplier;
+				double tangentSquaredLength = tangent.squared_length();
+				if (tangentSquaredLength > 0)
+					displacement = displacement - tangent * ((displacement * tangent) / tangentSquaredLength);
+				maxSquaredDisplacement = std::max(maxSquaredDisplacement, displacement.squared_length());
+			}
+		}
 
 		//actual flow
-		for (auto it = linePoints.begin(); it != linePoints.end(); ++it)
+		for (auto& point : linePoints)
 		{
-			Vector p = it->position + it->gradient * gradientMultiplier * direction;
-
-			Vector oldP = p;
-
-			p = p / sqrt(p.squared_length());
-
-			if (abs(p.x() * p.x() + p.y() * p.y() + p.z() * p.z() - 1) > 0.01)
-				std::cout << "Normalization of p failed. Input vector: " << oldP << ", output: " << p << std::endl;
-
-
-			it->position = p;
+			Vector p = point.position + point.gradient * gradientMultiplier * direction;
+			point.position = p / sqrt(p.squared_length());
 		}
 
 		//repair line if necessary
-		for (auto it = linePoints.begin(); it != linePoints.end();)
-		{
-			bool dontIncrement = false;
-
-			Vector p = it->position;
-
-			std::list<PositionGradient>::iterator prev, next;
-			FindLinkedListNeighbors<CIRCULAR>(linePoints, it, 1, prev, next);
-
-			if (next != it) //if this is not the last element
-			{
-				double distanceToNext = acos(it->position * next->position);
-				if (distanceToNext > 1.5 * LINE_POINT_DISTANCE)
-				{
-					Vector meanPosition = it->position + next->position;
-
-					Vector oldMean = meanPosition; //debug
-
-					meanPosition = meanPosition / sqrt(meanPosition.squared_length());
-
-					if (abs(meanPosition.x() * meanPosition.x() + meanPosition.y() * meanPosition.y() + meanPosition.z() * meanPosition.z() - 1) > 0.01)
-						std::cout << "Normalization of mean failed. Input vector: " << oldMean << ", output: " << meanPosition << std::endl;
-
-					linePoints.insert(next, PositionGradient(meanPosition));
-				}
-
-				if (prev != it) //if this is not the first or last element
-				{
-					double distancePrevToNext = acos(prev->position * next->position);
-					if (distanceToNext < 0.25 * LINE_POINT_DISTANCE || distancePrevToNext < 0.5 * LINE_POINT_DISTANCE)
-					{
-						it = linePoints.erase(it);
-						dontIncrement = true;
-					}
-				}
-			}
-
-			if (!dontIncrement)
-				++it;
-		}
+		ResampleLine<CIRCULAR>(linePoints, workspace.resampled);
 
 		//calculate average potential
 		double lineLength = 0;
 		double averagePotential = 0;
 
-		for (auto it = linePoints.begin(); it != linePoints.end(); ++it)
+		n = linePoints.size();
+		workspace.GatherPositions(linePoints);
+		sphereSampling.InterpolateField(potential, workspace.x.data(), workspace.y.data(), workspace.z.data(), n, workspace.potentials.data());
+		for (size_t i = 0; i < n; ++i)
 		{
-			Vector p = it->position;
+			double distance = workspace.potentials[i];
 
-			if (abs(p.squared_length() - 1) > 0.01)
-				std::cout << "Point on line has non-unit length:" << p << std::endl;
+			size_t prev = i > 0 ? i - 1 : (CIRCULAR ? n - 1 : i);
+			size_t next = i + 1 < n ? i + 1 : (CIRCULAR ? 0 : i);
 
-			double distance = sphereSampling.AccessInterpolatedContainerData(potential, p);
-
-			std::list<PositionGradient>::iterator prev, next;
-			FindLinkedListNeighbors<CIRCULAR>(linePoints, it, 1, prev, next);
-
-			double distanceToPrev = acos(std::min(1.0, std::max(-1.0, it->position * prev->position)));
-			double distanceToNext = acos(std::min(1.0, std::max(-1.0, it->position * next->position)));
+			double distanceToPrev = acos(std::min(1.0, std::max(-1.0, linePoints[i].position * linePoints[prev].position)));
+			double distanceToNext = acos(std::min(1.0, std::max(-1.0, linePoints[i].position * linePoints[next].position)));
 			double vertexDiameter = (distanceToPrev + distanceToNext) / 2;
 			lineLength += vertexDiameter;
 			averagePotential = averagePotential + vertexDiameter / lineLength * (distance - averagePotential);
@@ -216,9 +224,21 @@ void LineFlow(std::list<PositionGradient>& linePoints, const RegularUniformSpher
 
 		if (averagePotential * direction > optimalAveragePotential * direction)	//found a local extremum...
 		{
-			stopAfterIterations = 20;				//check 20 more iterations
+			stopAfterIterations = termination.patience;	//check some more iterations
 			optimalAveragePotential = averagePotential;
 			optimalLineLength = lineLength;
+			optimalIteration = iteration;
+		}
+
+		if (checkStationarity)
+		{
+			bool stationary = true;
+			if (termination.potentialTolerance > 0)
+				stationary &= std::abs(averagePotential - lastAveragePotential) <= termination.potentialTolerance * std::abs(averagePotential);
+			if (checkDisplacement)
+				stationary &= sqrt(maxSquaredDisplacement) <= termination.displacementTolerance * maxFlowDistance;
+			stationaryIterations = stationary ? stationaryIterations + 1 : 0;
+			lastAveragePotential = averagePotential;
 		}
 
 #ifdef WRITE_SPHERE_STATS
@@ -226,17 +246,32 @@ void LineFlow(std::list<PositionGradient>& linePoints, const RegularUniformSpher
 #endif
 
 		//draw separate image
-		TSphereVisualizer stateVis(visualizer);				
-		for (auto& p : linePoints)
+		if (TSphereVisualizer::DRAWS)
 		{
-			double phi, theta;
-			sphereSampling.ParametersFromPoint(p.position, phi, theta);
+			TSphereVisualizer stateVis(visualizer);
+			for (auto& p : linePoints)
+			{
+				double phi, theta;
+				sphereSampling.ParametersFromPoint(p.position, phi, theta);
 
-			stateVis.FillCircle(theta, phi, 3, SphereVisualizer::FLOW_OUTLINE_COLOR);
-			stateVis.FillCircle(theta, phi, 2, SphereVisualizer::FLOW_COLOR);
+				stateVis.FillCircle(theta, phi, 3, SphereVisualizer::FLOW_OUTLINE_COLOR);
+				stateVis.FillCircle(theta, phi, 2, SphereVisualizer::FLOW_COLOR);
+			}
+			std::wstring filename = baseFilename + L"_" + std::to_wstring(iteration) + L".png";
+			stateVis.Save(filename);
 		}
-		std::wstring filename = baseFilename + L"_" + std::to_wstring(iteration) + L".png";
-		stateVis.Save(filename);
+
+		if (checkStationarity && stationaryIterations >= termination.stationaryIterations)
+			break;
+	}
+
+	if (workspace.statistics)
+	{
+		++workspace.statistics->lines;
+		workspace.statistics->iterations += iterations;
+		workspace.statistics->iterationsAfterOptimum += iterations - 1 - optimalIteration;
+		if (checkStationarity && stationaryIterations >= termination.stationaryIterations)
+			++workspace.statistics->stationaryLines;
 	}
 
 #ifdef WRITE_SPHERE_STATS
@@ -245,67 +280,28 @@ void LineFlow(std::list<PositionGradient>& linePoints, const RegularUniformSpher
 }
 
 
+//Tables for FindOptimalMeanAverage() that keep their capacity between calls, such that the dynamic program does not allocate memory
+//once the tables have grown to the longest line. Every thread owns its own workspace.
 struct MeanAverageWorkspace
 {
-	struct TableEntry
-	{
-		double accumulatedValue;
-		int predecessor; //sequence last index
-	};
-
-	TableEntry* data;
-	int dataCount;
-	std::vector<std::pair<int, int>> columnBounds; //lower bound inclusive, upper bound exlusive
-
-	MeanAverageWorkspace() : dataCount(0), data(nullptr) {}
-
-	~MeanAverageWorkspace()
-	{
-		if (data)
-			delete[] data;
-	}
+	//Minimum sum of a sequence with row + 1 picks that ends at a sample (infinity if there is none), indexed by row * sampleCount + sample
+	std::vector<double> sums;
+	//Second to last pick of the sequence in sums (-1 for the first pick)
+	std::vector<int> predecessors;
+	//Monotone queue of the samples that can precede the current sample, ordered by sample and by increasing sum
+	std::vector<int> window;
 
 	void Initialize(int sampleCount, int maxSubsetSize)
 	{
-		this->sampleCount = sampleCount;
-		int requiredDataCount = sampleCount * maxSubsetSize;
-		if (dataCount < requiredDataCount)
+		size_t requiredCount = (size_t)sampleCount * maxSubsetSize;
+		if (sums.size() < requiredCount)
 		{
-			if (data)
-				delete[] data;
-			data = new TableEntry[requiredDataCount];
-			dataCount = requiredDataCount;
+			sums.resize(requiredCount);
+			predecessors.resize(requiredCount);
 		}
-		if(!columnBounds.empty())
-			memset(&columnBounds[0], 0, sizeof(std::pair<int, int>) * columnBounds.size()); //reset column bounds
-		columnBounds.resize(sampleCount, std::pair<int, int>(0, 0));
-	}
-
-	TableEntry& Entry(int subsetSize, int sampleIndex)
-	{
-		auto& bounds = columnBounds[sampleIndex];
-		if (subsetSize < bounds.first || bounds.first == 0)
-			bounds.first = subsetSize;
-		if (subsetSize + 1 > bounds.second)
-			bounds.second = subsetSize + 1;
-		return data[sampleIndex + (subsetSize - 1) * sampleCount];
-	}
-
-	bool HasEntry(int subsetSize, int sampleIndex)
-	{
-		auto& bounds = columnBounds[sampleIndex];
-		return subsetSize >= bounds.first && subsetSize < bounds.second;
+		if (window.size() < (size_t)sampleCount)
+			window.resize(sampleCount);
 	}
-
-	void ColumnBounds(int sampleIndex, int& minInclusive, int& maxExclusive)
-	{
-		auto& bounds = columnBounds[sampleIndex];
-		minInclusive = bounds.first;
-		maxExclusive = bounds.second;
-	}
-
-private:
-	int sampleCount;
 };
 
 /*
@@ -319,12 +315,13 @@ private:
 
  T - must have double value and double angle
  line - sorted wrt. angle
+ result - the picked samples in reverse order (R[|R| - 1], ..., R[0]), unchanged if there is no feasible subset
 */
-template <typename T>
-void FindOptimalMeanAverage(const std::vector<T>& line, double minAngularDistance, double maxAngularDistance, MeanAverageWorkspace& workspace, std::vector<int>& result)
+template <typename T, typename TLineAllocator, typename TResultAllocator>
+void FindOptimalMeanAverage(const std::vector<T, TLineAllocator>& line, double minAngularDistance, double maxAngularDistance, MeanAverageWorkspace& workspace, std::vector<int, TResultAllocator>& result)
 {
 	/*
-	This DP algorithm successively calculates the following table:
+	This DP algorithm successively calculates the following table for every first picked sample:
 	
 	k \ idx  |  0  |  1  |  2  | ... | ... | ... |  n
 	---------+-----+-----+-----+-----+-----+-----+-----
@@ -336,81 +333,109 @@ void FindOptimalMeanAverage(const std::vector<T>& line, double minAngularDistanc
 
 	where the entries denote the minimum sum of a sequence with k entries ending at idx.
 	The optimal solution is the entry in the accept-range with the minimum mean (= value / k).
+
+	The possible predecessors of idx are the samples whose angle lies in [angle(idx) - maxAngularDistance, angle(idx) - minAngularDistance].
+	Both bounds increase with idx, so the minimum of row k - 1 over this window is maintained in a monotone queue while sweeping
+	over a row. This takes O(n) per row instead of O(n^2). Among predecessors with equal sums, the first one is chosen, and among
+	entries with equal means, the one that the exhaustive relaxation over (predecessor, idx, k) would have found first.
 	*/
 
 	int n = (int)line.size();
+	int maxSubsetSize = (int)floor(2 * M_PI / minAngularDistance);
+	const double infinity = std::numeric_limits<double>::infinity();
+
+	workspace.Initialize(n, maxSubsetSize);
+	int* window = workspace.window.data();
 
-	double globalOptimalMean = std::numeric_limits<double>::infinity();
+	double globalOptimalMean = infinity;
 
 	for (int firstPickedSample = 0; firstPickedSample < n; ++firstPickedSample)
 	{
-		if (line.at(firstPickedSample).angle - line.at(0).angle > maxAngularDistance)
+		if (line[firstPickedSample].angle - line[0].angle > maxAngularDistance)
 			break;
 
-		workspace.Initialize(n, (int)floor(2 * M_PI / minAngularDistance));
+		double acceptMin = line[firstPickedSample].angle + 2 * M_PI - maxAngularDistance;
+		double acceptMax = line[firstPickedSample].angle + 2 * M_PI - minAngularDistance;
 
-		double acceptMin = line.at(firstPickedSample).angle + 2 * M_PI - maxAngularDistance;
-		double acceptMax = line.at(firstPickedSample).angle + 2 * M_PI - minAngularDistance;
+		//samples from endSample on are too close to the first picked sample (across the wrap-around) to be picked
+		int endSample = firstPickedSample + 1;
+		while (endSample < n && line[endSample].angle <= acceptMax)
+			++endSample;
 
-		double optimalMeanSoFar = std::numeric_limits<double>::infinity();
+		double optimalMeanSoFar = infinity;
 		int optimalMeanIdx = -1;
-		int optimalMeanK = -1;
+		int optimalMeanRow = -1;
+		int optimalMeanPredecessor = -1;
 
 		//Initialize the table
-		auto& initialEntry = workspace.Entry(1, firstPickedSample);
-		initialEntry.accumulatedValue = line.at(firstPickedSample).value;
-		initialEntry.predecessor = -1;
+		workspace.sums[firstPickedSample] = line[firstPickedSample].value;
+		workspace.predecessors[firstPickedSample] = -1;
+		//range of samples with entries in the previous row (entries outside of it are not initialized)
+		int previousBegin = firstPickedSample, previousEnd = firstPickedSample + 1;
 
 		//Start DP
-		for (int currentIdx = firstPickedSample; currentIdx < n; ++currentIdx)
+		for (int row = 1; row < maxSubsetSize; ++row)
 		{
-			//the next sample must be in this range
-			double minNextAngle = line.at(currentIdx).angle + minAngularDistance;
-			double maxNextAngle = std::min(line.at(currentIdx).angle + maxAngularDistance, acceptMax);
+			const double* previousSums = workspace.sums.data() + (row - 1) * n;
+			double* sums = workspace.sums.data() + row * n;
+			int* predecessors = workspace.predecessors.data() + row * n;
+
+			int begin = endSample, end = endSample;
+			int windowBegin = 0, windowEnd = 0;
+			int nextCandidate = previousBegin;
+			for (int idx = previousBegin + 1; idx < endSample; ++idx)
+			{
+				if (windowBegin == windowEnd && nextCandidate == previousEnd)
+					break; //there are no more predecessors
 
-			if (maxNextAngle < minNextAngle)
-				break; //we cannot find a new sample that falls in the accept range
+				double angle = line[idx].angle;
 
-			int kLower, kUpper;
-			workspace.ColumnBounds(currentIdx, kLower, kUpper);
+				//add the samples that are far enough from idx to the window
+				for (; nextCandidate < previousEnd && line[nextCandidate].angle + minAngularDistance <= angle; ++nextCandidate)
+				{
+					double candidateSum = previousSums[nextCandidate];
+					if (candidateSum == infinity)
+						continue;
+					while (windowEnd > windowBegin && previousSums[window[windowEnd - 1]] > candidateSum)
+						--windowEnd;
+					window[windowEnd++] = nextCandidate;
+				}
+				//remove the samples that are too far from idx
+				while (windowBegin < windowEnd && angle > line[window[windowBegin]].angle + maxAngularDistance)
+					++windowBegin;
 
-			for (int searchIdx = currentIdx + 1; searchIdx < n; ++searchIdx)
-			{
-				double angle = line.at(searchIdx).angle;
-				if (angle < minNextAngle)
+				if (windowBegin == windowEnd)
+				{
+					sums[idx] = infinity;
 					continue;
-				if (angle > maxNextAngle)
-					break;
+				}
 
-				double newSampleValue = line.at(searchIdx).value;
+				int predecessor = window[windowBegin];
+				sums[idx] = previousSums[predecessor] + line[idx].value;
+				predecessors[idx] = predecessor;
+				if (begin == endSample)
+					begin = idx;
+				end = idx + 1;
 
-				for (int currentK = kLower; currentK < kUpper; ++currentK)
+				//if we are in the accept range
+				if (angle >= acceptMin)
 				{
-					double newAccumulatedValue = workspace.Entry(currentK, currentIdx).accumulatedValue + newSampleValue;
-					bool overwrite = !workspace.HasEntry(currentK + 1, searchIdx);
-					auto& entry = workspace.Entry(currentK + 1, searchIdx);
-					if (!overwrite)
-						overwrite = newAccumulatedValue < entry.accumulatedValue;
-					if (overwrite)
+					//check if the new mean is better than the current best mean
+					double mean = sums[idx] / (row + 1);
+					if (mean < optimalMeanSoFar || (mean == optimalMeanSoFar && (predecessor < optimalMeanPredecessor
+						|| (predecessor == optimalMeanPredecessor && (idx < optimalMeanIdx || (idx == optimalMeanIdx && row < optimalMeanRow))))))
 					{
-						entry.accumulatedValue = newAccumulatedValue;
-						entry.predecessor = currentIdx;
-
-						//if we are in the accept range
-						if (angle >= acceptMin)
-						{
-							//check if the new mean is better than the current best mean
-							double mean = newAccumulatedValue / (currentK + 1);
-							if (mean < optimalMeanSoFar)
-							{
-								optimalMeanSoFar = mean;
-								optimalMeanIdx = searchIdx;
-								optimalMeanK = currentK + 1;
-							}
-						}
+						optimalMeanSoFar = mean;
+						optimalMeanIdx = idx;
+						optimalMeanRow = row;
+						optimalMeanPredecessor = predecessor;
 					}
 				}
 			}
+			if (begin == endSample)
+				break; //there are no longer sequences
+			previousBegin = begin;
+			previousEnd = end;
 		}
 		if (optimalMeanSoFar < globalOptimalMean)
 		{
@@ -418,8 +443,8 @@ void FindOptimalMeanAverage(const std::vector<T>& line, double minAngularDistanc
 			while (optimalMeanIdx >= 0)
 			{
 				result.push_back(optimalMeanIdx);
-				optimalMeanIdx = workspace.Entry(optimalMeanK, optimalMeanIdx).predecessor;
-				--optimalMeanK;
+				optimalMeanIdx = workspace.predecessors[optimalMeanRow * n + optimalMeanIdx];
+				--optimalMeanRow;
 			}
 			globalOptimalMean = optimalMeanSoFar;
 		}
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include "CGALCommon.h"
+#include "TriangleBVH.h"
 
 #include <CGAL/AABB_tree.h>
 #include <CGAL/AABB_traits.h>
@@ -12,4 +13,9 @@ typedef CGAL::AABB_triangle_primitive<K, Iterator> Primitive;
 typedef CGAL::AABB_traits<K, Primitive> AABB_triangle_traits;
 typedef CGAL::AABB_tree<AABB_triangle_traits> Tree;
 
-double GetSqrDistanceToMesh(const Point& p, const Vector& dir, const Tree& tree);
\ No newline at end of file
+//Returns the squared distance from p to the closest intersection of the ray (p, dir) with the mesh or infinity if there is none.
+//Reference implementation that enumerates all intersections along the ray.
+double GetSqrDistanceToMesh(const Point& p, const Vector& dir, const Tree& tree);
+
+//Same as above but uses a closest-hit traversal of the BVH.
+double GetSqrDistanceToMesh(const Point& p, const Vector& dir, const TriangleBVH& bvh);
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <new>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+//Memory for short-lived buffers that are all released at once, e.g. the temporary buffers of the cave size calculation for a single
+//skeleton vertex. Allocations bump a pointer in the current block; Reset() releases everything. If more than one block has been
+//needed since the last reset, Reset() replaces them by a single block of the total size, such that a thread that processes similar
+//vertices stops allocating from the heap after the first few. Every thread owns its own arena.
+class MonotonicArena
+{
+public:
+	MonotonicArena() : current(nullptr), end(nullptr), capacity(0), upstreamAllocations(0) { }
+
+	void* Allocate(size_t bytes, size_t alignment)
+	{
+		assert(alignment <= alignof(std::max_align_t));
+		char* p = Align(current, alignment);
+		if (p == nullptr || p + bytes > end)
+		{
+			//Grow geometrically, such that the number of blocks per vertex stays small
+			size_t blockSize = capacity;
+			if (blocks.empty())
+				blockSize = INITIAL_BLOCK_SIZE;
+			AddBlock(std::max(blockSize, bytes + alignment));
+			p = Align(current, alignment);
+		}
+		current = p + bytes;
+		return p;
+	}
+
+	//Releases all allocations. Memory that has been allocated from the arena must not be used afterwards.
+	void Reset()
+	{
+		if (blocks.size() > 1)
+		{
+			size_t totalSize = capacity;
+			blocks.clear();
+			capacity = 0;
+			AddBlock(totalSize);
+		}
+		else if (!blocks.empty())
+			current = blocks.front().get();
+	}
+
+	//Returns the number of blocks that have been allocated from the heap since the construction of the arena.
+	size_t UpstreamAllocations() const { return upstreamAllocations; }
+
+	//Returns the total size of all blocks.
+	size_t Capacity() const { return capacity; }
+
+private:
+	static const size_t INITIAL_BLOCK_SIZE = 16 * 1024;
+
+	static char* Align(char* p, size_t alignment)
+	{
+		return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	}
+
+	void AddBlock(size_t size)
+	{
+		blocks.emplace_back(new char[size]);
+		current = blocks.back().get();
+		end = current + size;
+		capacity += size;
+		++upstreamAllocations;
+	}
+
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char* current;
+	char* end;
+	size_t capacity;
+	size_t upstreamAllocations;
+};
+
+//STL allocator that allocates from a MonotonicArena. Deallocation is a no-op; the memory is released with MonotonicArena::Reset().
+//A default-constructed allocator uses the heap, such that containers with this allocator can also be used outside of an arena.
+template <typename T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef ArenaAllocator<U> other;
+	};
+
+	ArenaAllocator() : arena(nullptr) { }
+	ArenaAllocator(MonotonicArena& arena) : arena(&arena) { }
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) { }
+
+	T* allocate(size_t n)
+	{
+		if (arena)
+			return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		if (!arena)
+			::operator delete(p);
+	}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+	MonotonicArena* arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
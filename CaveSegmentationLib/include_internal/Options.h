@@ -23,8 +23,16 @@ const int imWidth = 1280;
 const int imHeight = imWidth / 2;
 #endif
 
-//The resolution of the regular sphere sampling used for cave size calculation
-const int SPHERE_SAMPLING_RESOLUTION = 51;
+//The default resolution (number of latitudes) of the regular sphere sampling used for cave size calculation
+const int DEFAULT_SPHERE_SAMPLING_RESOLUTION = 51;
+//All resolutions that can be selected at runtime (see ICaveData::SphereSamplingResolution())
+const int SPHERE_SAMPLING_RESOLUTIONS[] = { 31, 51, 81 };
+
+//Stride of the coarse grid (in samples along both axes) that is traced first with adaptive sphere sampling
+const int ADAPTIVE_SAMPLING_STRIDE = 4;
+
+//Angular radius of the neighborhood in which a sphere sample must be extreme to be a strong local extremum of the distance field
+const double MAXIMUM_SEARCH_RADIUS = 0.5;
 
 //Minimum angular distance of samples when finding representatives on the ridge line
 const double CIRCLE_SUBSAMPLING_MIN_DISTANCE = M_PI / 3;
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "ICaveData.h"
+
+//Stores the raw ray distances of all sphere samples per skeleton vertex, such that the sphere fields for a different
+//distance exponent can be calculated without ray casting.
+//Memory per skeleton vertex: samples * 4 bytes (Float32) or samples * 2 + 4 bytes (Float16), plus one byte of bookkeeping.
+class RayDistanceCache
+{
+public:
+	RayDistanceCache();
+
+	//Discards all stored distances and prepares the cache for the given number of vertices and samples per vertex.
+	void Reset(ICaveData::RayDistanceCacheMode mode, size_t vertexCount, size_t samplesPerVertex);
+
+	//Copies the stored distances of a vertex to distances. Returns false if there are none.
+	bool Get(size_t vertex, float* distances) const;
+
+	//Stores the distances of a vertex. Different vertices may be stored concurrently.
+	void Store(size_t vertex, const float* distances);
+
+	//Discards the stored distances of a vertex, e.g. because the geometry around it has changed.
+	void Invalidate(size_t vertex);
+
+	ICaveData::RayDistanceCacheMode Mode() const { return mode; }
+	bool IsEnabled() const { return mode != ICaveData::NoRayDistanceCache; }
+
+	//Returns if the cache has been set up for the given configuration.
+	bool Matches(ICaveData::RayDistanceCacheMode mode, size_t vertexCount, size_t samplesPerVertex) const;
+
+	//Reads the cache from a file that has been written with Save() for the same key and configuration. Returns false if the
+	//file does not exist or does not match; the cache is left unchanged in this case.
+	bool Load(const std::string& file, uint64_t key);
+
+	//Writes all stored distances to a file. The key identifies the geometry that the distances belong to.
+	void Save(const std::string& file, uint64_t key);
+
+	//Returns the number of bytes occupied by the stored distances.
+	size_t MemoryUsage() const;
+
+private:
+	ICaveData::RayDistanceCacheMode mode;
+	size_t samplesPerVertex;
+
+	std::vector<float> distances32;
+	std::vector<uint16_t> distances16;
+	//Per-vertex scale for Float16: the maximum distance of a vertex is mapped to 1
+	std::vector<float> scales16;
+	//Per-vertex flag if distances are stored (char instead of bool to allow concurrent writes)
+	std::vector<char> stored;
+};
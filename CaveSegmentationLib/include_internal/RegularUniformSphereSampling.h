@@ -3,6 +3,10 @@
 #include "Options.h"
 
 #include "CGALCommon.h"
+#include "SphereField.h"
+
+#include <cstdint>
+#include <cassert>
 
 //Represents a regular and uniform point sampling of a sphere.
 class RegularUniformSphereSampling
@@ -28,6 +32,10 @@ public:
 
 		void GetParameters(double& phi, double& theta) const;
 		void GetParameterSpaceRect(double& x, double& y, double& w, double& h);
+
+		//Returns the latitude of the sample and its index on this latitude
+		int Ring() const { return iPhi; }
+		int IndexOnRing() const { return iTheta; }
 		
 	private:
 		const RegularUniformSphereSampling* sampling;
@@ -98,6 +106,33 @@ public:
 		double angularDistance;
 	};	
 
+	//Contiguous range of sample indices
+	class index_range
+	{
+	public:
+		index_range(const uint32_t* first, const uint32_t* last) : first(first), last(last) { }
+		const uint32_t* begin() const { return first; }
+		const uint32_t* end() const { return last; }
+		size_t size() const { return last - first; }
+	private:
+		const uint32_t* first;
+		const uint32_t* last;
+	};
+
+	//Neighbors of every sample within a fixed angular distance in compressed sparse row format
+	class range_table
+	{
+	public:
+		//Returns the indices of all samples within the angular distance of the given sample
+		index_range Neighbors(size_t sample) const { return index_range(indices.data() + offsets[sample], indices.data() + offsets[sample + 1]); }
+		double AngularDistance() const { return angularDistance; }
+	private:
+		double angularDistance;
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> indices;
+		friend class RegularUniformSphereSampling;
+	};
+
 	//Iterator for all samples
 	sample_iterator begin() const;
 	sample_iterator end() const;
@@ -111,6 +146,10 @@ public:
 	//Iterator for all samples that are closer than angularDistance to center.
 	range_helper Neighbors(const Vector& center, double angularDistance) const;
 
+	//Collects the samples within angularDistance of every sample, i.e. the samples of Neighbors(Direction(i), angularDistance)
+	//in the same order, such that neighborhood queries with a fixed distance do not need to evaluate the range iterator.
+	range_table RangeNeighborhoods(double angularDistance) const;
+
 	//Returns the area occupied by a given sample
 	double Area(const sample_iterator&) const;
 
@@ -120,78 +159,121 @@ public:
 	//Returns the number of samples along the equator
 	int MaxNTheta() const;
 
-	//Resizes the container to hold values for every sample.
-	// TContainer must be a 2D container with a resize() method, e.g. std::vector<std::vector<DATA>>
-	template<typename TContainer>
-	void PrepareDataContainer(TContainer& container) const
-	{
-		container.resize(nPhi);
-		for (int i = 0; i < nPhi; ++i)
-		{
-			container[i].resize(nTheta[i]);
-		}
-	}
+	//Returns the total number of samples
+	size_t NumberOfSamples() const { return flatDirections[0].size(); }
+
+	//Returns one coordinate (0 = x, 1 = y, 2 = z) of all sample directions in iteration order as a contiguous float array.
+	const std::vector<float>& FlatDirections(int axis) const { return flatDirections[axis]; }
+
+	//Returns the position of a sample in iteration order (i.e. its index in FlatDirections()).
+	size_t SampleIndex(const sample_iterator& it) const { return ringOffsets[it.iPhi] + it.iTheta; }
+
+	//Adaptive sampling works on a coarse grid that consists of every stride-th latitude (plus the last one) and
+	//every stride-th sample on these latitudes. All values are stored per sample in iteration order.
+
+	//Sets mask to 1 for all samples of the coarse grid and to 0 for all others.
+	void MarkCoarseSamples(int stride, std::vector<char>& mask) const;
+
+	//Sets refine to 1 for all samples in the vicinity of coarse samples that are local extrema of values or where values change
+	//by more than relativeSteepness (relative to the value) per coarse grid cell. Other entries are left unchanged.
+	void MarkRefinementSamples(int stride, const std::vector<float>& values, double relativeSteepness, std::vector<char>& refine) const;
+
+	//Interpolates the values of all samples with known[i] == 0 bilinearly from the coarse grid. Samples next to a non-finite coarse
+	//value become infinite.
+	void InterpolateFromCoarseSamples(int stride, const std::vector<char>& known, std::vector<float>& values) const;
 
-	//Accesses a value from a container at a given sample location
-	template<typename TContainer>
-	typename TContainer::value_type::reference AccessContainerData(TContainer& container, sample_iterator it) const
+	//Returns the direction of the sample with the given index
+	const Vector& Direction(size_t sample) const { return samples[sample]; }
+
+	//Returns the indices of all neighbors of a sample (the same samples as Neighbors(sample_iterator), in the same order)
+	index_range NeighborIndices(size_t sample) const
 	{
-		return container[it.iPhi][it.iTheta];
+		return index_range(neighborIndices.data() + neighborOffsets[sample], neighborIndices.data() + neighborOffsets[sample + 1]);
 	}
 
-	//Accesses a value from a container at a given sample location
-	template<typename TContainer>
-	typename TContainer::value_type::const_reference AccessContainerData(const TContainer& container, sample_iterator it) const
+	//Returns the position of the first neighbor of a sample in the concatenation of all neighbor lists, such that
+	//per-neighbor data can be stored alongside the neighbor lists
+	size_t NeighborOffset(size_t sample) const { return neighborOffsets[sample]; }
+
+	//Returns the total length of all neighbor lists
+	size_t NumberOfNeighborEntries() const { return neighborIndices.size(); }
+
+	//Returns the number of latitudes
+	int RingCount() const { return nPhi; }
+
+	//Returns the angular distance between adjacent latitudes
+	double LatitudeSpacing() const { return M_PI / (nPhi - 1); }
+
+	//Returns the number of samples on a latitude
+	int RingSize(int ring) const { return nTheta[ring]; }
+
+	//Returns the index of the first sample of a latitude
+	size_t RingOffset(int ring) const { return ringOffsets[ring]; }
+
+	//Returns the latitude of the sample with the given index
+	int Ring(size_t sample) const { return sampleRings[sample]; }
+
+	//Returns the area occupied by the sample with the given index
+	double Area(size_t sample) const { return areaElements[sampleRings[sample]]; }
+
+	//Returns the rectangle in parameter space that is occupied by the sample with the given index
+	void GetParameterSpaceRect(size_t sample, double& x, double& y, double& w, double& h) const;
+
+	//Resizes the field to hold values for every sample.
+	template<typename TField>
+	void PrepareField(TField& field) const
 	{
-		return container[it.iPhi][it.iTheta];
+		field.Resize(NumberOfSamples());
 	}
 
-	//Interpolates a value from a container at a given position on the sphere
-	template<typename TContainer, typename T = TContainer::value_type::value_type>
-	const T AccessInterpolatedContainerData(const TContainer& container, double phi, double theta) const
+	//Interpolates a value from a field at a given position on the sphere
+	template<typename TField, typename T = typename TField::value_type>
+	const T InterpolateField(const TField& field, double phi, double theta) const
 	{
 
 		double phiSlice = M_PI / (nPhi - 1);
 		double iPhi = (phi / phiSlice);
 		int lowerPhi = (int)floor(iPhi);
 		int upperPhi = (int)ceil(iPhi);
-		
-		if (lowerPhi < 0 || std::isnan(iPhi) || upperPhi >= nPhi)
-			std::cout << "Phi " << phi << " resulted in iPhi = " << iPhi << ", lowerPhi = " << lowerPhi << ", upperPhi = " << upperPhi << ", with phiSlice = " << phiSlice << ", nPhi = " << nPhi;
+		assert(lowerPhi >= 0 && upperPhi < nPhi);
 
-		double lowerThetaSlice = 2 * M_PI / nTheta[lowerPhi];
+		size_t lowerOffset = ringOffsets[lowerPhi];
+		int lowerNTheta = nTheta[lowerPhi];
+		double lowerThetaSlice = 2 * M_PI / lowerNTheta;
 		double iLowerTheta = (theta / lowerThetaSlice);
 		int lowerLeftTheta = (int)floor(iLowerTheta);
 		int lowerRightTheta = (int)ceil(iLowerTheta);
 
-		if (lowerLeftTheta >= nTheta[lowerPhi])
+		if (lowerLeftTheta >= lowerNTheta)
 		{
-			iLowerTheta -= nTheta[lowerPhi];
-			lowerLeftTheta -= nTheta[lowerPhi];
-			lowerRightTheta -= nTheta[lowerPhi];
+			iLowerTheta -= lowerNTheta;
+			lowerLeftTheta -= lowerNTheta;
+			lowerRightTheta -= lowerNTheta;
 		}
 
 		//No interpolation required
 		if(lowerPhi == upperPhi && lowerLeftTheta == lowerRightTheta)
-			return container[lowerPhi][lowerLeftTheta];
+			return field[lowerOffset + lowerLeftTheta];
 
 		//Interpolation along the theta-axis
 		if (lowerPhi == upperPhi)
 		{
 			double alpha = (iLowerTheta - lowerLeftTheta);
-			return (1 - alpha ) * container[lowerPhi][lowerLeftTheta] + alpha * container[lowerPhi][lowerRightTheta % nTheta[lowerPhi]];
+			return (1 - alpha ) * field[lowerOffset + lowerLeftTheta] + alpha * field[lowerOffset + lowerRightTheta % lowerNTheta];
 		}
 
-		double upperThetaSlice = 2 * M_PI / nTheta[upperPhi];
+		size_t upperOffset = ringOffsets[upperPhi];
+		int upperNTheta = nTheta[upperPhi];
+		double upperThetaSlice = 2 * M_PI / upperNTheta;
 		double iUpperTheta = (theta / upperThetaSlice);
 		int upperLeftTheta = (int)floor(iUpperTheta);
 		int upperRightTheta = (int)ceil(iUpperTheta);		
 
-		if (upperLeftTheta >= nTheta[upperPhi])
+		if (upperLeftTheta >= upperNTheta)
 		{
-			iUpperTheta -= nTheta[upperPhi];
-			upperLeftTheta -= nTheta[upperPhi];
-			upperRightTheta -= nTheta[upperPhi];
+			iUpperTheta -= upperNTheta;
+			upperLeftTheta -= upperNTheta;
+			upperRightTheta -= upperNTheta;
 		}
 
 		T interpolLower, interpolUpper;
@@ -199,22 +281,22 @@ public:
 		//Interpolation along the phi-axis
 		if (lowerLeftTheta == lowerRightTheta)
 		{
-			interpolLower = container[lowerPhi][lowerLeftTheta];
+			interpolLower = field[lowerOffset + lowerLeftTheta];
 		}
 		else
 		{
 			double alphaLowerTheta = (iLowerTheta - lowerLeftTheta);
-			interpolLower = (1 - alphaLowerTheta) * container[lowerPhi][lowerLeftTheta] + alphaLowerTheta * container[lowerPhi][lowerRightTheta % nTheta[lowerPhi]];
+			interpolLower = (1 - alphaLowerTheta) * field[lowerOffset + lowerLeftTheta] + alphaLowerTheta * field[lowerOffset + lowerRightTheta % lowerNTheta];
 		}
 
 		if (upperLeftTheta == upperRightTheta)
 		{
-			interpolUpper = container[upperPhi][upperLeftTheta];
+			interpolUpper = field[upperOffset + upperLeftTheta];
 		}
 		else
 		{
 			double alphaUpperTheta = (iUpperTheta - upperLeftTheta);
-			interpolUpper = (1 - alphaUpperTheta) * container[upperPhi][upperLeftTheta] + alphaUpperTheta * container[upperPhi][upperRightTheta % nTheta[upperPhi]];
+			interpolUpper = (1 - alphaUpperTheta) * field[upperOffset + upperLeftTheta] + alphaUpperTheta * field[upperOffset + upperRightTheta % upperNTheta];
 		}
 
 		//Bilinear interpolation
@@ -222,26 +304,32 @@ public:
 		return (1 - alphaPhi) * interpolLower + alphaPhi * interpolUpper;
 	}
 
-	//Interpolates a value from a container at a given position on the sphere
-	template<typename TContainer, typename T = TContainer::value_type::value_type>
-	const T AccessInterpolatedContainerData(const TContainer& container, const Vector& p) const
+	//Interpolates a value from a field at a given position on the sphere
+	template<typename TField, typename T = typename TField::value_type>
+	const T InterpolateField(const TField& field, const Vector& p) const
 	{
-		if (abs(p.squared_length() - 1) > 0.01)
-			std::cout << "Point for container access has non-unit length:" << p << std::endl;
-
 		double phi, theta;
 		ParametersFromPoint(p, phi, theta);
-		if (phi < 0 ||std::isnan(phi))
-			std::cout << "Vector " << p << " resulted in phi = " << phi;
-		return AccessInterpolatedContainerData<TContainer, T>(container, phi, theta);
+		return InterpolateField<TField, T>(field, phi, theta);
 	}
+
+	//Interpolates a field at count unit vectors given as structure of arrays (x, y, z). Equivalent to calling
+	//InterpolateField(field, p) for every point but replaces acos/atan2 by polynomial approximations and the
+	//divisions by precomputed per-latitude factors. The angles deviate by at most 2.5e-8 from the exact ones, hence
+	//the interpolation weights by at most 2.5e-8 * max((nPhi - 1) / pi, MaxNTheta() / (2 pi)) (< 7e-7 for nPhi = 81)
+	//and the result by at most twice that times the largest difference of adjacent samples in the field.
+	void InterpolateField(const SphereScalarField& field, const double* x, const double* y, const double* z, size_t count, double* values) const;
+
+	//Interpolates a vector field at count unit vectors. The components of the results are stored in vx, vy, vz.
+	//Same accuracy as the scalar version.
+	void InterpolateField(const SphereVectorField& field, const double* x, const double* y, const double* z, size_t count, double* vx, double* vy, double* vz) const;
 	
 private:
 	//Number latitudes
 	const int nPhi;
 
-	//The actual samples
-	std::vector < std::vector< Vector> > directionSamples;
+	//The actual samples in iteration order
+	std::vector<Vector> samples;
 
 	//Number of samples for every latitude
 	std::vector<int> nTheta;
@@ -251,6 +339,39 @@ private:
 
 	int _maxNTheta;
 
+	//Index of the first sample of every latitude in iteration order
+	std::vector<size_t> ringOffsets;
+
+	//Factors that map phi to the latitude index and theta to the sample index on a latitude, i.e. (nPhi - 1) / pi and nTheta / (2 pi)
+	double phiToRing;
+	std::vector<double> thetaToIndex;
+
+	//Interpolation stencils of a block of points: the four samples that surround every point and their bilinear weights
+	struct interpolation_stencils;
+
+	//Calculates the interpolation stencils for count <= INTERPOLATION_BLOCK_SIZE points.
+	void CalculateInterpolationStencils(const double* x, const double* y, const double* z, size_t count, interpolation_stencils& stencils) const;
+
+	//Returns if a latitude belongs to the coarse grid with the given stride.
+	bool IsCoarseRing(int iPhi, int stride) const { return iPhi % stride == 0 || iPhi == nPhi - 1; }
+
+	//Returns the distance between two coarse samples on a latitude.
+	int CoarseThetaStride(int iPhi, int stride) const { return std::min(stride, nTheta[iPhi]); }
+
+	//Interpolates linearly between the coarse samples of a coarse latitude. Returns infinity if one of them is not finite.
+	float InterpolateCoarseRing(int iPhi, int stride, double theta, const std::vector<float>& values) const;
+
+	//Sample directions in iteration order as structure of arrays
+	std::vector<float> flatDirections[3];
+
+	//Latitude of every sample
+	std::vector<int> sampleRings;
+
+	//Neighbors of all samples in compressed sparse row format: the neighbors of sample i are
+	//neighborIndices[neighborOffsets[i]] to neighborIndices[neighborOffsets[i + 1] - 1]
+	std::vector<uint32_t> neighborOffsets;
+	std::vector<uint32_t> neighborIndices;
+
 	friend class sample_iterator;
 };
 
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CAVESEG_SIMD_AVX2
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CAVESEG_SIMD_SSE
+#endif
+
+//Thin wrappers around SIMD registers of floats. All wrappers offer the same static interface,
+//such that algorithms can be written once as templates and instantiated for every instruction set.
+//Masks are represented as registers of the same type (all bits set for true lanes).
+
+//Scalar fallback with a single lane.
+struct ScalarLanes
+{
+	static const int Width = 1;
+	typedef float Float;
+	typedef float Mask;
+
+	static Float Set(float x) { return x; }
+	static Float Load(const float* p) { return *p; }
+	static void Store(float* p, Float x) { *p = x; }
+
+	static Float Add(Float a, Float b) { return a + b; }
+	static Float Sub(Float a, Float b) { return a - b; }
+	static Float Mul(Float a, Float b) { return a * b; }
+	static Float Div(Float a, Float b) { return a / b; }
+	static Float Min(Float a, Float b) { return a < b ? a : b; }
+	static Float Max(Float a, Float b) { return a > b ? a : b; }
+
+	static Mask Less(Float a, Float b) { return a < b ? 1.0f : 0.0f; }
+	static Mask LessEqual(Float a, Float b) { return a <= b ? 1.0f : 0.0f; }
+	static Mask GreaterEqual(Float a, Float b) { return a >= b ? 1.0f : 0.0f; }
+	static Mask NotEqual(Float a, Float b) { return a != b ? 1.0f : 0.0f; }
+	static Mask And(Mask a, Mask b) { return a != 0 && b != 0 ? 1.0f : 0.0f; }
+
+	//Returns a where the mask is set and b otherwise.
+	static Float Select(Mask m, Float a, Float b) { return m != 0 ? a : b; }
+	//Returns a bit field with one bit per lane.
+	static int MoveMask(Mask m) { return m != 0 ? 1 : 0; }
+};
+
+#ifdef CAVESEG_SIMD_SSE
+//Four lanes with SSE2.
+struct SSELanes
+{
+	static const int Width = 4;
+	typedef __m128 Float;
+	typedef __m128 Mask;
+
+	static Float Set(float x) { return _mm_set1_ps(x); }
+	static Float Load(const float* p) { return _mm_loadu_ps(p); }
+	static void Store(float* p, Float x) { _mm_storeu_ps(p, x); }
+
+	static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+	static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+	static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+	static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+
+	static Mask Less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+	static Mask LessEqual(Float a, Float b) { return _mm_cmple_ps(a, b); }
+	static Mask GreaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+	static Mask NotEqual(Float a, Float b) { return _mm_cmpneq_ps(a, b); }
+	static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+
+	static Float Select(Mask m, Float a, Float b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	static int MoveMask(Mask m) { return _mm_movemask_ps(m); }
+};
+#endif
+
+#ifdef CAVESEG_SIMD_AVX2
+//Eight lanes with AVX2.
+struct AVXLanes
+{
+	static const int Width = 8;
+	typedef __m256 Float;
+	typedef __m256 Mask;
+
+	static Float Set(float x) { return _mm256_set1_ps(x); }
+	static Float Load(const float* p) { return _mm256_loadu_ps(p); }
+	static void Store(float* p, Float x) { _mm256_storeu_ps(p, x); }
+
+	static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+	static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+	static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+
+	static Mask Less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static Mask LessEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static Mask GreaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	static Mask NotEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_OQ); }
+	static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+
+	static Float Select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b, a, m); }
+	static int MoveMask(Mask m) { return _mm256_movemask_ps(m); }
+};
+#endif
+
+//Widest lanes that are available with the current compiler settings.
+#if defined(CAVESEG_SIMD_AVX2)
+typedef AVXLanes NativeLanes;
+#elif defined(CAVESEG_SIMD_SSE)
+typedef SSELanes NativeLanes;
+#else
+typedef ScalarLanes NativeLanes;
+#endif
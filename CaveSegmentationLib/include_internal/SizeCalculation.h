@@ -8,99 +8,131 @@
 #include "RegularUniformSphereSampling.h"
 #include "SphereVisualizer.h"
 #include "LineProc.h"
+#include "SphereProc.h"
 
 #include <queue>
 #include <omp.h>
 
 #define DIFFERENT_SIGN(e1, e2) (((e1) > 0) != ((e2) > 0))
 
-struct PositionValue
-{
-	Vector position;
-	double value;
-};
-
 struct Empty
 {
 
 };
 
-//Calculates the cave size by averaging the spherical radius over the Voronoi diagram defined by the minima of the radius field.
+//Specifies if the debug output of a vertex (images, statistics) is written, i.e. if it is worth building its file names
+template <typename TSphereVisualizer>
+bool WritesDebugOutput()
+{
+#ifdef WRITE_SPHERE_STATS
+	return true;
+#else
+	return TSphereVisualizer::DRAWS;
+#endif
+}
+
+//Calculates the cave size by averaging the spherical radius over the Voronoi diagram defined by the maxima of the radius field.
 class CaveSizeCalculatorVoronoi
 {
-	struct CellCenter
+public:
+	//Buffers that are re-used for all vertices of a thread
+	struct TCustomData
 	{
-		Vector location;
-		double distance;
+		TCustomData() : sampling(nullptr) {}
 
-		CellCenter(Vector location, double distance) : location(location), distance(distance) {}
-		bool operator<(const CellCenter& other) const { return distance < other.distance; }
-	};
+		//The sampling for which the corners have been calculated
+		const RegularUniformSphereSampling* sampling;
+		//Per sample, the directions to the corners (phi, theta), (phi + wPhi, theta), (phi + wPhi, theta + wTheta), (phi, theta + wTheta)
+		//of its parameter space rectangle
+		std::vector<Vector> corners;
+		//Per sample, the normal of the bisector plane between its two nearest maxima
+		std::vector<Vector> bisectorNormals;
 
-public:
-	typedef Empty TCustomData;
+		void PrepareCorners(const RegularUniformSphereSampling& sphereSampling)
+		{
+			if (sampling == &sphereSampling)
+				return;
+			sampling = &sphereSampling;
+			corners.resize(4 * sphereSampling.NumberOfSamples());
+			for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+			{
+				double theta, phi, wTheta, wPhi;
+				sphereSampling.GetParameterSpaceRect(iSample, theta, phi, wTheta, wPhi);
+				corners[4 * iSample + 0] = Vector(sin(phi) * sin(theta), sin(phi) * cos(theta), cos(phi));
+				corners[4 * iSample + 1] = Vector(sin(phi + wPhi) * sin(theta), sin(phi + wPhi) * cos(theta), cos(phi + wPhi));
+				corners[4 * iSample + 2] = Vector(sin(phi + wPhi) * sin(theta + wTheta), sin(phi + wPhi) * cos(theta + wTheta), cos(phi + wPhi));
+				corners[4 * iSample + 3] = Vector(sin(phi) * sin(theta + wTheta), sin(phi) * cos(theta + wTheta), cos(phi));
+			}
+		}
+	};
 
-	template <typename TSphereVisualizer>
-	static double CalculateDistance(const RegularUniformSphereSampling& sphereSampling,
-		const std::vector<std::vector<double>>& sphereDistances,
-		const std::vector<std::vector<Vector>>& distanceGradient,
-		const std::vector<PositionValue>& sphereDistanceMaxima,
-		const std::vector<PositionValue>& sphereDistanceMinima,
-		TSphereVisualizer& visualizer,
-		int iVert, TCustomData& customData)
+	//Assigns the two nearest maxima to every sample and stores the normal of the plane that bisects them (the direction of the only
+	//maximum if there is a single one, zero if there is none). Of two equally near maxima, the later one counts as the nearer one.
+	static void CalculateBisectorNormals(const RegularUniformSphereSampling& sphereSampling, const ArenaVector<PositionValue>& sphereDistanceMaxima, std::vector<Vector>& bisectorNormals)
 	{
-		double voronoiEdgeArea = 0.0;
-		double voronoiDistance = 0.0;
-		for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
+		bisectorNormals.resize(sphereSampling.NumberOfSamples());
+		size_t maximaCount = sphereDistanceMaxima.size();
+		for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
 		{
-			std::priority_queue<CellCenter> nearestNeighbors;
-			for (auto& clusterCenter : sphereDistanceMaxima)
+			const Vector& sample = sphereSampling.Direction(iSample);
+			int nearest = -1, secondNearest = -1;
+			double nearestDistance = std::numeric_limits<double>::infinity(), secondNearestDistance = nearestDistance;
+			for (size_t iMaximum = 0; iMaximum < maximaCount; ++iMaximum)
 			{
-				double distance = 1 - clusterCenter.position * *it;
-				if (nearestNeighbors.size() < 2)
-					nearestNeighbors.push(CellCenter(clusterCenter.position, distance));
-				else
+				double distance = 1 - sphereDistanceMaxima[iMaximum].position * sample;
+				if (distance <= nearestDistance)
 				{
-					if (distance < nearestNeighbors.top().distance)
-					{
-						nearestNeighbors.pop();
-						nearestNeighbors.push(CellCenter(clusterCenter.position, distance));
-					}
+					secondNearest = nearest;
+					secondNearestDistance = nearestDistance;
+					nearest = (int)iMaximum;
+					nearestDistance = distance;
+				}
+				else if (distance < secondNearestDistance || secondNearest == -1)
+				{
+					secondNearest = (int)iMaximum;
+					secondNearestDistance = distance;
 				}
 			}
-			Vector planeNormal = nearestNeighbors.top().location;
-			nearestNeighbors.pop();
-			if (nearestNeighbors.size() > 0)
-				planeNormal = planeNormal - nearestNeighbors.top().location;
-
-			double theta, phi, wTheta, wPhi;
-			it.GetParameterSpaceRect(theta, phi, wTheta, wPhi);
+			if (nearest == -1)
+				bisectorNormals[iSample] = Vector(0, 0, 0);
+			else if (secondNearest == -1)
+				bisectorNormals[iSample] = sphereDistanceMaxima[nearest].position;
+			else
+				bisectorNormals[iSample] = sphereDistanceMaxima[secondNearest].position - sphereDistanceMaxima[nearest].position;
+		}
+	}
 
-			bool isOnVoronoiEdge = false;
+	template <typename TSphereVisualizer>
+	static double CalculateDistance(const RegularUniformSphereSampling& sphereSampling,
+		const SphereScalarField& sphereDistances,
+		const SphereVectorField& distanceGradient,
+		const ArenaVector<PositionValue>& sphereDistanceMaxima,
+		const ArenaVector<PositionValue>& sphereDistanceMinima,
+		TSphereVisualizer& visualizer,
+		int iVert, MonotonicArena& arena, TCustomData& workspace)
+	{
+		workspace.PrepareCorners(sphereSampling);
+		CalculateBisectorNormals(sphereSampling, sphereDistanceMaxima, workspace.bisectorNormals);
 
-			Vector r1(sin(phi) * sin(theta), sin(phi) * cos(theta), cos(phi));
-			Vector r2(sin(phi + wPhi) * sin(theta), sin(phi + wPhi) * cos(theta), cos(phi + wPhi));
-			if (DIFFERENT_SIGN(r1 * planeNormal, r2 * planeNormal))
-				isOnVoronoiEdge = true;
-			else
+		//A sample lies on a Voronoi edge if the bisector plane of its two nearest maxima passes through its rectangle
+		double voronoiEdgeArea = 0.0;
+		double voronoiDistance = 0.0;
+		for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+		{
+			const Vector& planeNormal = workspace.bisectorNormals[iSample];
+			const Vector* corners = &workspace.corners[4 * iSample];
+			double d1 = corners[0] * planeNormal;
+			if (DIFFERENT_SIGN(d1, corners[1] * planeNormal) || DIFFERENT_SIGN(d1, corners[2] * planeNormal) || DIFFERENT_SIGN(d1, corners[3] * planeNormal))
 			{
-				Vector r3(sin(phi + wPhi) * sin(theta + wTheta), sin(phi + wPhi) * cos(theta + wTheta), cos(phi + wPhi));
-				if (DIFFERENT_SIGN(r1 * planeNormal, r3 * planeNormal))
-					isOnVoronoiEdge = true;
-				else
+				if (TSphereVisualizer::DRAWS)
 				{
-					Vector r4(sin(phi) * sin(theta + wTheta), sin(phi) * cos(theta + wTheta), cos(phi));
-					if (DIFFERENT_SIGN(r1 * planeNormal, r4 * planeNormal))
-						isOnVoronoiEdge = true;
+					double theta, phi, wTheta, wPhi;
+					sphereSampling.GetParameterSpaceRect(iSample, theta, phi, wTheta, wPhi);
+					visualizer.DrawRect(theta, phi, wTheta, wPhi, SphereVisualizer::VORONOI_COLOR);
 				}
-			}
-
-			if (isOnVoronoiEdge)
-			{
-				visualizer.DrawRect(theta, phi, wTheta, wPhi, SphereVisualizer::VORONOI_COLOR);
 
-				double area = (double)sphereSampling.Area(it);
-				voronoiDistance += area * sphereSampling.AccessContainerData(sphereDistances, it);
+				double area = sphereSampling.Area(iSample);
+				voronoiDistance += area * sphereDistances[iSample];
 				voronoiEdgeArea += area;
 			}
 		}
@@ -109,19 +141,26 @@ public:
 };
 
 //Calculates the cave size by averaging the spherical radius field over a path network defined through line flow.
+//The temporary buffers of a vertex are allocated from the arena.
 class CaveSizeCalculatorLineFlow 
 {
 public:
-	typedef MeanAverageWorkspace TCustomData;
+	//Buffers that are re-used for all vertices of a thread
+	struct TCustomData
+	{
+		MeanAverageWorkspace meanAverage;
+		LineFlowWorkspace lineFlow;
+		std::vector<PositionGradient> separatingCircle, minimaLine;
+	};
 
 	template <typename TSphereVisualizer>
 	static double CalculateDistance(const RegularUniformSphereSampling& sphereSampling,
-		const std::vector<std::vector<double>>& sphereDistances,
-		const std::vector<std::vector<Vector>>& distanceGradient,
-		const std::vector<PositionValue>& sphereDistanceMaxima,
-		const std::vector<PositionValue>& sphereDistanceMinima,
+		const SphereScalarField& sphereDistances,
+		const SphereVectorField& distanceGradient,
+		const ArenaVector<PositionValue>& sphereDistanceMaxima,
+		const ArenaVector<PositionValue>& sphereDistanceMinima,
 		TSphereVisualizer& visualizer,
-		int iVert, TCustomData& workspace)
+		int iVert, MonotonicArena& arena, TCustomData& workspace)
 	{
 		const int SEPARATING_CIRCLE_SAMPLE_RESOLUTION = 36;
 
@@ -188,9 +227,9 @@ public:
 			if (theta > 2 * M_PI)
 				theta -= 2 * M_PI;
 			double minDistance = std::numeric_limits<double>::infinity();
-			for (phi = 0; phi <= M_PI; phi += M_PI / (SPHERE_SAMPLING_RESOLUTION - 1))
+			for (phi = 0; phi <= M_PI; phi += sphereSampling.LatitudeSpacing())
 			{
-				double d = sphereSampling.AccessInterpolatedContainerData(sphereDistances, phi, theta);
+				double d = sphereSampling.InterpolateField(sphereDistances, phi, theta);
 				if (d < minDistance)
 				{
 					minDistance = d;
@@ -209,7 +248,8 @@ public:
 #endif
 
 		const double SEPARATING_CIRCLE_SAMPLE_ANGULAR_DISTANCE = 2 * M_PI / SEPARATING_CIRCLE_SAMPLE_RESOLUTION;
-		std::list<PositionGradient> separatingCircle;
+		std::vector<PositionGradient>& separatingCircle = workspace.separatingCircle;
+		separatingCircle.clear();
 		double minDistance = std::numeric_limits<double>::infinity();
 		for (int i = 0; i < SEPARATING_CIRCLE_SAMPLE_RESOLUTION; ++i)
 		{
@@ -229,7 +269,8 @@ public:
 		double partialAverageSize, partialLineLength;
 
 		// let the separating line climb up on the mountains...
-		LineFlow<true>(separatingCircle, sphereSampling, sphereDistances, distanceGradient, +1.0, partialAverageSize, partialLineLength, visualizer, L"separatingCircle_" + std::to_wstring(iVert));
+		LineFlow<true>(separatingCircle, sphereSampling, sphereDistances, distanceGradient, +1.0, partialAverageSize, partialLineLength, workspace.lineFlow, visualizer,
+			WritesDebugOutput<TSphereVisualizer>() ? L"separatingCircle_" + std::to_wstring(iVert) : std::wstring());
 
 		// find the angular distribution of the separating line
 
@@ -249,13 +290,26 @@ public:
 			double value;
 			Vector& position;
 		};
-		std::vector<AngleValuePosition> separatingLine, separatingLineLocalMinima;
+		ArenaVector<AngleValuePosition> separatingLine(arena), separatingLineLocalMinima(arena);
 		separatingLine.reserve(separatingCircle.size());
+		separatingLineLocalMinima.reserve(separatingCircle.size());
+
+		//interpolate the distances of all points on the separating line at once
+		size_t circlePoints = separatingCircle.size();
+		ArenaVector<double> x(circlePoints, 0.0, arena), y(circlePoints, 0.0, arena), z(circlePoints, 0.0, arena), circleValues(circlePoints, 0.0, arena);
+		size_t i = 0;
+		for (auto& p : separatingCircle)
+		{
+			x[i] = p.position.x(); y[i] = p.position.y(); z[i] = p.position.z();
+			++i;
+		}
+		sphereSampling.InterpolateField(sphereDistances, x.data(), y.data(), z.data(), circlePoints, circleValues.data());
 
 		double lastAngle;
 		double lastValue = std::numeric_limits<double>::infinity();
 		bool lastInResult = false;
-		for (auto it = separatingCircle.begin(); it != separatingCircle.end(); ++it)
+		i = 0;
+		for (auto it = separatingCircle.begin(); it != separatingCircle.end(); ++it, ++i)
 		{
 			double localX = it->position * localXAxis;
 			double localY = it->position * localYAxis;
@@ -272,7 +326,7 @@ public:
 				if (diffToLast < 0)
 					continue; //assert monotonically increasing sequence							
 			}
-			av.value = sphereSampling.AccessInterpolatedContainerData(sphereDistances, it->position);
+			av.value = circleValues[i];
 
 			separatingLine.push_back(av);
 
@@ -296,21 +350,22 @@ public:
 			lastAngle = av.angle;
 		}
 
-		for (auto& sample : separatingLine)
-		{
-			double phi, theta;
-			sphereSampling.ParametersFromPoint(sample.position, phi, theta);
-			visualizer.FillCircle(theta, phi, 2, SphereVisualizer::SEPARATING_LINE_COLOR);
-		}
+		if (TSphereVisualizer::DRAWS)
+			for (auto& sample : separatingLine)
+			{
+				double phi, theta;
+				sphereSampling.ParametersFromPoint(sample.position, phi, theta);
+				visualizer.FillCircle(theta, phi, 2, SphereVisualizer::SEPARATING_LINE_COLOR);
+			}
 
 		// Find the representative minima on the separating line
-		std::vector<int> representativeMinimaOnSeparatingLine;
-		std::vector<AngleValuePosition>* usedLine = &separatingLineLocalMinima;
-		FindOptimalMeanAverage(separatingLineLocalMinima, CIRCLE_SUBSAMPLING_MIN_DISTANCE, CIRCLE_SUBSAMPLING_MAX_DISTANCE, workspace, representativeMinimaOnSeparatingLine);
+		ArenaVector<int> representativeMinimaOnSeparatingLine(arena);
+		ArenaVector<AngleValuePosition>* usedLine = &separatingLineLocalMinima;
+		FindOptimalMeanAverage(separatingLineLocalMinima, CIRCLE_SUBSAMPLING_MIN_DISTANCE, CIRCLE_SUBSAMPLING_MAX_DISTANCE, workspace.meanAverage, representativeMinimaOnSeparatingLine);
 		if (representativeMinimaOnSeparatingLine.size() == 0)
 		{
 			usedLine = &separatingLine;
-			FindOptimalMeanAverage(separatingLine, CIRCLE_SUBSAMPLING_MIN_DISTANCE, CIRCLE_SUBSAMPLING_MAX_DISTANCE, workspace, representativeMinimaOnSeparatingLine);
+			FindOptimalMeanAverage(separatingLine, CIRCLE_SUBSAMPLING_MIN_DISTANCE, CIRCLE_SUBSAMPLING_MAX_DISTANCE, workspace.meanAverage, representativeMinimaOnSeparatingLine);
 		}
 
 		double averageSize = 0;
@@ -319,13 +374,17 @@ public:
 		int minimumIt = 0;
 		for (int minimumIndex : representativeMinimaOnSeparatingLine)
 		{
-			std::list<PositionGradient> minimaLine;
+			std::vector<PositionGradient>& minimaLine = workspace.minimaLine;
+			minimaLine.clear();
 
 			Vector passingThroughPoint = usedLine->at(minimumIndex).position;
 
-			double phi, theta;
-			sphereSampling.ParametersFromPoint(passingThroughPoint, phi, theta);
-			visualizer.FillCircle(theta, phi, 4, SphereVisualizer::SEPARATING_LINE_COLOR);
+			if (TSphereVisualizer::DRAWS)
+			{
+				double phi, theta;
+				sphereSampling.ParametersFromPoint(passingThroughPoint, phi, theta);
+				visualizer.FillCircle(theta, phi, 4, SphereVisualizer::SEPARATING_LINE_COLOR);
+			}
 
 			//Calculate the arc through both end points and the minimum
 			Vector circleAxis = CGAL::cross_product(p1 - passingThroughPoint, p2 - passingThroughPoint);
@@ -368,26 +427,30 @@ public:
 				Vector p = m + v1 * cos(beta) + v2 * sin(beta);
 				minimaLine.push_back({ p });
 
-				double phi, theta;
-				sphereSampling.ParametersFromPoint(p, phi, theta);
-
-				visualizer.FillCircle(theta, phi, 2, SphereVisualizer::SEPARATING_CIRCLE_COLOR);
+				if (TSphereVisualizer::DRAWS)
+				{
+					double phi, theta;
+					sphereSampling.ParametersFromPoint(p, phi, theta);
+					visualizer.FillCircle(theta, phi, 2, SphereVisualizer::SEPARATING_CIRCLE_COLOR);
+				}
 			}
 
 			//Let the line flow towards the valleys
-			LineFlow<false>(minimaLine, sphereSampling, sphereDistances, distanceGradient, -1.0, partialAverageSize, partialLineLength, visualizer, L"minimaLineFlow_" + std::to_wstring(iVert) + L"_" + std::to_wstring(minimumIt));
+			LineFlow<false>(minimaLine, sphereSampling, sphereDistances, distanceGradient, -1.0, partialAverageSize, partialLineLength, workspace.lineFlow, visualizer,
+				WritesDebugOutput<TSphereVisualizer>() ? L"minimaLineFlow_" + std::to_wstring(iVert) + L"_" + std::to_wstring(minimumIt) : std::wstring());
 
 			lineLength += partialLineLength;
 			averageSize += partialLineLength / lineLength * (partialAverageSize - averageSize);
 
 			//draw flown line
-			for (auto& p : minimaLine)
-			{
-				double phi, theta;
-				sphereSampling.ParametersFromPoint(p.position, phi, theta);
+			if (TSphereVisualizer::DRAWS)
+				for (auto& p : minimaLine)
+				{
+					double phi, theta;
+					sphereSampling.ParametersFromPoint(p.position, phi, theta);
 
-				visualizer.FillCircle(theta, phi, 2, SphereVisualizer::FLOW_COLOR);
-			}
+					visualizer.FillCircle(theta, phi, 2, SphereVisualizer::FLOW_COLOR);
+				}
 
 			++minimumIt;
 		}
@@ -403,12 +466,12 @@ public:
 
 	template <typename TSphereVisualizer>
 	static double CalculateDistance(const RegularUniformSphereSampling& sphereSampling,
-		const std::vector<std::vector<double>>& sphereDistances,
-		const std::vector<std::vector<Vector>>& distanceGradient,
-		const std::vector<PositionValue>& sphereDistanceMaxima,
-		const std::vector<PositionValue>& sphereDistanceMinima,
+		const SphereScalarField& sphereDistances,
+		const SphereVectorField& distanceGradient,
+		const ArenaVector<PositionValue>& sphereDistanceMaxima,
+		const ArenaVector<PositionValue>& sphereDistanceMinima,
 		TSphereVisualizer& visualizer,
-		int iVert, TCustomData& customData)
+		int iVert, MonotonicArena& arena, TCustomData& customData)
 	{
 		return 0.0;
 	}
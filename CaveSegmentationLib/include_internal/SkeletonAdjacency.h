@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <CurveSkeleton.h>
+
+#include "IGraph.h"
+
+//Adjacency of a skeleton in compressed sparse row format: the neighbors of vertex v are entries[offsets[v]] to
+//entries[offsets[v + 1] - 1] in the order of the edges, each with the id and the direction of the connecting edge. This is the same
+//order as adjacency lists that are filled edge by edge, so searches visit the neighbors in the same order.
+//Memory: 24 bytes per edge plus 8 bytes per vertex.
+class SkeletonAdjacency
+{
+public:
+	void Build(size_t vertexCount, const std::vector<CurveSkeleton::TEdge>& edges);
+
+	void Clear();
+
+	size_t NumberOfVertices() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+	SkeletonNeighborRange Neighbors(size_t v) const { return SkeletonNeighborRange(entries.data() + offsets[v], entries.data() + offsets[v + 1]); }
+
+	size_t Degree(size_t v) const { return offsets[v + 1] - offsets[v]; }
+
+	//Returns the id of the edge between v1 and v2, or -1 if they are not adjacent.
+	int FindEdge(size_t v1, size_t v2) const;
+
+	size_t MemoryUsage() const;
+
+private:
+	std::vector<size_t> offsets;
+	std::vector<SkeletonNeighbor> entries;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <CurveSkeleton.h>
+
+#include "SkeletonAdjacency.h"
+
+//Decomposition of a skeleton into chains, i.e. paths whose inner vertices have exactly two neighbors, between junctions (all other
+//vertices and the vertices on loops). It calculates the maxima over the geodesic neighborhoods of findMax() and maxAdvect() without
+//a search per vertex: within a chain, the neighborhood of a vertex is an interval of the chain, which is handled with sparse tables
+//for range maxima. Beyond a junction, everything that lies behind it is summarized in a staircase of (distance, maximum) entries
+//that is propagated from junction to junction and cut off at the largest search distance.
+//Only the parts of the skeleton that form a forest are handled this way. Vertices whose neighborhood contains a loop of the skeleton,
+//and vertices for which a distance lies within the rounding tolerance of the search distance, fall back to the depth-first search
+//of graphDFS(), such that the results are identical to findMax() and maxAdvect(). These searches skip the loop-free subtrees behind
+//junctions and take their contribution from the staircases instead.
+class SkeletonChains
+{
+public:
+	SkeletonChains();
+
+	//Decomposes the skeleton. vertices and adjacency are referenced until the next call of Build() or Clear().
+	void Build(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency);
+
+	void Clear();
+
+	//Returns if the decomposition has been built for a skeleton with the given number of vertices.
+	bool IsBuilt(size_t vertexCount) const { return vertices != nullptr && vertices->size() == vertexCount; }
+
+	size_t NumberOfChains() const { return chainOffsets.empty() ? 0 : chainOffsets.size() - 1; }
+
+	//Returns the number of vertices that lie on a loop of the skeleton.
+	size_t NumberOfLoopVertices() const { return loopVertexCount; }
+
+	//Same result as findMax(). Returns the number of vertices that have been calculated with a depth-first search.
+	size_t FindMax(std::function<double(int)> searchDistance, const std::vector<double>& source, std::vector<double>& target, int threads = 1) const;
+
+	//Same result as maxAdvect(). Returns the number of vertices that have been calculated with a depth-first search.
+	size_t MaxAdvect(std::function<double(int)> searchDistance, const std::vector<double>& source, std::vector<double>& target, int threads = 1) const;
+
+private:
+	//(distance or reach, maximum)
+	typedef std::pair<double, double> Step;
+
+	struct SearchWorkspace;
+
+	//Part of the neighborhood of a source on a loop that a search has skipped: the search has reached the start vertex of a half at
+	//the given distance and leaves everything behind it to the staircases.
+	struct SkippedSubtree
+	{
+		double distance;
+		double searchDistance;
+		double value;
+	};
+
+	//Bound for the rounding error of any distance that is calculated along the skeleton
+	double Tolerance(double maxSearchDistance) const;
+
+	//Half h = 2 * chain + direction enters the chain at its first (direction 0) or last vertex (direction 1).
+	int StartVertex(int half) const;
+	//Returns the half that leaves junction v towards its neighbor w, or -1 if the edge is on a loop.
+	int HalfTowards(int v, int w) const;
+
+	//Returns the maximum over the staircases of all halves that leave the start vertex of half, except half itself.
+	double MaxBehind(const std::vector<std::vector<Step>>& staircases, int half, double distance, double tolerance, bool& ambiguous) const;
+	double MaxReachingBehind(const std::vector<std::vector<Step>>& staircases, int half, double distance, double tolerance, bool& ambiguous) const;
+
+	//Same as MaxSearchDFSHook with graphDFS(), but skips subtrees whose maximum can be taken from the staircases.
+	double MaxSearch(int iVert, double searchDistance, const std::vector<double>& source, const std::vector<std::vector<Step>>& staircases, double tolerance, SearchWorkspace& workspace) const;
+
+	//Same as MaxAdvectDFSHook with graphDFS(), but records the skipped subtrees instead of advecting to them.
+	void AdvectSearch(int iVert, double searchDistance, const std::vector<double>& source, double tolerance, std::vector<double>& target,
+		std::vector<std::pair<int, SkippedSubtree>>& skipped, SearchWorkspace& workspace) const;
+
+	//Exact maximum of the sources in the forest and the skipped subtrees whose search distance reaches iVert, calculated with a
+	//search from iVert
+	double MaxReachingExactly(int iVert, const std::vector<double>& radii, const std::vector<char>& forestSource, const std::vector<double>& source,
+		const std::vector<std::vector<SkippedSubtree>>& skipped, double limit, double tolerance, SearchWorkspace& workspace) const;
+
+	const std::vector<CurveSkeleton::Vertex>* vertices;
+	const SkeletonAdjacency* adjacency;
+
+	//Skeleton without the edges on loops; the neighbors of vertex v are forestNeighbors[forestOffsets[v]] to forestNeighbors[forestOffsets[v + 1] - 1]
+	std::vector<size_t> forestOffsets;
+	std::vector<int> forestNeighbors;
+
+	//The vertices of chain c are chainVertices[chainOffsets[c]] to chainVertices[chainOffsets[c + 1] - 1]; chainDistances holds the
+	//distance of every vertex from the first vertex of its chain
+	std::vector<size_t> chainOffsets;
+	std::vector<int> chainVertices;
+	std::vector<double> chainDistances;
+
+	//Chain of every inner vertex; -1 for junctions
+	std::vector<int> vertexChain;
+	//The halves that leave vertex v are junctionHalves[junctionHalfOffsets[v]] to junctionHalves[junctionHalfOffsets[v + 1] - 1]
+	std::vector<size_t> junctionHalfOffsets;
+	std::vector<int> junctionHalves;
+	std::vector<int> junctions;
+	//Every half is preceded by the halves that leave its last vertex
+	std::vector<int> halfOrder;
+
+	//Geodesic distance to the closest vertex on a loop
+	std::vector<double> distanceToLoop;
+	//Distance from the start vertex of every half to the closest vertex on a loop behind it
+	std::vector<double> halfDistanceToLoop;
+	size_t loopVertexCount;
+	double totalLength;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <functional>
+#include <CurveSkeleton.h>
+
+#include "GraphProc.h"
+
+//Geodesic distances along the skeleton from every vertex to all vertices within a radius, stored as a sparse matrix in compressed
+//row storage. The entries of a row are ordered like the Dijkstra search of smoothSingleVertex() (by distance, then by index), such
+//that a Gaussian kernel whose cut-off radius is covered sums the same terms in the same order and gives bitwise identical results.
+//The operator is built once per skeleton and reused for all kernel sizes up to its radius.
+//Memory: 12 bytes per entry plus 8 bytes per vertex. Building it temporarily needs up to three times as much.
+class SmoothingOperator
+{
+public:
+	SmoothingOperator();
+
+	//Records the neighborhoods of all vertices within radius. Returns false and leaves the operator empty if building it needs more
+	//than memoryLimit bytes, including the per-thread buffers that are alive until the rows have been copied into the operator.
+	bool Build(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, double radius, size_t memoryLimit, int threads);
+
+	void Clear();
+
+	//Returns if the operator has been built for a skeleton with the given number of vertices and contains all neighbors within radius.
+	bool Covers(size_t vertexCount, double radius) const { return !rowOffsets.empty() && rowOffsets.size() == vertexCount + 1 && radius <= this->radius; }
+
+	double Radius() const { return radius; }
+
+	//Returns the number of bytes occupied by the operator.
+	size_t MemoryUsage() const;
+
+	//Same as smoothSingleVertex(); 3 * smoothDeviation must be covered by the operator's radius.
+	template <typename T>
+	T ApplySingleVertex(int iVert, double smoothDeviation, const std::vector<T>& source) const
+	{
+		if (smoothDeviation <= 0)
+			return source[iVert];
+
+		double distanceThreshold = 3 * smoothDeviation; //Gaussian is practically 0 after 3 * standardDeviation
+
+		double smoothVariance = smoothDeviation * smoothDeviation;
+		double sumWeight = 0;
+		T sumValue = 0;
+		for (size_t i = rowOffsets[iVert]; i < rowOffsets[iVert + 1] && distances[i] <= distanceThreshold; ++i)
+		{
+			auto v = source[columns[i]];
+			if (!std::isnan(v))
+			{
+				double weight = gauss(distances[i], smoothVariance);
+				sumWeight += weight;
+				sumValue += (T)(weight * v);
+			}
+		}
+		return static_cast<T>(sumValue / sumWeight);
+	}
+
+	//Same as smooth(); 3 * smoothDeviation(v) must be covered by the operator's radius for all vertices.
+	template <typename T>
+	void Apply(std::function<double(int)> smoothDeviation, const std::vector<T>& source, std::vector<T>& target, int threads) const
+	{
+#pragma omp parallel for schedule(dynamic, 256) num_threads(threads)
+		for (int iVert = 0; iVert < (int)rowOffsets.size() - 1; ++iVert)
+			target[iVert] = ApplySingleVertex(iVert, smoothDeviation(iVert), source);
+	}
+
+private:
+	//Entries of vertex v are at rowOffsets[v] to rowOffsets[v + 1] - 1
+	std::vector<size_t> rowOffsets;
+	std::vector<int32_t> columns;
+	std::vector<double> distances;
+	double radius;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "CGALCommon.h"
+
+//Scalar field over the samples of a RegularUniformSphereSampling. Values are stored contiguously and are
+//indexed by the sample index (i.e. in iteration order, see RegularUniformSphereSampling::SampleIndex()).
+class SphereScalarField
+{
+public:
+	typedef double value_type;
+
+	void Resize(size_t samples) { values.resize(samples); }
+	size_t Size() const { return values.size(); }
+
+	double& operator[](size_t sample) { return values[sample]; }
+	double operator[](size_t sample) const { return values[sample]; }
+
+	double* Data() { return values.data(); }
+	const double* Data() const { return values.data(); }
+
+private:
+	std::vector<double> values;
+};
+
+//Vector field over the samples of a RegularUniformSphereSampling, stored as a structure of arrays and
+//indexed by the sample index.
+class SphereVectorField
+{
+public:
+	typedef Vector value_type;
+
+	void Resize(size_t samples)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+			components[axis].resize(samples);
+	}
+	size_t Size() const { return components[0].size(); }
+
+	Vector operator[](size_t sample) const { return Vector(components[0][sample], components[1][sample], components[2][sample]); }
+
+	void Set(size_t sample, const Vector& v)
+	{
+		components[0][sample] = v.x();
+		components[1][sample] = v.y();
+		components[2][sample] = v.z();
+	}
+
+	//Returns one coordinate (0 = x, 1 = y, 2 = z) of all vectors as a contiguous array.
+	double* Component(int axis) { return components[axis].data(); }
+	const double* Component(int axis) const { return components[axis].data(); }
+
+private:
+	std::vector<double> components[3];
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Options.h"
+
+#include <vector>
+#include <memory>
+
+#include "CGALCommon.h"
+#include "RegularUniformSphereSampling.h"
+#include "SphereField.h"
+#include "SphereVisualizer.h"
+#include "MonotonicArena.h"
+
+struct PositionValue
+{
+	Vector position;
+	double value;
+};
+
+//Sparse linear operator that calculates the gradient field of a scalar field over the sphere.
+//The gradient at a sample is the least-squares fit to the directional derivatives towards its neighbors, projected onto the
+//tangent plane. Since the fit depends only on the sample directions, the weight of every neighbor difference is precomputed
+//(i.e. the direction multiplied by the inverse normal matrix and the tangent projection), such that calculating a
+//gradient field is a sparse matrix-vector product.
+class SphereGradientOperator
+{
+public:
+	//Precomputes the weights for the given sampling, which must outlive the operator.
+	SphereGradientOperator(const RegularUniformSphereSampling& sphereSampling);
+
+	//Calculates the gradient field of values.
+	void Apply(const SphereScalarField& values, SphereVectorField& gradient) const;
+
+private:
+	const RegularUniformSphereSampling& sphereSampling;
+
+	//Per entry of the sampling's neighbor lists, the weight of the difference between the neighbor's value and the sample's value
+	//for every component of the gradient
+	std::vector<double> weights[3];
+};
+
+//A sphere sampling together with all data that the cave size calculation precomputes for it. Instances are built once per
+//resolution and shared by all CaveData objects, such that the resolution can be chosen per job.
+struct PrebuiltSphereSampling
+{
+	PrebuiltSphereSampling(int resolution);
+
+	RegularUniformSphereSampling sampling;
+	SphereGradientOperator gradientOperator;
+	//Neighborhoods of all sphere samples for the extremum search (MAXIMUM_SEARCH_RADIUS)
+	RegularUniformSphereSampling::range_table extremumSearchNeighborhoods;
+
+	//Returns the instance for one of the SPHERE_SAMPLING_RESOLUTIONS and builds it on first use. Throws for other resolutions.
+	static std::shared_ptr<const PrebuiltSphereSampling> Get(int resolution);
+
+private:
+	PrebuiltSphereSampling(const PrebuiltSphereSampling&);
+	PrebuiltSphereSampling& operator=(const PrebuiltSphereSampling&);
+};
+
+//Finds strong local extrema of sphereDistances, i.e. points that are extreme in a neighborhood of the table's angular distance
+template <typename TSphereVisualizer>
+void FindStrongLocalExtrema(const RegularUniformSphereSampling& sphereSampling, const SphereScalarField& sphereDistances, const RegularUniformSphereSampling::range_table& extremumSearchNeighborhoods, ArenaVector<PositionValue>& maxima, ArenaVector<PositionValue>& minima, TSphereVisualizer& visualizer)
+{
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+	{
+		double dist = sphereDistances[iSample];
+		const Vector& position = sphereSampling.Direction(iSample);
+
+		bool isLocalMaximum = true;
+		bool isLocalMinimum = true;
+		if (isLocalMaximum || isLocalMinimum)
+			for (auto neighbor : extremumSearchNeighborhoods.Neighbors(iSample))
+			{
+				double d = sphereDistances[neighbor];
+				if (dist < d)
+					isLocalMaximum = false;
+				if (dist > d)
+					isLocalMinimum = false;
+				if (!isLocalMaximum && !isLocalMinimum)
+					break;
+			}
+
+		if (isLocalMaximum)
+			maxima.push_back({ position, dist });
+		if (isLocalMinimum)
+			minima.push_back({ position, dist });
+
+		if (!TSphereVisualizer::DRAWS)
+			continue;
+
+		double x, y, w, h;
+		BYTE c = (BYTE)(std::min(255.0, dist * 255 / 20));
+		BYTE r = c, g = c, b = c;
+		if (isLocalMaximum)
+		{
+			g >>= 1;
+			b >>= 1;
+		}
+		if (isLocalMinimum)
+		{
+			r >>= 1;
+			g >>= 1;
+		}
+		sphereSampling.GetParameterSpaceRect(iSample, x, y, w, h);
+
+		double myX = x + w / 2;
+		double myY = y + h / 2;
+
+		visualizer.FillRect(x, y, w, h, Gdiplus::Color(r, g, b));		
+		//visualizer.FillCircle(myX, myY, 2, SphereVisualizer::SAMPLE_COLOR);					
+	}
+}
@@ -21,6 +21,9 @@ public:
 	static const Gdiplus::Color SEPARATING_CIRCLE_COLOR;
 	static const Gdiplus::Color SEPARATING_LINE_COLOR;
 
+	//Specifies if the visualizer produces any output, i.e. if it is worth preparing drawing calls
+	static const bool DRAWS = true;
+
 	SphereVisualizer(const std::wstring& outputDirectory);
 	SphereVisualizer(const SphereVisualizer&);
 	~SphereVisualizer();
@@ -29,7 +32,7 @@ public:
 	void FillCircle(double theta, double phi, int radiusPixels, const Gdiplus::Color& color);
 
 	void DrawRect(double theta, double phi, double sizeTheta, double sizePhi, const Gdiplus::Color& color);
-	void DrawGradientField(const RegularUniformSphereSampling& sphereSampling, const std::vector<std::vector<Vector>>& gradient);
+	void DrawGradientField(const RegularUniformSphereSampling& sphereSampling, const SphereVectorField& gradient);
 
 	void Save(const std::wstring& filename);
 
@@ -41,6 +44,8 @@ private:
 class VoidSphereVisualizer
 {
 public:
+	static const bool DRAWS = false;
+
 	VoidSphereVisualizer(const std::wstring& outputDirectory);
 	VoidSphereVisualizer(const VoidSphereVisualizer&);
 
@@ -48,7 +53,7 @@ public:
 	void FillCircle(double theta, double phi, int radiusPixels, const Gdiplus::Color& color);
 
 	void DrawRect(double theta, double phi, double sizeTheta, double sizePhi, const Gdiplus::Color& color);
-	void DrawGradientField(const RegularUniformSphereSampling& sphereSampling, const std::vector<std::vector<Vector>>& gradient);
+	void DrawGradientField(const RegularUniformSphereSampling& sphereSampling, const SphereVectorField& gradient);
 
 	void Save(const std::wstring& filename);
 };
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+
+#include <Eigen/Dense>
+
+#include "IndexedTriangle.h"
+#include "AlignedAllocator.h"
+
+//Bounding volume hierarchy over an indexed triangle mesh that answers closest-hit ray queries.
+//The hierarchy only references the vertex and index arrays, which must outlive it.
+//The hierarchy is built with the surface area heuristic. Nodes are 32 bytes and siblings are stored
+//next to each other in a cache-line-aligned array, such that both children of a node share one cache line.
+class TriangleBVH
+{
+public:
+	struct Node
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		//Inner nodes: index of the first child (the second child directly follows the first one).
+		//Leaves: index of the first entry in primitiveIndices.
+		int32_t firstChildOrPrimitive;
+		//Number of triangles in a leaf; 0 for inner nodes.
+		int32_t primitiveCount;
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+	static_assert(sizeof(Node) == 32, "BVH nodes must be 32 bytes.");
+
+	TriangleBVH();
+
+	//Builds the hierarchy for the given mesh.
+	void Build(const std::vector<Eigen::Vector3f>& vertices, const std::vector<IndexedTriangle>& triangles);
+
+	void Clear();
+
+	bool IsEmpty() const { return nodes.empty(); }
+
+	//Returns the number of bytes occupied by the hierarchy (excluding the referenced mesh).
+	size_t MemoryUsage() const;
+
+	//Appends the hierarchy as a versioned section to a binary file.
+	void Write(FILE* file) const;
+
+	//Reads a hierarchy that has been written with Write() at the current file position. Returns false if there is no such section
+	//or if it has been written for a different mesh or by a different version of the hierarchy. The BVH is empty in that case.
+	bool Read(FILE* file, const std::vector<Eigen::Vector3f>& vertices, const std::vector<IndexedTriangle>& triangles);
+
+	//Version of the stored hierarchy. Must be increased whenever the node layout or the build algorithm changes.
+	static const uint32_t FILE_VERSION = 1;
+
+	//Counters that are accumulated by the traversal functions.
+	struct TraversalStatistics
+	{
+		size_t rays;
+		size_t visitedNodes; //for packets, every node is counted once per packet
+		size_t hintedRays; //rays whose hint triangle has been hit
+
+		TraversalStatistics() : rays(0), visitedNodes(0), hintedRays(0) { }
+	};
+
+	//Returns the ray parameter t of the closest intersection point origin + t * direction with t in [0, tMax),
+	//or infinity if there is no such intersection. Nodes are visited front-to-back and discarded as soon as
+	//their entry distance exceeds the closest hit found so far.
+	float ClosestHit(const float origin[3], const float direction[3], float tMax = std::numeric_limits<float>::infinity()) const;
+
+	//Same as above, but first intersects the ray with the hint triangle (if it is not negative). A hit bounds the traversal, which
+	//can then cull all nodes behind it. Coherent rays (e.g. the same direction from a nearby origin) often hit the same triangle.
+	//The index of the closest triangle (or -1) is stored in triangleHint. The hint test uses the same intersection routine as the
+	//traversal, hence, the returned distance is the same as without hint, except for hits that lie within the barycentric tolerance
+	//outside of a triangle and outside of its node's bounds, which the earlier bound may cull. The reported triangle may differ if
+	//several triangles are hit at exactly the same distance.
+	float ClosestHit(const float origin[3], const float direction[3], int32_t& triangleHint, TraversalStatistics* statistics = nullptr) const;
+
+	//Traces count rays with a common origin and stores the ray parameters of their closest hits in t (infinity if there is none).
+	//The directions are given as a structure of arrays. Consecutive rays are traced together in SIMD packets of PacketWidth() rays,
+	//hence, coherent rays should be stored next to each other. If triangleHints is given, it is used per ray as described above; the
+	//hint test uses the same packet arithmetic as the traversal, such that the distances do not depend on the hints either. They
+	//may differ from the single-ray ClosestHit() in the last bits.
+	void ClosestHits(const float origin[3], const float* directionX, const float* directionY, const float* directionZ, size_t count, float* t,
+		int32_t* triangleHints = nullptr, TraversalStatistics* statistics = nullptr) const;
+
+	//Returns the number of rays in a packet as traced by ClosestHits().
+	static int PacketWidth();
+
+private:
+	//Splits the node with the given index recursively.
+	void Subdivide(int32_t nodeIndex, const std::vector<Eigen::Vector3f>& centroids, int depth);
+
+	//Computes the bounds of the node's triangles.
+	void UpdateBounds(Node& node) const;
+
+	//Intersects the ray with the node's bounding box. Returns if the ray enters the box before tMax and stores the entry distance.
+	static bool IntersectBounds(const Node& node, const float origin[3], const float inverseDirection[3], float tMax, float& tEntry);
+
+	//Intersects the ray with a single triangle (Moeller-Trumbore). Returns infinity if there is no intersection.
+	float IntersectTriangle(int32_t triangle, const float origin[3], const float direction[3]) const;
+
+	//Finds the closest hit that is closer than closest. Updates hitTriangle if there is one and returns the new closest distance.
+	float Traverse(const float origin[3], const float direction[3], float closest, int32_t& hitTriangle, size_t& visitedNodes) const;
+
+	//Traces a full packet of Lanes::Width rays with a common origin. If hitTriangles is given, it provides the hints and receives the
+	//closest triangles. Returns a bit field of the lanes whose hint triangle has been hit.
+	template <typename Lanes>
+	int ClosestHitsPacket(const float origin[3], const float* directionX, const float* directionY, const float* directionZ, float* t,
+		int32_t* hitTriangles, size_t& visitedNodes) const;
+
+	std::vector<Node, AlignedAllocator<Node, 64>> nodes;
+	std::vector<int32_t> primitiveIndices;
+
+	const std::vector<Eigen::Vector3f>* vertices;
+	const std::vector<IndexedTriangle>* triangles;
+};
@@ -4,13 +4,19 @@
 #include "FileInputOutput.h"
 #include "GraphProc.h"
 #include "ImageProc.h"
+#include "SphereProc.h"
 
 #include <stack>
 #include <deque>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <sstream>
 
 #include <boost/filesystem/operations.hpp>
 
-void ReadOff(std::string filename, std::vector<Eigen::Vector3f>& vertices, std::vector<Triangle>& triangles, std::vector<IndexedTriangle>& triIndices)
+void ReadOff(std::string filename, std::vector<Eigen::Vector3f>& vertices, std::vector<IndexedTriangle>& triIndices)
 {
 	std::cout << "Reading file..." << std::endl;
 
@@ -22,7 +28,6 @@ void ReadOff(std::string filename, std::vector<Eigen::Vector3f>& vertices, std::
 	int nVertices = -1, nFaces = -1, nEdges = -1;
 
 	std::vector<Eigen::Vector3f>::iterator nextVertex;
-	auto nextTriangle = triangles.begin();
 	auto nextTriIndex = triIndices.begin();
 
 	while (std::getline(f, line))
@@ -39,10 +44,8 @@ void ReadOff(std::string filename, std::vector<Eigen::Vector3f>& vertices, std::
 		{
 			str >> nVertices >> nFaces >> nEdges;
 			vertices.resize(nVertices);
-			triangles.resize(nFaces);
 			triIndices.resize(nFaces);
 			nextVertex = vertices.begin();
-			nextTriangle = triangles.begin();
 			nextTriIndex = triIndices.begin();
 		}
 		else
@@ -59,15 +62,10 @@ void ReadOff(std::string filename, std::vector<Eigen::Vector3f>& vertices, std::
 				str >> n >> a >> b >> c;
 				if (n != 3)
 					throw;
-				(*nextTriangle) = Triangle(
-					Point(vertices[a].x(), vertices[a].y(), vertices[a].z()),
-					Point(vertices[b].x(), vertices[b].y(), vertices[b].z()),
-					Point(vertices[c].x(), vertices[c].y(), vertices[c].z()));
 				(*nextTriIndex).i[0] = a;
 				(*nextTriIndex).i[1] = b;
 				(*nextTriIndex).i[2] = c;
 
-				++nextTriangle;
 				++nextTriIndex;
 				--nFaces;
 			}
@@ -76,121 +74,21 @@ void ReadOff(std::string filename, std::vector<Eigen::Vector3f>& vertices, std::
 	f.close();
 }
 
-//Calculates the gradient field of sphereDistances over the sphere.
-void CalculateGradient(const RegularUniformSphereSampling& sphereSampling, const std::vector<std::vector<double>>& sphereDistances, std::vector<std::vector<Vector>>& distanceGradient)
-{
-	for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
-	{
-		double currentDistance = sphereSampling.AccessContainerData(sphereDistances, it);
-		Vector currentPos = *it;
-
-		//Calculate a 3D gradient from directional derivatives.
-		//Solve
-		//    arg min  Σ ( dot(g, direction_i) - derivative_i )^2
-		//       g
-
-		//parameters of the linear system
-		// | a  b  c | | x |   | g |
-		// | b  d  e | | y | = | h |
-		// | c  e  f | | z |   | i |
-		double a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, h = 0, i = 0;
-
-		for (auto neighbor : sphereSampling.Neighbors(it))
-		{
-			Vector neighborPos = *neighbor;
-			double neighborDistance = sphereSampling.AccessContainerData(sphereDistances, neighbor);
-			Vector direction = neighborPos - currentPos;
-			double dirLength = sqrt(direction.squared_length());
-			direction = direction * (1.0 / dirLength);
-			double derivative = (neighborDistance - currentDistance) / dirLength;
-
-			a += direction.x() * direction.x();
-			b += direction.x() * direction.y();
-			c += direction.x() * direction.z();
-			d += direction.y() * direction.y();
-			e += direction.y() * direction.z();
-			f += direction.z() * direction.z();
-			g += direction.x() * derivative;
-			h += direction.y() * derivative;
-			i += direction.z() * derivative;
-		}
-
-		//Solve the linear system
-		double denom = c * c * d - 2 * b * c * e + a * e * e + b * b * f - a * d * f;
-		Vector gradient(
-			(e * e * g - d * f * g - c * e * h + b * f * h + c * d * i - b * e * i) / denom,
-			(b * f * g - c * e * g + c * c * h - a * f * h - b * c * i + a * e * i) / denom,
-			(c * d * g - b * e * g - b * c * h + a * e * h + b * b * i - a * d * i) / denom);
-
-		//project gradient on sphere surface
-		gradient = gradient - (gradient * currentPos) * currentPos;
-
-		if (isnan(gradient.x()))
-		{
-			std::cout << "g is nan." << std::endl;
-			system("PAUSE");
-		}
-
-		sphereSampling.AccessContainerData(distanceGradient, it) = gradient;
-	}
-}
-
-//Finds strong local extrema of sphereDistances, i.e. points that are extreme in a neighborhood of extremumSearchRadius
-template <typename TSphereVisualizer>
-void FindStrongLocalExtrema(const RegularUniformSphereSampling& sphereSampling, const std::vector<std::vector<double>>& sphereDistances, double extremumSearchRadius, std::vector<PositionValue>& maxima, std::vector<PositionValue>& minima, TSphereVisualizer& visualizer)
-{
-	for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
-	{
-		double dist = sphereSampling.AccessContainerData(sphereDistances, it);
-
-		bool isLocalMaximum = true;
-		bool isLocalMinimum = true;
-		if (isLocalMaximum || isLocalMinimum)
-			for (auto neighbor : sphereSampling.Neighbors(*it, extremumSearchRadius))
-			{
-				double d = sphereSampling.AccessContainerData(sphereDistances, neighbor);
-				if (dist < d)
-					isLocalMaximum = false;
-				if (dist > d)
-					isLocalMinimum = false;
-				if (!isLocalMaximum && !isLocalMinimum)
-					break;
-			}
-
-		if (isLocalMaximum)
-			maxima.push_back({ *it, dist });
-		if (isLocalMinimum)
-			minima.push_back({ *it, dist });
-
-
-		double x, y, w, h;
-		BYTE c = (BYTE)(std::min(255.0, dist * 255 / 20));
-		BYTE r = c, g = c, b = c;
-		if (isLocalMaximum)
-		{
-			g >>= 1;
-			b >>= 1;
-		}
-		if (isLocalMinimum)
-		{
-			r >>= 1;
-			g >>= 1;
-		}
-		it.GetParameterSpaceRect(x, y, w, h);
-
-		double myX = x + w / 2;
-		double myY = y + h / 2;
-
-		visualizer.FillRect(x, y, w, h, Gdiplus::Color(r, g, b));		
-		//visualizer.FillCircle(myX, myY, 2, SphereVisualizer::SAMPLE_COLOR);					
-	}
-}
-
 CaveData::CaveData()
 	: skeleton(nullptr), verbose(true),
-	  sphereSampling(SPHERE_SAMPLING_RESOLUTION),
-	  CAVE_SCALE_KERNEL_FACTOR(10.0), CAVE_SIZE_KERNEL_FACTOR(0.2), CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR(0.2), CAVE_SCALE_ALGORITHM(CaveData::Max)
+	  sphere(PrebuiltSphereSampling::Get(DEFAULT_SPHERE_SAMPLING_RESOLUTION)),
+	  CAVE_SCALE_KERNEL_FACTOR(10.0), CAVE_SIZE_KERNEL_FACTOR(0.2), CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR(0.2), CAVE_SCALE_ALGORITHM(CaveData::Max),
+	  RAY_CASTING_ENGINE(CaveData::ClosestHitBVH), CAVE_SIZE_CALCULATOR(CaveData::LineFlowCaveSize), RAY_DISTANCE_CACHE_MODE(CaveData::NoRayDistanceCache), NUMBER_OF_THREADS(0), SPHERE_SAMPLING_QUALITY(1.0), SPHERE_SAMPLING_RESOLUTION(DEFAULT_SPHERE_SAMPLING_RESOLUTION), RAY_TRAVERSAL_HINTS(false),
+	  RECORD_LINE_FLOW_STATISTICS(false), SMOOTHING_OPERATOR_MEMORY_LIMIT(256 * 1024 * 1024)
 {
+	distanceStatistics = { 0, 0, 0.0, 0.0, 0, 0, 0 };
+	rayDistanceCacheQuality = SPHERE_SAMPLING_QUALITY;
+	rayDistanceCacheEngine = RAY_CASTING_ENGINE;
+	shardExponent = 1.0f;
+	smoothedCaveScaleAlgorithm = CAVE_SCALE_ALGORITHM;
+	smoothedKernelFactors[0] = smoothedKernelFactors[1] = smoothedKernelFactors[2] = 0;
+	smoothingOperatorFailedRadius = std::numeric_limits<double>::infinity();
+	smoothingOperatorFailedLimit = 0;
 }
 
 void CaveData::LoadMesh(const std::string & offFile)
@@ -198,6 +96,7 @@ void CaveData::LoadMesh(const std::string & offFile)
 	//Check if a cache for this file exists
 	std::string cachePath = offFile + ".cache";
 	bool loadFromCache = false;
+	bool bvhFromCache = false;
 	auto lastModifiedTimeOfMesh = boost::filesystem::last_write_time(offFile);
 	if (boost::filesystem::exists(cachePath))
 	{
@@ -214,7 +113,6 @@ void CaveData::LoadMesh(const std::string & offFile)
 				std::cout << "Loading from cache instead of OFF..." << std::endl;
 
 				_meshVertices.clear();
-				_meshTriangles.clear();
 				_meshTriIndices.clear();
 
 				int32_t n_vertices;
@@ -230,37 +128,34 @@ void CaveData::LoadMesh(const std::string & offFile)
 				if (n_triangles > 0)
 				{
 					_meshTriIndices.resize(n_triangles);
-					_meshTriangles.resize(n_triangles);
 					fread(&_meshTriIndices[0], sizeof(IndexedTriangle), n_triangles, cache);
-
-					for (int i = 0; i < n_triangles; ++i)
-					{
-						auto& tri = _meshTriIndices.at(i);
-						auto& v1 = _meshVertices.at(tri.i[0]);
-						auto& v2 = _meshVertices.at(tri.i[1]);
-						auto& v3 = _meshVertices.at(tri.i[2]);
-
-						_meshTriangles.at(i) = Triangle(Point(v1.x(), v1.y(), v1.z()), Point(v2.x(), v2.y(), v2.z()), Point(v3.x(), v3.y(), v3.z()));
-					}
 				}
 
-				fclose(cache);
+				//Caches from older versions may not contain the BVH section
+				bvhFromCache = _meshBVH.Read(cache, _meshVertices, _meshTriIndices);
+
 				loadFromCache = true;
 			}
 			else
 				std::cout << "Cannot read from cache." << std::endl;
+			fclose(cache);
 		}
 	}
 
 	if(!loadFromCache)
-		ReadOff(offFile, _meshVertices, _meshTriangles, _meshTriIndices);
+		ReadOff(offFile, _meshVertices, _meshTriIndices);
 	ResizeMeshAttributes(_meshVertices.size());
 
+	//The CGAL reference structures are only built on demand
 	_meshAABBTree.clear();
-	_meshAABBTree.insert(_meshTriangles.begin(), _meshTriangles.end());
-	_meshAABBTree.build();
+	TriangleList().swap(_meshTriangles);
+
+	if (!bvhFromCache)
+		_meshBVH.Build(_meshVertices, _meshTriIndices);
 
-	if (!loadFromCache)
+	rayDistanceCache.Reset(NoRayDistanceCache, 0, 0);
+
+	if (!loadFromCache || !bvhFromCache)
 	{
 		//Write the cache
 		FILE* cache = fopen(cachePath.c_str(), "wb");
@@ -278,6 +173,8 @@ void CaveData::LoadMesh(const std::string & offFile)
 			if (n_triangles > 0)
 				fwrite(&_meshTriIndices[0], sizeof(IndexedTriangle), n_triangles, cache);
 
+			_meshBVH.Write(cache);
+
 			fclose(cache);
 		}
 		else
@@ -323,10 +220,17 @@ void CaveData::WriteSurfaceSegmentation(const std::string& path, const std::vect
 void CaveData::SetSkeleton(CurveSkeleton * skeleton)
 {
 	this->skeleton = skeleton;
+	distanceCalculationSeconds.clear();
+	smoothedCaveSizeUnsmoothed.clear();
+	rayDistanceCache.Reset(NoRayDistanceCache, 0, 0);
+	smoothingOperator.Clear();
+	smoothingOperatorFailedRadius = std::numeric_limits<double>::infinity();
+	skeletonChains.Clear();
 	if (skeleton)
 	{
 		ResizeSkeletonAttributes(skeleton->vertices.size(), skeleton->edges.size());
 		CalculateBasicSkeletonData();
+		skeletonChains.Build(skeleton->vertices, adjacency);
 	}
 	else
 		ResizeSkeletonAttributes(0, 0);
@@ -341,24 +245,225 @@ bool CaveData::CalculateDistancesSingleVertexWithDebugOutput(int iVert, float ex
 template <typename TSphereVisualizer>
 bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent)
 {
-	std::vector<std::vector<double>> sphereDistances;
-	std::vector<std::vector<Vector>> distanceGradient;
-	sphereSampling.PrepareDataContainer(sphereDistances);
-	sphereSampling.PrepareDataContainer(distanceGradient);
+	PrepareSphereSampling();
+	PrepareRayCasting();
+	PrepareRayDistanceCache();
+	PrepareLineFlowStatistics();
 
-	caveSizeCalculatorCustomData.resize(1);
+	DistanceWorkspace workspace(sphere->sampling);
 
-	return CalculateDistancesSingleVertex<TSphereVisualizer>(iVert, exponent, sphereDistances, distanceGradient);
+	return CalculateDistancesSingleVertex<TSphereVisualizer>(iVert, exponent, workspace);
 }
 
 template bool CaveData::CalculateDistancesSingleVertex<SphereVisualizer>(int iVert, float exponent);
 template bool CaveData::CalculateDistancesSingleVertex<VoidSphereVisualizer>(int iVert, float exponent);
 
+void CaveData::PrepareRayCasting()
+{
+	if (RAY_CASTING_ENGINE != AllIntersectionsAABBTree || !_meshTriangles.empty())
+		return;
+
+	_meshTriangles.resize(_meshTriIndices.size());
+	for (size_t i = 0; i < _meshTriIndices.size(); ++i)
+	{
+		auto& tri = _meshTriIndices[i];
+		auto& v1 = _meshVertices.at(tri.i[0]);
+		auto& v2 = _meshVertices.at(tri.i[1]);
+		auto& v3 = _meshVertices.at(tri.i[2]);
+
+		_meshTriangles[i] = Triangle(Point(v1.x(), v1.y(), v1.z()), Point(v2.x(), v2.y(), v2.z()), Point(v3.x(), v3.y(), v3.z()));
+	}
+
+	_meshAABBTree.clear();
+	_meshAABBTree.insert(_meshTriangles.begin(), _meshTriangles.end());
+	_meshAABBTree.build();
+}
+
+void CaveData::PrepareSphereSampling()
+{
+	if (sphere->sampling.RingCount() != SPHERE_SAMPLING_RESOLUTION)
+		sphere = PrebuiltSphereSampling::Get(SPHERE_SAMPLING_RESOLUTION);
+}
+
+void CaveData::PrepareLineFlowStatistics()
+{
+	if (RECORD_LINE_FLOW_STATISTICS && lineFlowStatistics.size() != skeleton->vertices.size())
+		lineFlowStatistics.assign(skeleton->vertices.size(), ICaveData::LineFlowStatistics{ 0, 0, 0, 0 });
+}
+
+ICaveData::LineFlowStatistics CaveData::VertexLineFlowStatistics(size_t iVertex) const
+{
+	if (iVertex < lineFlowStatistics.size())
+		return lineFlowStatistics[iVertex];
+	return ICaveData::LineFlowStatistics{ 0, 0, 0, 0 };
+}
+
+void CaveData::SetRayDistanceCacheFile(const std::string& file)
+{
+	rayDistanceCacheFile = file;
+	//Force the cache to be re-initialized from the new file
+	rayDistanceCache.Reset(NoRayDistanceCache, 0, 0);
+}
+
+void CaveData::PrepareRayDistanceCache()
+{
+	size_t vertexCount = skeleton ? skeleton->vertices.size() : 0;
+	size_t samples = sphere->sampling.NumberOfSamples();
+	if (rayDistanceCache.Matches(RAY_DISTANCE_CACHE_MODE, vertexCount, samples) && rayDistanceCacheQuality == SPHERE_SAMPLING_QUALITY
+		&& rayDistanceCacheEngine == RAY_CASTING_ENGINE)
+		return;
+
+	rayDistanceCacheQuality = SPHERE_SAMPLING_QUALITY;
+	rayDistanceCacheEngine = RAY_CASTING_ENGINE;
+	rayDistanceCache.Reset(RAY_DISTANCE_CACHE_MODE, vertexCount, samples);
+	if (!rayDistanceCacheFile.empty() && rayDistanceCache.IsEnabled() && rayDistanceCache.Load(rayDistanceCacheFile, RayDistanceCacheKey()) && verbose)
+		std::cout << "Loaded ray distances from " << rayDistanceCacheFile << std::endl;
+}
+
+uint64_t CaveData::RayDistanceCacheKey() const
+{
+	//FNV-1a hash of everything that influences the ray distances
+	uint64_t hash = 14695981039346656037ULL;
+	auto addBytes = [&](const void* data, size_t size)
+	{
+		auto bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	};
+	if (!_meshVertices.empty())
+		addBytes(&_meshVertices[0], _meshVertices.size() * sizeof(Eigen::Vector3f));
+	if (!_meshTriIndices.empty())
+		addBytes(&_meshTriIndices[0], _meshTriIndices.size() * sizeof(IndexedTriangle));
+	if (skeleton)
+		for (auto& v : skeleton->vertices)
+			addBytes(v.position.data(), 3 * sizeof(float));
+	for (int axis = 0; axis < 3; ++axis)
+		addBytes(sphere->sampling.FlatDirections(axis).data(), sphere->sampling.NumberOfSamples() * sizeof(float));
+	addBytes(&SPHERE_SAMPLING_QUALITY, sizeof(double));
+	//The engines differ in the rounding of the distances
+	int32_t engine = RAY_CASTING_ENGINE;
+	addBytes(&engine, sizeof(engine));
+	return hash;
+}
+
+//Maps the sphere sampling quality to the stride of the coarse grid for adaptive sampling (1 = trace every sample).
+int CoarseSamplingStride(double quality)
+{
+	return quality >= 1 ? 1 : ADAPTIVE_SAMPLING_STRIDE;
+}
+
+//Relative change of the distance per coarse grid cell above which adaptive sampling is refined.
+double RefinementSteepness(double quality)
+{
+	return 2.0 * (1.0 - std::max(0.0, quality));
+}
+
+float CaveData::CastRay(const Eigen::Vector3f& origin, size_t sample, DistanceWorkspace& workspace) const
+{
+	auto& sphereSampling = sphere->sampling;
+	float direction[3] = { sphereSampling.FlatDirections(0)[sample], sphereSampling.FlatDirections(1)[sample], sphereSampling.FlatDirections(2)[sample] };
+	int32_t noHint = -1;
+	int32_t& hint = RAY_TRAVERSAL_HINTS ? workspace.triangleHints[sample] : noHint;
+	//Sample directions have unit length, so the ray parameters are the distances
+	return _meshBVH.ClosestHit(origin.data(), direction, hint, &workspace.traversalStatistics);
+}
+
+size_t CaveData::CastRays(const Eigen::Vector3f& origin, const std::vector<char>& mask, DistanceWorkspace& workspace) const
+{
+	auto& sphereSampling = sphere->sampling;
+	auto& samples = workspace.raySamples;
+	samples.clear();
+	for (size_t i = 0; i < mask.size(); ++i)
+		if (mask[i])
+			samples.push_back(i);
+
+	if (RAY_CASTING_ENGINE == PacketBVH)
+	{
+		//Gather the directions and hints, such that they can be traced in packets
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			auto& directions = workspace.rayDirections[axis];
+			directions.resize(samples.size());
+			for (size_t i = 0; i < samples.size(); ++i)
+				directions[i] = sphereSampling.FlatDirections(axis)[samples[i]];
+		}
+		workspace.rayHints.resize(samples.size());
+		for (size_t i = 0; i < samples.size(); ++i)
+			workspace.rayHints[i] = workspace.triangleHints[samples[i]];
+		workspace.rayParameters.resize(samples.size());
+		_meshBVH.ClosestHits(origin.data(), workspace.rayDirections[0].data(), workspace.rayDirections[1].data(), workspace.rayDirections[2].data(),
+			samples.size(), workspace.rayParameters.data(), RAY_TRAVERSAL_HINTS ? workspace.rayHints.data() : nullptr, &workspace.traversalStatistics);
+		for (size_t i = 0; i < samples.size(); ++i)
+		{
+			workspace.rayDistances[samples[i]] = workspace.rayParameters[i];
+			workspace.triangleHints[samples[i]] = workspace.rayHints[i];
+		}
+	}
+	else if (RAY_CASTING_ENGINE == ClosestHitBVH)
+	{
+		for (auto i : samples)
+			workspace.rayDistances[i] = CastRay(origin, i, workspace);
+	}
+	else
+	{
+		Point p(origin.x(), origin.y(), origin.z());
+		for (auto i : samples)
+		{
+			Vector direction(sphereSampling.FlatDirections(0)[i], sphereSampling.FlatDirections(1)[i], sphereSampling.FlatDirections(2)[i]);
+			workspace.rayDistances[i] = (float)sqrt(SqrDistanceToMesh(p, direction));
+		}
+	}
+	return samples.size();
+}
+
+size_t CaveData::CastRaysAdaptively(const Eigen::Vector3f& origin, int coarseStride, double refinementSteepness, DistanceWorkspace& workspace) const
+{
+	auto& sphereSampling = sphere->sampling;
+	auto& known = workspace.knownSamples;
+	auto& refine = workspace.refinedSamples;
+
+	sphereSampling.MarkCoarseSamples(coarseStride, known);
+	size_t tracedRays = CastRays(origin, known, workspace);
+	sphereSampling.InterpolateFromCoarseSamples(coarseStride, known, workspace.rayDistances);
+
+	//Trace the regions that the extremum search and the line flow depend on at full resolution
+	refine.assign(known.size(), 0);
+	sphereSampling.MarkRefinementSamples(coarseStride, workspace.rayDistances, refinementSteepness, refine);
+	for (size_t i = 0; i < refine.size(); ++i)
+		if (known[i])
+			refine[i] = 0;
+	tracedRays += CastRays(origin, refine, workspace);
+
+	return tracedRays;
+}
+
+double CaveData::SqrDistanceToMesh(const Point& p, const Vector& dir) const
+{
+	switch (RAY_CASTING_ENGINE)
+	{
+	case AllIntersectionsAABBTree:
+		return GetSqrDistanceToMesh(p, dir, _meshAABBTree);
+	case ClosestHitBVH:
+	case PacketBVH:
+	default:
+		return GetSqrDistanceToMesh(p, dir, _meshBVH);
+	}
+}
+
 //Calculates the cave size at a single skeleton vertex and stores it in caveSizeUnsmoothed.
 template <typename TSphereVisualizer>
-bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent, std::vector<std::vector<double>>& sphereDistances, std::vector<std::vector<Vector>>& distanceGradient)
+bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent, DistanceWorkspace& workspace)
 {
+	auto& sphereSampling = sphere->sampling;
 	auto& vert = skeleton->vertices.at(iVert);
+	auto& rayDistances = workspace.rayDistances;
+	auto& sphereDistances = workspace.sphereDistances;
+	auto& distanceGradient = workspace.distanceGradient;
+	auto& arena = workspace.arena;
+	arena.Reset();
 
 #ifdef WRITE_SPHERE_VIS
 	auto sphereVisFilename = outputDirectoryW + L"/sphereVis" + std::to_wstring(iVert) + L".obj";
@@ -371,13 +476,52 @@ bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent, std::ve
 	double minSphereDistance = std::numeric_limits<double>::infinity();
 	double M2 = 0.0;
 
-	const double MAXIMUM_SEARCH_RADIUS = 0.5;
+	//Cast rays for all samples unless their distances are cached
+	bool distancesFromCache = rayDistanceCache.Get(iVert, rayDistances.data());
+	if (distancesFromCache)
+	{
+#pragma omp atomic
+		++distanceStatistics.cachedVertices;
+	}
+	else
+	{
+		auto rayCastingStart = std::chrono::high_resolution_clock::now();
+		size_t tracedRays = rayDistances.size();
+		int coarseStride = CoarseSamplingStride(SPHERE_SAMPLING_QUALITY);
+		if (coarseStride > 1)
+			tracedRays = CastRaysAdaptively(vert.position, coarseStride, RefinementSteepness(SPHERE_SAMPLING_QUALITY), workspace);
+		else if (RAY_CASTING_ENGINE == PacketBVH)
+		{
+			//Sample directions have unit length, so the ray parameters are the distances
+			_meshBVH.ClosestHits(vert.position.data(), sphereSampling.FlatDirections(0).data(), sphereSampling.FlatDirections(1).data(), sphereSampling.FlatDirections(2).data(),
+				rayDistances.size(), rayDistances.data(), RAY_TRAVERSAL_HINTS ? workspace.triangleHints.data() : nullptr, &workspace.traversalStatistics);
+		}
+		else if (RAY_CASTING_ENGINE == ClosestHitBVH)
+		{
+			for (size_t i = 0; i < rayDistances.size(); ++i)
+				rayDistances[i] = CastRay(vert.position, i, workspace);
+		}
+		else
+		{
+			Point origin(vert.position.x(), vert.position.y(), vert.position.z());
+			size_t iSample = 0;
+			for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it, ++iSample)
+				rayDistances[iSample] = (float)sqrt(SqrDistanceToMesh(origin, *it));
+		}
+
+		double rayCastingSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - rayCastingStart).count();
+#pragma omp atomic
+		distanceStatistics.tracedRays += tracedRays;
+#pragma omp atomic
+		distanceStatistics.rayCastingSeconds += rayCastingSeconds;
+	}
 
 	//Record distances
-	for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
+	size_t iSample = 0;
+	for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it, ++iSample)
 	{
-		double visDist = sqrt(GetSqrDistanceToMesh(Point(vert.position.x(), vert.position.y(), vert.position.z()), *it, _meshAABBTree));
-		if (isinf(visDist))
+		double visDist = rayDistances[iSample];
+		if (!std::isfinite(visDist))
 		{
 			if(verbose)
 #pragma omp critical
@@ -393,7 +537,7 @@ bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent, std::ve
 
 			return false;
 		}
-		sphereSampling.AccessContainerData(sphereDistances, it) = pow(visDist, exponent);
+		sphereDistances[iSample] = pow(visDist, exponent);
 
 		++n;
 		double delta = visDist - meanSphereDistance;
@@ -410,6 +554,9 @@ bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent, std::ve
 #endif
 	}
 
+	if (!distancesFromCache)
+		rayDistanceCache.Store(iVert, rayDistances.data());
+
 	double variance = n < 2 ? 0 : M2 / (n - 1);
 	maxDistances.at(iVert) = maxSphereDistance;
 	minDistances.at(iVert) = minSphereDistance;
@@ -438,13 +585,13 @@ bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent, std::ve
 	heightFieldSphere << "usemtl Default_Smoothing" << std::endl;
 
 	int sample_resolution_x = sphereSampling.MaxNTheta();
-	for (int y = 0; y < SPHERE_SAMPLING_RESOLUTION; ++y)
+	for (int y = 0; y < sphereSampling.RingCount(); ++y)
 	{
-		double phi = y * M_PI / (SPHERE_SAMPLING_RESOLUTION - 1);
+		double phi = y * sphereSampling.LatitudeSpacing();
 		for (int x = 0; x < sample_resolution_x; ++x)
 		{
 			double theta = x * 2 * M_PI / sample_resolution_x;
-			double height = sphereSampling.AccessInterpolatedContainerData(sphereDistances, phi, theta) / 10;
+			double height = sphereSampling.InterpolateField(sphereDistances, phi, theta) / 10;
 			heightField << "v " << theta << " " << phi << " " << height << std::endl;
 			heightField << "vt " << theta / 2 / M_PI << " " << 1 - phi / M_PI << std::endl;
 			Vector p = sphereSampling.Point(phi, theta) * height;
@@ -473,20 +620,41 @@ bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent, std::ve
 	TSphereVisualizer sphereVisualizer(outputDirectoryW);
 
 	//calculate gradient
-	CalculateGradient(sphereSampling, sphereDistances, distanceGradient);
+	sphere->gradientOperator.Apply(sphereDistances, distanceGradient);
 
-	std::vector<PositionValue> sphereDistanceMaxima, sphereDistanceMinima;
-	FindStrongLocalExtrema(sphereSampling, sphereDistances, MAXIMUM_SEARCH_RADIUS, sphereDistanceMaxima, sphereDistanceMinima, sphereVisualizer);
+	ArenaVector<PositionValue> sphereDistanceMaxima(arena), sphereDistanceMinima(arena);
+	FindStrongLocalExtrema(sphereSampling, sphereDistances, sphere->extremumSearchNeighborhoods, sphereDistanceMaxima, sphereDistanceMinima, sphereVisualizer);
 
-	sphereVisualizer.Save(L"distanceField" + std::to_wstring(iVert) + L".png");
+	if (TSphereVisualizer::DRAWS)
+		sphereVisualizer.Save(L"distanceField" + std::to_wstring(iVert) + L".png");
 
 	//sphereVisualizer.DrawGradientField(sphereSampling, distanceGradient);		
 
-	int threadId = omp_in_parallel() ? omp_get_thread_num() : 0;
+	auto& lineFlowWorkspace = workspace.lineFlowCalculatorData.lineFlow;
+	ICaveData::LineFlowStatistics vertexLineFlowStatistics = { 0, 0, 0, 0 };
+	lineFlowWorkspace.termination = LINE_FLOW_TERMINATION;
+	lineFlowWorkspace.statistics = RECORD_LINE_FLOW_STATISTICS ? &vertexLineFlowStatistics : nullptr;
+
+	double caveSize;
+	switch (CAVE_SIZE_CALCULATOR)
+	{
+	case VoronoiCaveSize:
+		caveSize = CaveSizeCalculatorVoronoi::CalculateDistance(sphereSampling, sphereDistances, distanceGradient, sphereDistanceMaxima, sphereDistanceMinima, sphereVisualizer, iVert, arena, workspace.voronoiCalculatorData);
+		break;
+	case VoidCaveSize:
+		caveSize = CaveSizeCalculatorVoid::CalculateDistance(sphereSampling, sphereDistances, distanceGradient, sphereDistanceMaxima, sphereDistanceMinima, sphereVisualizer, iVert, arena, workspace.voidCalculatorData);
+		break;
+	default:
+		caveSize = CaveSizeCalculatorLineFlow::CalculateDistance(sphereSampling, sphereDistances, distanceGradient, sphereDistanceMaxima, sphereDistanceMinima, sphereVisualizer, iVert, arena, workspace.lineFlowCalculatorData);
+		break;
+	}
+	caveSizeUnsmoothed.at(iVert) = pow(caveSize, 1.0 / exponent);
 
-	caveSizeUnsmoothed.at(iVert) = pow(CaveSizeCalculator::CalculateDistance(sphereSampling, sphereDistances, distanceGradient, sphereDistanceMaxima, sphereDistanceMinima, sphereVisualizer, iVert, caveSizeCalculatorCustomData.at(threadId)), 1.0 / exponent);
+	if (TSphereVisualizer::DRAWS)
+		sphereVisualizer.Save(L"sphereVis" + std::to_wstring(iVert) + L".png");
 
-	sphereVisualizer.Save(L"sphereVis" + std::to_wstring(iVert) + L".png");
+	if (RECORD_LINE_FLOW_STATISTICS)
+		lineFlowStatistics.at(iVert) = vertexLineFlowStatistics;
 
 #ifdef WRITE_SPHERE_STATS
 	sphereStats.close();
@@ -499,39 +667,121 @@ bool CaveData::CalculateDistancesSingleVertex(int iVert, float exponent, std::ve
 	return true;
 }
 
-template bool CaveData::CalculateDistancesSingleVertex<SphereVisualizer>(int iVert, float exponent, std::vector<std::vector<double>>& sphereDistances, std::vector<std::vector<Vector>>& distanceGradient);
-template bool CaveData::CalculateDistancesSingleVertex<VoidSphereVisualizer>(int iVert, float exponent, std::vector<std::vector<double>>& sphereDistances, std::vector<std::vector<Vector>>& distanceGradient);
+template bool CaveData::CalculateDistancesSingleVertex<SphereVisualizer>(int iVert, float exponent, DistanceWorkspace& workspace);
+template bool CaveData::CalculateDistancesSingleVertex<VoidSphereVisualizer>(int iVert, float exponent, DistanceWorkspace& workspace);
 
-//Calculates the cave sizes for the entire skeleton and stores them in caveSizeUnsmoothed.
-bool CaveData::CalculateDistances(float exponent)
-{	
-	if(verbose)
-		std::cout << "Calculating distances..." << std::endl;
+void CaveData::DistanceCalculationChunks(int threads, const std::vector<size_t>* vertices, std::vector<int>& order, std::vector<size_t>& chunkOffsets) const
+{
+	//Number of chunks per thread; more chunks balance better, longer chunks profit more from traversal hints
+	const int CHUNKS_PER_THREAD = 8;
 
-	invalidVertices.clear();
+	int vertexCount = (int)skeleton->vertices.size();
 
-	caveSizeCalculatorCustomData.resize(omp_get_num_procs());
-#pragma omp parallel
+	//Depth-first traversal, such that consecutive vertices are mostly neighbors
+	std::vector<int> graphOrder;
+	graphOrder.reserve(vertexCount);
+	std::vector<bool> visited(vertexCount, false);
+	std::stack<int> stack;
+	for (int root = 0; root < vertexCount; ++root)
 	{
-		std::vector<std::vector<double>> sphereDistances;
-		std::vector<std::vector<Vector>> distanceGradient;
-		sphereSampling.PrepareDataContainer(sphereDistances);
-		sphereSampling.PrepareDataContainer(distanceGradient);
-#pragma omp for
-		for (int iVert = 0; iVert < skeleton->vertices.size(); ++iVert)
+		stack.push(root);
+		while (!stack.empty())
 		{
-			bool vertexValid = CalculateDistancesSingleVertex(iVert, exponent, sphereDistances, distanceGradient);
-			if (!vertexValid)
-#pragma omp critical
+			int v = stack.top();
+			stack.pop();
+			if (visited[v])
+				continue;
+			visited[v] = true;
+			graphOrder.push_back(v);
+			auto adj = adjacency.Neighbors(v);
+			for (size_t i = adj.size(); i > 0; --i)
+				if (!visited[adj[i - 1].vertex])
+					stack.push(adj[i - 1].vertex);
+		}
+	}
+
+	if (vertices)
+	{
+		std::vector<bool> selected(vertexCount, false);
+		for (size_t v : *vertices)
+			selected.at(v) = true;
+		graphOrder.erase(std::remove_if(graphOrder.begin(), graphOrder.end(), [&](int v) { return !selected[v]; }), graphOrder.end());
+		vertexCount = (int)graphOrder.size();
+	}
+
+	int chunkSize = std::max(1, vertexCount / (threads * CHUNKS_PER_THREAD));
+	int chunkCount = (vertexCount + chunkSize - 1) / chunkSize;
+	std::vector<int> chunks(chunkCount);
+	std::vector<double> chunkCosts(chunkCount, 0.0);
+	for (int c = 0; c < chunkCount; ++c)
+	{
+		chunks[c] = c;
+		if (distanceCalculationSeconds.size() == skeleton->vertices.size())
+			for (int i = c * chunkSize; i < std::min(vertexCount, (c + 1) * chunkSize); ++i)
+				chunkCosts[c] += distanceCalculationSeconds[graphOrder[i]];
+	}
+
+	//Expensive chunks are scheduled first, such that the cheap ones can fill the gaps at the end.
+	//Without a previous calculation, the graph order is kept. Geometric estimates like the node radius
+	//do not correlate with the actual cost well enough to be better than that.
+	std::stable_sort(chunks.begin(), chunks.end(), [&](int a, int b) { return chunkCosts[a] > chunkCosts[b]; });
+
+	order.clear();
+	chunkOffsets.clear();
+	for (int c : chunks)
+	{
+		chunkOffsets.push_back(order.size());
+		for (int i = c * chunkSize; i < std::min(vertexCount, (c + 1) * chunkSize); ++i)
+			order.push_back(graphOrder[i]);
+	}
+	chunkOffsets.push_back(order.size());
+}
+
+int CaveData::Threads() const
+{
+	return NUMBER_OF_THREADS > 0 ? NUMBER_OF_THREADS : omp_get_max_threads();
+}
+
+void CaveData::CalculateDistancesOfChunks(int threads, const std::vector<int>& order, const std::vector<size_t>& chunkOffsets, float exponent, std::vector<size_t>& invalid)
+{
+	if (distanceCalculationSeconds.size() != skeleton->vertices.size())
+		distanceCalculationSeconds.assign(skeleton->vertices.size(), 0.0);
+	PrepareLineFlowStatistics();
+
+#pragma omp parallel num_threads(threads)
+	{
+#pragma omp master
+		distanceStatistics.threads = omp_get_num_threads();
+
+		DistanceWorkspace workspace(sphere->sampling);
+#pragma omp for schedule(dynamic, 1)
+		for (int chunk = 0; chunk < (int)chunkOffsets.size() - 1; ++chunk)
+		{
+			for (size_t i = chunkOffsets[chunk]; i < chunkOffsets[chunk + 1]; ++i)
 			{
-				invalidVertices.push_back(iVert);
+				int iVert = order[i];
+				auto vertexStart = std::chrono::high_resolution_clock::now();
+				bool vertexValid = CalculateDistancesSingleVertex(iVert, exponent, workspace);
+				distanceCalculationSeconds[iVert] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - vertexStart).count();
+				if (!vertexValid)
+#pragma omp critical
+				{
+					invalid.push_back(iVert);
+				}
 			}
 		}
-	}
 
-	if(verbose)
-		std::cout << "Finished." << std::endl;	
+		size_t visitedNodes = workspace.traversalStatistics.visitedNodes;
+		size_t hintedRays = workspace.traversalStatistics.hintedRays;
+#pragma omp atomic
+		distanceStatistics.visitedNodes += visitedNodes;
+#pragma omp atomic
+		distanceStatistics.hintedRays += hintedRays;
+	}
+}
 
+void CaveData::ReconstructInvalidSizes()
+{
 	std::deque<int> invalidWork(invalidVertices.begin(), invalidVertices.end());
 	//TODO: instead of reconstruction, move skeleton vertices inside shape
 	//try to reconstruct invalid skeleton vertices by interpolating from valid neighbors
@@ -542,8 +792,9 @@ bool CaveData::CalculateDistances(float exponent)
 		{
 			int validNeighborCount = 0;
 			double validSum = 0;
-			for (int n : adjacency.at(*it))
+			for (auto& neighbor : adjacency.Neighbors(*it))
 			{
+				int n = neighbor.vertex;
 				double neighborSize = caveSizeUnsmoothed.at(n);
 				if (!std::isnan(neighborSize))
 				{
@@ -560,10 +811,99 @@ bool CaveData::CalculateDistances(float exponent)
 			}
 		}
 	}
+}
+
+//Calculates the cave sizes for the entire skeleton and stores them in caveSizeUnsmoothed.
+bool CaveData::CalculateDistances(float exponent)
+{	
+	if(verbose)
+		std::cout << "Calculating distances..." << std::endl;
+
+	invalidVertices.clear();
+	smoothedCaveSizeUnsmoothed.clear();
+	distanceStatistics = { 0, 0, 0.0, 0.0, 1, 0, 0 };
+	auto start = std::chrono::high_resolution_clock::now();
+
+	PrepareSphereSampling();
+	PrepareRayCasting();
+	PrepareRayDistanceCache();
+
+	//The cost per vertex varies a lot (long rays and complex line flows in large chambers), so chunks of neighboring
+	//vertices are handed out dynamically in the order of decreasing expected cost instead of in static blocks.
+	int threads = Threads();
+	std::vector<int> order;
+	std::vector<size_t> chunkOffsets;
+	DistanceCalculationChunks(threads, nullptr, order, chunkOffsets);
+	CalculateDistancesOfChunks(threads, order, chunkOffsets, exponent, invalidVertices);
+	std::sort(invalidVertices.begin(), invalidVertices.end());
+
+	if (!rayDistanceCacheFile.empty() && rayDistanceCache.IsEnabled() && distanceStatistics.tracedRays > 0)
+		rayDistanceCache.Save(rayDistanceCacheFile, RayDistanceCacheKey());
+
+	distanceStatistics.totalSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	if(verbose)
+		std::cout << "Finished (traced " << distanceStatistics.tracedRays << " rays, " << distanceStatistics.cachedVertices << " vertices from ray distance cache, " << distanceStatistics.totalSeconds << " s)." << std::endl;	
+
+	ReconstructInvalidSizes();
 
 	return invalidVertices.size() == 0;
 }
 
+//Recalculates the cave sizes of the given vertices and updates the smoothed measures around them.
+bool CaveData::CalculateDistances(const std::vector<size_t>& vertices, float exponent)
+{
+	if (verbose)
+		std::cout << "Recalculating distances of " << vertices.size() << " vertices..." << std::endl;
+
+	distanceStatistics = { 0, 0, 0.0, 0.0, 1, 0, 0 };
+	auto start = std::chrono::high_resolution_clock::now();
+
+	PrepareSphereSampling();
+	PrepareRayCasting();
+	PrepareRayDistanceCache();
+
+	//The geometry around the vertices may have changed, so their cached ray distances must not be used
+	for (size_t v : vertices)
+		rayDistanceCache.Invalidate(v);
+
+	int threads = Threads();
+	std::vector<int> order;
+	std::vector<size_t> chunkOffsets;
+	DistanceCalculationChunks(threads, &vertices, order, chunkOffsets);
+	std::vector<size_t> newInvalidVertices;
+	CalculateDistancesOfChunks(threads, order, chunkOffsets, exponent, newInvalidVertices);
+
+	//Recalculated vertices are invalid only if they are still invalid. All invalid vertices are reconstructed again
+	//since their neighbors may have changed.
+	std::vector<size_t> recalculated(vertices);
+	std::sort(recalculated.begin(), recalculated.end());
+	std::vector<size_t> remainingInvalidVertices;
+	std::set_difference(invalidVertices.begin(), invalidVertices.end(), recalculated.begin(), recalculated.end(), std::back_inserter(remainingInvalidVertices));
+	invalidVertices.swap(remainingInvalidVertices);
+	invalidVertices.insert(invalidVertices.end(), newInvalidVertices.begin(), newInvalidVertices.end());
+	std::sort(invalidVertices.begin(), invalidVertices.end());
+	for (size_t v : invalidVertices)
+		caveSizeUnsmoothed.at(v) = std::numeric_limits<double>::quiet_NaN();
+
+	if (!rayDistanceCacheFile.empty() && rayDistanceCache.IsEnabled() && distanceStatistics.tracedRays > 0)
+		rayDistanceCache.Save(rayDistanceCacheFile, RayDistanceCacheKey());
+
+	distanceStatistics.totalSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	if (verbose)
+		std::cout << "Finished (traced " << distanceStatistics.tracedRays << " rays, " << distanceStatistics.totalSeconds << " s)." << std::endl;
+
+	ReconstructInvalidSizes();
+
+	if (SmoothedDistancesAreCurrent())
+	{
+		std::vector<size_t> changedVertices;
+		std::set_union(recalculated.begin(), recalculated.end(), invalidVertices.begin(), invalidVertices.end(), std::back_inserter(changedVertices));
+		SmoothAndDeriveDistances(changedVertices);
+	}
+
+	return newInvalidVertices.size() == 0;
+}
+
 void CaveData::LoadDistances(const std::string & file)
 {
 	std::cout << "Loading distances from file..." << std::endl;
@@ -576,6 +916,7 @@ void CaveData::LoadDistances(const std::string & file)
 	distanceFile.read(reinterpret_cast<char*>(&meanDistances[0]), sizeof(double) * meanDistances.size());
 	distanceFile.read(reinterpret_cast<char*>(&caveSizeUnsmoothed[0]), sizeof(double) * caveSizeUnsmoothed.size());
 	distanceFile.close();
+	smoothedCaveSizeUnsmoothed.clear();
 }
 
 void CaveData::SaveDistances(const std::string & file) const
@@ -590,6 +931,208 @@ void CaveData::SaveDistances(const std::string & file) const
 	distanceFile.close();
 }
 
+//Identifies partial distance files of a single shard
+const char DISTANCE_SHARD_TAG[4] = { 'D', 'S', 'H', 'D' };
+//Version of the partial distance file format
+const uint32_t DISTANCE_SHARD_VERSION = 2;
+
+//Returns the vertices that belong to a shard. Every shardCount-th vertex is assigned to the same shard, such that expensive
+//regions of the skeleton are spread over all shards.
+std::vector<size_t> ShardVertices(size_t vertexCount, int shard, int shardCount)
+{
+	std::vector<size_t> vertices;
+	for (size_t v = shard; v < vertexCount; v += shardCount)
+		vertices.push_back(v);
+	return vertices;
+}
+
+//Writes the options that influence the distances of a shard besides the mesh, the skeleton, the sampling, and the ray casting engine,
+//which are covered by RayDistanceCacheKey().
+void WriteDistanceShardOptions(std::ostream& file, float exponent, ICaveData::CaveSizeCalculatorType calculator, const ICaveData::LineFlowTermination& termination)
+{
+	uint32_t calculatorId = calculator;
+	int32_t iterations[3] = { termination.patience, termination.maxIterations, termination.stationaryIterations };
+	double tolerances[2] = { termination.potentialTolerance, termination.displacementTolerance };
+	file.write(reinterpret_cast<const char*>(&exponent), sizeof(exponent));
+	file.write(reinterpret_cast<const char*>(&calculatorId), sizeof(calculatorId));
+	file.write(reinterpret_cast<const char*>(iterations), sizeof(iterations));
+	file.write(reinterpret_cast<const char*>(tolerances), sizeof(tolerances));
+}
+
+bool CaveData::CalculateDistanceShard(int shard, int shardCount, float exponent)
+{
+	if (shardCount < 1 || shard < 0 || shard >= shardCount)
+		throw std::exception("Invalid distance shard");
+
+	if (verbose)
+		std::cout << "Calculating distances of shard " << shard << "/" << shardCount << "..." << std::endl;
+
+	invalidVertices.clear();
+	smoothedCaveSizeUnsmoothed.clear();
+	distanceStatistics = { 0, 0, 0.0, 0.0, 1, 0, 0 };
+	auto start = std::chrono::high_resolution_clock::now();
+
+	PrepareSphereSampling();
+	PrepareRayCasting();
+	PrepareRayDistanceCache();
+
+	int threads = Threads();
+	std::vector<size_t> vertices = ShardVertices(skeleton->vertices.size(), shard, shardCount);
+	std::vector<int> order;
+	std::vector<size_t> chunkOffsets;
+	DistanceCalculationChunks(threads, &vertices, order, chunkOffsets);
+	CalculateDistancesOfChunks(threads, order, chunkOffsets, exponent, invalidVertices);
+	std::sort(invalidVertices.begin(), invalidVertices.end());
+
+	shardExponent = exponent;
+
+	//The ray distance cache is not saved, since every shard only has a part of the distances and shards may run concurrently.
+	//Invalid vertices are reconstructed after merging, when the sizes of their neighbors are known.
+
+	distanceStatistics.totalSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	if (verbose)
+		std::cout << "Finished (traced " << distanceStatistics.tracedRays << " rays, " << distanceStatistics.cachedVertices << " vertices from ray distance cache, " << distanceStatistics.totalSeconds << " s)." << std::endl;
+
+	return invalidVertices.size() == 0;
+}
+
+void CaveData::SaveDistanceShard(const std::string& file, int shard, int shardCount) const
+{
+	std::ofstream shardFile(file.c_str(), std::ios::binary);
+	if (!shardFile.good())
+		throw std::exception("Cannot open file");
+
+	uint32_t version = DISTANCE_SHARD_VERSION;
+	uint32_t shardIndex = shard, shards = shardCount;
+	uint64_t vertexCount = skeleton->vertices.size();
+	uint64_t key = RayDistanceCacheKey();
+	shardFile.write(DISTANCE_SHARD_TAG, sizeof(DISTANCE_SHARD_TAG));
+	shardFile.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	shardFile.write(reinterpret_cast<const char*>(&shardIndex), sizeof(shardIndex));
+	shardFile.write(reinterpret_cast<const char*>(&shards), sizeof(shards));
+	shardFile.write(reinterpret_cast<const char*>(&vertexCount), sizeof(vertexCount));
+	shardFile.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	WriteDistanceShardOptions(shardFile, shardExponent, CAVE_SIZE_CALCULATOR, LINE_FLOW_TERMINATION);
+
+	//Per vertex of the shard: maximum, minimum, and mean distance, and the unreconstructed cave size (NaN if invalid)
+	for (size_t v : ShardVertices(skeleton->vertices.size(), shard, shardCount))
+	{
+		double size = std::binary_search(invalidVertices.begin(), invalidVertices.end(), v) ? std::numeric_limits<double>::quiet_NaN() : caveSizeUnsmoothed[v];
+		double values[4] = { maxDistances[v], minDistances[v], meanDistances[v], size };
+		shardFile.write(reinterpret_cast<const char*>(values), sizeof(values));
+	}
+	shardFile.close();
+}
+
+void CaveData::MergeDistanceShards(const std::vector<std::string>& files, float exponent)
+{
+	if (verbose)
+		std::cout << "Merging " << files.size() << " distance shards..." << std::endl;
+
+	PrepareSphereSampling();
+	size_t vertexCount = skeleton->vertices.size();
+	uint64_t key = RayDistanceCacheKey();
+	std::ostringstream optionsStream;
+	WriteDistanceShardOptions(optionsStream, exponent, CAVE_SIZE_CALCULATOR, LINE_FLOW_TERMINATION);
+	std::string options = optionsStream.str();
+	std::vector<bool> shardMerged(files.size(), false);
+	for (auto& file : files)
+	{
+		std::ifstream shardFile(file.c_str(), std::ios::binary);
+		if (!shardFile.good())
+			throw std::exception("Cannot open file");
+
+		char tag[4];
+		uint32_t version, shard, shardCount;
+		uint64_t shardVertexCount, shardKey;
+		shardFile.read(tag, sizeof(tag));
+		shardFile.read(reinterpret_cast<char*>(&version), sizeof(version));
+		shardFile.read(reinterpret_cast<char*>(&shard), sizeof(shard));
+		shardFile.read(reinterpret_cast<char*>(&shardCount), sizeof(shardCount));
+		shardFile.read(reinterpret_cast<char*>(&shardVertexCount), sizeof(shardVertexCount));
+		shardFile.read(reinterpret_cast<char*>(&shardKey), sizeof(shardKey));
+		if (!shardFile.good() || memcmp(tag, DISTANCE_SHARD_TAG, sizeof(tag)) != 0 || version != DISTANCE_SHARD_VERSION)
+			throw std::exception("Not a distance shard file");
+		std::string shardOptions(options.size(), '\0');
+		shardFile.read(&shardOptions[0], shardOptions.size());
+		if (!shardFile.good())
+			throw std::exception("Distance shard file is truncated");
+		if (shardCount != files.size() || shard >= shardCount)
+			throw std::exception("Distance shard belongs to a different number of shards");
+		if (shardVertexCount != vertexCount || shardKey != key)
+			throw std::exception("Distance shard belongs to a different mesh, skeleton, sampling, or ray casting engine");
+		if (shardOptions != options)
+			throw std::exception("Distance shard has been calculated with a different exponent, cave size calculator, or line flow termination");
+		if (shardMerged[shard])
+			throw std::exception("Distance shard is given more than once");
+		shardMerged[shard] = true;
+
+		for (size_t v : ShardVertices(vertexCount, shard, shardCount))
+		{
+			double values[4];
+			shardFile.read(reinterpret_cast<char*>(values), sizeof(values));
+			maxDistances[v] = values[0];
+			minDistances[v] = values[1];
+			meanDistances[v] = values[2];
+			caveSizeUnsmoothed[v] = values[3];
+		}
+		if (!shardFile.good())
+			throw std::exception("Distance shard file is truncated");
+	}
+
+	invalidVertices.clear();
+	for (size_t v = 0; v < vertexCount; ++v)
+		if (std::isnan(caveSizeUnsmoothed[v]))
+			invalidVertices.push_back(v);
+	ReconstructInvalidSizes();
+	smoothedCaveSizeUnsmoothed.clear();
+}
+
+//Returns the maximum of the given values, ignoring NaNs.
+double MaxValue(const std::vector<double>& values)
+{
+	double maximum = 0;
+	for (double v : values)
+		if (v > maximum)
+			maximum = v;
+	return maximum;
+}
+
+bool CaveData::PrepareSmoothingOperator(double radius)
+{
+	//Kernel sweeps usually increase the radius step by step, so the operator is built with some slack to avoid rebuilding it every time
+	const double RADIUS_SLACK = 1.5;
+
+	size_t vertexCount = skeleton->vertices.size();
+	if (smoothingOperator.Covers(vertexCount, radius))
+		return true;
+	if (radius >= smoothingOperatorFailedRadius && SMOOTHING_OPERATOR_MEMORY_LIMIT <= smoothingOperatorFailedLimit)
+		return false;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!smoothingOperator.Build(skeleton->vertices, adjacency, RADIUS_SLACK * radius, SMOOTHING_OPERATOR_MEMORY_LIMIT, Threads())
+		&& !smoothingOperator.Build(skeleton->vertices, adjacency, radius, SMOOTHING_OPERATOR_MEMORY_LIMIT, Threads()))
+	{
+		smoothingOperatorFailedRadius = radius;
+		smoothingOperatorFailedLimit = SMOOTHING_OPERATOR_MEMORY_LIMIT;
+		if (verbose)
+			std::cout << "The smoothing operator for radius " << radius << " exceeds the memory limit." << std::endl;
+		return false;
+	}
+	if (verbose)
+		std::cout << "Built smoothing operator with radius " << smoothingOperator.Radius() << " (" << smoothingOperator.MemoryUsage() / 1024 / 1024 << " MB) in "
+			<< std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() << " s." << std::endl;
+	return true;
+}
+
+void CaveData::SmoothVertices(std::function<double(int)> smoothDeviation, double maxDeviation, std::vector<double>& source, std::vector<double>& target)
+{
+	if (PrepareSmoothingOperator(3 * maxDeviation)) //see smoothSingleVertex()
+		smoothingOperator.Apply(smoothDeviation, source, target, Threads());
+	else
+		smooth(skeleton->vertices, adjacency, smoothDeviation, source, target, Threads());
+}
+
 //Calculates additional measures from the unsmoothed cave sizes.
 void CaveData::SmoothAndDeriveDistances()
 {
@@ -605,18 +1148,18 @@ void CaveData::SmoothAndDeriveDistances()
 	switch (CAVE_SCALE_ALGORITHM)
 	{
 	case Max:
-		findMax(skeleton->vertices, adjacency, [this](int iVert) { return CAVE_SCALE_KERNEL_FACTOR * caveSizeUnsmoothed.at(iVert); }, caveSizeUnsmoothed, caveScale);
+		skeletonChains.FindMax([this](int iVert) { return CAVE_SCALE_KERNEL_FACTOR * caveSizeUnsmoothed.at(iVert); }, caveSizeUnsmoothed, caveScale, Threads());
 		break;
 	case Smooth:
-		smooth(skeleton->vertices, adjacency, [this](int iVert) { return CAVE_SCALE_KERNEL_FACTOR * caveSizeUnsmoothed.at(iVert); }, caveSizeUnsmoothed, caveScale);
+		SmoothVertices([this](int iVert) { return CAVE_SCALE_KERNEL_FACTOR * caveSizeUnsmoothed.at(iVert); }, CAVE_SCALE_KERNEL_FACTOR * MaxValue(caveSizeUnsmoothed), caveSizeUnsmoothed, caveScale);
 		break;
 	case Advect:
-		maxAdvect(skeleton->vertices, adjacency, [this](int iVert) { return CAVE_SCALE_KERNEL_FACTOR * caveSizeUnsmoothed.at(iVert); }, caveSizeUnsmoothed, caveScale);
+		skeletonChains.MaxAdvect([this](int iVert) { return CAVE_SCALE_KERNEL_FACTOR * caveSizeUnsmoothed.at(iVert); }, caveSizeUnsmoothed, caveScale, Threads());
 		break;
 	}	
 
 	//Smooth cave sizes: caveSizes <- smooth(caveSizeUnsmoothed)
-	smooth(skeleton->vertices, adjacency, [this](int iVert) { return CAVE_SIZE_KERNEL_FACTOR * caveScale.at(iVert); }, caveSizeUnsmoothed, caveSizes);
+	SmoothVertices([this](int iVert) { return CAVE_SIZE_KERNEL_FACTOR * caveScale.at(iVert); }, CAVE_SIZE_KERNEL_FACTOR * MaxValue(caveScale), caveSizeUnsmoothed, caveSizes);
 
 	//Derive cave sizes: smoothWorkDouble <- derive(caveSizes)
 	derivePerEdgeFromVertices(skeleton, caveSizes, smoothWorkDouble);
@@ -625,15 +1168,160 @@ void CaveData::SmoothAndDeriveDistances()
 	{
 		auto edge = skeleton->edges.at(iEdge);
 		return CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR * 0.5 * (caveScale.at(edge.first) + caveScale.at(edge.second));
-	}, smoothWorkDouble, caveSizeDerivativesPerEdge);
+	}, smoothWorkDouble, caveSizeDerivativesPerEdge, Threads());
 
 	//Derive second derivatives: caveSizeCurvaturesPerEdge <- derive(caveSizeDerivativesPerEdge)
 	derivePerEdge<double, true>(*this, caveSizeDerivativesPerEdge, caveSizeCurvaturesPerEdge);
 
+	smoothedCaveSizeUnsmoothed = caveSizeUnsmoothed;
+	smoothedCaveScaleAlgorithm = CAVE_SCALE_ALGORITHM;
+	smoothedKernelFactors[0] = CAVE_SCALE_KERNEL_FACTOR;
+	smoothedKernelFactors[1] = CAVE_SIZE_KERNEL_FACTOR;
+	smoothedKernelFactors[2] = CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR;
+
 	if(verbose)
 		std::cout << "Finished smoothing." << std::endl;
 }
 
+bool CaveData::SmoothedDistancesAreCurrent() const
+{
+	return skeleton != nullptr && smoothedCaveSizeUnsmoothed.size() == skeleton->vertices.size() && smoothedCaveScaleAlgorithm == CAVE_SCALE_ALGORITHM
+		&& smoothedKernelFactors[0] == CAVE_SCALE_KERNEL_FACTOR && smoothedKernelFactors[1] == CAVE_SIZE_KERNEL_FACTOR && smoothedKernelFactors[2] == CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR;
+}
+
+//Updates the smoothed and derived measures after the unsmoothed cave sizes of the given vertices have changed. Every smoothing step
+//is only repeated for the vertices (or edges) whose kernel reaches a vertex that has been changed by the previous step, which is
+//bounded conservatively by the largest kernel radius of the step. The results are identical to SmoothAndDeriveDistances().
+void CaveData::SmoothAndDeriveDistances(const std::vector<size_t>& changedVertices)
+{
+	if (!SmoothedDistancesAreCurrent())
+	{
+		SmoothAndDeriveDistances();
+		return;
+	}
+
+	if (verbose)
+		std::cout << "Updating smoothed distances around " << changedVertices.size() << " vertices..." << std::endl;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//Dijkstra and depth-first distances of the same vertices are summed in different orders, so kernel radii get a small tolerance
+	const double RADIUS_TOLERANCE = 1.0 + 1e-6;
+
+	auto& vertices = skeleton->vertices;
+	int threads = Threads();
+	std::vector<double> smoothWorkDouble(std::max(vertices.size(), skeleton->edges.size()));
+	auto caveScaleSearchDistance = [this](int iVert) { return CAVE_SCALE_KERNEL_FACTOR * caveSizeUnsmoothed.at(iVert); };
+
+	//Cave scale: the search distance of a vertex depends on its own size. For advection, the vertices that have been reached
+	//with the old size of a changed vertex must be updated as well.
+	double maxCaveScaleRadius = CAVE_SCALE_KERNEL_FACTOR * MaxValue(caveSizeUnsmoothed);
+	if (CAVE_SCALE_ALGORITHM == Smooth)
+		maxCaveScaleRadius *= 3; //see smoothSingleVertex()
+	if (CAVE_SCALE_ALGORITHM == Advect)
+		for (size_t v : changedVertices)
+			maxCaveScaleRadius = std::max(maxCaveScaleRadius, CAVE_SCALE_KERNEL_FACTOR * smoothedCaveSizeUnsmoothed.at(v));
+	std::vector<size_t> scaleVertices;
+	verticesWithinDistance(vertices, adjacency, changedVertices, maxCaveScaleRadius * RADIUS_TOLERANCE, scaleVertices);
+
+	switch (CAVE_SCALE_ALGORITHM)
+	{
+	case Max:
+#pragma omp parallel for schedule(dynamic, 16) num_threads(threads)
+		for (int i = 0; i < (int)scaleVertices.size(); ++i)
+		{
+			int iVert = (int)scaleVertices[i];
+			MaxSearchDFSHook<double> hook(caveSizeUnsmoothed);
+			graphDFS(hook, vertices, iVert, adjacency, caveScaleSearchDistance(iVert));
+			caveScale[iVert] = hook.getMaximum();
+		}
+		break;
+	case Smooth:
+	{
+		//Only a few vertices are updated, which does not pay for (re)building the smoothing operator, so it is only used if it covers the kernels
+		bool useOperator = smoothingOperator.Covers(vertices.size(), 3 * (CAVE_SCALE_KERNEL_FACTOR * MaxValue(caveSizeUnsmoothed)));
+#pragma omp parallel num_threads(threads)
+		{
+			DijkstraWorkspace workspace;
+#pragma omp for schedule(dynamic, 16)
+			for (int i = 0; i < (int)scaleVertices.size(); ++i)
+			{
+				int iVert = (int)scaleVertices[i];
+				if (useOperator)
+					caveScale[iVert] = smoothingOperator.ApplySingleVertex(iVert, caveScaleSearchDistance(iVert), caveSizeUnsmoothed);
+				else
+					caveScale[iVert] = smoothSingleVertex(vertices, iVert, adjacency, caveScaleSearchDistance(iVert), caveSizeUnsmoothed, workspace);
+			}
+		}
+		break;
+	}
+	case Advect:
+	{
+		std::vector<char> scaleVertexMask(vertices.size(), 0);
+		for (size_t v : scaleVertices)
+			scaleVertexMask[v] = 1;
+		std::vector<size_t> advectionSources;
+		verticesWithinDistance(vertices, adjacency, scaleVertices, maxCaveScaleRadius * RADIUS_TOLERANCE, advectionSources);
+		maxAdvect<double>(vertices, adjacency, caveScaleSearchDistance, caveSizeUnsmoothed, caveScale, advectionSources, scaleVertexMask);
+		break;
+	}
+	}
+
+	//Cave sizes: depend on the unsmoothed sizes and, via the kernel size, on the cave scale
+	double maxCaveScale = MaxValue(caveScale);
+	std::vector<size_t> sizeVertices;
+	verticesWithinDistance(vertices, adjacency, scaleVertices, 3 * CAVE_SIZE_KERNEL_FACTOR * maxCaveScale * RADIUS_TOLERANCE, sizeVertices);
+	bool useOperator = smoothingOperator.Covers(vertices.size(), 3 * (CAVE_SIZE_KERNEL_FACTOR * maxCaveScale));
+#pragma omp parallel num_threads(threads)
+	{
+		DijkstraWorkspace workspace;
+#pragma omp for schedule(dynamic, 16)
+		for (int i = 0; i < (int)sizeVertices.size(); ++i)
+		{
+			int iVert = (int)sizeVertices[i];
+			if (useOperator)
+				caveSizes[iVert] = smoothingOperator.ApplySingleVertex(iVert, CAVE_SIZE_KERNEL_FACTOR * caveScale[iVert], caveSizeUnsmoothed);
+			else
+				caveSizes[iVert] = smoothSingleVertex(vertices, iVert, adjacency, CAVE_SIZE_KERNEL_FACTOR * caveScale[iVert], caveSizeUnsmoothed, workspace);
+		}
+	}
+
+	//Derivatives are cheap to calculate and are updated everywhere; only their smoothing is restricted. An edge's kernel
+	//reaches a changed edge if one of its vertices is within the kernel radius plus the length of the changed edge.
+	derivePerEdgeFromVertices(skeleton, caveSizes, smoothWorkDouble);
+	double maxEdgeLength = 0;
+	for (auto& edge : skeleton->edges)
+		maxEdgeLength = std::max(maxEdgeLength, (double)(vertices[edge.first].position - vertices[edge.second].position).norm());
+	std::vector<size_t> derivativeVertices;
+	verticesWithinDistance(vertices, adjacency, sizeVertices, (3 * CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR * maxCaveScale + maxEdgeLength) * RADIUS_TOLERANCE, derivativeVertices);
+	std::vector<char> derivativeVertexMask(vertices.size(), 0);
+	for (size_t v : derivativeVertices)
+		derivativeVertexMask[v] = 1;
+	std::vector<int> derivativeEdges;
+	for (int iEdge = 0; iEdge < (int)skeleton->edges.size(); ++iEdge)
+		if (derivativeVertexMask[skeleton->edges[iEdge].first] || derivativeVertexMask[skeleton->edges[iEdge].second])
+			derivativeEdges.push_back(iEdge);
+#pragma omp parallel num_threads(threads)
+	{
+		EdgeSmoothingWorkspace workspace;
+#pragma omp for schedule(dynamic, 16)
+		for (int i = 0; i < (int)derivativeEdges.size(); ++i)
+		{
+			int iEdge = derivativeEdges[i];
+			auto edge = skeleton->edges.at(iEdge);
+			double deviation = CAVE_SIZE_DERIVATIVE_KERNEL_FACTOR * 0.5 * (caveScale.at(edge.first) + caveScale.at(edge.second));
+			caveSizeDerivativesPerEdge[iEdge] = smoothSingleEdge<double, true>(*this, iEdge, deviation, smoothWorkDouble, workspace);
+		}
+	}
+
+	derivePerEdge<double, true>(*this, caveSizeDerivativesPerEdge, caveSizeCurvaturesPerEdge);
+
+	smoothedCaveSizeUnsmoothed = caveSizeUnsmoothed;
+
+	if (verbose)
+		std::cout << "Finished smoothing (updated " << scaleVertices.size() << " scales, " << sizeVertices.size() << " sizes, " << derivativeEdges.size() << " edge derivatives in "
+			<< std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() << " s)." << std::endl;
+}
+
 void CaveData::SetOutputDirectory(const std::wstring & outputDirectory)
 {
 	outputDirectoryW = outputDirectory;
@@ -652,7 +1340,7 @@ void CaveData::ResizeSkeletonAttributes(size_t vertexCount, size_t edgeCount)
 	caveSizes.resize(vertexCount);
 	nodeRadii.resize(vertexCount);
 	caveScale.resize(vertexCount);	
-	adjacency.clear(); adjacency.resize(vertexCount);
+	adjacency.Build(vertexCount, std::vector<CurveSkeleton::TEdge>());
 
 	caveSizeUnsmoothed.resize(caveSizes.size());	
 
@@ -665,14 +1353,7 @@ void CaveData::CalculateBasicSkeletonData()
 	if(verbose)
 		std::cout << "Calculating adjacency list..." << std::endl;
 
-	for (int iEdge = 0; iEdge < skeleton->edges.size(); ++iEdge)
-	{
-		auto& edge = skeleton->edges.at(iEdge);
-		adjacency[edge.first].push_back(edge.second);
-		adjacency[edge.second].push_back(edge.first);
-		vertexPairToEdge[edge] = iEdge;
-		vertexPairToEdge[std::pair<int, int>(edge.second, edge.first)] = iEdge;
-	}	
+	adjacency.Build(skeleton->vertices.size(), skeleton->edges);
 
 	//Clean correspondences (use the closer skeleton vertex of local neighbors)
 	std::vector<std::vector<int>> cleanedCorrespondences(skeleton->vertices.size());
@@ -692,9 +1373,9 @@ void CaveData::CalculateBasicSkeletonData()
 			do
 			{
 				changed = false;
-				auto& adj = adjacency.at(closestSkeletonVertex);
-				for (auto n : adj)
+				for (auto& neighbor : adjacency.Neighbors(closestSkeletonVertex))
 				{
+					int n = neighbor.vertex;
 					double currentDistance = (meshVertex - skeleton->vertices.at(n).position).norm();
 					if (currentDistance < closestDistance)
 					{
@@ -719,16 +1400,16 @@ void CaveData::CalculateBasicSkeletonData()
 	{
 		++iVert;
 
-		auto& adj = adjacency.at(iVert);
+		auto adj = adjacency.Neighbors(iVert);
 		for (auto c : vert.correspondingOriginalVertices)
 		{
 			meshVertexCorrespondsTo[c] = iVert;
 		}
 
 		double nodeRadius = 0.0;		
-		for (auto adjV : adj)
+		for (auto& neighbor : adj)
 		{
-			auto& v = skeleton->vertices.at(adjV);
+			auto& v = skeleton->vertices.at(neighbor.vertex);
 			nodeRadius += (vert.position - v.position).norm() / 2.0;
 		}
 		nodeRadii.at(iVert) = nodeRadius / adj.size();
@@ -12,10 +12,10 @@ void propagateDistance(const ICaveData& data, int vertex, double currentDistance
 	if (currentDistance < distancesFromEnd.at(vertex) && currentDistance < ENTRANCE_MIN_DISTANCE_TO_END)
 	{
 		distancesFromEnd.at(vertex) = currentDistance;
-		for (int neighbor : data.AdjacentNodes(vertex))
+		for (auto& neighbor : data.Neighbors(vertex))
 		{
-			double distance = (data.VertexPosition(vertex) - data.VertexPosition(neighbor)).norm();
-			propagateDistance(data, neighbor, currentDistance + distance, distancesFromEnd);
+			double distance = (data.VertexPosition(vertex) - data.VertexPosition(neighbor.vertex)).norm();
+			propagateDistance(data, neighbor.vertex, currentDistance + distance, distancesFromEnd);
 		}
 	}
 }
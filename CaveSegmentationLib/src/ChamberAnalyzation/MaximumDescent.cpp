@@ -22,10 +22,10 @@ bool MaximumDescentDFS(int currentVertex, double passageSize, TAccessor accessor
 
 	bool finalResult = false;
 	visitedNodes.push_back(currentVertex);
-	for (auto n : graph.AdjacentNodes(currentVertex))
-		if (dfsVisitedState[n] == 0)
+	for (auto& neighbor : graph.Neighbors(currentVertex))
+		if (dfsVisitedState[neighbor.vertex] == 0)
 		{
-			bool localResult = MaximumDescentDFS(n, passageSize, accessor, graph, dfsVisitedState, visitedNodes, segmentation);
+			bool localResult = MaximumDescentDFS(neighbor.vertex, passageSize, accessor, graph, dfsVisitedState, visitedNodes, segmentation);
 			finalResult = finalResult || localResult;
 		}
 
@@ -53,11 +53,10 @@ void MaximumDescent::FindChambers(const ICaveData& data, std::vector<int>& segme
 		double size = data.CaveSize(iVertex);
 		//check if this is a local maximum
 
-		auto& neighbors = data.AdjacentNodes(iVertex);
 		bool isLocalMaximum = true;
-		for (int iNeighbor : neighbors)
+		for (auto& neighbor : data.Neighbors(iVertex))
 		{
-			if (data.CaveSize(iNeighbor) > size)
+			if (data.CaveSize(neighbor.vertex) > size)
 			{
 				isLocalMaximum = false;
 				break;
@@ -26,8 +26,8 @@ void AssignUniqueChamberIndices(const ICaveData & data, std::vector<int32_t>& se
 				continue;
 			assignedNewIndex[currentVertex] = true;
 			segmentation[currentVertex] = nextSegment;
-			for (auto n : data.AdjacentNodes(currentVertex))
-				traversalStack.push(n);
+			for (auto& neighbor : data.Neighbors(currentVertex))
+				traversalStack.push(neighbor.vertex);
 		}
 		++nextSegment;
 	}
@@ -11,33 +11,22 @@ double gaussIntegrate(double standardDeviation, double lower, double upper)
 	return std::erf(upper / sqrt2sigma) - std::erf(lower / sqrt2sigma);
 }
 
-void addEdgeNeighborsToSet(const EdgeOrientationDistance& eod, double distanceAtTip, const IGraph& graph, std::set<EdgeOrientationDistance>& edgeSet, std::map<size_t, double>& distances)
+TabulatedErf::TabulatedErf()
 {
-	size_t v1, v2;
-	graph.IncidentVertices(eod.edge, v1, v2);
-	auto baseVertex = (eod.propagationReversed ? v2 : v1);
-	auto tipVertex = (eod.propagationReversed ? v1 : v2);
-	//propagation direction is baseVertex--->tipVertex
-
-	auto& adj = graph.AdjacentNodes(tipVertex);
-
-	auto& tipPosition = graph.VertexPosition(tipVertex);
-	for (auto adjV : adj)
+	//Hermite interpolation between the samples with the derivative 2 / sqrt(pi) * exp(-x^2)
+	const double h = 1.0 / SAMPLES_PER_UNIT;
+	coefficients.resize(4 * RANGE * SAMPLES_PER_UNIT);
+	for (int i = 0; i < RANGE * SAMPLES_PER_UNIT; ++i)
 	{
-		if (adjV == baseVertex) //wrong direction
-			continue;
-
-		size_t e = graph.EdgeIdFromVertexPair(adjV, tipVertex);
-		auto distanceEntry = distances.find(adjV);
-		if (distanceEntry == distances.end() || distanceEntry->second > distanceAtTip)
-		{
-			if (distanceEntry != distances.end())
-				edgeSet.erase(EdgeOrientationDistance(e, distanceEntry->second));
-			size_t incident1, incident2;
-			graph.IncidentVertices(e, incident1, incident2);
-			bool propReversed = (incident1 == adjV);
-			edgeSet.insert(EdgeOrientationDistance(e, distanceAtTip, propReversed, eod.measureReversed ^ eod.propagationReversed ^ propReversed));
-			distances[e] = distanceAtTip;
-		}
+		double x0 = i * h, x1 = (i + 1) * h;
+		double y0 = std::erf(x0), y1 = std::erf(x1);
+		double m0 = h * 2 / sqrt(M_PI) * exp(-x0 * x0), m1 = h * 2 / sqrt(M_PI) * exp(-x1 * x1);
+		double* c = &coefficients[4 * i];
+		c[0] = y0;
+		c[1] = m0;
+		c[2] = 3 * (y1 - y0) - 2 * m0 - m1;
+		c[3] = 2 * (y0 - y1) + m0 + m1;
 	}
-}
\ No newline at end of file
+}
+
+const TabulatedErf tabulatedErf;
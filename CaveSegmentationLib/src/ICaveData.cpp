@@ -38,4 +38,12 @@ const int* ICaveData::GetSegmentColor(int segmentIndex)
 		return noSegmentColor;
 	else
 		return segmentColors[segmentIndex % 10];
+}
+
+bool ICaveData::IsSupportedSphereSamplingResolution(int resolution)
+{
+	for (int supportedResolution : SPHERE_SAMPLING_RESOLUTIONS)
+		if (supportedResolution == resolution)
+			return true;
+	return false;
 }
\ No newline at end of file
@@ -43,4 +43,16 @@ double GetSqrDistanceToMesh(const Point& p, const Vector& dir, const Tree& tree)
 	tree.all_intersections(ray_query, min);
 
 	return minDistance;
+}
+
+double GetSqrDistanceToMesh(const Point& p, const Vector& dir, const TriangleBVH& bvh)
+{
+	float origin[3] = { (float)p.x(), (float)p.y(), (float)p.z() };
+	float direction[3] = { (float)dir.x(), (float)dir.y(), (float)dir.z() };
+
+	double t = bvh.ClosestHit(origin, direction);
+	if (std::isinf(t))
+		return std::numeric_limits<double>::infinity();
+
+	return t * t * dir.squared_length();
 }
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "RayDistanceCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+//Identifies ray distance cache files
+const char FILE_TAG[4] = { 'R', 'D', 'C', ' ' };
+
+//Version of the file format
+const uint32_t FILE_VERSION = 1;
+
+namespace
+{
+	struct FileHeader
+	{
+		char tag[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t mode;
+		uint32_t reserved;
+		uint64_t vertexCount;
+		uint64_t samplesPerVertex;
+	};
+
+	//Converts a float to IEEE 754 half precision with round-to-nearest-even.
+	uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(float));
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t biasedExponent = (bits >> 23) & 0xff;
+		uint32_t mantissa = bits & 0x7fffff;
+
+		if (biasedExponent == 0xff) //infinity or NaN
+			return (uint16_t)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+
+		int32_t exponent = (int32_t)biasedExponent - 127 + 15;
+		if (exponent >= 31) //overflow
+			return (uint16_t)(sign | 0x7c00);
+
+		if (exponent <= 0)
+		{
+			//Subnormal half
+			if (exponent < -10)
+				return (uint16_t)sign;
+			mantissa |= 0x800000;
+			uint32_t shift = (uint32_t)(14 - exponent);
+			uint32_t half = mantissa >> shift;
+			uint32_t remainder = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (remainder > halfway || (remainder == halfway && (half & 1)))
+				++half;
+			return (uint16_t)(sign | half);
+		}
+
+		uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+		uint32_t remainder = mantissa & 0x1fff;
+		//A carry into the exponent is the correct result
+		if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+			++half;
+		return (uint16_t)half;
+	}
+
+	//Converts an IEEE 754 half precision value to float.
+	float HalfToFloat(uint16_t half)
+	{
+		uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1f;
+		uint32_t mantissa = half & 0x3ff;
+		uint32_t bits;
+		if (exponent == 0)
+		{
+			if (mantissa == 0)
+				bits = sign;
+			else
+			{
+				//Normalize the subnormal value
+				exponent = 127 - 15 + 1;
+				while ((mantissa & 0x400) == 0)
+				{
+					mantissa <<= 1;
+					--exponent;
+				}
+				mantissa &= 0x3ff;
+				bits = sign | (exponent << 23) | (mantissa << 13);
+			}
+		}
+		else if (exponent == 31)
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		else
+			bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+		float value;
+		memcpy(&value, &bits, sizeof(float));
+		return value;
+	}
+}
+
+RayDistanceCache::RayDistanceCache()
+	: mode(ICaveData::NoRayDistanceCache), samplesPerVertex(0)
+{ }
+
+void RayDistanceCache::Reset(ICaveData::RayDistanceCacheMode mode, size_t vertexCount, size_t samplesPerVertex)
+{
+	this->mode = mode;
+	this->samplesPerVertex = samplesPerVertex;
+
+	std::vector<float>().swap(distances32);
+	std::vector<uint16_t>().swap(distances16);
+	std::vector<float>().swap(scales16);
+	std::vector<char>().swap(stored);
+
+	switch (mode)
+	{
+	case ICaveData::Float32RayDistanceCache:
+		distances32.resize(vertexCount * samplesPerVertex);
+		break;
+	case ICaveData::Float16RayDistanceCache:
+		distances16.resize(vertexCount * samplesPerVertex);
+		scales16.resize(vertexCount);
+		break;
+	default:
+		return;
+	}
+	stored.resize(vertexCount, 0);
+}
+
+bool RayDistanceCache::Matches(ICaveData::RayDistanceCacheMode mode, size_t vertexCount, size_t samplesPerVertex) const
+{
+	return this->mode == mode && stored.size() == (mode == ICaveData::NoRayDistanceCache ? 0 : vertexCount) && this->samplesPerVertex == samplesPerVertex;
+}
+
+bool RayDistanceCache::Get(size_t vertex, float* distances) const
+{
+	if (!IsEnabled() || !stored[vertex])
+		return false;
+
+	size_t offset = vertex * samplesPerVertex;
+	if (mode == ICaveData::Float32RayDistanceCache)
+		std::copy(distances32.begin() + offset, distances32.begin() + offset + samplesPerVertex, distances);
+	else
+	{
+		float scale = scales16[vertex];
+		for (size_t i = 0; i < samplesPerVertex; ++i)
+			distances[i] = HalfToFloat(distances16[offset + i]) * scale;
+	}
+	return true;
+}
+
+void RayDistanceCache::Store(size_t vertex, const float* distances)
+{
+	if (!IsEnabled())
+		return;
+
+	size_t offset = vertex * samplesPerVertex;
+	if (mode == ICaveData::Float32RayDistanceCache)
+		std::copy(distances, distances + samplesPerVertex, distances32.begin() + offset);
+	else
+	{
+		//Normalize by the maximum distance, such that the relative precision of half floats is independent of the model's scale
+		float scale = *std::max_element(distances, distances + samplesPerVertex);
+		if (scale <= 0 || std::isinf(scale))
+			return;
+		scales16[vertex] = scale;
+		float invScale = 1.0f / scale;
+		for (size_t i = 0; i < samplesPerVertex; ++i)
+			distances16[offset + i] = FloatToHalf(distances[i] * invScale);
+	}
+	stored[vertex] = 1;
+}
+
+void RayDistanceCache::Invalidate(size_t vertex)
+{
+	if (IsEnabled())
+		stored[vertex] = 0;
+}
+
+bool RayDistanceCache::Load(const std::string& file, uint64_t key)
+{
+	FILE* f = fopen(file.c_str(), "rb");
+	if (!f)
+		return false;
+
+	FileHeader header;
+	bool valid = fread(&header, sizeof(FileHeader), 1, f) == 1
+		&& memcmp(header.tag, FILE_TAG, sizeof(header.tag)) == 0 && header.version == FILE_VERSION && header.key == key
+		&& header.mode == (uint32_t)mode && header.vertexCount == stored.size() && header.samplesPerVertex == samplesPerVertex;
+
+	if (valid && IsEnabled())
+	{
+		std::vector<char> fileStored(stored.size());
+		std::vector<float> fileDistances32(distances32.size());
+		std::vector<uint16_t> fileDistances16(distances16.size());
+		std::vector<float> fileScales16(scales16.size());
+		valid = fread(fileStored.data(), sizeof(char), fileStored.size(), f) == fileStored.size()
+			&& fread(fileDistances32.data(), sizeof(float), fileDistances32.size(), f) == fileDistances32.size()
+			&& fread(fileDistances16.data(), sizeof(uint16_t), fileDistances16.size(), f) == fileDistances16.size()
+			&& fread(fileScales16.data(), sizeof(float), fileScales16.size(), f) == fileScales16.size();
+		if (valid)
+		{
+			stored.swap(fileStored);
+			distances32.swap(fileDistances32);
+			distances16.swap(fileDistances16);
+			scales16.swap(fileScales16);
+		}
+	}
+	fclose(f);
+	return valid;
+}
+
+void RayDistanceCache::Save(const std::string& file, uint64_t key)
+{
+	FILE* f = fopen(file.c_str(), "wb");
+	if (!f)
+		return;
+
+	FileHeader header;
+	memcpy(header.tag, FILE_TAG, sizeof(header.tag));
+	header.version = FILE_VERSION;
+	header.key = key;
+	header.mode = (uint32_t)mode;
+	header.reserved = 0;
+	header.vertexCount = stored.size();
+	header.samplesPerVertex = samplesPerVertex;
+	fwrite(&header, sizeof(FileHeader), 1, f);
+
+	fwrite(stored.data(), sizeof(char), stored.size(), f);
+	fwrite(distances32.data(), sizeof(float), distances32.size(), f);
+	fwrite(distances16.data(), sizeof(uint16_t), distances16.size(), f);
+	fwrite(scales16.data(), sizeof(float), scales16.size(), f);
+	fclose(f);
+}
+
+size_t RayDistanceCache::MemoryUsage() const
+{
+	return distances32.capacity() * sizeof(float) + distances16.capacity() * sizeof(uint16_t) + scales16.capacity() * sizeof(float) + stored.capacity();
+}
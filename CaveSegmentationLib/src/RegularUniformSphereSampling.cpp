@@ -1,5 +1,7 @@
 #include "RegularUniformSphereSampling.h"
 
+#include <limits>
+
 // -----  RegularUniformSphereSampling -----
 
 int closestPowerOfTwo(double x)
@@ -13,15 +15,24 @@ int closestPowerOfTwo(double x)
 		return upper;
 }
 
+//Linear interpolation that returns infinity if one of the values is not finite (a missed ray), even if its weight is 0.
+//Otherwise, 0 * inf would result in NaN.
+double blendFinite(double lower, double upper, double alpha)
+{
+	if (!std::isfinite(lower) || !std::isfinite(upper))
+		return std::numeric_limits<double>::infinity();
+	return (1 - alpha) * lower + alpha * upper;
+}
+
 RegularUniformSphereSampling::RegularUniformSphereSampling(const int nPhi)
 	:nPhi(nPhi)
 {
 	assert(nPhi > 2);
 	const int nThetaEq = (nPhi - 1) * 2; //number of samples along the equator	
 
-	directionSamples.resize(nPhi);
 	nTheta.resize(nPhi);
 	areaElements.resize(nPhi);
+	ringOffsets.resize(nPhi);
 
 	int nDirectionSamples = 0;
 	_maxNTheta = closestPowerOfTwo(nThetaEq);
@@ -29,7 +40,7 @@ RegularUniformSphereSampling::RegularUniformSphereSampling(const int nPhi)
 	{
 		double phi = iPhi * M_PI / (nPhi - 1);
 		nTheta[iPhi] = closestPowerOfTwo(sin(phi)*nThetaEq);
-		directionSamples[iPhi] .resize(nTheta[iPhi]);
+		ringOffsets[iPhi] = nDirectionSamples;
 		if (iPhi == 0 || iPhi == nPhi - 1)
 			areaElements[iPhi] = (1 - cos(M_PI / (nPhi - 1) / 2.0)) * 2 * M_PI;
 		else
@@ -37,10 +48,28 @@ RegularUniformSphereSampling::RegularUniformSphereSampling(const int nPhi)
 		for (int iTheta = 0; iTheta < nTheta[iPhi]; ++iTheta)
 		{
 			double theta = iTheta * 2 * M_PI / nTheta[iPhi];
-			directionSamples[iPhi][iTheta] = Point((double)phi, (double)theta);
+			samples.push_back(Point((double)phi, (double)theta));
+			sampleRings.push_back(iPhi);
+			for (int axis = 0; axis < 3; ++axis)
+				flatDirections[axis].push_back((float)samples.back()[axis]);
 			++nDirectionSamples;
 		}
 	}
+
+	//Collect the neighbors of all samples once, such that algorithms do not need to run the neighbor_iterator state machine
+	neighborOffsets.reserve(nDirectionSamples + 1);
+	neighborOffsets.push_back(0);
+	for (auto it = begin(); it != end(); ++it)
+	{
+		for (auto n : Neighbors(it))
+			neighborIndices.push_back((uint32_t)SampleIndex(n));
+		neighborOffsets.push_back((uint32_t)neighborIndices.size());
+	}
+	phiToRing = (nPhi - 1) / M_PI;
+	thetaToIndex.resize(nPhi);
+	for (int iPhi = 0; iPhi < nPhi; ++iPhi)
+		thetaToIndex[iPhi] = nTheta[iPhi] / (2 * M_PI);
+
 	std::cout << nDirectionSamples << " direction samples." << std::endl;
 }
 
@@ -67,6 +96,115 @@ void RegularUniformSphereSampling::ParametersFromPoint(const Vector & point, dou
 		theta += 2 * M_PI;
 }
 
+//Polynomial approximation of acos on [-1, 1] with an absolute error below 2.5e-8 (Abramowitz & Stegun 4.4.46)
+inline double FastAcos(double x)
+{
+	double a = std::abs(x);
+	double p = ((((((-0.0012624911 * a + 0.0066700901) * a - 0.0170881256) * a + 0.0308918810) * a - 0.0501743046) * a + 0.0889789874) * a - 0.2145988016) * a + 1.5707963050;
+	double r = sqrt(1 - a) * p;
+	return x < 0 ? M_PI - r : r;
+}
+
+//Polynomial approximation of atan2(x, y) mapped to [0, 2 pi] (as in ParametersFromPoint) with an absolute error below 2e-8 (Abramowitz & Stegun 4.4.49)
+inline double FastTheta(double x, double y)
+{
+	double ax = std::abs(x), ay = std::abs(y);
+	double maxAbs = std::max(ax, ay);
+	double r = maxAbs > 0 ? std::min(ax, ay) / maxAbs : 0;
+	double r2 = r * r;
+	double p = (((((((0.0028662257 * r2 - 0.0161657367) * r2 + 0.0429096138) * r2 - 0.0752896400) * r2 + 0.1065626393) * r2 - 0.1420889944) * r2 + 0.1999355085) * r2 - 0.3333314528) * r2 + 1;
+	double t = r * p;
+	t = ax > ay ? M_PI / 2 - t : t;
+	t = y < 0 ? M_PI - t : t;
+	return x < 0 ? 2 * M_PI - t : t;
+}
+
+const size_t INTERPOLATION_BLOCK_SIZE = 64;
+
+struct RegularUniformSphereSampling::interpolation_stencils
+{
+	//lower left, lower right, upper left, upper right
+	uint32_t samples[4][INTERPOLATION_BLOCK_SIZE];
+	double weights[4][INTERPOLATION_BLOCK_SIZE];
+};
+
+void RegularUniformSphereSampling::CalculateInterpolationStencils(const double* x, const double* y, const double* z, size_t count, interpolation_stencils& stencils) const
+{
+	double ringParameter[INTERPOLATION_BLOCK_SIZE];
+	double theta[INTERPOLATION_BLOCK_SIZE];
+
+	//Branch-free part that the compiler can vectorize
+	const double maxRing = nPhi - 1;
+	for (size_t i = 0; i < count; ++i)
+	{
+		double clampedZ = std::min(1.0, std::max(-1.0, z[i]));
+		ringParameter[i] = std::min(maxRing, FastAcos(clampedZ) * phiToRing);
+		theta[i] = FastTheta(x[i], y[i]);
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		int lowerRing = (int)ringParameter[i];
+		int upperRing = std::min(lowerRing + 1, nPhi - 1);
+		double alphaPhi = ringParameter[i] - lowerRing;
+
+		//Ring sizes are powers of two, so wrapping around is a bit mask. theta <= 2 pi, hence the left index is at most nTheta.
+		double lowerT = theta[i] * thetaToIndex[lowerRing];
+		int lowerLeft = (int)lowerT;
+		double alphaLower = lowerT - lowerLeft;
+		int lowerMask = nTheta[lowerRing] - 1;
+
+		double upperT = theta[i] * thetaToIndex[upperRing];
+		int upperLeft = (int)upperT;
+		double alphaUpper = upperT - upperLeft;
+		int upperMask = nTheta[upperRing] - 1;
+
+		uint32_t lowerOffset = (uint32_t)ringOffsets[lowerRing];
+		uint32_t upperOffset = (uint32_t)ringOffsets[upperRing];
+		stencils.samples[0][i] = lowerOffset + (lowerLeft & lowerMask);
+		stencils.samples[1][i] = lowerOffset + ((lowerLeft + 1) & lowerMask);
+		stencils.samples[2][i] = upperOffset + (upperLeft & upperMask);
+		stencils.samples[3][i] = upperOffset + ((upperLeft + 1) & upperMask);
+		stencils.weights[0][i] = (1 - alphaPhi) * (1 - alphaLower);
+		stencils.weights[1][i] = (1 - alphaPhi) * alphaLower;
+		stencils.weights[2][i] = alphaPhi * (1 - alphaUpper);
+		stencils.weights[3][i] = alphaPhi * alphaUpper;
+	}
+}
+
+void RegularUniformSphereSampling::InterpolateField(const SphereScalarField& field, const double* x, const double* y, const double* z, size_t count, double* values) const
+{
+	interpolation_stencils stencils;
+	const double* f = field.Data();
+	for (size_t blockStart = 0; blockStart < count; blockStart += INTERPOLATION_BLOCK_SIZE)
+	{
+		size_t blockSize = std::min(INTERPOLATION_BLOCK_SIZE, count - blockStart);
+		CalculateInterpolationStencils(x + blockStart, y + blockStart, z + blockStart, blockSize, stencils);
+		for (size_t i = 0; i < blockSize; ++i)
+			values[blockStart + i] = stencils.weights[0][i] * f[stencils.samples[0][i]] + stencils.weights[1][i] * f[stencils.samples[1][i]]
+				+ stencils.weights[2][i] * f[stencils.samples[2][i]] + stencils.weights[3][i] * f[stencils.samples[3][i]];
+	}
+}
+
+void RegularUniformSphereSampling::InterpolateField(const SphereVectorField& field, const double* x, const double* y, const double* z, size_t count, double* vx, double* vy, double* vz) const
+{
+	interpolation_stencils stencils;
+	double* results[3] = { vx, vy, vz };
+	for (size_t blockStart = 0; blockStart < count; blockStart += INTERPOLATION_BLOCK_SIZE)
+	{
+		size_t blockSize = std::min(INTERPOLATION_BLOCK_SIZE, count - blockStart);
+		CalculateInterpolationStencils(x + blockStart, y + blockStart, z + blockStart, blockSize, stencils);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const double* f = field.Component(axis);
+			double* result = results[axis] + blockStart;
+			for (size_t i = 0; i < blockSize; ++i)
+				result[i] = stencils.weights[0][i] * f[stencils.samples[0][i]] + stencils.weights[1][i] * f[stencils.samples[1][i]]
+					+ stencils.weights[2][i] * f[stencils.samples[2][i]] + stencils.weights[3][i] * f[stencils.samples[3][i]];
+		}
+	}
+}
+
 RegularUniformSphereSampling::sample_iterator RegularUniformSphereSampling::begin() const
 {
 	return RegularUniformSphereSampling::sample_iterator(this, 0, 0);
@@ -91,6 +229,21 @@ RegularUniformSphereSampling::range_helper RegularUniformSphereSampling::Neighbo
 	return range_helper(this, center, angularDistance);
 }
 
+RegularUniformSphereSampling::range_table RegularUniformSphereSampling::RangeNeighborhoods(double angularDistance) const
+{
+	range_table table;
+	table.angularDistance = angularDistance;
+	table.offsets.reserve(samples.size() + 1);
+	table.offsets.push_back(0);
+	for (size_t iSample = 0; iSample < samples.size(); ++iSample)
+	{
+		for (auto n : Neighbors(samples[iSample], angularDistance))
+			table.indices.push_back((uint32_t)SampleIndex(n));
+		table.offsets.push_back((uint32_t)table.indices.size());
+	}
+	return table;
+}
+
 double RegularUniformSphereSampling::Area(const RegularUniformSphereSampling::sample_iterator& it) const
 {
 	return areaElements[it.iPhi];
@@ -105,11 +258,117 @@ RegularUniformSphereSampling::sample_iterator RegularUniformSphereSampling::Clos
 	return sample_iterator(this, iPhi, iTheta);
 }
 
+void RegularUniformSphereSampling::GetParameterSpaceRect(size_t sample, double& x, double& y, double& w, double& h) const
+{
+	int iPhi = sampleRings[sample];
+	int iTheta = (int)(sample - ringOffsets[iPhi]);
+
+	h = M_PI / (nPhi - 1);
+	y = h * iPhi - h / 2;
+
+	w = 2.0 * M_PI / nTheta[iPhi];
+	x = iTheta * w - w / 2;
+
+	if (iPhi == 0)
+	{
+		h /= 2;
+		y = 0;
+	}
+}
+
 int RegularUniformSphereSampling::MaxNTheta() const
 {
 	return _maxNTheta;
 }
 
+void RegularUniformSphereSampling::MarkCoarseSamples(int stride, std::vector<char>& mask) const
+{
+	mask.assign(NumberOfSamples(), 0);
+	for (int iPhi = 0; iPhi < nPhi; ++iPhi)
+	{
+		if (!IsCoarseRing(iPhi, stride))
+			continue;
+		int thetaStride = CoarseThetaStride(iPhi, stride);
+		for (int iTheta = 0; iTheta < nTheta[iPhi]; iTheta += thetaStride)
+			mask[ringOffsets[iPhi] + iTheta] = 1;
+	}
+}
+
+void RegularUniformSphereSampling::MarkRefinementSamples(int stride, const std::vector<float>& values, double relativeSteepness, std::vector<char>& refine) const
+{
+	//Everything within 1.5 coarse grid cells around a critical coarse sample is refined
+	double refinementRadius = 1.5 * stride * M_PI / (nPhi - 1);
+
+	for (int iPhi = 0; iPhi < nPhi; ++iPhi)
+	{
+		if (!IsCoarseRing(iPhi, stride))
+			continue;
+		int thetaStride = CoarseThetaStride(iPhi, stride);
+		for (int iTheta = 0; iTheta < nTheta[iPhi]; iTheta += thetaStride)
+		{
+			size_t sample = ringOffsets[iPhi] + iTheta;
+			float value = values[sample];
+			bool isMaximum = true, isMinimum = true;
+			float maxDifference = 0;
+			for (auto n : NeighborIndices(sample))
+			{
+				float neighborValue = values[n];
+				isMaximum &= value >= neighborValue;
+				isMinimum &= value <= neighborValue;
+				maxDifference = std::max(maxDifference, std::abs(value - neighborValue));
+			}
+
+			//Neighbors are interpolated, so their differences are 1/stride of the coarse differences
+			if (!isMaximum && !isMinimum && maxDifference * stride <= relativeSteepness * value)
+				continue;
+
+			const Vector& center = samples[sample];
+			for (auto s : Neighbors(center, refinementRadius))
+				refine[SampleIndex(s)] = 1;
+		}
+	}
+}
+
+float RegularUniformSphereSampling::InterpolateCoarseRing(int iPhi, int stride, double theta, const std::vector<float>& values) const
+{
+	int thetaStride = CoarseThetaStride(iPhi, stride);
+	int coarseSamples = nTheta[iPhi] / thetaStride;
+	double t = theta * coarseSamples / (2 * M_PI);
+	int lower = (int)floor(t);
+	double alpha = t - lower;
+	lower %= coarseSamples;
+	int upper = (lower + 1) % coarseSamples;
+	size_t offset = ringOffsets[iPhi];
+	return (float)blendFinite(values[offset + lower * thetaStride], values[offset + upper * thetaStride], alpha);
+}
+
+void RegularUniformSphereSampling::InterpolateFromCoarseSamples(int stride, const std::vector<char>& known, std::vector<float>& values) const
+{
+	for (int iPhi = 0; iPhi < nPhi; ++iPhi)
+	{
+		size_t offset = ringOffsets[iPhi];
+		if (IsCoarseRing(iPhi, stride))
+		{
+			for (int iTheta = 0; iTheta < nTheta[iPhi]; ++iTheta)
+				if (!known[offset + iTheta])
+					values[offset + iTheta] = InterpolateCoarseRing(iPhi, stride, iTheta * 2 * M_PI / nTheta[iPhi], values);
+		}
+		else
+		{
+			int lowerPhi = iPhi - iPhi % stride;
+			int upperPhi = std::min(lowerPhi + stride, nPhi - 1);
+			double alphaPhi = (double)(iPhi - lowerPhi) / (upperPhi - lowerPhi);
+			for (int iTheta = 0; iTheta < nTheta[iPhi]; ++iTheta)
+			{
+				if (known[offset + iTheta])
+					continue;
+				double theta = iTheta * 2 * M_PI / nTheta[iPhi];
+				values[offset + iTheta] = (float)blendFinite(InterpolateCoarseRing(lowerPhi, stride, theta, values), InterpolateCoarseRing(upperPhi, stride, theta, values), alphaPhi);
+			}
+		}
+	}
+}
+
 // -----  RegularUniformSphereSampling::sample_iterator -----
 
 RegularUniformSphereSampling::sample_iterator::sample_iterator(const RegularUniformSphereSampling* sampling, int iPhi, int iTheta)
@@ -123,7 +382,7 @@ RegularUniformSphereSampling::sample_iterator::sample_iterator(const RegularUnif
 
 const Vector& RegularUniformSphereSampling::sample_iterator::operator*() const
 {
-	return sampling->directionSamples[iPhi][iTheta];
+	return sampling->samples[sampling->ringOffsets[iPhi] + iTheta];
 }
 
 bool RegularUniformSphereSampling::sample_iterator::operator!=(const sample_iterator& rhs) const
@@ -159,18 +418,7 @@ void RegularUniformSphereSampling::sample_iterator::GetParameters(double & phi,
 
 void RegularUniformSphereSampling::sample_iterator::GetParameterSpaceRect(double& x, double& y, double& w, double& h)
 {	
-	h = M_PI / (sampling->nPhi - 1);
-	y = h * iPhi - h/2;
-
-	w = 2.0 * M_PI / sampling->nTheta[iPhi];
-	x = iTheta * w - w/2;
-
-	if (iPhi == 0)
-	{
-		h /= 2;
-		y = 0;
-	}
-	
+	sampling->GetParameterSpaceRect(sampling->SampleIndex(*this), x, y, w, h);
 }
 
 // -----  RegularUniformSphereSampling::neighbor_iterator -----
@@ -0,0 +1,43 @@
+#include "SkeletonAdjacency.h"
+
+void SkeletonAdjacency::Build(size_t vertexCount, const std::vector<CurveSkeleton::TEdge>& edges)
+{
+	offsets.assign(vertexCount + 1, 0);
+	for (auto& edge : edges)
+	{
+		++offsets[edge.first + 1];
+		++offsets[edge.second + 1];
+	}
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] += offsets[v];
+
+	entries.resize(2 * edges.size());
+	std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+	for (int iEdge = 0; iEdge < (int)edges.size(); ++iEdge)
+	{
+		auto& edge = edges[iEdge];
+		entries[next[edge.first]++] = { edge.second, iEdge, 1 };
+		entries[next[edge.second]++] = { edge.first, iEdge, -1 };
+	}
+}
+
+void SkeletonAdjacency::Clear()
+{
+	offsets.clear();
+	offsets.shrink_to_fit();
+	entries.clear();
+	entries.shrink_to_fit();
+}
+
+int SkeletonAdjacency::FindEdge(size_t v1, size_t v2) const
+{
+	for (auto& neighbor : Neighbors(v1))
+		if (neighbor.vertex == (int)v2)
+			return neighbor.edge;
+	return -1;
+}
+
+size_t SkeletonAdjacency::MemoryUsage() const
+{
+	return offsets.capacity() * sizeof(size_t) + entries.capacity() * sizeof(SkeletonNeighbor);
+}
@@ -0,0 +1,902 @@
+#include "SkeletonChains.h"
+
+#include "GraphProc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <omp.h>
+
+namespace
+{
+	typedef std::pair<double, double> Step;
+
+	const double NO_VALUE = -std::numeric_limits<double>::infinity();
+
+	//Keeps the steps that are not dominated by a step with a smaller or equal distance and a larger or equal maximum, ordered by
+	//increasing distance.
+	void StaircaseByIncreasingDistance(std::vector<Step>& steps)
+	{
+		std::sort(steps.begin(), steps.end(), [](const Step& a, const Step& b) { return a.first < b.first || (a.first == b.first && a.second > b.second); });
+		size_t kept = 0;
+		double maximum = NO_VALUE;
+		for (auto& step : steps)
+			if (step.second > maximum)
+			{
+				maximum = step.second;
+				steps[kept++] = step;
+			}
+		steps.resize(kept);
+	}
+
+	//Keeps the steps that are not dominated by a step with a larger or equal reach and a larger or equal maximum, ordered by
+	//decreasing reach.
+	void StaircaseByDecreasingReach(std::vector<Step>& steps)
+	{
+		std::sort(steps.begin(), steps.end(), [](const Step& a, const Step& b) { return a.first > b.first || (a.first == b.first && a.second > b.second); });
+		size_t kept = 0;
+		double maximum = NO_VALUE;
+		for (auto& step : steps)
+			if (step.second > maximum)
+			{
+				maximum = step.second;
+				steps[kept++] = step;
+			}
+		steps.resize(kept);
+	}
+
+	//Maximum of the steps with a distance of at most distance
+	double MaxUpTo(const std::vector<Step>& staircase, double distance, double tolerance, bool& ambiguous)
+	{
+		auto near = std::lower_bound(staircase.begin(), staircase.end(), distance - tolerance, [](const Step& step, double d) { return step.first < d; });
+		if (near != staircase.end() && near->first <= distance + tolerance)
+			ambiguous = true;
+		auto it = std::upper_bound(near, staircase.end(), distance, [](double d, const Step& step) { return d < step.first; });
+		return it == staircase.begin() ? NO_VALUE : (it - 1)->second;
+	}
+
+	//Maximum of the steps with a reach of at least distance
+	double MaxReaching(const std::vector<Step>& staircase, double distance, double tolerance, bool& ambiguous)
+	{
+		auto near = std::lower_bound(staircase.begin(), staircase.end(), distance + tolerance, [](const Step& step, double d) { return step.first > d; });
+		if (near != staircase.end() && near->first >= distance - tolerance)
+			ambiguous = true;
+		auto it = std::upper_bound(near, staircase.end(), distance, [](double d, const Step& step) { return d > step.first; });
+		return it == staircase.begin() ? NO_VALUE : (it - 1)->second;
+	}
+
+	//Returns if any of the ascending distances lies within tolerance of distance
+	bool AnyWithin(const double* begin, const double* end, double distance, double tolerance)
+	{
+		auto it = std::lower_bound(begin, end, distance - tolerance);
+		return it != end && *it <= distance + tolerance;
+	}
+
+	int FloorLog2(size_t n)
+	{
+		int k = 0;
+		while (((size_t)2 << k) <= n)
+			++k;
+		return k;
+	}
+
+	//Sparse table: table[k * n + i] is the maximum of the entries i to i + 2^k - 1. The entries must be in table[0] to table[n - 1].
+	void BuildRangeMaximum(std::vector<double>& table, size_t n)
+	{
+		int levels = FloorLog2(n) + 1;
+		table.resize(levels * n);
+		for (int k = 1; k < levels; ++k)
+		{
+			size_t half = (size_t)1 << (k - 1);
+			for (size_t i = 0; i + 2 * half <= n; ++i)
+				table[k * n + i] = std::max(table[(k - 1) * n + i], table[(k - 1) * n + i + half]);
+		}
+	}
+
+	double RangeMaximum(const std::vector<double>& table, size_t n, size_t first, size_t last)
+	{
+		int k = FloorLog2(last - first + 1);
+		return std::max(table[k * n + first], table[k * n + last + 1 - ((size_t)1 << k)]);
+	}
+
+	//Reverse sparse table: raises the entries first to last to at least value. The result is in table[0] to table[n - 1] after
+	//PushDownRangeMaximum().
+	void RaiseRange(std::vector<double>& table, size_t n, size_t first, size_t last, double value)
+	{
+		int k = FloorLog2(last - first + 1);
+		double& a = table[k * n + first];
+		double& b = table[k * n + last + 1 - ((size_t)1 << k)];
+		a = std::max(a, value);
+		b = std::max(b, value);
+	}
+
+	void PushDownRangeMaximum(std::vector<double>& table, size_t n)
+	{
+		for (int k = FloorLog2(n); k > 0; --k)
+		{
+			size_t half = (size_t)1 << (k - 1);
+			for (size_t i = 0; i + 2 * half <= n; ++i)
+			{
+				double value = table[k * n + i];
+				table[(k - 1) * n + i] = std::max(table[(k - 1) * n + i], value);
+				table[(k - 1) * n + i + half] = std::max(table[(k - 1) * n + i + half], value);
+			}
+		}
+	}
+
+	//Result of MaxSearchDFSHook for the given maximum
+	double FinishMax(double maximum)
+	{
+		return maximum > std::numeric_limits<double>::min() ? maximum : std::numeric_limits<double>::min();
+	}
+
+	//Result of maxAdvect() for a vertex with the given source value and advected maximum
+	double FinishAdvect(double source, double maximum)
+	{
+		return source < maximum ? maximum : source;
+	}
+}
+
+//Visited markers, parents, and the stack of a search, reused for all searches of a thread
+struct SkeletonChains::SearchWorkspace
+{
+	std::vector<unsigned int> stamps;
+	unsigned int generation;
+	std::vector<int> parents;
+	std::vector<NodeDistance> stack;
+
+	SearchWorkspace() : generation(0) { }
+
+	void Begin(size_t vertexCount)
+	{
+		if (stamps.size() != vertexCount)
+		{
+			stamps.assign(vertexCount, 0);
+			parents.resize(vertexCount);
+			generation = 0;
+		}
+		if (++generation == 0)
+		{
+			//the stamps have wrapped around
+			std::fill(stamps.begin(), stamps.end(), 0);
+			generation = 1;
+		}
+		stack.clear();
+	}
+
+	bool Visited(int node) const { return stamps[node] == generation; }
+
+	void Visit(int node, int parent, double distance)
+	{
+		stamps[node] = generation;
+		parents[node] = parent;
+		stack.emplace_back(node, distance);
+	}
+};
+
+SkeletonChains::SkeletonChains()
+	: vertices(nullptr), adjacency(nullptr), loopVertexCount(0), totalLength(0)
+{ }
+
+void SkeletonChains::Clear()
+{
+	vertices = nullptr;
+	adjacency = nullptr;
+	forestOffsets.clear();
+	forestNeighbors.clear();
+	chainOffsets.clear();
+	chainVertices.clear();
+	chainDistances.clear();
+	vertexChain.clear();
+	junctionHalfOffsets.clear();
+	junctionHalves.clear();
+	junctions.clear();
+	halfOrder.clear();
+	distanceToLoop.clear();
+	halfDistanceToLoop.clear();
+	loopVertexCount = 0;
+	totalLength = 0;
+}
+
+void SkeletonChains::Build(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency)
+{
+	Clear();
+	this->vertices = &vertices;
+	this->adjacency = &adjacency;
+	int vertexCount = (int)vertices.size();
+
+	//Find the bridges (edges that are not on a loop) with Tarjan's algorithm. The first occurrence of the parent in the adjacency
+	//list is the tree edge; further occurrences are parallel edges, which form a loop.
+	struct Frame
+	{
+		int vertex;
+		int parent;
+		size_t next;
+		bool parentSkipped;
+	};
+	std::vector<int> discovery(vertexCount, -1), low(vertexCount), parents(vertexCount, -1);
+	std::vector<char> bridgeToParent(vertexCount, 0);
+	std::vector<Frame> stack;
+	int time = 0;
+	for (int root = 0; root < vertexCount; ++root)
+	{
+		if (discovery[root] != -1)
+			continue;
+		discovery[root] = low[root] = time++;
+		stack.push_back({ root, -1, 0, false });
+		while (!stack.empty())
+		{
+			Frame& frame = stack.back();
+			int v = frame.vertex;
+			auto adj = adjacency.Neighbors(v);
+			if (frame.next < adj.size())
+			{
+				int w = adj[frame.next++].vertex;
+				if (w == frame.parent && !frame.parentSkipped)
+					frame.parentSkipped = true;
+				else if (discovery[w] == -1)
+				{
+					discovery[w] = low[w] = time++;
+					parents[w] = v;
+					stack.push_back({ w, v, 0, false });
+				}
+				else
+					low[v] = std::min(low[v], discovery[w]);
+			}
+			else
+			{
+				int p = frame.parent;
+				stack.pop_back();
+				if (p >= 0)
+				{
+					low[p] = std::min(low[p], low[v]);
+					if (low[v] > discovery[p])
+						bridgeToParent[v] = 1;
+				}
+			}
+		}
+	}
+
+	//Vertices on loops are the end points of all other edges (self-loops are ignored by the search and do not count)
+	std::vector<char> onLoop(vertexCount, 0);
+	std::vector<int> forestDegree(vertexCount, 0);
+	totalLength = 0;
+	for (int v = 0; v < vertexCount; ++v)
+	{
+		if (bridgeToParent[v])
+		{
+			++forestDegree[v];
+			++forestDegree[parents[v]];
+		}
+		for (auto& neighbor : adjacency.Neighbors(v))
+		{
+			int w = neighbor.vertex;
+			if (w == v)
+				continue;
+			totalLength += (vertices[w].position - vertices[v].position).norm();
+			bool bridge = (parents[w] == v && bridgeToParent[w]) || (parents[v] == w && bridgeToParent[v]);
+			if (!bridge)
+				onLoop[v] = 1;
+		}
+	}
+	loopVertexCount = std::count(onLoop.begin(), onLoop.end(), 1);
+
+	forestOffsets.resize(vertexCount + 1);
+	forestOffsets[0] = 0;
+	for (int v = 0; v < vertexCount; ++v)
+		forestOffsets[v + 1] = forestOffsets[v] + forestDegree[v];
+	forestNeighbors.resize(forestOffsets[vertexCount]);
+	{
+		std::vector<size_t> fill(forestOffsets.begin(), forestOffsets.end() - 1);
+		for (int v = 0; v < vertexCount; ++v)
+			if (bridgeToParent[v])
+			{
+				forestNeighbors[fill[v]++] = parents[v];
+				forestNeighbors[fill[parents[v]]++] = v;
+			}
+	}
+
+	//Chains between junctions of the forest. Vertices on loops are junctions, such that searches that touch a loop can skip the
+	//subtrees behind them.
+	auto isJunction = [&](int v) { return forestDegree[v] != 2 || onLoop[v]; };
+	vertexChain.assign(vertexCount, -1);
+	chainOffsets.push_back(0);
+	for (int v = 0; v < vertexCount; ++v)
+	{
+		if (!isJunction(v))
+			continue;
+		junctions.push_back(v);
+		for (size_t i = forestOffsets[v]; i < forestOffsets[v + 1]; ++i)
+		{
+			int next = forestNeighbors[i];
+			//Every chain is created from its first vertex; a chain without inner vertices from its smaller end point
+			if (!isJunction(next) ? vertexChain[next] != -1 : next < v)
+				continue;
+			int chain = (int)chainOffsets.size() - 1;
+			int previous = v;
+			double distance = 0;
+			chainVertices.push_back(v);
+			chainDistances.push_back(0);
+			while (true)
+			{
+				distance += (vertices[next].position - vertices[previous].position).norm();
+				chainVertices.push_back(next);
+				chainDistances.push_back(distance);
+				if (isJunction(next))
+					break;
+				vertexChain[next] = chain;
+				size_t first = forestOffsets[next];
+				int following = forestNeighbors[first] == previous ? forestNeighbors[first + 1] : forestNeighbors[first];
+				previous = next;
+				next = following;
+			}
+			chainOffsets.push_back(chainVertices.size());
+		}
+	}
+
+	int chainCount = (int)chainOffsets.size() - 1;
+	junctionHalfOffsets.assign(vertexCount + 1, 0);
+	for (int c = 0; c < chainCount; ++c)
+	{
+		++junctionHalfOffsets[chainVertices[chainOffsets[c]] + 1];
+		++junctionHalfOffsets[chainVertices[chainOffsets[c + 1] - 1] + 1];
+	}
+	for (int v = 0; v < vertexCount; ++v)
+		junctionHalfOffsets[v + 1] += junctionHalfOffsets[v];
+	junctionHalves.resize(2 * chainCount);
+	{
+		std::vector<size_t> fill(junctionHalfOffsets.begin(), junctionHalfOffsets.end() - 1);
+		for (int c = 0; c < chainCount; ++c)
+		{
+			junctionHalves[fill[chainVertices[chainOffsets[c]]]++] = 2 * c;
+			junctionHalves[fill[chainVertices[chainOffsets[c + 1] - 1]]++] = 2 * c + 1;
+		}
+	}
+
+	//Order the halves such that the halves that leave the last vertex of a half come first (post-order of the forest of halves)
+	std::vector<char> state(2 * chainCount, 0);
+	std::vector<int> halfStack;
+	for (int root = 0; root < 2 * chainCount; ++root)
+	{
+		if (state[root])
+			continue;
+		halfStack.push_back(root);
+		while (!halfStack.empty())
+		{
+			int h = halfStack.back();
+			if (state[h] == 0)
+			{
+				state[h] = 1;
+				int last = StartVertex(h ^ 1);
+				for (size_t i = junctionHalfOffsets[last]; i < junctionHalfOffsets[last + 1]; ++i)
+					if (junctionHalves[i] != (h ^ 1) && state[junctionHalves[i]] == 0)
+						halfStack.push_back(junctionHalves[i]);
+			}
+			else
+			{
+				halfStack.pop_back();
+				if (state[h] == 1)
+				{
+					state[h] = 2;
+					halfOrder.push_back(h);
+				}
+			}
+		}
+	}
+
+	halfDistanceToLoop.resize(2 * chainCount);
+	for (int h : halfOrder)
+	{
+		int c = h / 2;
+		double length = chainDistances[chainOffsets[c + 1] - 1];
+		int end = StartVertex(h ^ 1);
+		double distance = onLoop[end] ? length : std::numeric_limits<double>::infinity();
+		for (size_t i = junctionHalfOffsets[end]; i < junctionHalfOffsets[end + 1]; ++i)
+			if (junctionHalves[i] != (h ^ 1))
+				distance = std::min(distance, length + halfDistanceToLoop[junctionHalves[i]]);
+		halfDistanceToLoop[h] = distance;
+	}
+
+	//Distance to the closest loop (multi-source Dijkstra)
+	DijkstraWorkspace workspace;
+	workspace.Begin(vertexCount);
+	for (int v = 0; v < vertexCount; ++v)
+		if (onLoop[v])
+			workspace.Push(v, 0.0);
+	NodeDistance current(0, 0.0);
+	while (workspace.Pop(current))
+	{
+		for (auto& neighbor : adjacency.Neighbors(current.node))
+		{
+			int adj = neighbor.vertex;
+			double distance = current.distance + (vertices[adj].position - vertices[current.node].position).norm();
+			if (distance < workspace.Distance(adj))
+				workspace.Push(adj, distance);
+		}
+	}
+	distanceToLoop.resize(vertexCount);
+	for (int v = 0; v < vertexCount; ++v)
+		distanceToLoop[v] = workspace.Distance(v);
+}
+
+double SkeletonChains::Tolerance(double maxSearchDistance) const
+{
+	//Every distance is a sum, difference, or shift of at most two per vertex terms whose magnitude is bounded by the total length
+	//and the search distance
+	return 4.0 * (vertices->size() + 2) * std::numeric_limits<double>::epsilon() * (totalLength + maxSearchDistance);
+}
+
+int SkeletonChains::StartVertex(int half) const
+{
+	int c = half / 2;
+	return (half & 1) ? chainVertices[chainOffsets[c + 1] - 1] : chainVertices[chainOffsets[c]];
+}
+
+int SkeletonChains::HalfTowards(int v, int w) const
+{
+	for (size_t i = junctionHalfOffsets[v]; i < junctionHalfOffsets[v + 1]; ++i)
+	{
+		int half = junctionHalves[i];
+		int c = half / 2;
+		int second = (half & 1) ? chainVertices[chainOffsets[c + 1] - 2] : chainVertices[chainOffsets[c] + 1];
+		if (second == w)
+			return half;
+	}
+	return -1;
+}
+
+double SkeletonChains::MaxBehind(const std::vector<std::vector<Step>>& staircases, int half, double distance, double tolerance, bool& ambiguous) const
+{
+	double maximum = NO_VALUE;
+	int start = StartVertex(half);
+	for (size_t i = junctionHalfOffsets[start]; i < junctionHalfOffsets[start + 1]; ++i)
+		if (junctionHalves[i] != half)
+			maximum = std::max(maximum, MaxUpTo(staircases[junctionHalves[i]], distance, tolerance, ambiguous));
+	return maximum;
+}
+
+double SkeletonChains::MaxReachingBehind(const std::vector<std::vector<Step>>& staircases, int half, double distance, double tolerance, bool& ambiguous) const
+{
+	double maximum = NO_VALUE;
+	int start = StartVertex(half);
+	for (size_t i = junctionHalfOffsets[start]; i < junctionHalfOffsets[start + 1]; ++i)
+		if (junctionHalves[i] != half)
+			maximum = std::max(maximum, MaxReaching(staircases[junctionHalves[i]], distance, tolerance, ambiguous));
+	return maximum;
+}
+
+size_t SkeletonChains::FindMax(std::function<double(int)> searchDistance, const std::vector<double>& source, std::vector<double>& target, int threads) const
+{
+	int vertexCount = (int)vertices->size();
+	int chainCount = (int)NumberOfChains();
+
+	std::vector<double> radii(vertexCount), values(vertexCount);
+	double maxRadius = 0;
+	for (int v = 0; v < vertexCount; ++v)
+	{
+		radii[v] = searchDistance(v);
+		values[v] = std::isnan(source[v]) ? NO_VALUE : source[v];
+		if (radii[v] > maxRadius)
+			maxRadius = radii[v];
+	}
+	double tolerance = Tolerance(maxRadius);
+	double limit = maxRadius + tolerance;
+
+	//staircases[h]: maxima of the vertices of the chain (without the start vertex) and everything behind it by distance from the start vertex
+	std::vector<std::vector<Step>> staircases(2 * chainCount);
+	std::vector<Step> steps;
+	for (int h : halfOrder)
+	{
+		int c = h / 2;
+		size_t first = chainOffsets[c], last = chainOffsets[c + 1] - 1;
+		double length = chainDistances[last];
+		steps.clear();
+		for (size_t k = first; k <= last; ++k)
+		{
+			if ((h & 1) ? k == last : k == first)
+				continue;
+			double distance = (h & 1) ? length - chainDistances[k] : chainDistances[k];
+			if (distance <= limit && values[chainVertices[k]] != NO_VALUE)
+				steps.emplace_back(distance, values[chainVertices[k]]);
+		}
+		int end = StartVertex(h ^ 1);
+		for (size_t i = junctionHalfOffsets[end]; i < junctionHalfOffsets[end + 1]; ++i)
+			if (junctionHalves[i] != (h ^ 1))
+				for (auto& step : staircases[junctionHalves[i]])
+					if (step.first + length <= limit)
+						steps.emplace_back(step.first + length, step.second);
+		StaircaseByIncreasingDistance(steps);
+		staircases[h] = steps;
+	}
+
+	//Vertices whose neighborhood touches a loop or whose result is ambiguous
+	std::vector<char> searchVertex(vertexCount, 0);
+	auto needsSearch = [&](int v) { return !(distanceToLoop[v] > radii[v] + tolerance); };
+
+#pragma omp parallel num_threads(threads)
+	{
+		std::vector<double> table;
+#pragma omp for schedule(dynamic, 16)
+		for (int c = 0; c < chainCount; ++c)
+		{
+			size_t first = chainOffsets[c];
+			size_t n = chainOffsets[c + 1] - first;
+			const double* distances = &chainDistances[first];
+			double length = distances[n - 1];
+			table.resize(n);
+			for (size_t i = 0; i < n; ++i)
+				table[i] = values[chainVertices[first + i]];
+			BuildRangeMaximum(table, n);
+
+			for (size_t i = 1; i + 1 < n; ++i)
+			{
+				int v = chainVertices[first + i];
+				double r = radii[v];
+				if (!(r >= 0))
+				{
+					//The neighborhood consists of v only
+					target[v] = FinishMax(values[v]);
+					continue;
+				}
+				if (needsSearch(v))
+				{
+					searchVertex[v] = 1;
+					continue;
+				}
+				bool ambiguous = AnyWithin(distances, distances + n, distances[i] - r, tolerance) || AnyWithin(distances, distances + n, distances[i] + r, tolerance);
+				size_t lower = std::lower_bound(distances, distances + n, distances[i] - r) - distances;
+				size_t upper = std::upper_bound(distances, distances + n, distances[i] + r) - distances - 1;
+				double maximum = RangeMaximum(table, n, lower, upper);
+				if (lower == 0)
+					maximum = std::max(maximum, MaxBehind(staircases, 2 * c, r - distances[i], tolerance, ambiguous));
+				if (upper == n - 1)
+					maximum = std::max(maximum, MaxBehind(staircases, 2 * c + 1, r - (length - distances[i]), tolerance, ambiguous));
+				if (ambiguous)
+					searchVertex[v] = 1;
+				else
+					target[v] = FinishMax(maximum);
+			}
+		}
+
+#pragma omp for schedule(dynamic, 64)
+		for (int j = 0; j < (int)junctions.size(); ++j)
+		{
+			int v = junctions[j];
+			double r = radii[v];
+			if (!(r >= 0))
+			{
+				target[v] = FinishMax(values[v]);
+				continue;
+			}
+			if (needsSearch(v))
+			{
+				searchVertex[v] = 1;
+				continue;
+			}
+			bool ambiguous = false;
+			double maximum = values[v];
+			for (size_t i = junctionHalfOffsets[v]; i < junctionHalfOffsets[v + 1]; ++i)
+				maximum = std::max(maximum, MaxUpTo(staircases[junctionHalves[i]], r, tolerance, ambiguous));
+			if (ambiguous)
+				searchVertex[v] = 1;
+			else
+				target[v] = FinishMax(maximum);
+		}
+	}
+
+	std::vector<int> searches;
+	for (int v = 0; v < vertexCount; ++v)
+		if (searchVertex[v])
+			searches.push_back(v);
+#pragma omp parallel num_threads(threads)
+	{
+		SearchWorkspace workspace;
+#pragma omp for schedule(dynamic, 16)
+		for (int i = 0; i < (int)searches.size(); ++i)
+		{
+			int v = searches[i];
+			target[v] = MaxSearch(v, radii[v], source, staircases, tolerance, workspace);
+		}
+	}
+	return searches.size();
+}
+
+double SkeletonChains::MaxSearch(int iVert, double searchDistance, const std::vector<double>& source, const std::vector<std::vector<Step>>& staircases, double tolerance, SearchWorkspace& workspace) const
+{
+	double maximum = std::numeric_limits<double>::min();
+	workspace.Begin(vertices->size());
+	workspace.Visit(iVert, iVert, 0.0);
+	while (!workspace.stack.empty())
+	{
+		NodeDistance current = workspace.stack.back();
+		workspace.stack.pop_back();
+		if (source[current.node] > maximum)
+			maximum = source[current.node];
+
+		auto currentP = (*vertices)[current.node].position;
+		for (auto& neighbor : adjacency->Neighbors(current.node))
+		{
+			int adj = neighbor.vertex;
+			double distance = current.distance + ((*vertices)[adj].position - currentP).norm();
+			if (distance <= searchDistance && !workspace.Visited(adj))
+			{
+				//A subtree that is entered through an edge of the forest can only be reached through this edge. If the search does
+				//not reach a loop behind it, its maximum is in the staircase.
+				int half = vertexChain[current.node] == -1 ? HalfTowards(current.node, adj) : -1;
+				if (half != -1 && halfDistanceToLoop[half] > searchDistance - current.distance + tolerance)
+				{
+					bool ambiguous = false;
+					double behind = MaxUpTo(staircases[half], searchDistance - current.distance, tolerance, ambiguous);
+					if (!ambiguous)
+					{
+						if (behind > maximum)
+							maximum = behind;
+						continue;
+					}
+				}
+				workspace.Visit(adj, current.node, distance);
+			}
+		}
+	}
+	return maximum;
+}
+
+void SkeletonChains::AdvectSearch(int iVert, double searchDistance, const std::vector<double>& source, double tolerance, std::vector<double>& target,
+	std::vector<std::pair<int, SkippedSubtree>>& skipped, SearchWorkspace& workspace) const
+{
+	double value = source[iVert];
+	workspace.Begin(vertices->size());
+	workspace.Visit(iVert, iVert, 0.0);
+	while (!workspace.stack.empty())
+	{
+		NodeDistance current = workspace.stack.back();
+		workspace.stack.pop_back();
+		if (target[current.node] < value)
+			target[current.node] = value;
+
+		auto currentP = (*vertices)[current.node].position;
+		for (auto& neighbor : adjacency->Neighbors(current.node))
+		{
+			int adj = neighbor.vertex;
+			double distance = current.distance + ((*vertices)[adj].position - currentP).norm();
+			if (distance <= searchDistance && !workspace.Visited(adj))
+			{
+				int half = vertexChain[current.node] == -1 ? HalfTowards(current.node, adj) : -1;
+				if (half != -1 && halfDistanceToLoop[half] > searchDistance - current.distance + tolerance)
+				{
+					skipped.emplace_back(half, SkippedSubtree{ current.distance, searchDistance, value });
+					continue;
+				}
+				workspace.Visit(adj, current.node, distance);
+			}
+		}
+	}
+}
+
+double SkeletonChains::MaxReachingExactly(int iVert, const std::vector<double>& radii, const std::vector<char>& forestSource, const std::vector<double>& source,
+	const std::vector<std::vector<SkippedSubtree>>& skipped, double limit, double tolerance, SearchWorkspace& workspace) const
+{
+	//Sums the distance from v to iVert in the order of a search that has reached v at the given distance
+	auto distanceFrom = [&](int v, double distance)
+	{
+		for (int u = v; u != iVert; u = workspace.parents[u])
+			distance += ((*vertices)[workspace.parents[u]].position - (*vertices)[u].position).norm();
+		return distance;
+	};
+
+	double maximum = NO_VALUE;
+	workspace.Begin(vertices->size());
+	workspace.Visit(iVert, iVert, 0.0);
+	while (!workspace.stack.empty())
+	{
+		NodeDistance current = workspace.stack.back();
+		workspace.stack.pop_back();
+		int v = current.node;
+		if (v != iVert)
+		{
+			double r = radii[v];
+			if (forestSource[v] && source[v] > maximum && current.distance <= r + tolerance
+				&& (current.distance < r - tolerance || distanceFrom(v, 0.0) <= r))
+				maximum = source[v];
+
+			//Subtrees towards iVert that a search from a loop has skipped at v
+			int half = vertexChain[v] == -1 ? HalfTowards(v, workspace.parents[v]) : -1;
+			if (half != -1)
+				for (auto& subtree : skipped[half])
+				{
+					double reach = subtree.searchDistance - subtree.distance;
+					if (subtree.value > maximum && current.distance <= reach + tolerance
+						&& (current.distance < reach - tolerance || distanceFrom(v, subtree.distance) <= subtree.searchDistance))
+						maximum = subtree.value;
+				}
+		}
+		for (size_t i = forestOffsets[v]; i < forestOffsets[v + 1]; ++i)
+		{
+			int w = forestNeighbors[i];
+			if (workspace.Visited(w))
+				continue;
+			double distance = current.distance + ((*vertices)[w].position - (*vertices)[v].position).norm();
+			if (distance <= limit)
+				workspace.Visit(w, v, distance);
+		}
+	}
+	return maximum;
+}
+
+size_t SkeletonChains::MaxAdvect(std::function<double(int)> searchDistance, const std::vector<double>& source, std::vector<double>& target, int threads) const
+{
+	int vertexCount = (int)vertices->size();
+	int chainCount = (int)NumberOfChains();
+
+	std::vector<double> radii(vertexCount);
+	double maxRadius = 0;
+	for (int v = 0; v < vertexCount; ++v)
+	{
+		radii[v] = searchDistance(v);
+		if (!std::isnan(source[v]) && radii[v] > maxRadius)
+			maxRadius = radii[v];
+	}
+	double tolerance = Tolerance(maxRadius);
+
+	//Sources whose neighborhood lies in the forest are handled by the chains; sources whose neighborhood touches a loop are
+	//advected with a search. Sources without a value or without a neighborhood do not change anything.
+	std::vector<char> forestSource(vertexCount, 0);
+	std::vector<int> loopSources;
+	for (int v = 0; v < vertexCount; ++v)
+	{
+		if (std::isnan(source[v]) || !(radii[v] >= 0))
+			continue;
+		if (distanceToLoop[v] > radii[v] + tolerance)
+			forestSource[v] = 1;
+		else
+			loopSources.push_back(v);
+	}
+
+	//The searches advect to the vertices they visit and leave the subtrees they skip to the chains
+	std::vector<double> searchAdvected(vertexCount, NO_VALUE);
+	std::vector<std::vector<SkippedSubtree>> skipped(2 * chainCount);
+#pragma omp parallel num_threads(threads)
+	{
+		SearchWorkspace workspace;
+		std::vector<double> advected(vertexCount, NO_VALUE);
+		std::vector<std::pair<int, SkippedSubtree>> mySkipped;
+#pragma omp for schedule(dynamic, 16)
+		for (int i = 0; i < (int)loopSources.size(); ++i)
+		{
+			int v = loopSources[i];
+			AdvectSearch(v, radii[v], source, tolerance, advected, mySkipped, workspace);
+		}
+#pragma omp critical
+		{
+			for (int v = 0; v < vertexCount; ++v)
+				searchAdvected[v] = std::max(searchAdvected[v], advected[v]);
+			for (auto& entry : mySkipped)
+				skipped[entry.first].push_back(entry.second);
+		}
+	}
+
+	//staircases[h]: maxima of the sources in the chain (without the start vertex) and behind it by their remaining search
+	//distance at the start vertex
+	std::vector<std::vector<Step>> staircases(2 * chainCount);
+	std::vector<Step> steps;
+	for (int h : halfOrder)
+	{
+		int c = h / 2;
+		size_t first = chainOffsets[c], last = chainOffsets[c + 1] - 1;
+		double length = chainDistances[last];
+		steps.clear();
+		for (size_t k = first; k <= last; ++k)
+		{
+			int v = chainVertices[k];
+			if (!forestSource[v] || ((h & 1) ? k == last : k == first))
+				continue;
+			double reach = radii[v] - ((h & 1) ? length - chainDistances[k] : chainDistances[k]);
+			if (reach >= -tolerance)
+				steps.emplace_back(reach, source[v]);
+		}
+		for (auto& subtree : skipped[h ^ 1])
+		{
+			double reach = subtree.searchDistance - subtree.distance - length;
+			if (reach >= -tolerance)
+				steps.emplace_back(reach, subtree.value);
+		}
+		int end = StartVertex(h ^ 1);
+		for (size_t i = junctionHalfOffsets[end]; i < junctionHalfOffsets[end + 1]; ++i)
+			if (junctionHalves[i] != (h ^ 1))
+				for (auto& step : staircases[junctionHalves[i]])
+					if (step.first - length >= -tolerance)
+						steps.emplace_back(step.first - length, step.second);
+		StaircaseByDecreasingReach(steps);
+		staircases[h] = steps;
+	}
+
+	std::vector<char> ambiguousVertex(vertexCount, 0);
+	std::vector<double> advected(vertexCount, NO_VALUE);
+
+#pragma omp parallel num_threads(threads)
+	{
+		std::vector<double> table;
+#pragma omp for schedule(dynamic, 16)
+		for (int c = 0; c < chainCount; ++c)
+		{
+			size_t first = chainOffsets[c];
+			size_t n = chainOffsets[c + 1] - first;
+			const double* distances = &chainDistances[first];
+			double length = distances[n - 1];
+			table.assign((FloorLog2(n) + 1) * n, NO_VALUE);
+
+			//Raises the entries within distance r of chain position center, and marks the inner vertices whose distance lies
+			//within the tolerance of r
+			auto raise = [&](double center, double r, double value, bool backward, bool forward)
+			{
+				size_t lower = backward ? std::lower_bound(distances, distances + n, center - r) - distances : 0;
+				size_t upper = forward ? std::upper_bound(distances, distances + n, center + r) - distances - 1 : n - 1;
+				RaiseRange(table, n, lower, upper, value);
+				for (int side = 0; side < 2; ++side)
+				{
+					if (!(side ? forward : backward))
+						continue;
+					double boundary = side ? center + r : center - r;
+					for (size_t j = std::lower_bound(distances, distances + n, boundary - tolerance) - distances; j < n && distances[j] <= boundary + tolerance; ++j)
+						if (j > 0 && j + 1 < n)
+							ambiguousVertex[chainVertices[first + j]] = 1;
+				}
+			};
+
+			for (size_t i = 0; i < n; ++i)
+			{
+				int v = chainVertices[first + i];
+				if (forestSource[v])
+					raise(distances[i], radii[v], source[v], true, true);
+			}
+			for (auto& subtree : skipped[2 * c])
+				raise(0, subtree.searchDistance - subtree.distance, subtree.value, false, true);
+			for (auto& subtree : skipped[2 * c + 1])
+				raise(length, subtree.searchDistance - subtree.distance, subtree.value, true, false);
+			PushDownRangeMaximum(table, n);
+
+			for (size_t i = 1; i + 1 < n; ++i)
+			{
+				int v = chainVertices[first + i];
+				bool ambiguous = false;
+				double maximum = std::max(table[i], MaxReachingBehind(staircases, 2 * c, distances[i], tolerance, ambiguous));
+				maximum = std::max(maximum, MaxReachingBehind(staircases, 2 * c + 1, length - distances[i], tolerance, ambiguous));
+				advected[v] = maximum;
+				if (ambiguous)
+					ambiguousVertex[v] = 1;
+			}
+		}
+
+#pragma omp for schedule(dynamic, 64)
+		for (int j = 0; j < (int)junctions.size(); ++j)
+		{
+			int v = junctions[j];
+			bool ambiguous = false;
+			double maximum = NO_VALUE;
+			for (size_t i = junctionHalfOffsets[v]; i < junctionHalfOffsets[v + 1]; ++i)
+				maximum = std::max(maximum, MaxReaching(staircases[junctionHalves[i]], 0, tolerance, ambiguous));
+			advected[v] = maximum;
+			if (ambiguous)
+				ambiguousVertex[v] = 1;
+		}
+	}
+
+	std::vector<int> searches;
+	for (int v = 0; v < vertexCount; ++v)
+		if (ambiguousVertex[v])
+			searches.push_back(v);
+#pragma omp parallel num_threads(threads)
+	{
+		SearchWorkspace workspace;
+#pragma omp for schedule(dynamic, 16)
+		for (int i = 0; i < (int)searches.size(); ++i)
+		{
+			int v = searches[i];
+			advected[v] = MaxReachingExactly(v, radii, forestSource, source, skipped, maxRadius + tolerance, tolerance, workspace);
+		}
+	}
+
+	for (int v = 0; v < vertexCount; ++v)
+		target[v] = FinishAdvect(source[v], std::max(advected[v], searchAdvected[v]));
+	return searches.size() + loopSources.size();
+}
@@ -0,0 +1,103 @@
+#include "SmoothingOperator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <omp.h>
+
+SmoothingOperator::SmoothingOperator()
+	: radius(0)
+{ }
+
+bool SmoothingOperator::Build(const std::vector<CurveSkeleton::Vertex>& vertices, const SkeletonAdjacency& adjacency, double radius, size_t memoryLimit, int threads)
+{
+	Clear();
+
+	const long long entryBytes = sizeof(int32_t) + sizeof(double);
+
+	//Every thread collects its rows in its own buffers; they are copied in vertex order afterwards
+	int vertexCount = (int)vertices.size();
+	std::vector<std::vector<int32_t>> threadColumns(threads);
+	std::vector<std::vector<double>> threadDistances(threads);
+	std::vector<int> rowThreads(vertexCount);
+	std::vector<size_t> rowStarts(vertexCount), rowLengths(vertexCount);
+
+	//Peak memory: the row bookkeeping and offsets, the thread buffers (old and new ones while they grow), and the final entries,
+	//which are allocated while the thread buffers are still alive
+	std::atomic<long long> peakBytes((long long)(vertexCount * (sizeof(int) + 2 * sizeof(size_t)) + (vertexCount + 1) * sizeof(size_t)));
+	std::atomic<bool> exceeded((size_t)peakBytes.load() > memoryLimit);
+	auto addPeakBytes = [&](long long bytes)
+	{
+		if ((size_t)(peakBytes.fetch_add(bytes) + bytes) <= memoryLimit)
+			return true;
+		exceeded.store(true, std::memory_order_relaxed);
+		return false;
+	};
+
+#pragma omp parallel num_threads(threads)
+	{
+		int thread = omp_get_thread_num();
+		auto& myColumns = threadColumns[thread];
+		auto& myDistances = threadDistances[thread];
+		DijkstraWorkspace workspace;
+#pragma omp for schedule(dynamic, 256)
+		for (int iVert = 0; iVert < vertexCount; ++iVert)
+		{
+			if (exceeded.load(std::memory_order_relaxed))
+				continue;
+			size_t start = myColumns.size();
+			dijkstraWithinDistance(vertices, iVert, adjacency, radius, workspace, [&](const NodeDistance& node)
+			{
+				if (myColumns.size() == myColumns.capacity())
+				{
+					//Grow explicitly to account for the new buffers before they are allocated
+					size_t oldCapacity = myColumns.capacity();
+					size_t capacity = std::max((size_t)1024, 2 * oldCapacity);
+					if (exceeded.load(std::memory_order_relaxed) || !addPeakBytes((long long)capacity * entryBytes))
+						return;
+					myColumns.reserve(capacity);
+					myDistances.reserve(capacity);
+					peakBytes.fetch_sub((long long)oldCapacity * entryBytes);
+				}
+				myColumns.push_back(node.node);
+				myDistances.push_back(node.distance);
+			});
+			rowThreads[iVert] = thread;
+			rowStarts[iVert] = start;
+			rowLengths[iVert] = myColumns.size() - start;
+			addPeakBytes((long long)rowLengths[iVert] * entryBytes);
+		}
+	}
+	if (exceeded.load())
+		return false;
+
+	rowOffsets.resize(vertexCount + 1);
+	rowOffsets[0] = 0;
+	for (int iVert = 0; iVert < vertexCount; ++iVert)
+		rowOffsets[iVert + 1] = rowOffsets[iVert] + rowLengths[iVert];
+	columns.resize(rowOffsets[vertexCount]);
+	distances.resize(rowOffsets[vertexCount]);
+	for (int iVert = 0; iVert < vertexCount; ++iVert)
+	{
+		int thread = rowThreads[iVert];
+		std::copy_n(threadColumns[thread].begin() + rowStarts[iVert], rowLengths[iVert], columns.begin() + rowOffsets[iVert]);
+		std::copy_n(threadDistances[thread].begin() + rowStarts[iVert], rowLengths[iVert], distances.begin() + rowOffsets[iVert]);
+	}
+	this->radius = radius;
+	return true;
+}
+
+void SmoothingOperator::Clear()
+{
+	rowOffsets.clear();
+	rowOffsets.shrink_to_fit();
+	columns.clear();
+	columns.shrink_to_fit();
+	distances.clear();
+	distances.shrink_to_fit();
+	radius = 0;
+}
+
+size_t SmoothingOperator::MemoryUsage() const
+{
+	return rowOffsets.capacity() * sizeof(size_t) + columns.capacity() * sizeof(int32_t) + distances.capacity() * sizeof(double);
+}
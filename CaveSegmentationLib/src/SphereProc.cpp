@@ -0,0 +1,125 @@
+﻿#include "SphereProc.h"
+
+#include <mutex>
+
+SphereGradientOperator::SphereGradientOperator(const RegularUniformSphereSampling& sphereSampling)
+	: sphereSampling(sphereSampling)
+{
+	for (int axis = 0; axis < 3; ++axis)
+		weights[axis].resize(sphereSampling.NumberOfNeighborEntries());
+
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+	{
+		const Vector& currentPos = sphereSampling.Direction(iSample);
+
+		//Calculate a 3D gradient from directional derivatives.
+		//Solve
+		//    arg min  Σ ( dot(g, direction_i) - derivative_i )^2
+		//       g
+
+		//normal matrix of the linear system
+		// | a  b  c |
+		// | b  d  e |
+		// | c  e  f |
+		double a = 0, b = 0, c = 0, d = 0, e = 0, f = 0;
+
+		for (auto neighbor : sphereSampling.NeighborIndices(iSample))
+		{
+			Vector direction = sphereSampling.Direction(neighbor) - currentPos;
+			direction = direction * (1.0 / sqrt(direction.squared_length()));
+
+			a += direction.x() * direction.x();
+			b += direction.x() * direction.y();
+			c += direction.x() * direction.z();
+			d += direction.y() * direction.y();
+			e += direction.y() * direction.z();
+			f += direction.z() * direction.z();
+		}
+
+		//Invert the (symmetric) normal matrix
+		double denom = c * c * d - 2 * b * c * e + a * e * e + b * b * f - a * d * f;
+		if (denom == 0 || std::isnan(denom))
+			throw std::exception("The neighbors of a sphere sample do not allow to calculate a gradient.");
+		double inverse[3][3] =
+		{
+			{ (e * e - d * f) / denom, (b * f - c * e) / denom, (c * d - b * e) / denom },
+			{ (b * f - c * e) / denom, (c * c - a * f) / denom, (a * e - b * c) / denom },
+			{ (c * d - b * e) / denom, (a * e - b * c) / denom, (b * b - a * d) / denom },
+		};
+
+		//The right hand side is the sum of direction * derivative over all neighbors, where derivative is the
+		//value difference divided by the distance. Hence, every difference is weighted by
+		//projection * inverse * direction / distance.
+		size_t entry = sphereSampling.NeighborOffset(iSample);
+		for (auto neighbor : sphereSampling.NeighborIndices(iSample))
+		{
+			Vector direction = sphereSampling.Direction(neighbor) - currentPos;
+			double dirLength = sqrt(direction.squared_length());
+			direction = direction * (1.0 / dirLength);
+
+			Vector weight(
+				(inverse[0][0] * direction.x() + inverse[0][1] * direction.y() + inverse[0][2] * direction.z()) / dirLength,
+				(inverse[1][0] * direction.x() + inverse[1][1] * direction.y() + inverse[1][2] * direction.z()) / dirLength,
+				(inverse[2][0] * direction.x() + inverse[2][1] * direction.y() + inverse[2][2] * direction.z()) / dirLength);
+
+			//project gradient on sphere surface
+			weight = weight - (weight * currentPos) * currentPos;
+
+			for (int axis = 0; axis < 3; ++axis)
+				weights[axis][entry] = weight[axis];
+			++entry;
+		}
+	}
+}
+
+void SphereGradientOperator::Apply(const SphereScalarField& values, SphereVectorField& gradient) const
+{
+	const double* v = values.Data();
+	const double* weightX = weights[0].data();
+	const double* weightY = weights[1].data();
+	const double* weightZ = weights[2].data();
+	double* gradientX = gradient.Component(0);
+	double* gradientY = gradient.Component(1);
+	double* gradientZ = gradient.Component(2);
+
+	for (size_t iSample = 0; iSample < sphereSampling.NumberOfSamples(); ++iSample)
+	{
+		double current = v[iSample];
+		double x = 0, y = 0, z = 0;
+		size_t entry = sphereSampling.NeighborOffset(iSample);
+		for (auto neighbor : sphereSampling.NeighborIndices(iSample))
+		{
+			double difference = v[neighbor] - current;
+			x += weightX[entry] * difference;
+			y += weightY[entry] * difference;
+			z += weightZ[entry] * difference;
+			++entry;
+		}
+		gradientX[iSample] = x;
+		gradientY[iSample] = y;
+		gradientZ[iSample] = z;
+	}
+}
+
+PrebuiltSphereSampling::PrebuiltSphereSampling(int resolution)
+	: sampling(resolution), gradientOperator(sampling), extremumSearchNeighborhoods(sampling.RangeNeighborhoods(MAXIMUM_SEARCH_RADIUS))
+{
+}
+
+std::shared_ptr<const PrebuiltSphereSampling> PrebuiltSphereSampling::Get(int resolution)
+{
+	const size_t resolutionCount = sizeof(SPHERE_SAMPLING_RESOLUTIONS) / sizeof(SPHERE_SAMPLING_RESOLUTIONS[0]);
+	static std::shared_ptr<const PrebuiltSphereSampling> instances[resolutionCount];
+	static std::mutex instancesMutex;
+
+	for (size_t i = 0; i < resolutionCount; ++i)
+	{
+		if (SPHERE_SAMPLING_RESOLUTIONS[i] != resolution)
+			continue;
+		std::lock_guard<std::mutex> lock(instancesMutex);
+		if (!instances[i])
+			instances[i] = std::make_shared<PrebuiltSphereSampling>(resolution);
+		return instances[i];
+	}
+	throw std::exception("Unsupported sphere sampling resolution. Supported resolutions are 31, 51, and 81.");
+}
@@ -71,7 +71,7 @@ void SphereVisualizer::DrawRect(double theta, double phi, double sizeTheta, doub
 	graphics->DrawRectangle(&pen, x, y, w, h);
 }
 
-void SphereVisualizer::DrawGradientField(const RegularUniformSphereSampling& sphereSampling, const std::vector<std::vector<Vector>>& gradientField)
+void SphereVisualizer::DrawGradientField(const RegularUniformSphereSampling& sphereSampling, const SphereVectorField& gradientField)
 {
 	for (auto it = sphereSampling.begin(); it != sphereSampling.end(); ++it)
 	{
@@ -82,7 +82,7 @@ void SphereVisualizer::DrawGradientField(const RegularUniformSphereSampling& sph
 		Gdiplus::SolidBrush longBrush(Gdiplus::Color(0, 128, 128));
 		Gdiplus::Pen normalPen(&normalBrush);
 		Gdiplus::Pen longPen(&longBrush);
-		const Vector& gradient = sphereSampling.AccessContainerData(gradientField, it);
+		Vector gradient = gradientField[sphereSampling.SampleIndex(it)];
 
 		//transform positional gradient to parameter space gradient
 		//with inverse Jacobian
@@ -165,7 +165,7 @@ void VoidSphereVisualizer::DrawRect(double theta, double phi, double sizeTheta,
 {
 }
 
-void VoidSphereVisualizer::DrawGradientField(const RegularUniformSphereSampling & sphereSampling, const std::vector<std::vector<Vector>>& gradient)
+void VoidSphereVisualizer::DrawGradientField(const RegularUniformSphereSampling & sphereSampling, const SphereVectorField& gradient)
 {
 }
 
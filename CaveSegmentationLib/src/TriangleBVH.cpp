@@ -0,0 +1,733 @@
+#include "TriangleBVH.h"
+#include "SimdLanes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//Triangle count up to which the surface area heuristic may decide to stop splitting
+const int32_t MAX_LEAF_SIZE = 8;
+
+//Number of bins per axis for the binned surface area heuristic
+const int SAH_BINS = 16;
+
+//Cost of traversing an inner node relative to intersecting a triangle
+const float SAH_TRAVERSAL_COST = 1.0f;
+
+//Tolerance on the barycentric coordinates. Rays that hit an edge or a vertex exactly must not slip through between neighboring triangles.
+const float BARYCENTRIC_EPSILON = 1e-6f;
+
+//Smallest direction component magnitude. Replaces zero components to avoid NaNs in the slab test.
+const float MIN_DIRECTION_COMPONENT = 1e-20f;
+
+//Upper bound for the depth of the traversal stack
+const int TRAVERSAL_STACK_SIZE = 64;
+
+//Maximum depth of the hierarchy. Every level adds at most one entry to the traversal stack.
+const int MAX_DEPTH = TRAVERSAL_STACK_SIZE - 2;
+
+namespace
+{
+	struct Bounds
+	{
+		Eigen::Vector3f min, max;
+
+		Bounds()
+			: min(Eigen::Vector3f::Constant(std::numeric_limits<float>::infinity())), max(Eigen::Vector3f::Constant(-std::numeric_limits<float>::infinity()))
+		{ }
+
+		void Add(const Eigen::Vector3f& p) { min = min.cwiseMin(p); max = max.cwiseMax(p); }
+		void Add(const Bounds& b) { min = min.cwiseMin(b.min); max = max.cwiseMax(b.max); }
+
+		float HalfSurfaceArea() const
+		{
+			if (min.x() > max.x())
+				return 0;
+			Eigen::Vector3f e = max - min;
+			return e.x() * e.y() + e.y() * e.z() + e.z() * e.x();
+		}
+	};
+}
+
+TriangleBVH::TriangleBVH()
+	: vertices(nullptr), triangles(nullptr)
+{ }
+
+void TriangleBVH::Clear()
+{
+	nodes.clear();
+	primitiveIndices.clear();
+	vertices = nullptr;
+	triangles = nullptr;
+}
+
+size_t TriangleBVH::MemoryUsage() const
+{
+	return nodes.capacity() * sizeof(Node) + primitiveIndices.capacity() * sizeof(int32_t);
+}
+
+void TriangleBVH::Build(const std::vector<Eigen::Vector3f>& vertices, const std::vector<IndexedTriangle>& triangles)
+{
+	Clear();
+	this->vertices = &vertices;
+	this->triangles = &triangles;
+
+	if (triangles.empty())
+		return;
+
+	std::vector<Eigen::Vector3f> centroids(triangles.size());
+	primitiveIndices.resize(triangles.size());
+	for (int32_t i = 0; i < (int32_t)triangles.size(); ++i)
+	{
+		auto& tri = triangles[i];
+		centroids[i] = (vertices[tri.i[0]] + vertices[tri.i[1]] + vertices[tri.i[2]]) / 3.0f;
+		primitiveIndices[i] = i;
+	}
+
+	//Node 1 is left empty, such that all sibling pairs start at even indices and share a cache line
+	nodes.reserve(2 * triangles.size());
+	nodes.resize(2);
+	nodes[0].firstChildOrPrimitive = 0;
+	nodes[0].primitiveCount = (int32_t)triangles.size();
+	UpdateBounds(nodes[0]);
+	Subdivide(0, centroids, 0);
+	nodes.shrink_to_fit();
+}
+
+//Identifies the BVH section in a cache file
+const char FILE_SECTION_TAG[4] = { 'B', 'V', 'H', ' ' };
+
+//Alignment of the node array within the file, such that the section can be mapped directly
+const long FILE_NODE_ALIGNMENT = 64;
+
+namespace
+{
+	struct FileSectionHeader
+	{
+		char tag[4];
+		uint32_t version;
+		uint32_t vertexCount;
+		uint32_t triangleCount;
+		uint32_t nodeCount;
+		uint32_t primitiveCount;
+	};
+
+	//Number of padding bytes after the header, such that the nodes start at an aligned file offset
+	long PaddingAfterHeader(long headerStart)
+	{
+		long dataStart = headerStart + (long)sizeof(FileSectionHeader);
+		return (FILE_NODE_ALIGNMENT - dataStart % FILE_NODE_ALIGNMENT) % FILE_NODE_ALIGNMENT;
+	}
+}
+
+void TriangleBVH::Write(FILE* file) const
+{
+	FileSectionHeader header;
+	memcpy(header.tag, FILE_SECTION_TAG, sizeof(header.tag));
+	header.version = FILE_VERSION;
+	header.vertexCount = (uint32_t)(vertices ? vertices->size() : 0);
+	header.triangleCount = (uint32_t)(triangles ? triangles->size() : 0);
+	header.nodeCount = (uint32_t)nodes.size();
+	header.primitiveCount = (uint32_t)primitiveIndices.size();
+
+	long padding = PaddingAfterHeader(ftell(file));
+	fwrite(&header, sizeof(FileSectionHeader), 1, file);
+	const char zeros[FILE_NODE_ALIGNMENT] = { };
+	fwrite(zeros, 1, padding, file);
+	if (!nodes.empty())
+		fwrite(&nodes[0], sizeof(Node), nodes.size(), file);
+	if (!primitiveIndices.empty())
+		fwrite(&primitiveIndices[0], sizeof(int32_t), primitiveIndices.size(), file);
+}
+
+bool TriangleBVH::Read(FILE* file, const std::vector<Eigen::Vector3f>& vertices, const std::vector<IndexedTriangle>& triangles)
+{
+	Clear();
+
+	long headerStart = ftell(file);
+	FileSectionHeader header;
+	if (fread(&header, sizeof(FileSectionHeader), 1, file) != 1)
+		return false;
+	if (memcmp(header.tag, FILE_SECTION_TAG, sizeof(header.tag)) != 0 || header.version != FILE_VERSION
+		|| header.vertexCount != vertices.size() || header.triangleCount != triangles.size() || header.primitiveCount != triangles.size()
+		|| (header.nodeCount == 0) != triangles.empty() || header.nodeCount > 2 * triangles.size())
+		return false;
+
+	fseek(file, PaddingAfterHeader(headerStart), SEEK_CUR);
+	nodes.resize(header.nodeCount);
+	primitiveIndices.resize(header.primitiveCount);
+	if ((header.nodeCount > 0 && fread(&nodes[0], sizeof(Node), header.nodeCount, file) != header.nodeCount)
+		|| (header.primitiveCount > 0 && fread(&primitiveIndices[0], sizeof(int32_t), header.primitiveCount, file) != header.primitiveCount))
+	{
+		Clear();
+		return false;
+	}
+
+	//Reject corrupt data that would lead to out-of-bounds accesses during traversal. Children follow their parents and start at
+	//index 2 or later, so the nodes are visited in index order to find the reachable ones and their depths. Node 1 is unreachable.
+	std::vector<int> depths(nodes.size(), -1);
+	if (!nodes.empty())
+		depths[0] = 0;
+	for (int32_t i = 0; i < (int32_t)nodes.size(); ++i)
+	{
+		auto& node = nodes[i];
+		if (depths[i] < 0)
+			continue;
+		bool valid = depths[i] <= MAX_DEPTH && (node.IsLeaf()
+			? node.firstChildOrPrimitive >= 0 && (int64_t)node.firstChildOrPrimitive + node.primitiveCount <= (int64_t)primitiveIndices.size()
+			: node.firstChildOrPrimitive >= 2 && node.firstChildOrPrimitive > i && node.firstChildOrPrimitive + 1 < (int32_t)nodes.size());
+		if (!valid)
+		{
+			Clear();
+			return false;
+		}
+		if (!node.IsLeaf())
+			for (int32_t child = node.firstChildOrPrimitive; child <= node.firstChildOrPrimitive + 1; ++child)
+				depths[child] = std::max(depths[child], depths[i] + 1);
+	}
+	for (int32_t tri : primitiveIndices)
+		if (tri < 0 || tri >= (int32_t)triangles.size())
+		{
+			Clear();
+			return false;
+		}
+
+	this->vertices = &vertices;
+	this->triangles = &triangles;
+	return true;
+}
+
+void TriangleBVH::UpdateBounds(Node& node) const
+{
+	Bounds bounds;
+	for (int32_t i = node.firstChildOrPrimitive; i < node.firstChildOrPrimitive + node.primitiveCount; ++i)
+	{
+		auto& tri = (*triangles)[primitiveIndices[i]];
+		for (int j = 0; j < 3; ++j)
+			bounds.Add((*vertices)[tri.i[j]]);
+	}
+	for (int j = 0; j < 3; ++j)
+	{
+		node.boundsMin[j] = bounds.min(j);
+		node.boundsMax[j] = bounds.max(j);
+	}
+}
+
+void TriangleBVH::Subdivide(int32_t nodeIndex, const std::vector<Eigen::Vector3f>& centroids, int depth)
+{
+	int32_t first = nodes[nodeIndex].firstChildOrPrimitive;
+	int32_t count = nodes[nodeIndex].primitiveCount;
+	if (count <= 1 || depth >= MAX_DEPTH)
+		return;
+
+	Bounds centroidBounds;
+	for (int32_t i = first; i < first + count; ++i)
+		centroidBounds.Add(centroids[primitiveIndices[i]]);
+	Eigen::Vector3f centroidExtent = centroidBounds.max - centroidBounds.min;
+
+	//Find the split with the lowest cost according to the binned surface area heuristic
+	struct Bin
+	{
+		Bounds bounds;
+		int32_t count;
+	};
+	float bestCost = std::numeric_limits<float>::infinity();
+	int bestAxis = -1;
+	int bestSplit = -1;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (centroidExtent(axis) <= 0)
+			continue;
+		Bin bins[SAH_BINS];
+		for (int b = 0; b < SAH_BINS; ++b)
+			bins[b].count = 0;
+		float binScale = SAH_BINS / centroidExtent(axis);
+		for (int32_t i = first; i < first + count; ++i)
+		{
+			int32_t tri = primitiveIndices[i];
+			int b = std::min(SAH_BINS - 1, (int)((centroids[tri](axis) - centroidBounds.min(axis)) * binScale));
+			++bins[b].count;
+			for (int j = 0; j < 3; ++j)
+				bins[b].bounds.Add((*vertices)[(*triangles)[tri].i[j]]);
+		}
+
+		//Sweep from the right to accumulate the costs of the right partitions
+		float rightCost[SAH_BINS];
+		Bounds accumulated;
+		int32_t accumulatedCount = 0;
+		for (int b = SAH_BINS - 1; b > 0; --b)
+		{
+			accumulated.Add(bins[b].bounds);
+			accumulatedCount += bins[b].count;
+			rightCost[b] = accumulated.HalfSurfaceArea() * accumulatedCount;
+		}
+		//Sweep from the left and evaluate the split in front of every bin
+		accumulated = Bounds();
+		accumulatedCount = 0;
+		for (int b = 1; b < SAH_BINS; ++b)
+		{
+			accumulated.Add(bins[b - 1].bounds);
+			accumulatedCount += bins[b - 1].count;
+			float cost = accumulated.HalfSurfaceArea() * accumulatedCount + rightCost[b];
+			if (accumulatedCount > 0 && accumulatedCount < count && cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	auto& node = nodes[nodeIndex];
+	Bounds nodeBounds;
+	nodeBounds.Add(Eigen::Vector3f(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]));
+	nodeBounds.Add(Eigen::Vector3f(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]));
+	float nodeArea = nodeBounds.HalfSurfaceArea();
+	float splitCost = SAH_TRAVERSAL_COST + (nodeArea > 0 ? bestCost / nodeArea : 0);
+	if (count <= MAX_LEAF_SIZE && splitCost >= count)
+		return; //a leaf is cheaper than any split
+
+	int32_t half;
+	if (bestAxis >= 0)
+	{
+		float binScale = SAH_BINS / centroidExtent(bestAxis);
+		auto middle = std::partition(primitiveIndices.begin() + first, primitiveIndices.begin() + first + count, [&](int32_t tri)
+		{
+			return std::min(SAH_BINS - 1, (int)((centroids[tri](bestAxis) - centroidBounds.min(bestAxis)) * binScale)) < bestSplit;
+		});
+		half = (int32_t)(middle - primitiveIndices.begin()) - first;
+	}
+	else
+	{
+		//All centroids coincide; split in the middle of the list
+		half = count / 2;
+	}
+
+	int32_t leftChild = (int32_t)nodes.size();
+	nodes.emplace_back();
+	nodes.emplace_back();
+
+	nodes[leftChild].firstChildOrPrimitive = first;
+	nodes[leftChild].primitiveCount = half;
+	nodes[leftChild + 1].firstChildOrPrimitive = first + half;
+	nodes[leftChild + 1].primitiveCount = count - half;
+	UpdateBounds(nodes[leftChild]);
+	UpdateBounds(nodes[leftChild + 1]);
+
+	nodes[nodeIndex].firstChildOrPrimitive = leftChild;
+	nodes[nodeIndex].primitiveCount = 0;
+
+	Subdivide(leftChild, centroids, depth + 1);
+	Subdivide(leftChild + 1, centroids, depth + 1);
+}
+
+bool TriangleBVH::IntersectBounds(const Node& node, const float origin[3], const float inverseDirection[3], float tMax, float& tEntry)
+{
+	float tNear = 0;
+	float tFar = tMax;
+	for (int i = 0; i < 3; ++i)
+	{
+		float t0 = (node.boundsMin[i] - origin[i]) * inverseDirection[i];
+		float t1 = (node.boundsMax[i] - origin[i]) * inverseDirection[i];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1);
+	}
+	tEntry = tNear;
+	return tNear <= tFar;
+}
+
+float TriangleBVH::IntersectTriangle(int32_t triangle, const float origin[3], const float direction[3]) const
+{
+	auto& tri = (*triangles)[triangle];
+	const Eigen::Vector3f& p0 = (*vertices)[tri.i[0]];
+	Eigen::Vector3f e1 = (*vertices)[tri.i[1]] - p0;
+	Eigen::Vector3f e2 = (*vertices)[tri.i[2]] - p0;
+	Eigen::Vector3f o(origin[0], origin[1], origin[2]);
+	Eigen::Vector3f d(direction[0], direction[1], direction[2]);
+
+	Eigen::Vector3f p = d.cross(e2);
+	float det = e1.dot(p);
+	if (det == 0)
+		return std::numeric_limits<float>::infinity();
+	float invDet = 1.0f / det;
+
+	Eigen::Vector3f s = o - p0;
+	float u = s.dot(p) * invDet;
+	if (u < -BARYCENTRIC_EPSILON || u > 1 + BARYCENTRIC_EPSILON)
+		return std::numeric_limits<float>::infinity();
+
+	Eigen::Vector3f q = s.cross(e1);
+	float v = d.dot(q) * invDet;
+	if (v < -BARYCENTRIC_EPSILON || u + v > 1 + BARYCENTRIC_EPSILON)
+		return std::numeric_limits<float>::infinity();
+
+	float t = e2.dot(q) * invDet;
+	if (t < 0)
+		return std::numeric_limits<float>::infinity();
+	return t;
+}
+
+float TriangleBVH::ClosestHit(const float origin[3], const float direction[3], float tMax) const
+{
+	int32_t hitTriangle = -1;
+	size_t visitedNodes = 0;
+	float closest = Traverse(origin, direction, tMax, hitTriangle, visitedNodes);
+	return hitTriangle >= 0 ? closest : std::numeric_limits<float>::infinity();
+}
+
+float TriangleBVH::ClosestHit(const float origin[3], const float direction[3], int32_t& triangleHint, TraversalStatistics* statistics) const
+{
+	float closest = std::numeric_limits<float>::infinity();
+	int32_t hitTriangle = -1;
+	if (triangleHint >= 0 && !nodes.empty() && triangleHint < (int32_t)triangles->size())
+	{
+		//A hit with the hint is a valid upper bound for the closest hit
+		closest = IntersectTriangle(triangleHint, origin, direction);
+		if (closest != std::numeric_limits<float>::infinity())
+			hitTriangle = triangleHint;
+	}
+	bool hinted = hitTriangle >= 0;
+
+	size_t visitedNodes = 0;
+	closest = Traverse(origin, direction, closest, hitTriangle, visitedNodes);
+	triangleHint = hitTriangle;
+
+	if (statistics)
+	{
+		++statistics->rays;
+		statistics->visitedNodes += visitedNodes;
+		if (hinted)
+			++statistics->hintedRays;
+	}
+	return hitTriangle >= 0 ? closest : std::numeric_limits<float>::infinity();
+}
+
+float TriangleBVH::Traverse(const float origin[3], const float direction[3], float closest, int32_t& hitTriangle, size_t& visitedNodes) const
+{
+	if (nodes.empty())
+		return closest;
+
+	float inverseDirection[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		float d = direction[i];
+		if (std::abs(d) < MIN_DIRECTION_COMPONENT)
+			d = (d < 0 ? -MIN_DIRECTION_COMPONENT : MIN_DIRECTION_COMPONENT);
+		inverseDirection[i] = 1.0f / d;
+	}
+
+	struct StackEntry
+	{
+		int32_t node;
+		float tEntry;
+	} stack[TRAVERSAL_STACK_SIZE];
+	int stackSize = 0;
+
+	float tEntry;
+	if (!IntersectBounds(nodes[0], origin, inverseDirection, closest, tEntry))
+		return closest;
+	stack[stackSize++] = { 0, tEntry };
+
+	while (stackSize > 0)
+	{
+		auto entry = stack[--stackSize];
+		//A closer hit may have been found since the node has been pushed
+		if (entry.tEntry >= closest)
+			continue;
+
+		++visitedNodes;
+		auto& node = nodes[entry.node];
+		if (node.IsLeaf())
+		{
+			for (int32_t i = node.firstChildOrPrimitive; i < node.firstChildOrPrimitive + node.primitiveCount; ++i)
+			{
+				float t = IntersectTriangle(primitiveIndices[i], origin, direction);
+				if (t < closest)
+				{
+					closest = t;
+					hitTriangle = primitiveIndices[i];
+				}
+			}
+		}
+		else
+		{
+			int32_t left = node.firstChildOrPrimitive;
+			int32_t right = left + 1;
+			float tLeft, tRight;
+			bool hitLeft = IntersectBounds(nodes[left], origin, inverseDirection, closest, tLeft);
+			bool hitRight = IntersectBounds(nodes[right], origin, inverseDirection, closest, tRight);
+			if (hitLeft && hitRight)
+			{
+				//Push the far child first so that the near child is visited next
+				if (tLeft <= tRight)
+				{
+					stack[stackSize++] = { right, tRight };
+					stack[stackSize++] = { left, tLeft };
+				}
+				else
+				{
+					stack[stackSize++] = { left, tLeft };
+					stack[stackSize++] = { right, tRight };
+				}
+			}
+			else if (hitLeft)
+				stack[stackSize++] = { left, tLeft };
+			else if (hitRight)
+				stack[stackSize++] = { right, tRight };
+		}
+	}
+
+	return closest;
+}
+
+int TriangleBVH::PacketWidth()
+{
+	return NativeLanes::Width;
+}
+
+void TriangleBVH::ClosestHits(const float origin[3], const float* directionX, const float* directionY, const float* directionZ, size_t count, float* t,
+	int32_t* triangleHints, TraversalStatistics* statistics) const
+{
+	const int width = NativeLanes::Width;
+	size_t visitedNodes = 0;
+	size_t hintedRays = 0;
+	size_t fullPackets = count / width;
+	for (size_t packet = 0; packet < fullPackets; ++packet)
+	{
+		size_t offset = packet * width;
+		int hintedLanes = ClosestHitsPacket<NativeLanes>(origin, directionX + offset, directionY + offset, directionZ + offset, t + offset,
+			triangleHints ? triangleHints + offset : nullptr, visitedNodes);
+		for (; hintedLanes != 0; hintedLanes >>= 1)
+			hintedRays += hintedLanes & 1;
+	}
+
+	//Fill the last packet by repeating its last ray
+	size_t remaining = count - fullPackets * width;
+	if (remaining > 0)
+	{
+		float dx[width], dy[width], dz[width], tPacket[width];
+		int32_t hints[width];
+		for (int i = 0; i < width; ++i)
+		{
+			size_t ray = fullPackets * width + std::min<size_t>(i, remaining - 1);
+			dx[i] = directionX[ray];
+			dy[i] = directionY[ray];
+			dz[i] = directionZ[ray];
+			hints[i] = triangleHints ? triangleHints[ray] : -1;
+		}
+		int hintedLanes = ClosestHitsPacket<NativeLanes>(origin, dx, dy, dz, tPacket, triangleHints ? hints : nullptr, visitedNodes);
+		for (size_t i = 0; i < remaining; ++i)
+		{
+			t[fullPackets * width + i] = tPacket[i];
+			if (triangleHints)
+				triangleHints[fullPackets * width + i] = hints[i];
+			hintedRays += (hintedLanes >> i) & 1;
+		}
+	}
+
+	if (statistics)
+	{
+		statistics->rays += count;
+		statistics->visitedNodes += visitedNodes;
+		statistics->hintedRays += hintedRays;
+	}
+}
+
+template <typename Lanes>
+int TriangleBVH::ClosestHitsPacket(const float origin[3], const float* directionX, const float* directionY, const float* directionZ, float* t,
+	int32_t* hitTriangles, size_t& visitedNodes) const
+{
+	typedef typename Lanes::Float Float;
+	typedef typename Lanes::Mask Mask;
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	if (nodes.empty())
+	{
+		Lanes::Store(t, Lanes::Set(infinity));
+		return 0;
+	}
+
+	Float d[3] = { Lanes::Load(directionX), Lanes::Load(directionY), Lanes::Load(directionZ) };
+	Float inverseDirection[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float* components = (axis == 0 ? directionX : (axis == 1 ? directionY : directionZ));
+		float inverse[Lanes::Width];
+		for (int i = 0; i < Lanes::Width; ++i)
+		{
+			float c = components[i];
+			if (std::abs(c) < MIN_DIRECTION_COMPONENT)
+				c = (c < 0 ? -MIN_DIRECTION_COMPONENT : MIN_DIRECTION_COMPONENT);
+			inverse[i] = 1.0f / c;
+		}
+		inverseDirection[axis] = Lanes::Load(inverse);
+	}
+
+	const Float zero = Lanes::Set(0);
+	const Float lowerBarycentric = Lanes::Set(-BARYCENTRIC_EPSILON);
+	const Float upperBarycentric = Lanes::Set(1 + BARYCENTRIC_EPSILON);
+	Float closest = Lanes::Set(infinity);
+
+	//Intersects all rays of the packet with a triangle (Moeller-Trumbore, where all terms that only depend on the common origin are
+	//scalars). Returns the lanes that hit the triangle and stores the ray parameters in tHit.
+	auto intersectTriangle = [&](int32_t triangle, Float& tHit)
+	{
+		auto& tri = (*triangles)[triangle];
+		const Eigen::Vector3f& p0 = (*vertices)[tri.i[0]];
+		Eigen::Vector3f e1 = (*vertices)[tri.i[1]] - p0;
+		Eigen::Vector3f e2 = (*vertices)[tri.i[2]] - p0;
+		Eigen::Vector3f s = Eigen::Vector3f(origin[0], origin[1], origin[2]) - p0;
+		Eigen::Vector3f q = s.cross(e1);
+
+		//p = d x e2
+		Float px = Lanes::Sub(Lanes::Mul(d[1], Lanes::Set(e2.z())), Lanes::Mul(d[2], Lanes::Set(e2.y())));
+		Float py = Lanes::Sub(Lanes::Mul(d[2], Lanes::Set(e2.x())), Lanes::Mul(d[0], Lanes::Set(e2.z())));
+		Float pz = Lanes::Sub(Lanes::Mul(d[0], Lanes::Set(e2.y())), Lanes::Mul(d[1], Lanes::Set(e2.x())));
+
+		Float det = Lanes::Add(Lanes::Add(Lanes::Mul(Lanes::Set(e1.x()), px), Lanes::Mul(Lanes::Set(e1.y()), py)), Lanes::Mul(Lanes::Set(e1.z()), pz));
+		Float invDet = Lanes::Div(Lanes::Set(1), det);
+
+		Float u = Lanes::Mul(Lanes::Add(Lanes::Add(Lanes::Mul(Lanes::Set(s.x()), px), Lanes::Mul(Lanes::Set(s.y()), py)), Lanes::Mul(Lanes::Set(s.z()), pz)), invDet);
+		Float v = Lanes::Mul(Lanes::Add(Lanes::Add(Lanes::Mul(d[0], Lanes::Set(q.x())), Lanes::Mul(d[1], Lanes::Set(q.y()))), Lanes::Mul(d[2], Lanes::Set(q.z()))), invDet);
+		tHit = Lanes::Mul(Lanes::Set(e2.dot(q)), invDet);
+
+		Mask valid = Lanes::NotEqual(det, zero);
+		valid = Lanes::And(valid, Lanes::GreaterEqual(u, lowerBarycentric));
+		valid = Lanes::And(valid, Lanes::LessEqual(u, upperBarycentric));
+		valid = Lanes::And(valid, Lanes::GreaterEqual(v, lowerBarycentric));
+		valid = Lanes::And(valid, Lanes::LessEqual(Lanes::Add(u, v), upperBarycentric));
+		valid = Lanes::And(valid, Lanes::GreaterEqual(tHit, zero));
+		return valid;
+	};
+
+	//Hits with the hint triangles are valid upper bounds for the closest hits. They are calculated with the same arithmetic as
+	//in the traversal, such that the result does not depend on the hints.
+	int hintedLanes = 0;
+	if (hitTriangles)
+	{
+		float initialClosest[Lanes::Width];
+		for (int i = 0; i < Lanes::Width; ++i)
+		{
+			initialClosest[i] = infinity;
+			if (hitTriangles[i] >= 0 && hitTriangles[i] < (int32_t)triangles->size())
+			{
+				Float tHit;
+				int hitLanes = Lanes::MoveMask(intersectTriangle(hitTriangles[i], tHit));
+				if ((hitLanes >> i) & 1)
+				{
+					float tLanes[Lanes::Width];
+					Lanes::Store(tLanes, tHit);
+					initialClosest[i] = tLanes[i];
+				}
+			}
+			if (initialClosest[i] == infinity)
+				hitTriangles[i] = -1;
+			else
+				hintedLanes |= 1 << i;
+		}
+		closest = Lanes::Load(initialClosest);
+	}
+
+	//Intersects all rays of the packet with the node's bounds. Returns the lanes that enter the box before their closest hit
+	//and stores the smallest entry distance of those lanes.
+	auto intersectBounds = [&](const Node& node, float& minEntry)
+	{
+		Float tNear = zero;
+		Float tFar = closest;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			//All rays share the origin, so the slab offsets are scalars
+			Float t0 = Lanes::Mul(Lanes::Set(node.boundsMin[axis] - origin[axis]), inverseDirection[axis]);
+			Float t1 = Lanes::Mul(Lanes::Set(node.boundsMax[axis] - origin[axis]), inverseDirection[axis]);
+			tNear = Lanes::Max(tNear, Lanes::Min(t0, t1));
+			tFar = Lanes::Min(tFar, Lanes::Max(t0, t1));
+		}
+		Mask hit = Lanes::LessEqual(tNear, tFar);
+		int hitLanes = Lanes::MoveMask(hit);
+		if (hitLanes != 0)
+		{
+			float entries[Lanes::Width];
+			Lanes::Store(entries, Lanes::Select(hit, tNear, Lanes::Set(infinity)));
+			minEntry = *std::min_element(entries, entries + Lanes::Width);
+		}
+		return hitLanes;
+	};
+
+	//Returns the largest closest hit distance of all lanes; nodes that are entered after this distance can be culled.
+	auto maxClosest = [&]()
+	{
+		float c[Lanes::Width];
+		Lanes::Store(c, closest);
+		return *std::max_element(c, c + Lanes::Width);
+	};
+
+	struct StackEntry
+	{
+		int32_t node;
+		float minEntry;
+	} stack[TRAVERSAL_STACK_SIZE];
+	int stackSize = 0;
+
+	float minEntry;
+	if (intersectBounds(nodes[0], minEntry) != 0)
+		stack[stackSize++] = { 0, minEntry };
+
+	while (stackSize > 0)
+	{
+		auto entry = stack[--stackSize];
+		if (entry.minEntry >= maxClosest())
+			continue;
+
+		++visitedNodes;
+		auto& node = nodes[entry.node];
+		if (node.IsLeaf())
+		{
+			for (int32_t i = node.firstChildOrPrimitive; i < node.firstChildOrPrimitive + node.primitiveCount; ++i)
+			{
+				Float tHit;
+				Mask valid = intersectTriangle(primitiveIndices[i], tHit);
+				valid = Lanes::And(valid, Lanes::Less(tHit, closest));
+				closest = Lanes::Select(valid, tHit, closest);
+
+				if (hitTriangles)
+				{
+					int hitLanes = Lanes::MoveMask(valid);
+					for (int lane = 0; hitLanes != 0; ++lane, hitLanes >>= 1)
+						if (hitLanes & 1)
+							hitTriangles[lane] = primitiveIndices[i];
+				}
+			}
+		}
+		else
+		{
+			int32_t left = node.firstChildOrPrimitive;
+			int32_t right = left + 1;
+			float entryLeft, entryRight;
+			bool hitLeft = intersectBounds(nodes[left], entryLeft) != 0;
+			bool hitRight = intersectBounds(nodes[right], entryRight) != 0;
+			if (hitLeft && hitRight)
+			{
+				//Push the far child first so that the near child is visited next
+				if (entryLeft <= entryRight)
+				{
+					stack[stackSize++] = { right, entryRight };
+					stack[stackSize++] = { left, entryLeft };
+				}
+				else
+				{
+					stack[stackSize++] = { left, entryLeft };
+					stack[stackSize++] = { right, entryRight };
+				}
+			}
+			else if (hitLeft)
+				stack[stackSize++] = { left, entryLeft };
+			else if (hitRight)
+				stack[stackSize++] = { right, entryRight };
+		}
+	}
+
+	Lanes::Store(t, closest);
+	return hintedLanes;
+}
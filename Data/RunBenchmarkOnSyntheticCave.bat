@@ -0,0 +1 @@
+call "../x64/Release/Benchmark.exe" -d SyntheticCave --rays --exponents --scaling --adaptive --hints --resolutions --flowConvergence --calculators --micro
\ No newline at end of file
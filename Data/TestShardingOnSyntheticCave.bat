@@ -0,0 +1,31 @@
+@echo off
+rem Calculates the distances of the synthetic cave in a single run and in 4 shards and checks that the merged result is identical.
+setlocal
+set CLI="../x64/Release/CaveSegmentationCommandLine.exe"
+set WORK=ShardingTest
+
+if exist %WORK% rmdir /s /q %WORK%
+for %%d in (single sharded) do (
+	mkdir %WORK%\%%d
+	copy SyntheticCave\model.off %WORK%\%%d >nul
+	copy SyntheticCave\model.skel %WORK%\%%d >nul
+)
+
+call %CLI% -d %WORK%/single --calcDist || goto failed
+
+rem The shards are independent and could also run concurrently or on different machines
+for /L %%i in (0,1,3) do (
+	call %CLI% -d %WORK%/sharded --shard %%i/4 || goto failed
+)
+call %CLI% -d %WORK%/sharded --mergeShards 4 || goto failed
+
+fc /b %WORK%\single\distances.bin %WORK%\sharded\distances.bin >nul || goto failed
+fc /b %WORK%\single\output\segmentation.seg %WORK%\sharded\output\segmentation.seg >nul || goto failed
+
+echo Sharding test passed.
+rmdir /s /q %WORK%
+exit /b 0
+
+:failed
+echo Sharding test FAILED.
+exit /b 1
@@ -19,6 +19,8 @@ struct CaveInfo
 
 		data->LoadMesh(offFile);
 		data->SetVerbose(false);
+		//The evaluation sweeps over exponents, which only needs to cast rays once
+		data->RayDistanceCaching() = ICaveData::Float32RayDistanceCache;
 
 		CurveSkeleton* skeleton = LoadCurveSkeleton(skeletonFile.c_str());
 		data->SetSkeleton(skeleton);